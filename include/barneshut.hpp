@@ -0,0 +1,44 @@
+#ifndef BARNESHUT_HPP
+#define BARNESHUT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "octree.hpp"
+#include "threadpool.hpp"
+
+//O(N log N) tree code on the linear Octree. Nodes carry monopole and quadrupole moments about their centre of mass.
+//The walk is done per group of Morton-consecutive targets, whose particle-particle part runs through the SIMD directTile kernel.
+class BarnesHut {
+public:
+    explicit BarnesHut(float theta = 0.5f, size_t leafSize = 16);
+    //Writes (not adds) into ax, ay and az, in the same softened G = 1 units as directAccelerations
+    void computeAccelerations(const float* x, const float* y, const float* z, const float* m, size_t n, float softening, float* ax, float* ay, float* az, ThreadPool& pool);
+    
+    void setTheta(float newTheta);
+    float getTheta() const;
+    double getBuildSeconds() const;
+    double getWalkSeconds() const;
+    size_t getNodeCount() const;
+private:
+    struct Moments {
+        float comX, comY, comZ, mass;
+        float qxx, qxy, qxz, qyy, qyz, qzz;
+        //Squared distance from the centre of mass beyond which the node may be used as a whole
+        float openRadius2;
+    };
+    
+    void computeMoments(ThreadPool& pool);
+    void walk(float softening, float* ax, float* ay, float* az, ThreadPool& pool);
+    
+    float theta;
+    size_t leafSize;
+    double buildSeconds, walkSeconds;
+    Octree tree;
+    //One entry per tree node
+    std::vector<Moments> moments;
+    std::vector<float> sortedAccelerationX, sortedAccelerationY, sortedAccelerationZ;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,39 @@
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+
+#include <cstddef>
+
+//Times every available SIMD level of the disk kernel, at each accuracy of fastmath.hpp, against the scalar reference for 10^6 up
+//to maxN particles, and the best level through the thread pool at 1, 2, 4 and every hardware thread
+void benchmarkDiskKernel(size_t maxN);
+//Time and accuracy of the FMM at every expansion order, of Barnes-Hut and of the particle mesh at three grid sizes and both
+//assignments, against direct summation on an n particle disk, and
+//the disk size from which the default FMM beats Barnes-Hut at theta 0.5 for no larger error
+void benchmarkFastMultipole(size_t n);
+//Energy error per 10^5 steps of float, double and compensated positions, each against a double-precision run of the same scheme
+void benchmarkPrecision(size_t steps);
+//Build time, interpolation error over an n particle disk and step time of the (R, z) table at several sizes
+void benchmarkPotentialTable(size_t n);
+//Fused Potential<Components...> accelerations against one pass per component, and the step time of the galaxy with a bulge and halo
+void benchmarkPotential(size_t n);
+//Time per SPH pass on an n particle gas disk, and the densities and pressure forces of a sample against brute force
+void benchmarkHydrodynamics(size_t n);
+//Build time of the cell list against a hash map of vectors and a disk step, and range and nearest queries against brute force
+void benchmarkCellList(size_t n);
+//Cost of the batched spawns, removals and star formations of the particle pool over a step, and every particle checked by ID after
+void benchmarkParticlePool(size_t n);
+//stellarProperties() against the scalar functions per star, against copying the same bytes, and its largest error, then the colour
+//table against colourFromTemperature() on the same stars and over its whole range
+void benchmarkStellarProperties(size_t n);
+//Time and largest error in ulps and relative of every function and accuracy of fastmath.hpp at every SIMD level, against libm
+void benchmarkFastMath(size_t n);
+//Time of reset() against the stall and the total of a background reset, and the particles and total mass of a background reset
+//and of a reset() cancelling one against plain resets. Resets with one thread and with several have to match bit for bit, and two
+//reset()s in a row then have to hit the cache on the second, in a scratch directory without --ic-cache. Returns whether every
+//check passed.
+bool benchmarkReset(size_t n);
+//Position drift of block timesteps and of every particle on the full step, with direct gravity over a fixed interval, from a run
+//with every particle on the deepest level's step. Returns whether the block timesteps drift less.
+bool benchmarkBlockTimesteps(size_t n);
+
+#endif
\ No newline at end of file
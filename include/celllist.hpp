@@ -0,0 +1,131 @@
+#ifndef CELLLIST_HPP
+#define CELLLIST_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "threadpool.hpp"
+
+//Stable parallel counting sort of [0, n) by key(i) < buckets: per-chunk histograms, a prefix sum over (bucket, chunk), then a
+//scatter in index order. order gets the indices bucket by bucket and start[b] the first of bucket b, with start[buckets] = n.
+//key is called twice per index, so it should be cheap or read from an array. offsets is scratch of chunks * buckets, kept by the
+//caller to skip the allocation on every sort. chunk 0 takes the pool's chunk size.
+template<class Index, class Key> void countingSort(size_t n, size_t buckets, Key key, std::vector<Index>& order, std::vector<Index>& start, std::vector<Index>& offsets, ThreadPool& pool, size_t chunk = 0){
+    if(chunk == 0) chunk = pool.getChunkSize();
+    const size_t chunks = (n + chunk - 1) / chunk;
+    offsets.assign(chunks * buckets, 0);
+    pool.parallelFor(0, n, chunk, [&](size_t begin, size_t end){
+        Index* count = offsets.data() + (begin / chunk) * buckets;
+        for(size_t i = begin;i < end;++i) ++count[key(i)];
+    });
+    start.resize(buckets + 1);
+    Index total = 0;
+    for(size_t b = 0;b < buckets;++b){
+        start[b] = total;
+        for(size_t c = 0;c < chunks;++c){
+            Index count = offsets[c * buckets + b];
+            offsets[c * buckets + b] = total;
+            total += count;
+        }
+    }
+    start[buckets] = total;
+    order.resize(n);
+    pool.parallelFor(0, n, chunk, [&](size_t begin, size_t end){
+        Index* next = offsets.data() + (begin / chunk) * buckets;
+        for(size_t i = begin;i < end;++i) order[next[key(i)]++] = i;
+    });
+}
+
+//Spatial hash over points: cubic cells of a fixed side, hashed into a power-of-two table of about one bucket per point, so the
+//exponential tails of the galaxy cost nothing the way a grid over its bounding box would. A build is a counting sort by bucket,
+//two passes over the points with no allocation once the vectors have grown. The points are kept in bucket order with their
+//cell, so a query touching two cells that share a bucket still reports every point once.
+class CellList {
+public:
+    CellList();
+    void build(const float* x, const float* y, const float* z, size_t n, float cellSize, ThreadPool& pool);
+    
+    //Calls f(index, r2) for every point with r2 < radius^2 from (px, py, pz), in no particular order
+    template<class F> void forEachInRange(float px, float py, float pz, float radius, F&& f) const;
+    //Appends the indices of the points within radius to out
+    void rangeQuery(float px, float py, float pz, float radius, std::vector<uint32_t>& out) const;
+    //The k nearest points, nearest first, or all of them if there are fewer
+    void nearest(float px, float py, float pz, size_t k, std::vector<uint32_t>& out) const;
+    
+    size_t size() const;
+    float getCellSize() const;
+    size_t getBucketCount() const;
+    double getBuildSeconds() const;
+private:
+    //Cell coordinates stay within 21 bits each so a cell packs into one key
+    static constexpr int32_t cellLimit = 1 << 20;
+    
+    int32_t cellCoordinate(float x) const;
+    static uint64_t packCell(int32_t ix, int32_t iy, int32_t iz);
+    uint32_t bucketOf(int32_t ix, int32_t iy, int32_t iz) const;
+    
+    float cellSize, invCellSize;
+    size_t bucketMask;
+    double buildSeconds;
+    //Range of the occupied cells, which bounds how far nearest() has to search
+    int32_t cellMin[3], cellMax[3];
+    //bucket[i] of original point i during the build, then order[start[b], start[b + 1]) are the points of bucket b
+    std::vector<uint32_t> bucket, order, start, offsets;
+    std::vector<int32_t> chunkBounds;
+    //Packed cell of every point, in the original and in bucket order
+    std::vector<uint64_t> cell, sortedCell;
+    std::vector<float> sortedX, sortedY, sortedZ;
+};
+
+inline int32_t CellList::cellCoordinate(float x) const {
+    return static_cast<int32_t>(std::clamp(std::floor(x * invCellSize), -static_cast<float>(cellLimit), static_cast<float>(cellLimit - 1)));
+}
+
+inline uint64_t CellList::packCell(int32_t ix, int32_t iy, int32_t iz){
+    return static_cast<uint64_t>(ix + cellLimit) | static_cast<uint64_t>(iy + cellLimit) << 21 | static_cast<uint64_t>(iz + cellLimit) << 42;
+}
+
+inline uint32_t CellList::bucketOf(int32_t ix, int32_t iy, int32_t iz) const {
+    return (static_cast<uint32_t>(ix) * 73856093u ^ static_cast<uint32_t>(iy) * 19349663u ^ static_cast<uint32_t>(iz) * 83492791u) & bucketMask;
+}
+
+template<class F> void CellList::forEachInRange(float px, float py, float pz, float radius, F&& f) const {
+    if(order.empty()) return;
+    const float radius2 = radius * radius;
+    int32_t low[3] = {cellCoordinate(px - radius), cellCoordinate(py - radius), cellCoordinate(pz - radius)};
+    int32_t high[3] = {cellCoordinate(px + radius), cellCoordinate(py + radius), cellCoordinate(pz + radius)};
+    for(int a = 0;a < 3;++a){
+        low[a] = std::max(low[a], cellMin[a]);
+        high[a] = std::min(high[a], cellMax[a]);
+        if(low[a] > high[a]) return;
+    }
+    //Past one cell per point it is cheaper to test every point once
+    const double cells = static_cast<double>(high[0] - low[0] + 1) * (high[1] - low[1] + 1) * (high[2] - low[2] + 1);
+    if(cells > static_cast<double>(order.size())){
+        for(size_t p = 0;p < order.size();++p){
+            float dx = sortedX[p] - px, dy = sortedY[p] - py, dz = sortedZ[p] - pz;
+            float r2 = dx * dx + dy * dy + dz * dz;
+            if(r2 < radius2) f(order[p], r2);
+        }
+        return;
+    }
+    for(int32_t iz = low[2];iz <= high[2];++iz){
+        for(int32_t iy = low[1];iy <= high[1];++iy){
+            for(int32_t ix = low[0];ix <= high[0];++ix){
+                const uint64_t key = packCell(ix, iy, iz);
+                const uint32_t b = bucketOf(ix, iy, iz);
+                for(uint32_t p = start[b];p < start[b + 1];++p){
+                    if(sortedCell[p] != key) continue;
+                    float dx = sortedX[p] - px, dy = sortedY[p] - py, dz = sortedZ[p] - pz;
+                    float r2 = dx * dx + dy * dy + dz * dz;
+                    if(r2 < radius2) f(order[p], r2);
+                }
+            }
+        }
+    }
+}
+
+#endif
\ No newline at end of file
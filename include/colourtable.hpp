@@ -0,0 +1,104 @@
+#ifndef COLOURTABLE_HPP
+#define COLOURTABLE_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <glm/glm.hpp>
+
+//colourFromTemperature() sampled at compile time on a grid uniform in ln T, for linear interpolation on the CPU and as a 1D
+//texture in shader.vert. Below 500 K the formula is the constant (1, 0, 0), which the first entry holds exactly. 10^6 K is
+//reached by temperatureFromMass() at about 60 solar masses, and hotter stars keep the last entry.
+//The interpolation is within 0.0022 per channel of the formula, except within a cell of its jumps (B at 2000 K and 6500 K,
+//R and G at 6600 K), where it reaches 0.034, at 2000 K. Away from the jumps 512 entries would give 0.0066, 2048 entries 0.0011.
+namespace colourTable {
+    constexpr size_t size = 1024;
+    constexpr double minTemperature = 500.0, maxTemperature = 1e6;
+    
+    //log and exp good to a few ulps in double, as the <cmath> ones are not constexpr
+    constexpr double ln2 = 0.693147180559945309417;
+    constexpr double log(double x){
+        int k = 0;
+        while(x > 1.41421356237309504880){
+            x *= 0.5;
+            ++k;
+        }
+        while(x < 0.70710678118654752440){
+            x *= 2.0;
+            --k;
+        }
+        //ln x = 2 atanh((x - 1) / (x + 1)), with |s| < 0.18 after the reduction
+        const double s = (x - 1.0) / (x + 1.0), s2 = s * s;
+        double term = s, sum = 0.0;
+        for(int n = 1;n < 40;n += 2){
+            sum += term / n;
+            term *= s2;
+        }
+        return 2.0 * sum + k * ln2;
+    }
+    constexpr double exp(double x){
+        const int k = static_cast<int>(x / ln2 + (x < 0.0 ? -0.5 : 0.5));
+        const double r = x - k * ln2;
+        double term = 1.0, sum = 1.0;
+        for(int n = 1;n < 24;++n){
+            term *= r / n;
+            sum += term;
+        }
+        for(int i = 0;i < k;++i) sum *= 2.0;
+        for(int i = 0;i > k;--i) sum *= 0.5;
+        return sum;
+    }
+    constexpr double pow(double x, double y){
+        return exp(y * log(x));
+    }
+    constexpr double clamp01(double x){
+        return x < 0.0 ? 0.0 : x > 1.0 ? 1.0 : x;
+    }
+    
+    //colourFromTemperature() in double
+    constexpr std::array<float, 3> colour(double temperature){
+        const double t = temperature / 100.0;
+        const double r = temperature < 6600.0 ? 1.0 : clamp01(329.698727446 * pow(t - 60.0, -0.1332047592) / 256.0);
+        const double g = temperature < 6600.0 ? clamp01((99.4708025861 * log(t) - 161.1195681661) / 256.0) : clamp01(288.1221695283 / 256.0 * pow(t - 60.0, -0.0755148492));
+        const double b = temperature < 2000.0 ? 0.0 : temperature > 6500.0 ? 1.0 : clamp01((138.5177312231 * log(t - 10.0) - 305.0447927307) / 256.0);
+        return {static_cast<float>(r), static_cast<float>(g), static_cast<float>(b)};
+    }
+    
+    constexpr double logMin = log(minTemperature), logMax = log(maxTemperature);
+    
+    //RGBA per entry, the layout of the GL_RGBA32F texture
+    constexpr std::array<float, 4 * size> generate(){
+        std::array<float, 4 * size> table{};
+        for(size_t i = 0;i < size;++i){
+            const std::array<float, 3> c = colour(exp(logMin + (logMax - logMin) * i / (size - 1)));
+            table[4 * i] = c[0];
+            table[4 * i + 1] = c[1];
+            table[4 * i + 2] = c[2];
+            table[4 * i + 3] = 1.0f;
+        }
+        return table;
+    }
+    
+    inline constexpr std::array<float, 4 * size> table = generate();
+    
+    //Defines for shader.vert, which does the same lookup with the texture's linear filtering
+    std::string glslDefines();
+}
+
+//Linear interpolation in the table, as shader.vert does it
+inline glm::vec4 colourFromTemperatureTable(float temperature){
+    const float scale = static_cast<float>((colourTable::size - 1) / (colourTable::logMax - colourTable::logMin));
+    float u = (std::log(temperature) - static_cast<float>(colourTable::logMin)) * scale;
+    //Also catches NaN and temperatures of 0
+    if(!(u > 0.0f)) u = 0.0f;
+    if(u > colourTable::size - 1) u = colourTable::size - 1;
+    const size_t i = std::min(static_cast<size_t>(u), colourTable::size - 2);
+    const float f = u - i;
+    const float* a = colourTable::table.data() + 4 * i;
+    return glm::vec4(a[0] + f * (a[4] - a[0]), a[1] + f * (a[5] - a[1]), a[2] + f * (a[6] - a[2]), 1.0f);
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,11 @@
+#ifndef CPUFEATURES_HPP
+#define CPUFEATURES_HPP
+
+//Runtime instruction set detection for the hand-vectorised kernels in simd.hpp
+enum class SimdLevel {Scalar, SSE2, AVX2, AVX512};
+
+//Widest instruction set the running CPU supports, detected once
+SimdLevel detectSimdLevel();
+const char* simdLevelName(SimdLevel level);
+
+#endif
\ No newline at end of file
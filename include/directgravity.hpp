@@ -0,0 +1,22 @@
+#ifndef DIRECTGRAVITY_HPP
+#define DIRECTGRAVITY_HPP
+
+#include <cstddef>
+
+#include "threadpool.hpp"
+
+//O(N^2) self-gravity with Plummer softening in the same G = 1 units as the analytic potential. Targets are split into chunks
+//over the pool, and each chunk sweeps the sources one L1/L2-sized tile at a time. Writes (not adds) into ax, ay and az.
+void directAccelerations(const float* x, const float* y, const float* z, const float* m, size_t n, float softening, float* ax, float* ay, float* az, ThreadPool& pool);
+//Same for separate targets tx, ty and tz [0, targets), e.g. only the particles active in a block timestep. A target at exactly the
+//position of a source feels nothing from it.
+void directAccelerations(const float* tx, const float* ty, const float* tz, size_t targets, const float* x, const float* y, const float* z, const float* m, size_t n, float softening, float* ax, float* ay, float* az, ThreadPool& pool);
+
+//Adds the pull of sources [0, count) on targets [begin, end) to ax, ay and az with the widest SIMD kernel available. eps2 is the
+//squared softening and has to be positive.
+void directTile(const float* x, const float* y, const float* z, size_t begin, size_t end, const float* sx, const float* sy, const float* sz, const float* sm, size_t count, float eps2, float* ax, float* ay, float* az);
+
+//Double precision, untiled and single-threaded, for checking the fast version on small N
+void directAccelerationsReference(const float* x, const float* y, const float* z, const float* m, size_t n, float softening, double* ax, double* ay, double* az);
+
+#endif
\ No newline at end of file
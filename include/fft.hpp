@@ -0,0 +1,43 @@
+#ifndef FFT_HPP
+#define FFT_HPP
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//Iterative radix-2 complex FFT of one power-of-two length, with twiddles and the bit reversal precomputed
+class FFTPlan {
+public:
+    explicit FFTPlan(size_t n = 1);
+    //Unnormalised in both directions, inverse uses e^(+2 pi i jk / n)
+    void transform(std::complex<float>* data, bool inverse) const;
+    size_t size() const;
+private:
+    size_t n;
+    std::vector<std::complex<float>> twiddles;
+    std::vector<uint32_t> bitReverse;
+};
+
+//Real-to-complex FFT of an even power-of-two length n through a complex FFT of length n / 2
+class RealFFTPlan {
+public:
+    explicit RealFFTPlan(size_t n = 2);
+    //n reals in, n / 2 + 1 complex out
+    void forward(const float* in, std::complex<float>* out) const;
+    //n / 2 + 1 complex in, n reals out, unnormalised like FFTPlan. in is used as scratch.
+    void inverse(std::complex<float>* in, float* out) const;
+    size_t size() const;
+private:
+    size_t n;
+    FFTPlan half;
+    std::vector<std::complex<float>> twiddles;
+};
+
+inline size_t nextPowerOfTwo(size_t n){
+    size_t p = 1;
+    while(p < n) p <<= 1;
+    return p;
+}
+
+#endif
\ No newline at end of file
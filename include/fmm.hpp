@@ -0,0 +1,91 @@
+#ifndef FMM_HPP
+#define FMM_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "octree.hpp"
+#include "threadpool.hpp"
+
+//O(N) fast multipole method on the adaptive Octree with Cartesian Taylor expansions up to a configurable order. Expanding the
+//Plummer-softened kernel itself keeps the far field softened exactly like directAccelerations. Interaction lists come from a dual
+//tree traversal, and the upward pass, M2L, near field and downward pass run as one dependency-driven task graph, so far-field
+//translations start as soon as the multipoles they need are done. The kernel is softened and so not harmonic, which rules out
+//traceless or rotation-based translations; M2L instead builds the kernel derivatives by recursion and batches sources per target.
+//On the benchmark disk the default order 7 is level with Barnes-Hut at theta 0.5 around 5e4 particles and pulls ahead above.
+class FastMultipole {
+public:
+    static constexpr int maxOrder = 10;
+    
+    //A theta of 0 or less follows matchedTheta of the order
+    explicit FastMultipole(int order = 7, float theta = 0.0f, size_t leafSize = 256);
+    //Writes (not adds) into ax, ay and az, in the same softened G = 1 units as directAccelerations
+    void computeAccelerations(const float* x, const float* y, const float* z, const float* m, size_t n, float softening, float* ax, float* ay, float* az, ThreadPool& pool);
+    
+    //Highest degree of the multipole and local expansions, clamped to [0, maxOrder]
+    void setOrder(int newOrder);
+    int getOrder() const;
+    //Opening angle at which the given order reaches about the rms error of Barnes-Hut at theta 0.5 on a disk. Orders below 4
+    //cannot reach it at any affordable angle and get 0.3.
+    static float matchedTheta(int order);
+    //0 or less goes back to matchedTheta, also after later setOrder calls
+    void setTheta(float newTheta);
+    float getTheta() const;
+    double getBuildSeconds() const;
+    double getListSeconds() const;
+    double getEvaluateSeconds() const;
+    size_t getNodeCount() const;
+    size_t getM2LCount() const;
+    size_t getP2PCount() const;
+private:
+    //One coefficient of a translation: out[target] += left[leftTerm] * right[rightTerm]
+    struct Product {
+        uint16_t target, leftTerm, rightTerm;
+    };
+    //How M2L raises one index of a kernel derivative: from term lower one level up times the coordinate along axis, plus count
+    //times term lower2 of that level
+    struct Raise {
+        uint16_t axis, lower, lower2, count;
+    };
+    
+    void buildTables();
+    void computeRadii(ThreadPool& pool);
+    void buildLists();
+    void buildTaskGraph();
+    void upward(uint32_t i);
+    void multipoleToLocal(uint32_t i, float eps2);
+    void nearField(uint32_t i, float eps2);
+    void downward(uint32_t i);
+    void monomials(double dx, double dy, double dz, double* out, size_t count) const;
+    
+    int order;
+    float theta;
+    bool matchTheta;
+    size_t leafSize;
+    double buildSeconds, listSeconds, evaluateSeconds;
+    Octree tree;
+    //Radius around the node centre that holds all of its particles
+    std::vector<float> radius;
+    //Multi-indices (a, b, c) with a + b + c <= order, sorted by degree, and the index of every one in termIndex[(a * s + b) * s + c]
+    //with s = order + 1. lowerX/Y/Z give the index of the term with a, b or c one lower, or -1, upperX/Y/Z the one higher.
+    std::vector<int> termA, termB, termC, termIndex, lowerX, lowerY, lowerZ, upperX, upperY, upperZ;
+    std::vector<double> inverseFactorial;
+    //1 / (count + 1) of raiseTable[t], the factor from the monomial below to monomial t
+    std::vector<double> inverseRaise;
+    std::vector<Product> m2mTable, m2lTable, l2lTable;
+    //m2lTable is sorted by target, with the products of term k in [m2lRowStart[k], m2lRowStart[k + 1])
+    std::vector<uint32_t> m2lRowStart;
+    //raiseTable[t] builds term t of the kernel derivatives. Level m of them starts at derivativeLevelStart[m] and holds the terms
+    //of degree up to order - m.
+    std::vector<Raise> raiseTable;
+    std::vector<uint32_t> derivativeLevelStart;
+    //Taylor coefficients per node, one block of termA.size() each
+    std::vector<double> multipoles, locals;
+    //Per target node, in compressed rows: the well-separated source nodes and, for leaves, the neighbouring source leaves
+    std::vector<uint32_t> m2lStart, m2lSource, p2pStart, p2pSource;
+    TaskGraph graph;
+    std::vector<float> sortedAccelerationX, sortedAccelerationY, sortedAccelerationZ;
+};
+
+#endif
\ No newline at end of file
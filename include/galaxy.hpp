@@ -2,33 +2,284 @@
 #define GALAXY_HPP
 
 #define _USE_MATH_DEFINES
+#include <atomic>
 #include <cmath>
+#include <cstdint>
+#include <ostream>
 #include <vector>
 #include <random>
+#include <thread>
 #include <glm/glm.hpp>
 
 #include "util.hpp"
+#include "random.hpp"
+#include "integrator.hpp"
+#include "symplectic.hpp"
+#include "mixedprecision.hpp"
+#include "potentialtable.hpp"
+#include "potential.hpp"
+#include "barneshut.hpp"
+#include "fmm.hpp"
+#include "particlemesh.hpp"
+#include "sph.hpp"
+#include "celllist.hpp"
+#include "stellarevolution.hpp"
+#include "iccache.hpp"
+
+enum class Backend {GPU, CPU};
+//Analytic is the fixed disk potential of verlet.comp, the others are CPU-only self-gravity solvers using the particle masses
+enum class Gravity {Analytic, Direct, BarnesHut, FMM, ParticleMesh};
 
 class Galaxy {
 public:
-    Galaxy(size_t n, size_t nCloud, float hr, float hz, float gmMin, float gmMax, float dt, int seed, int screenWidth, int screenHeight);
-    void integrate();
+    //Headless: no GL calls at all, always integrates on the CPU. Neither constructor generates the particles, the first reset()
+    //does, so the settings that shape them, such as the table, bulge and halo, can all come before it.
+    Galaxy(size_t n, size_t nCloud, float hr, float hz, float gmMin, float gmMax, float dt, int seed);
+    Galaxy(size_t n, size_t nCloud, float hr, float hz, float gmMin, float gmMax, float dt, int seed, int screenWidth, int screenHeight, Backend backend = Backend::GPU);
+    ~Galaxy();
+    //Advances by steps * dt, with the CPU upload or the GL program setup done once for the whole batch
+    void integrate(size_t steps = 1);
     void draw();
+    //Cancels a background reset under way. With the initial conditions cache on, from the second reset of the same settings the
+    //particles come from the mapped cache file. On the GPU backend that is uploaded straight from the mapping, and the CPU arrays
+    //are only filled from it once something on the CPU needs them. Headless or on the CPU backend the hit is copied into the
+    //arrays instead, which took 90 ms for 6e6 particles against about 1 s to generate them.
     void reset();
+    //reset() without stalling the frames: the particles are generated on a thread of their own into a spare set of arrays,
+    //uploaded a slice per updateReset() into a spare set of buffers, and swapped in with the rest of the reset by the
+    //updateReset() after the last slice. The current particles are simulated and drawn until then. Does nothing while one is
+    //under way. The spare set is kept for the next one.
+    void startReset();
+    //Once per frame, from the thread of the GL context
+    void updateReset();
+    bool resetPending() const;
+    //Fraction of a background reset done, generation and upload together
+    float getResetProgress() const;
+    void setBackend(Backend newBackend);
+    Backend getBackend() const;
+    float getTimestep() const;
+    //Switches the CPU kernels and recompiles verlet.comp for the new scheme
+    void setIntegrator(Integrator newIntegrator);
+    Integrator getIntegrator() const;
+    //Double or compensated positions for long runs, CPU backend and position Verlet only
+    void setPrecision(Precision newPrecision);
+    Precision getPrecision() const;
+    //Reads the analytic disk force from a size x size (R, z) table, in verlet.comp right away and for the initial velocities from
+    //the next reset(). GPU backend only: the CPU kernels keep evaluating the exps, which --bench table has at about twice the
+    //speed of the lookups there. 0 goes back to evaluating the exps per particle.
+    void setPotentialTable(size_t size);
+    //Hernquist bulge and NFW halo around the disk, in the analytic force of every backend and for the initial velocities from the
+    //next reset(). The disk is then evaluated exactly, without the potential table. A gm of 0 removes the component, and with
+    //both gone the disk-only kernels are back.
+    void setBulge(float gm, float a);
+    void setHalo(float gm, float rs);
+    void setGravity(Gravity newGravity);
+    Gravity getGravity() const;
+    void setSoftening(float newSoftening);
+    //Opening angle of both tree solvers
+    void setTheta(float theta);
+    void setExpansionOrder(int order);
+    void setMeshSize(size_t nx, size_t ny, size_t nz);
+    void setMassAssignment(MassAssignment assignment);
+    //Splits each integrate() into up to 2^maxLevel substeps, with every particle stepping at dt / 2^level for the smallest level
+    //that resolves accuracy times its dynamical time. 0 turns it off. CPU backend only.
+    void setBlockTimesteps(int maxLevel, float accuracy = 0.02f);
+    //Isothermal SPH pressure between the cloud particles on top of the gravity, with the given sound speed and neighbour count.
+    //A sound speed of 0 turns it off. CPU backend only, and not stepped by the block timesteps.
+    void setHydrodynamics(float soundSpeed, float neighbours = 48.0f);
+    //Sorts the stars and the cloud each by Morton key of their position every so many steps, checked after every integrate(), so
+    //particles close in space are close in memory for the solvers and the vertex cache. 0 turns it off.
+    void setReorderInterval(size_t steps);
+    //ids[i] is the index particle i had after the last reset(), which reordering and compaction carry along, or for a spawned
+    //particle the next one after those. Only the first size() are live.
+    const std::vector<uint32_t>& getParticleIds() const;
+    //Every interval steps, moves the particles farther than radius from the centre behind the live ones, which every kernel,
+    //dispatch and draw call then stops at. A radius of 0 turns it off. They come back with the next reset().
+    void setEscapeRadius(float radius, size_t interval = 64);
+    //Changes to the particle set, queued and applied together at the start of the next integrate(), so indices stay valid until
+    //then. A spawned particle takes a free slot behind the live ones, growing every array and buffer if there is none, and gets
+    //the next particle ID. formStar() turns a cloud particle into a star in place.
+    void spawnParticle(const glm::vec3& position, const glm::vec3& velocity, float mass, bool cloud = false);
+    void removeParticle(size_t i);
+    void formStar(size_t i);
+    //Chance per unit time of every cloud particle to form a star, drawn once per integrate(). 0 turns it off.
+    void setStarFormationRate(float rate);
+    //Ages the stars through the main sequence, giant branch and remnant, with the main sequence of one solar mass lasting
+    //solarLifetime. The stars of a reset() get random ages up to that, formed and spawned ones start at the time they appear.
+    //Only the stars changing phase in a step are recoloured and uploaded. 0 turns it off and brings back the main sequence.
+    void setStellarEvolution(float solarLifetime);
+    size_t getStarCount() const;
+    size_t getCloudCount() const;
+    //Particles the arrays and buffers have room for before they grow again
+    size_t getCapacity() const;
+    //Spatial hash over the current positions with cells of the given side, rebuilt on the first call after the particles moved
+    const CellList& getCellList(float cellSize);
+    //Timings of the last self-gravity solve
+    void printSolverStats(std::ostream& out) const;
+    size_t size() const;
+    float getTotalMass() const;
+    //The particles in the layout of the GL buffers, which the CPU backend only writes its positions back to for an upload, so
+    //they are exact after a reset() on the CPU backend
+    const std::vector<glm::vec4>& getPositions() const;
+    const std::vector<glm::vec4>& getPreviousPositions() const;
+    const std::vector<float>& getMasses() const;
+    //The arrays the CPU kernels step, current after every integrate() headless and on the CPU backend
+    const ParticleArrays& getParticles() const;
 private:
-    size_t n, nCloud;
-    float hr, hz, totalMass, dt;
+    void integrateVerlet(size_t steps);
+    template<class Scheme> void integrateCPU(size_t steps);
+    void integratePrecise(size_t steps);
+    //The disk with the given mass plus the bulge and the halo
+    GalaxyPotential galaxyPotential(float diskGM) const;
+    bool hasHaloOrBulge() const;
+    void loadComputeProgram();
+    void uploadPositions();
+    void downloadPositions();
+    void copyToArrays();
+    //Fills the CPU arrays from pendingConditions, if a reset() left them there
+    void loadArrays();
+    //Where the particles of a reset are written: the live arrays, or the spare ones of a background reset
+    struct InitialConditions {
+        glm::vec4* currentPosition;
+        glm::vec4* previousPosition;
+        float* mass;
+        float* luminosity;
+        float* temperature;
+    };
+    //What the particles of a reset depend on, for the current settings
+    InitialConditionsKey initialConditionsKey() const;
+    //Fills conditions with the particles of key, copied from cached on a hit or generated and then stored in the cache, and sets
+    //total to their mass. Both go in slices that add to resetProgress and stop early once resetCancelled is set.
+    void loadInitialConditions(const InitialConditionsKey& key, const MappedInitialConditions& cached, const InitialConditions& conditions, float& total);
+    //Returns the total mass
+    float generateInitialConditions(const InitialConditionsKey& key, const InitialConditions& conditions);
+    //Everything else a reset brings back, once the arrays hold the new particles
+    void restartSimulation();
+    //Joins the thread of a background reset, which the settings it reads may only change after
+    void waitForResetThread();
+    void cancelReset();
+    void computeAccelerations(const float* x, const float* y, const float* z);
+    void diskAccelerations();
+    //Adds the SPH accelerations of the cloud, from x - prev over the last step when the velocities are not integrated themselves
+    void hydroAccelerations(bool finiteDifference);
+    void rescaleStep(size_t i, int newLevel);
+    void reorder();
+    void formStars(size_t steps);
+    //Phases of the stars of a reset() or of setStellarEvolution() from random ages
+    void startEvolution();
+    //Recolours the stars whose phase changed by now and uploads them
+    void evolveStars();
+    void uploadAttributes(size_t begin, size_t end);
+    //Writes the queued spawns behind the live particles and partitions them in with compact()
+    void applyCommands();
+    //Makes room for needed particles, at least doubling the capacity so the copies of every growth add up to a constant per
+    //particle
+    void reserveParticles(size_t needed);
+    //Partitions the live particles and the spawned ones right behind them into stars, cloud and removed, on the CPU for either
+    //backend, with the GPU backend's positions downloaded for it and the moved particles uploaded after
+    void compact(size_t spawned = 0);
+    //Moves particle order[i] to i in every per-particle array, with the first newN stars and newNCloud cloud particles live after
+    void permuteParticles(const std::vector<uint32_t>& order, size_t newN, size_t newNCloud);
+    //Uploads the positions and attributes of [begin, end)
+    void uploadParticleBuffers(size_t begin, size_t end);
+    void assignLevels();
+    void integrateBlocks();
+    
+    static constexpr int maxBlockLevel = 16;
+    
+    //What the next compaction does with a particle
+    enum Fate : uint8_t {Keep, Remove, FormStar};
+    struct Spawn {
+        glm::vec3 position, velocity;
+        float mass;
+        bool cloud;
+    };
+    
+    bool headless;
+    Backend backend;
+    Gravity gravity;
+    //Live stars and cloud particles, the first n + nCloud of every array, and how many reset() brings back. The slots behind them
+    //up to the capacity are free.
+    size_t n, nCloud, initialN, initialNCloud;
+    float hr, hz, totalMass, dt, softening;
     float salpeterA, salpeterB, salpeterC;
-    std::vector<glm::vec4> currentPosition, previousPosition, colour;
+    std::vector<glm::vec4> currentPosition, previousPosition;
     std::vector<float> mass, luminosity, temperature;
+    std::vector<uint32_t> particleId;
+    //Index of every particle ID handed out, UINT32_MAX once it is removed
+    std::vector<uint32_t> particleIndex;
+    ParticleArrays particles;
+    std::vector<float> accelerationX, accelerationY, accelerationZ;
+    std::vector<float> velocityX, velocityY, velocityZ;
+    class BarnesHut barnesHut;
+    FastMultipole fastMultipole;
+    class ParticleMesh particleMesh;
+    bool hydro;
+    SmoothedParticles hydrodynamics;
+    CellList cellList;
+    //Whether cellList was built from the current positions
+    bool cellListCurrent;
+    size_t reorderInterval, stepsSinceReorder;
+    std::vector<uint64_t> reorderKeys;
+    std::vector<uint32_t> reorderOrder;
+    float escapeRadius;
+    size_t compactionInterval, stepsSinceCompaction;
+    bool commandsPending;
+    std::vector<Spawn> spawns;
+    uint32_t nextParticleId;
+    float starFormationRate;
+    std::default_random_engine formationEngine;
+    std::vector<uint8_t> fate, particleClass;
+    //Time since the last reset()
+    double simulationTime;
+    StellarEvolution evolution;
+    //IDs of the stars to start evolving after the next applyCommands()
+    std::vector<uint32_t> newStarIds;
+    std::vector<uint32_t> evolvedIds, evolvedIndices;
+    size_t evolvedLastStep, evolutionUploads;
+    std::vector<uint32_t> compactStart, compactOffsets;
+    Integrator integrator;
+    Precision precision;
+    //Whether precise still holds the current state, see integrate()
+    bool preciseLoaded;
+    PrecisePositions precise;
+    PotentialTable potentialTable;
+    float bulgeGM, bulgeA, haloGM, haloRs;
+    int maxLevel;
+    float timestepAccuracy;
+    size_t activeSteps;
+    std::vector<uint8_t> level;
+    //Particle indices sorted by level, with level l at [levelStart[l], levelStart[l + 1])
+    std::vector<size_t> levelOrder, levelStart, levelCount, levelOffsets;
+    ParticleArrays active, blockScratch;
+    std::vector<float> activeAccelerationX, activeAccelerationY, activeAccelerationZ;
     const float vertexScreen[24] = {-1, -1, 1, 1, -1, 1, 1, 1, 1, -1, 1, 1, -1, 1, 1, 1, 1, -1, 1, 1, 1, 1, 1, 1};
     GLuint hGaussProgram, vGaussProgram, computeProgram;
-    GLuint nId, totalGMId, dtId, hrId, hzId;
-    GLuint currentPositionBuffer, previousPositionBuffer, massBuffer, colourBuffer, luminosityBuffer, vertexScreenBuffer;
+    GLuint nId, stepsId, totalGMId, dtId, hrId, hzId, tableId, potentialId;
+    GLuint currentPositionBuffer, previousPositionBuffer, massBuffer, temperatureBuffer, luminosityBuffer, vertexScreenBuffer;
     GLuint framebuffers[2];
     GLuint framebufferTextures[2];
-    std::default_random_engine randomEngine;
-    std::uniform_real_distribution<float> distribution;
+    GLuint tableTexture;
+    //colourTable::table, read by shader.vert from texture unit 2
+    GLuint colourTexture;
+    //Key of the counter-based generator of the initial conditions, so every reset replays the same particles
+    uint32_t seed;
+    //A background reset: resetGenerated is set by its thread once the spare arrays hold resetCount particles, of which
+    //resetUploaded are in the spare buffers, ordered like currentPositionBuffer, previousPositionBuffer, massBuffer,
+    //luminosityBuffer and temperatureBuffer
+    bool resetRunning;
+    std::thread resetThread;
+    std::atomic<bool> resetGenerated, resetCancelled;
+    std::atomic<size_t> resetProgress;
+    size_t resetCount, resetUploaded;
+    float resetTotalMass;
+    std::vector<glm::vec4> resetCurrentPosition, resetPreviousPosition;
+    std::vector<float> resetMass, resetLuminosity, resetTemperature;
+    GLuint resetBuffers[5];
+    //The cache file of a reset() on the GPU backend that hit, until loadArrays() has copied it into the CPU arrays
+    MappedInitialConditions pendingConditions;
+    //Particles the spare buffers have room for, 0 before they exist
+    size_t resetBufferCapacity;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,83 @@
+#ifndef ICCACHE_HPP
+#define ICCACHE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <glm/glm.hpp>
+
+//Everything Galaxy::reset() generates from. version is bumped whenever reset() changes what it makes of the rest.
+struct InitialConditionsKey {
+    uint64_t version, n, nCloud, tableSizeR, tableSizeZ, seed;
+    float hr, hz, salpeterA, salpeterB, salpeterC, dt, bulgeGM, bulgeA, haloGM, haloRs;
+    
+    bool operator==(const InitialConditionsKey&) const = default;
+};
+
+//A cache file mapped read-only, with the arrays in the layout of the GL buffers. Empty on a miss.
+class MappedInitialConditions {
+public:
+    MappedInitialConditions() = default;
+    MappedInitialConditions(MappedInitialConditions&& other) noexcept;
+    MappedInitialConditions& operator=(MappedInitialConditions&& other) noexcept;
+    MappedInitialConditions(const MappedInitialConditions&) = delete;
+    MappedInitialConditions& operator=(const MappedInitialConditions&) = delete;
+    ~MappedInitialConditions();
+    
+    explicit operator bool() const;
+    size_t count() const;
+    double totalMass() const;
+    const glm::vec4* currentPosition() const;
+    const glm::vec4* previousPosition() const;
+    const float* mass() const;
+    const float* luminosity() const;
+    const float* temperature() const;
+private:
+    friend class InitialConditionsCache;
+    
+    void release();
+    
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    //No mmap, the file is read into this instead
+    unsigned char* buffer = nullptr;
+#endif
+};
+
+//Content-addressed store of the particles reset() generates: one file per key, named by its hash, holding the key to rule out
+//collisions and the arrays, each 64-byte aligned, so a hit maps the file and uploads from it without a parse. Files are written
+//under a temporary name and renamed, so a reader never sees half of one. Every change of the settings is a new key, so the
+//directory is kept within a byte budget: after each store the files least recently used, by modification time, which a hit
+//renews, are removed.
+class InitialConditionsCache {
+public:
+    static InitialConditionsCache& global();
+    
+    //Empty turns the cache off, which is the default
+    void setDirectory(const std::string& directory);
+    const std::string& getDirectory() const;
+    bool enabled() const;
+    //Bytes the cache files may take together, 4 GiB by default. Galaxies larger than that are not stored.
+    void setBudget(uint64_t bytes);
+    
+    MappedInitialConditions load(const InitialConditionsKey& key) const;
+    //Loads that found their file, and ones that did not, while the cache was on
+    size_t getHits() const;
+    size_t getMisses() const;
+    void store(const InitialConditionsKey& key, size_t count, double totalMass, const glm::vec4* currentPosition, const glm::vec4* previousPosition, const float* mass, const float* luminosity, const float* temperature) const;
+private:
+    std::string path(const InitialConditionsKey& key) const;
+    //The file of key mapped and checked against it, or empty
+    MappedInitialConditions map(const InitialConditionsKey& key) const;
+    //Removes the least recently used files other than keep until the rest fit in the budget
+    void evict(const std::string& keep) const;
+    
+    std::string directory;
+    uint64_t budget = uint64_t(4) << 30;
+    //A background reset loads on a thread of its own
+    mutable std::atomic<size_t> hits = 0, misses = 0;
+};
+
+#endif
\ No newline at end of file
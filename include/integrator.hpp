@@ -0,0 +1,44 @@
+#ifndef INTEGRATOR_HPP
+#define INTEGRATOR_HPP
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include "cpufeatures.hpp"
+#include "fastmath.hpp"
+
+//Structure-of-arrays copy of the particle positions for the CPU backend
+struct ParticleArrays {
+    std::vector<float> x, y, z, prevX, prevY, prevZ;
+    
+    void resize(size_t n);
+    size_t size() const;
+    void swap();
+};
+
+//totalGM * (1 - exp(-R / hr)) * (1 - exp(-|z| / hz)) / r^3 with gmDt2 = totalGM * dt^2, the factor of -xyz in a * dt^2 of the disk potential
+inline float diskFactor(float x, float y, float z, float invHr, float invHz, float gmDt2){
+    float rProj2 = x * x + y * y;
+    float r2 = rProj2 + z * z;
+    float invR = 1.0f / std::sqrt(r2);
+    return gmDt2 * (1.0f - std::exp(-std::sqrt(rProj2) * invHr)) * (1.0f - std::exp(-std::fabs(z) * invHz)) * invR * invR * invR;
+}
+
+//Same position-Verlet step as shaders/verlet.comp: writes the new positions into prev for [begin, end), call swap() once all ranges are done.
+//accuracy picks the exp and 1 / sqrt of the SIMD kernels, see fastmath.hpp.
+void verletStep(ParticleArrays& p, size_t begin, size_t end, float totalGM, float hr, float hz, float dt);
+void verletStep(ParticleArrays& p, size_t begin, size_t end, float totalGM, float hr, float hz, float dt, SimdLevel level, fastmath::Accuracy accuracy = fastmath::Accuracy::Precise);
+//Plain libm version, kept as the reference the SIMD kernels are checked against
+void verletStepScalar(ParticleArrays& p, size_t begin, size_t end, float totalGM, float hr, float hz, float dt);
+//steps disk steps in a row with each particle kept in registers. Unlike verletStep this leaves the new position in x and the one
+//before it in prev, so no swap() follows.
+void verletSteps(ParticleArrays& p, size_t begin, size_t end, float totalGM, float hr, float hz, float dt, size_t steps, fastmath::Accuracy accuracy = fastmath::Accuracy::Precise);
+void verletStepsScalar(ParticleArrays& p, size_t begin, size_t end, float totalGM, float hr, float hz, float dt, size_t steps);
+//steps disk steps with one of the policies from symplectic.hpp, in the same x / prev storage and like verletSteps without a swap()
+template<class Scheme> void integrateDisk(ParticleArrays& p, size_t begin, size_t end, float totalGM, float hr, float hz, float dt, size_t steps, fastmath::Accuracy accuracy = fastmath::Accuracy::Precise);
+template<class Scheme> void integrateDiskScalar(ParticleArrays& p, size_t begin, size_t end, float totalGM, float hr, float hz, float dt, size_t steps);
+//Position-Verlet step with precomputed accelerations, used by the self-gravity solvers
+void verletStep(ParticleArrays& p, size_t begin, size_t end, const float* ax, const float* ay, const float* az, float dt);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,39 @@
+#ifndef MIXEDPRECISION_HPP
+#define MIXEDPRECISION_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "integrator.hpp"
+#include "threadpool.hpp"
+
+//Float is the plain x / prev storage. The others never form 2x - prev: they keep the displacement d = x - prev over the last step,
+//which is velocity-sized, as a float plus the rounding error of its a * dt^2 updates, and only the position itself gets extra
+//bits. Double stores it as a double, Compensated as a float pair hi + lo so the kernels stay at full float width.
+enum class Precision {Float, Double, Compensated};
+
+struct PrecisePositions {
+    Precision precision = Precision::Double;
+    std::vector<double> x, y, z;
+    std::vector<float> hiX, hiY, hiZ, loX, loY, loZ;
+    std::vector<float> dx, dy, dz, loDx, loDy, loDz;
+    
+    //Takes over the state of p, with d = x - prev
+    void load(const ParticleArrays& p, Precision newPrecision);
+    //Takes over [begin, end) of p, growing the arrays if needed, for particles added to an already loaded state
+    void reload(const ParticleArrays& p, size_t begin, size_t end);
+    //Rounds [begin, end) back into the float x / prev view the rest of the code reads
+    void store(ParticleArrays& p, size_t begin, size_t end) const;
+    //Moves particle order[i] to i for i < order.size(), as applyOrder does for the float arrays
+    void permute(const std::vector<uint32_t>& order, ThreadPool& pool);
+    size_t size() const;
+};
+
+//steps position-Verlet steps of the disk potential for [begin, end), the same scheme as verletStep
+void preciseSteps(PrecisePositions& s, size_t begin, size_t end, float totalGM, float hr, float hz, float dt, size_t steps);
+void preciseStepsScalar(PrecisePositions& s, size_t begin, size_t end, float totalGM, float hr, float hz, float dt, size_t steps);
+//One step with precomputed accelerations, for the self-gravity solvers
+void preciseStep(PrecisePositions& s, size_t begin, size_t end, const float* ax, const float* ay, const float* az, float dt);
+
+#endif
\ No newline at end of file
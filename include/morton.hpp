@@ -0,0 +1,56 @@
+#ifndef MORTON_HPP
+#define MORTON_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "threadpool.hpp"
+
+//Bounding cube of a particle set, the frame every Morton key is relative to
+struct MortonBox {
+    float minX, minY, minZ, size;
+};
+
+//21 bits per axis, so the keys use the low 63 bits and the deepest cell is size / 2^21
+constexpr int mortonLevels = 21;
+
+inline uint64_t mortonSpread(uint64_t v){
+    v &= 0x1fffff;
+    v = (v | v << 32) & 0x1f00000000ffffull;
+    v = (v | v << 16) & 0x1f0000ff0000ffull;
+    v = (v | v << 8) & 0x100f00f00f00f00full;
+    v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+    v = (v | v << 2) & 0x1249249249249249ull;
+    return v;
+}
+
+inline uint64_t mortonKey(const MortonBox& box, float x, float y, float z){
+    const float scale = (1 << mortonLevels) / box.size;
+    auto cell = [scale](float v, float min){
+        float c = (v - min) * scale;
+        return static_cast<uint64_t>(c < 0.0f ? 0.0f : c > (1 << mortonLevels) - 1 ? (1 << mortonLevels) - 1 : c);
+    };
+    return mortonSpread(cell(x, box.minX)) | mortonSpread(cell(y, box.minY)) << 1 | mortonSpread(cell(z, box.minZ)) << 2;
+}
+
+//Per-axis minimum and maximum of the particle positions, as a parallel reduction
+void axisBounds(const float* x, const float* y, const float* z, size_t n, float min[3], float max[3], ThreadPool& pool);
+//Smallest cube around all particles, with a little padding so the maximum lands inside the last cell
+MortonBox mortonBounds(const float* x, const float* y, const float* z, size_t n, ThreadPool& pool);
+void mortonKeys(const MortonBox& box, const float* x, const float* y, const float* z, size_t n, std::vector<uint64_t>& keys, ThreadPool& pool);
+//Stable parallel LSD radix sort of keys, with order permuted along. order is (re)initialised to 0..n-1 first.
+void radixSort(std::vector<uint64_t>& keys, std::vector<uint32_t>& order, ThreadPool& pool);
+
+//Moves the old v[order[i]] to v[i], the sorted order radixSort leaves behind. Only the first order.size() elements take part, so
+//v may be longer.
+template<class T> void applyOrder(std::vector<T>& v, const std::vector<uint32_t>& order, ThreadPool& pool){
+    std::vector<T> permuted(order.size());
+    pool.parallelFor(0, order.size(), [&](size_t begin, size_t end){
+        for(size_t i = begin;i < end;++i) permuted[i] = v[order[i]];
+    });
+    std::copy(permuted.begin(), permuted.end(), v.begin());
+}
+
+#endif
\ No newline at end of file
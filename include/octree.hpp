@@ -0,0 +1,35 @@
+#ifndef OCTREE_HPP
+#define OCTREE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "morton.hpp"
+#include "threadpool.hpp"
+
+//Adaptive linear octree over Morton-sorted particles, shared by the tree-based gravity solvers. Every node is a contiguous range of
+//the sorted particles, the children of a node are stored next to each other and nodes are grouped by depth.
+struct OctreeNode {
+    uint32_t begin, end, firstChild, parent;
+    uint8_t childCount, depth;
+    //Geometric centre and side length of the node's cube
+    float centreX, centreY, centreZ, size;
+};
+
+class Octree {
+public:
+    //Sorts the particles and splits every node holding more than leafSize of them, down to the deepest Morton level
+    void build(const float* x, const float* y, const float* z, const float* m, size_t n, size_t leafSize, ThreadPool& pool);
+    
+    MortonBox box;
+    std::vector<uint64_t> keys;
+    //order[i] is the original index of sorted particle i
+    std::vector<uint32_t> order;
+    std::vector<float> sortedX, sortedY, sortedZ, sortedMass;
+    std::vector<OctreeNode> nodes;
+    //nodes[levelStart[d], levelStart[d + 1]) are the nodes at depth d
+    std::vector<size_t> levelStart;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,64 @@
+#ifndef PARTICLEMESH_HPP
+#define PARTICLEMESH_HPP
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "fft.hpp"
+#include "threadpool.hpp"
+
+//Cloud-in-cell spreads a particle over the 8 nearest cells, triangular-shaped cloud over 27 with smoother forces
+enum class MassAssignment {CIC, TSC};
+
+//O(N + M log M) particle-mesh gravity with isolated boundaries: mass is deposited on a grid spanning the particles, convolved with
+//the softened Green's function through a zero-padded real-to-complex FFT, differentiated on the grid and interpolated back with
+//the same assignment. Cell sizes are set per axis, so a thin disk can use far fewer cells in z than in x and y.
+class ParticleMesh {
+public:
+    //Grid sizes are rounded up to powers of two, at least 8
+    explicit ParticleMesh(size_t nx = 128, size_t ny = 128, size_t nz = 16, MassAssignment assignment = MassAssignment::TSC);
+    //Writes (not adds) into ax, ay and az, in the same softened G = 1 units as directAccelerations. Forces are further smoothed
+    //on the scale of a cell.
+    void computeAccelerations(const float* x, const float* y, const float* z, const float* m, size_t n, float softening, float* ax, float* ay, float* az, ThreadPool& pool);
+    
+    void setGridSize(size_t nx, size_t ny, size_t nz);
+    void getGridSize(size_t& nx, size_t& ny, size_t& nz) const;
+    void setAssignment(MassAssignment newAssignment);
+    MassAssignment getAssignment() const;
+    double getDepositSeconds() const;
+    double getSolveSeconds() const;
+    double getInterpolateSeconds() const;
+    //Number of times the Green's function had to be rebuilt because the grid moved or was resized
+    size_t getGreenRebuilds() const;
+private:
+    bool updateBox(const float* x, const float* y, const float* z, size_t n, ThreadPool& pool);
+    void buildGreen(float softening, ThreadPool& pool);
+    void forward(const float* in, std::complex<float>* out, bool sparse, ThreadPool& pool);
+    void inverse(std::complex<float>* in, float* out, ThreadPool& pool);
+    void transformZ(std::complex<float>* data, bool inverse, size_t keep, ThreadPool& pool);
+    void deposit(const float* x, const float* y, const float* z, const float* m, size_t n, ThreadPool& pool);
+    void differentiate(ThreadPool& pool);
+    void interpolate(const float* x, const float* y, const float* z, size_t n, float* ax, float* ay, float* az, ThreadPool& pool);
+    
+    //Physical grid size and the padded size used for the isolated convolution, twice as large per axis
+    size_t size[3], padded[3];
+    MassAssignment assignment;
+    //Position of the corner of cell 0 and the cell size per axis
+    float origin[3], spacing[3];
+    float greenSoftening;
+    bool greenValid;
+    size_t greenRebuilds;
+    double depositSeconds, solveSeconds, interpolateSeconds;
+    RealFFTPlan planX;
+    FFTPlan planY, planZ;
+    //Real (not complex) since the Green's function is even in every axis
+    std::vector<float> greenSpectrum;
+    std::vector<std::complex<float>> spectrum;
+    std::vector<float> density, potential, gridX, gridY, gridZ;
+    //Particles ordered by x slab for the coloured deposit, with slabStart[s] the first particle of slab s
+    std::vector<uint32_t> slabOrder, slabStart;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,192 @@
+#ifndef POTENTIAL_HPP
+#define POTENTIAL_HPP
+
+#include <cfloat>
+#include <cstddef>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <utility>
+
+#include "fastmath.hpp"
+#include "integrator.hpp"
+#include "simd.hpp"
+
+//Fixed galaxy potentials built from components at compile time. Every component has an accelerate() templated on the lane type,
+//float for the scalar loops and __m256 / __m512 inside the SIMD kernels, that adds its acceleration at (x, y, z) to (ax, ay, az).
+//Potential<Components...> calls them one after the other on the same registers, so a halo costs its arithmetic and nothing else:
+//no second pass over the particles and no virtual call. glsl() generates the same sum for verlet.comp, reading the parameters
+//from a uniform array so a new mass does not need a recompile.
+
+//Name of parameter i in the generated GLSL
+inline std::string glslParameter(size_t i){
+    return "potentialParameters[" + std::to_string(i) + "]";
+}
+
+//The exp and log of the components, Precise to stay within a few roundings of the analytic kernels the components are checked
+//against
+inline constexpr fastmath::Accuracy potentialAccuracy = fastmath::Accuracy::Precise;
+
+//The components below pass __m256 and __m512 through functions without a target attribute, which GCC warns changes the ABI.
+//They are always inlined into a kernel that has one, so no call ever crosses that boundary.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+//The disk of the particles: -gm * (1 - exp(-R / hr)) * (1 - exp(-|z| / hz)) * p / r^3, as in verlet.comp
+struct ExponentialDisk {
+    static constexpr size_t parameterCount = 3;
+    float gm, hr, hz;
+    
+    template<class V> [[gnu::always_inline]] void accelerate(const V& x, const V& y, const V& z, V& ax, V& ay, V& az) const {
+        using namespace simd;
+        V rProj2 = x * x + y * y;
+        V r2 = vmax(rProj2 + z * z, FLT_MIN);
+        //The arguments are clamped to the domain of fastmath::exp, 1 - exp is 1 beyond it anyway
+        V f = gm * (1.0f - fastmath::exp<potentialAccuracy>(vmax(vsqrt(rProj2) * (-1.0f / hr), -87.3f))) * (1.0f - fastmath::exp<potentialAccuracy>(vmax(vabs(z) * (-1.0f / hz), -87.3f))) / (r2 * vsqrt(r2));
+        ax -= f * x;
+        ay -= f * y;
+        az -= f * z;
+    }
+    void parameters(float* out) const {
+        out[0] = gm;
+        out[1] = hr;
+        out[2] = hz;
+    }
+    static std::string glsl(size_t offset){
+        return "    a -= " + glslParameter(offset) + " * (1.0 - exp(-length(p.xy) / " + glslParameter(offset + 1) + ")) * (1.0 - exp(-abs(p.z) / " + glslParameter(offset + 2) + ")) / pow(max(dot(p, p), 1e-30), 1.5) * p;\n";
+    }
+};
+
+//Bulge: Phi = -gm / (r + a)
+struct Hernquist {
+    static constexpr size_t parameterCount = 2;
+    float gm, a;
+    
+    template<class V> [[gnu::always_inline]] void accelerate(const V& x, const V& y, const V& z, V& ax, V& ay, V& az) const {
+        using namespace simd;
+        V r = vsqrt(vmax(x * x + y * y + z * z, FLT_MIN));
+        V ra = r + a;
+        V f = gm / (r * ra * ra);
+        ax -= f * x;
+        ay -= f * y;
+        az -= f * z;
+    }
+    void parameters(float* out) const {
+        out[0] = gm;
+        out[1] = a;
+    }
+    static std::string glsl(size_t offset){
+        std::string r = "max(length(p), 1e-15)", ra = "(" + r + " + " + glslParameter(offset + 1) + ")";
+        return "    a -= " + glslParameter(offset) + " / (" + r + " * " + ra + " * " + ra + ") * p;\n";
+    }
+};
+
+//Dark halo: Phi = -gm * ln(1 + r / rs) / r, so the mass inside r is gm * (ln(1 + x) - x / (1 + x)) with x = r / rs
+struct NFW {
+    static constexpr size_t parameterCount = 2;
+    float gm, rs;
+    
+    template<class V> [[gnu::always_inline]] void accelerate(const V& x, const V& y, const V& z, V& ax, V& ay, V& az) const {
+        using namespace simd;
+        V r = vsqrt(vmax(x * x + y * y + z * z, FLT_MIN));
+        V s = r * (1.0f / rs);
+        //The two terms cancel to x^2 / 2 near the centre, where the series of their difference takes over
+        V series = ((((((0.875f * s - 0.857142857f) * s + 0.833333333f) * s - 0.8f) * s + 0.75f) * s - 0.666666667f) * s + 0.5f) / (rs * rs * r);
+        V full = (fastmath::log<potentialAccuracy>(1.0f + s) - s / (1.0f + s)) / (r * r * r);
+        V f = gm * (s < 0.1f ? series : full);
+        ax -= f * x;
+        ay -= f * y;
+        az -= f * z;
+    }
+    void parameters(float* out) const {
+        out[0] = gm;
+        out[1] = rs;
+    }
+    static std::string glsl(size_t offset){
+        std::ostringstream out;
+        out << "    {\n";
+        out << "        float r = max(length(p), 1e-15), s = r / " << glslParameter(offset + 1) << ";\n";
+        out << "        float m = s < 0.1 ? s * s * ((((((0.875 * s - 0.857142857) * s + 0.833333333) * s - 0.8) * s + 0.75) * s - 0.666666667) * s + 0.5) : log(1.0 + s) - s / (1.0 + s);\n";
+        out << "        a -= " << glslParameter(offset) << " * m / (r * r * r) * p;\n";
+        out << "    }\n";
+        return out.str();
+    }
+};
+
+//Thick disk: Phi = -gm / sqrt(R^2 + (a + sqrt(z^2 + b^2))^2)
+struct MiyamotoNagai {
+    static constexpr size_t parameterCount = 3;
+    float gm, a, b;
+    
+    template<class V> [[gnu::always_inline]] void accelerate(const V& x, const V& y, const V& z, V& ax, V& ay, V& az) const {
+        using namespace simd;
+        V zeta = vsqrt(z * z + b * b);
+        V sum = a + zeta;
+        V d2 = x * x + y * y + sum * sum;
+        V f = gm / (d2 * vsqrt(d2));
+        ax -= f * x;
+        ay -= f * y;
+        az -= f * z * sum / zeta;
+    }
+    void parameters(float* out) const {
+        out[0] = gm;
+        out[1] = a;
+        out[2] = b;
+    }
+    static std::string glsl(size_t offset){
+        std::ostringstream out;
+        out << "    {\n";
+        out << "        float zeta = sqrt(p.z * p.z + " << glslParameter(offset + 2) << " * " << glslParameter(offset + 2) << "), az = " << glslParameter(offset + 1) << " + zeta;\n";
+        out << "        float d2 = dot(p.xy, p.xy) + az * az;\n";
+        out << "        a -= " << glslParameter(offset) << " / (d2 * sqrt(d2)) * vec3(p.xy, p.z * az / zeta);\n";
+        out << "    }\n";
+        return out.str();
+    }
+};
+
+template<class... Components> struct Potential {
+    static constexpr size_t parameterCount = (Components::parameterCount + ... + 0);
+    std::tuple<Components...> components;
+    
+    template<class V> [[gnu::always_inline]] void accelerate(const V& x, const V& y, const V& z, V& ax, V& ay, V& az) const {
+        accelerateAll(x, y, z, ax, ay, az, std::index_sequence_for<Components...>());
+    }
+    //All parameters in component order, as the generated GLSL expects them in potentialParameters
+    void parameters(float* out) const {
+        parametersAll(out, std::index_sequence_for<Components...>());
+    }
+    //Defines POTENTIAL and potentialAcceleration(p) for the #ifdef POTENTIAL branch of verlet.comp
+    static std::string glsl(){
+        std::ostringstream out;
+        out << "#define POTENTIAL\nuniform float potentialParameters[" << parameterCount << "];\n";
+        out << "vec3 potentialAcceleration(vec3 p){\n    vec3 a = vec3(0.0);\n";
+        size_t offset = 0;
+        ((out << Components::glsl(offset), offset += Components::parameterCount), ...);
+        out << "    return a;\n}\n";
+        return out.str();
+    }
+private:
+    template<class V, size_t... I> [[gnu::always_inline]] void accelerateAll(const V& x, const V& y, const V& z, V& ax, V& ay, V& az, std::index_sequence<I...>) const {
+        (std::get<I>(components).accelerate(x, y, z, ax, ay, az), ...);
+    }
+    template<size_t... I> void parametersAll(float* out, std::index_sequence<I...>) const {
+        size_t offset = 0;
+        ((std::get<I>(components).parameters(out + offset), offset += Components::parameterCount), ...);
+    }
+};
+
+#pragma GCC diagnostic pop
+
+//The disk of the particles with a bulge and a dark halo, what Galaxy integrates once either of the latter has mass
+using GalaxyPotential = Potential<ExponentialDisk, Hernquist, NFW>;
+//Miyamoto-Nagai disk, Hernquist bulge and NFW halo, the usual Milky Way style model, used by the benchmark
+using MilkyWayPotential = Potential<MiyamotoNagai, Hernquist, NFW>;
+
+//Adds the acceleration of the potential at the positions in [begin, end) to (ax, ay, az)
+template<class P> void potentialAccelerations(const float* x, const float* y, const float* z, size_t begin, size_t end, const P& potential, float* ax, float* ay, float* az);
+//verletSteps in the potential, the same x / prev storage and no swap() afterwards
+template<class P> void potentialSteps(ParticleArrays& p, size_t begin, size_t end, const P& potential, float dt, size_t steps);
+//integrateDisk in the potential
+template<class Scheme, class P> void integratePotential(ParticleArrays& p, size_t begin, size_t end, const P& potential, float dt, size_t steps);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,43 @@
+#ifndef POTENTIALTABLE_HPP
+#define POTENTIALTABLE_HPP
+
+#include <cstddef>
+#include <vector>
+
+#include "integrator.hpp"
+#include "threadpool.hpp"
+
+//The disk acceleration of verlet.comp is -totalGM * h(R, |z|) * p / r^3 with h = (1 - exp(-R / hr)) * (1 - exp(-|z| / hz)), and
+//the initial circular velocity is sqrt(M * h / r). Only h is tabulated: it holds both exps, depends on hr and hz alone so one
+//table serves every mass, and unlike the full force it is smooth and bounded everywhere. The 1 / r^3 stays exact, which keeps
+//the error small near the centre. h is sampled on s = R / (R + hr), t = |z| / (|z| + hz), so the grid covers all of space with
+//most of its nodes where the particles are.
+class PotentialTable {
+public:
+    //Samples h on an nR x nZ grid of nodes, one row of constant t per task. Does nothing if nothing changed.
+    void build(float hr, float hz, size_t nR, size_t nZ, ThreadPool& pool);
+    //Bilinear interpolation of h, exactly like the texelFetch version in verlet.comp
+    float lookup(float rProj, float absZ) const;
+    //Largest and root mean square relative acceleration error over the given positions, against h in double precision
+    void error(const float* x, const float* y, const float* z, size_t n, double& maxError, double& rmsError) const;
+    //Row-major, R along the rows, as uploaded to the GL_R32F texture
+    const std::vector<float>& data() const;
+    float getHr() const;
+    float getHz() const;
+    size_t getSizeR() const;
+    size_t getSizeZ() const;
+    bool empty() const;
+    
+    static double exact(double rProj, double absZ, double hr, double hz);
+private:
+    float hr = 0.0f, hz = 0.0f;
+    size_t nR = 0, nZ = 0;
+    std::vector<float> table;
+};
+
+//verletSteps with the disk acceleration read from the table, what verlet.comp does with it. Galaxy's CPU backend keeps to
+//verletSteps, which is faster, so these are only run by --bench table.
+void tabulatedSteps(ParticleArrays& p, size_t begin, size_t end, const PotentialTable& table, float totalGM, float dt, size_t steps);
+void tabulatedStepsScalar(ParticleArrays& p, size_t begin, size_t end, const PotentialTable& table, float totalGM, float dt, size_t steps);
+
+#endif
\ No newline at end of file
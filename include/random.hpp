@@ -0,0 +1,40 @@
+#ifndef RANDOM_HPP
+#define RANDOM_HPP
+
+#include <array>
+#include <cstdint>
+
+//Philox4x32-10 of Salmon et al., "Parallel random numbers: as easy as 1, 2, 3": the numbers for a counter are a keyed bijection
+//of it, so any of them comes straight from (key, counter) with no state carried from one to the next. Whichever thread draws a
+//particle's numbers, and in whatever order, they come out the same.
+constexpr std::array<uint32_t, 4> philox4x32(std::array<uint32_t, 4> counter, std::array<uint32_t, 2> key){
+    for(int round = 0;round < 10;++round){
+        const uint64_t p0 = static_cast<uint64_t>(0xD2511F53u) * counter[0];
+        const uint64_t p1 = static_cast<uint64_t>(0xCD9E8D57u) * counter[2];
+        counter = {static_cast<uint32_t>(p1 >> 32) ^ counter[1] ^ key[0], static_cast<uint32_t>(p1), static_cast<uint32_t>(p0 >> 32) ^ counter[3] ^ key[1], static_cast<uint32_t>(p0)};
+        key[0] += 0x9E3779B9u;
+        key[1] += 0xBB67AE85u;
+    }
+    return counter;
+}
+
+//Known-answer vectors of the Random123 distribution
+static_assert(philox4x32({0, 0, 0, 0}, {0, 0}) == std::array<uint32_t, 4>{0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8});
+static_assert(philox4x32({0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff}, {0xffffffff, 0xffffffff}) == std::array<uint32_t, 4>{0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd});
+static_assert(philox4x32({0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344}, {0xa4093822, 0x299f31d0}) == std::array<uint32_t, 4>{0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1});
+
+//The top 23 bits as a float in the open interval (0, 1), so neither log(u) nor log(1 - u) can be infinite. With 24 the largest,
+//1 - 2^-25, would round to 1.
+constexpr float uniformOpen(uint32_t bits){
+    return ((bits >> 9) + 0.5f) * 0x1p-23f;
+}
+
+static_assert(uniformOpen(0) > 0.0f && uniformOpen(0xffffffff) < 1.0f);
+
+//Four uniforms of stream for item index under key
+inline std::array<float, 4> uniform4(std::array<uint32_t, 2> key, uint64_t index, uint32_t stream = 0){
+    const std::array<uint32_t, 4> bits = philox4x32({static_cast<uint32_t>(index), static_cast<uint32_t>(index >> 32), stream, 0}, key);
+    return {uniformOpen(bits[0]), uniformOpen(bits[1]), uniformOpen(bits[2]), uniformOpen(bits[3])};
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,92 @@
+#ifndef SIMD_HPP
+#define SIMD_HPP
+
+//Shared helpers for the hand-vectorised CPU kernels. Each function carries its own target attribute so the kernels can be
+//compiled into one binary and picked at runtime with detectSimdLevel().
+
+#include <cfloat>
+#include <cmath>
+
+#include "cpufeatures.hpp"
+#include "fastmath.hpp"
+
+#ifdef SIMD_X86
+namespace simd {
+    //totalGM * (1 - exp(-R / hr)) * (1 - exp(-|z| / hz)) / r^3 with gmDt2 = totalGM * dt^2, the factor of -xyz in a * dt^2 of the disk potential.
+    //A is the accuracy of the exp and rsqrt from fastmath.hpp. The exp arguments are clamped to its domain, far out they are
+    //unbounded and 1 - exp is 1 there anyway.
+    template<fastmath::Accuracy A> inline __m128 diskFactor128(__m128 vx, __m128 vy, __m128 vz, __m128 negInvHr, __m128 negInvHz, __m128 gmDt2){
+        const __m128 one = _mm_set1_ps(1.0f), tiny = _mm_set1_ps(FLT_MIN), expLo = _mm_set1_ps(-87.3f), absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+        __m128 rProj2 = _mm_max_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), tiny);
+        __m128 invR = fastmath::rsqrt<A>(_mm_add_ps(rProj2, _mm_mul_ps(vz, vz)));
+        __m128 rProj = _mm_mul_ps(rProj2, fastmath::rsqrt<A>(rProj2));
+        __m128 fr = _mm_sub_ps(one, fastmath::exp<A>(_mm_max_ps(_mm_mul_ps(rProj, negInvHr), expLo)));
+        __m128 fz = _mm_sub_ps(one, fastmath::exp<A>(_mm_max_ps(_mm_mul_ps(_mm_and_ps(vz, absMask), negInvHz), expLo)));
+        return _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(gmDt2, fr), fz), _mm_mul_ps(_mm_mul_ps(invR, invR), invR));
+    }
+    
+    template<fastmath::Accuracy A> __attribute__((target("avx2,fma"))) inline __m256 diskFactor256(__m256 vx, __m256 vy, __m256 vz, __m256 negInvHr, __m256 negInvHz, __m256 gmDt2){
+        const __m256 one = _mm256_set1_ps(1.0f), tiny = _mm256_set1_ps(FLT_MIN), expLo = _mm256_set1_ps(-87.3f), absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+        __m256 rProj2 = _mm256_max_ps(_mm256_fmadd_ps(vx, vx, _mm256_mul_ps(vy, vy)), tiny);
+        __m256 invR = fastmath::rsqrt<A>(_mm256_fmadd_ps(vz, vz, rProj2));
+        __m256 rProj = _mm256_mul_ps(rProj2, fastmath::rsqrt<A>(rProj2));
+        __m256 fr = _mm256_sub_ps(one, fastmath::exp<A>(_mm256_max_ps(_mm256_mul_ps(rProj, negInvHr), expLo)));
+        __m256 fz = _mm256_sub_ps(one, fastmath::exp<A>(_mm256_max_ps(_mm256_mul_ps(_mm256_and_ps(vz, absMask), negInvHz), expLo)));
+        return _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(gmDt2, fr), fz), _mm256_mul_ps(_mm256_mul_ps(invR, invR), invR));
+    }
+    
+    template<fastmath::Accuracy A> __attribute__((target("avx512f"))) inline __m512 diskFactor512(__m512 vx, __m512 vy, __m512 vz, __m512 negInvHr, __m512 negInvHz, __m512 gmDt2){
+        const __m512 one = _mm512_set1_ps(1.0f), tiny = _mm512_set1_ps(FLT_MIN), expLo = _mm512_set1_ps(-87.3f);
+        __m512 rProj2 = _mm512_max_ps(_mm512_fmadd_ps(vx, vx, _mm512_mul_ps(vy, vy)), tiny);
+        __m512 invR = fastmath::rsqrt<A>(_mm512_fmadd_ps(vz, vz, rProj2));
+        __m512 rProj = _mm512_mul_ps(rProj2, fastmath::rsqrt<A>(rProj2));
+        __m512 fr = _mm512_sub_ps(one, fastmath::exp<A>(_mm512_max_ps(_mm512_mul_ps(rProj, negInvHr), expLo)));
+        __m512 fz = _mm512_sub_ps(one, fastmath::exp<A>(_mm512_max_ps(_mm512_mul_ps(_mm512_abs_ps(vz), negInvHz), expLo)));
+        return _mm512_mul_ps(_mm512_mul_ps(_mm512_mul_ps(gmDt2, fr), fz), _mm512_mul_ps(_mm512_mul_ps(invR, invR), invR));
+    }
+    
+    //Overloads for float, __m256 and __m512, so code templated on the lane type can be written once with the vector extension
+    //operators, these and the functions of fastmath.hpp
+    __attribute__((target("avx2,fma"))) inline __m256 vsqrt(__m256 x){
+        return _mm256_sqrt_ps(x);
+    }
+    __attribute__((target("avx2,fma"))) inline __m256 vabs(__m256 x){
+        return _mm256_and_ps(x, _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff)));
+    }
+    __attribute__((target("avx2,fma"))) inline __m256 vmax(__m256 x, float y){
+        return _mm256_max_ps(x, _mm256_set1_ps(y));
+    }
+    __attribute__((target("avx2,fma"))) inline __m256 vmin(__m256 x, float y){
+        return _mm256_min_ps(x, _mm256_set1_ps(y));
+    }
+    __attribute__((target("avx512f"))) inline __m512 vsqrt(__m512 x){
+        return _mm512_sqrt_ps(x);
+    }
+    __attribute__((target("avx512f"))) inline __m512 vabs(__m512 x){
+        return _mm512_abs_ps(x);
+    }
+    __attribute__((target("avx512f"))) inline __m512 vmax(__m512 x, float y){
+        return _mm512_max_ps(x, _mm512_set1_ps(y));
+    }
+    __attribute__((target("avx512f"))) inline __m512 vmin(__m512 x, float y){
+        return _mm512_min_ps(x, _mm512_set1_ps(y));
+    }
+}
+#endif
+
+namespace simd {
+    inline float vsqrt(float x){
+        return std::sqrt(x);
+    }
+    inline float vabs(float x){
+        return std::fabs(x);
+    }
+    inline float vmax(float x, float y){
+        return x > y ? x : y;
+    }
+    inline float vmin(float x, float y){
+        return x < y ? x : y;
+    }
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,66 @@
+#ifndef SPH_HPP
+#define SPH_HPP
+
+#include <cstddef>
+#include <vector>
+
+#include "octree.hpp"
+#include "threadpool.hpp"
+
+//Smoothed-particle hydrodynamics for an isothermal gas, P = c^2 rho, with the cubic-spline kernel of support 2h. Every particle
+//adapts h until the kernel-weighted number of particles within 2h, (4 pi / 3) (2h)^3 sum W, is the requested count. The pressure
+//force is the symmetric P_i / rho_i^2 + P_j / rho_j^2 form with the kernel gradients of both smoothing lengths averaged, plus
+//Monaghan's artificial viscosity between approaching pairs. Neighbours come from a walk of the linear Octree per group of
+//Morton-consecutive particles, the density one within a bound on 2h and the force one within 2 max(h_i, h_j) using the largest h
+//below every node.
+class SmoothedParticles {
+public:
+    explicit SmoothedParticles(float soundSpeed = 1.0f, float neighbours = 48.0f, size_t leafSize = 16);
+    //Adds the pressure and viscosity accelerations of particles [0, n) to ax, ay and az. The smoothing lengths of the previous call
+    //are the first guess of this one, so the particles have to keep their indices from call to call.
+    void computeAccelerations(const float* x, const float* y, const float* z, const float* vx, const float* vy, const float* vz, const float* m, size_t n, float* ax, float* ay, float* az, ThreadPool& pool);
+    
+    void setSoundSpeed(float newSoundSpeed);
+    float getSoundSpeed() const;
+    void setNeighbours(float newNeighbours);
+    float getNeighbours() const;
+    //Per particle in the original order, from the last call
+    const std::vector<float>& getSmoothingLengths() const;
+    const std::vector<float>& getDensities() const;
+    //Moves the state of particle order[i] to i, for when the caller reorders its particles between calls. Particles missing from
+    //order are dropped, and indices past the last particle start new ones from a fresh guess.
+    void permute(const std::vector<uint32_t>& order, ThreadPool& pool);
+    double getBuildSeconds() const;
+    double getDensitySeconds() const;
+    double getForceSeconds() const;
+    //Mean of the kernel-weighted neighbour count that h is solved for, and of the pairs actually summed in the force pass
+    double getMeanNeighbours() const;
+    double getMeanPairs() const;
+    
+    //The kernel W(r, h) and dW/dr / r, which times the separation vector is the gradient
+    static float kernel(float r2, float h);
+    static float kernelGradient(float r2, float h);
+private:
+    //Bounding box of the particles below every node, and the largest h among them once the densities are solved
+    struct NodeBounds {
+        float min[3], max[3], h;
+    };
+    
+    void computeNodeBounds(ThreadPool& pool);
+    void solveDensities(ThreadPool& pool);
+    void computeNodeSmoothingLengths(ThreadPool& pool);
+    void computeForces(ThreadPool& pool);
+    
+    float soundSpeed, neighbours;
+    size_t leafSize;
+    double buildSeconds, densitySeconds, forceSeconds, meanNeighbours, meanPairs;
+    Octree tree;
+    //Nodes the walks are done for, in Morton order
+    std::vector<uint32_t> groups;
+    std::vector<float> smoothingLength, density;
+    std::vector<float> sortedVx, sortedVy, sortedVz, sortedH, sortedDensity;
+    std::vector<float> sortedAccelerationX, sortedAccelerationY, sortedAccelerationZ;
+    std::vector<NodeBounds> bounds;
+};
+
+#endif
\ No newline at end of file
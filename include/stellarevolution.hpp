@@ -0,0 +1,59 @@
+#ifndef STELLAREVOLUTION_HPP
+#define STELLAREVOLUTION_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <vector>
+
+enum class StellarPhase : uint8_t {MainSequence, Giant, Remnant};
+
+//Main sequence, giant branch and remnant of every star. A star of mass m stays on the main sequence for solarLifetime * m^-2.5
+//and a tenth of that on the giant branch. The state is kept by particle ID, which reordering and compaction never change, and
+//the phase changes are events in a queue ordered by time, so a step only looks at the stars that actually change.
+class StellarEvolution {
+public:
+    explicit StellarEvolution(float solarLifetime = 0.0f);
+    //Main-sequence lifetime of a star of one solar mass in simulation time, 0 turns the evolution off
+    void setSolarLifetime(float newSolarLifetime);
+    float getSolarLifetime() const;
+    bool enabled() const;
+    //Forgets every star and every pending event
+    void clear();
+    //Starts tracking star id, born at birthTime, and returns its phase at time
+    StellarPhase addStar(uint32_t id, float mass, double birthTime, double time);
+    //Pops the transitions up to time and appends the IDs of the stars that changed phase to changed, in no particular order
+    void advance(double time, std::vector<uint32_t>& changed);
+    StellarPhase getPhase(uint32_t id) const;
+    size_t getPendingEvents() const;
+    //Stars per phase among the tracked ones, removed particles included
+    size_t getCount(StellarPhase p) const;
+    double mainSequenceLifetime(float mass) const;
+    double giantLifetime(float mass) const;
+    
+    //Rough luminosity and surface temperature in a phase: the main sequence from the mass, then a giant ten times as bright at
+    //4000 K (a supergiant as bright at 3500 K from 8 solar masses), then a white dwarf, or a neutron star or black hole that
+    //hardly shows at all
+    static void attributes(float mass, StellarPhase phase, float& luminosity, float& temperature);
+private:
+    struct Event {
+        double time;
+        uint32_t id;
+        
+        bool operator>(const Event& other) const {
+            return time > other.time;
+        }
+    };
+    
+    void schedule(uint32_t id, double time);
+    
+    float solarLifetime;
+    std::vector<StellarPhase> phase;
+    std::vector<float> stellarMass;
+    std::vector<uint8_t> tracked;
+    size_t counts[3];
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events;
+};
+
+#endif
\ No newline at end of file
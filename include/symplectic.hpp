@@ -0,0 +1,83 @@
+#ifndef SYMPLECTIC_HPP
+#define SYMPLECTIC_HPP
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <sstream>
+#include <string>
+
+//Compile-time integrator policies. The particles keep the x / prev storage of position Verlet, which holds the half-step velocity
+//(x - prev) / dt, so the policies only turn that into a synchronised velocity at the start of a batch of steps and back at the end.
+//A policy's step() drives a System that provides kick(h) (v += h a), drift(h, h2) (x += h v + h2 a) and forces() (a = a(x)).
+//Systems exist for one SIMD vector of disk particles and for the whole self-gravity arrays, so the same step runs in both.
+
+enum class Integrator {PositionVerlet, LeapfrogKDK, VelocityVerlet, ForestRuth};
+inline constexpr const char* integratorNames[] = {"verlet", "kdk", "vv", "forestruth"};
+inline constexpr size_t integratorCount = sizeof(integratorNames) / sizeof(integratorNames[0]);
+
+//kick[0] drift[0] kick[1] ... drift[n - 1] kick[n], with the acceleration at the end reused by the next step's first kick
+template<class Scheme, class System> inline void splitStep(System& s, float dt){
+    for(size_t k = 0;k < Scheme::drift.size();++k){
+        s.kick(Scheme::kick[k] * dt);
+        s.drift(Scheme::drift[k] * dt, 0.0f);
+        s.forces();
+    }
+    s.kick(Scheme::kick[Scheme::drift.size()] * dt);
+}
+
+struct LeapfrogKDK {
+    static constexpr std::array<float, 2> kick = {0.5f, 0.5f};
+    static constexpr std::array<float, 1> drift = {1.0f};
+    
+    template<class System> static void step(System& s, float dt){
+        splitStep<LeapfrogKDK>(s, dt);
+    }
+};
+
+//The same map as KDK in exact arithmetic, written the textbook way with the position advanced by v and a together. On the GPU it
+//runs as its KDK splitting.
+struct VelocityVerlet {
+    static constexpr std::array<float, 2> kick = {0.5f, 0.5f};
+    static constexpr std::array<float, 1> drift = {1.0f};
+    
+    template<class System> static void step(System& s, float dt){
+        s.drift(dt, 0.5f * dt * dt);
+        s.kick(0.5f * dt);
+        s.forces();
+        s.kick(0.5f * dt);
+    }
+};
+
+//Fourth order Forest-Ruth / Yoshida triple jump, three force evaluations per step
+struct ForestRuth {
+    static constexpr float w = 1.0f / (2.0f - 1.25992104989487316f);
+    static constexpr std::array<float, 4> kick = {0.5f * w, 0.5f * (1.0f - w), 0.5f * (1.0f - w), 0.5f * w};
+    static constexpr std::array<float, 3> drift = {w, 1.0f - 2.0f * w, w};
+    
+    template<class System> static void step(System& s, float dt){
+        splitStep<ForestRuth>(s, dt);
+    }
+};
+
+//steps steps of Scheme on a System that was loaded with v = (x - prev) / dt, leaving v ready to be stored back the same way
+template<class Scheme, class System> inline void runSteps(System& s, float dt, size_t steps){
+    s.forces();
+    s.kick(0.5f * dt);
+    for(size_t i = 0;i < steps;++i) Scheme::step(s, dt);
+    s.kick(-0.5f * dt);
+}
+
+//Defines for the splitting branch of shaders/verlet.comp
+template<class Scheme> std::string glslSplitting(){
+    std::ostringstream out;
+    out.precision(9);
+    out << "#define SPLITTING\n#define KICKS float[](";
+    for(size_t k = 0;k < Scheme::kick.size();++k) out << (k ? ", " : "") << std::fixed << Scheme::kick[k];
+    out << ")\n#define DRIFTS float[](";
+    for(size_t k = 0;k < Scheme::drift.size();++k) out << (k ? ", " : "") << std::fixed << Scheme::drift[k];
+    out << ")\n";
+    return out.str();
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,79 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+//Dependency graph for ThreadPool::runTasks. dependents[dependentStart[i], dependentStart[i + 1]) are the tasks waiting on task i,
+//and dependencyCount[i] is the number of tasks task i waits on.
+struct TaskGraph {
+    std::vector<uint32_t> dependencyCount, dependentStart, dependents;
+};
+
+//Persistent pool for chunked particle ranges. Each parallelFor hands every worker a contiguous run of chunks, so neighbouring
+//particles stay on one core, and idle workers steal chunks from the back of the others' queues.
+class ThreadPool {
+public:
+    struct WorkerStats {
+        double busySeconds, idleSeconds;
+        size_t chunks, steals;
+    };
+    
+    //threads includes the calling thread, which works along during parallelFor
+    explicit ThreadPool(size_t threads = std::thread::hardware_concurrency(), size_t chunkSize = 16384);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    
+    //Runs f(chunkBegin, chunkEnd) over [begin, end) and returns once every chunk is done. Chunks always start at begin + k * chunkSize,
+    //so (chunkBegin - begin) / chunkSize can index per-chunk partial results. Calls from inside a chunk run serially.
+    void parallelFor(size_t begin, size_t end, const std::function<void(size_t, size_t)>& f);
+    void parallelFor(size_t begin, size_t end, size_t chunkSize, const std::function<void(size_t, size_t)>& f);
+    
+    //Runs task(i) for every task of the graph, each as soon as everything it depends on has finished, and returns once all are done.
+    //Tasks that become ready are picked most recent first, so a finished subtree tends to be continued on the same core.
+    void runTasks(const TaskGraph& graph, const std::function<void(size_t)>& task);
+    
+    void setThreadCount(size_t threads);
+    size_t getThreadCount() const;
+    void setChunkSize(size_t size);
+    size_t getChunkSize() const;
+    std::vector<WorkerStats> getStats() const;
+    void resetStats();
+    
+    //Shared pool used by Galaxy and the solvers
+    static ThreadPool& global();
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<std::pair<size_t, size_t>> chunks;
+        std::atomic<uint64_t> busyNanoseconds{0}, idleNanoseconds{0}, chunkCount{0}, stealCount{0};
+    };
+    
+    void start(size_t threads);
+    void stop();
+    void workerLoop(size_t index);
+    void runChunks(size_t index);
+    bool popChunk(size_t index, std::pair<size_t, size_t>& chunk);
+    
+    size_t chunkSize;
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+    const std::function<void(size_t, size_t)>* job;
+    std::atomic<size_t> remaining;
+    std::mutex callMutex, wakeMutex, doneMutex;
+    std::condition_variable wakeCondition, doneCondition;
+    uint64_t generation;
+    bool stopping;
+};
+
+#endif
\ No newline at end of file
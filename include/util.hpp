@@ -3,14 +3,24 @@
 
 #define _USE_MATH_DEFINES
 #include <cmath>
+#include <span>
+#include <string>
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
-GLuint loadProgram(size_t count, const char** files, const GLuint* types);
+#include "fastmath.hpp"
+
+//defines is inserted into every shader right after its #version line
+GLuint loadProgram(size_t count, const char** files, const GLuint* types, const std::string& defines = "");
 
 float luminosityFromMass(float mass);
 float temperatureFromMass(float mass);
 void colourFromTemperature(float temp, glm::vec4& c);
 glm::vec4 colourFromTemperature(float temp);
+//luminosityFromMass() and temperatureFromMass() over spans of the same size with the widest SIMD level there is. The piecewise
+//power law is one log and one exp per star with its coefficient and exponent picked per lane, and the temperature reuses the
+//logs of the luminosity. They agree with the scalar functions to a few float roundings at the default accuracy, which picks the
+//log and exp of fastmath.hpp. The colours come from colourTable instead.
+void stellarProperties(std::span<const float> mass, std::span<float> luminosity, std::span<float> temperature, fastmath::Accuracy accuracy = fastmath::Accuracy::Precise);
 
 #endif
\ No newline at end of file
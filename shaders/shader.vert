@@ -1,14 +1,20 @@
 #version 460 core
 
 layout(location = 0) in vec4 vertexPosition;
-layout(location = 1) in vec4 vertexColour;
+layout(location = 1) in float vertexTemperature;
 layout(location = 2) in float vertexLuminosity;
 
+//colourTable::table, uniform in ln T
+layout(binding = 2) uniform sampler1D colourTable;
+
 uniform mat4 mvp;
 
 out vec4 fragmentColour;
 
 void main(){
     gl_Position = mvp * vertexPosition;
+    //Texel centres, so that the linear filtering interpolates like colourFromTemperatureTable()
+    float u = clamp((log(vertexTemperature) - COLOUR_TABLE_LOG_MIN) / (COLOUR_TABLE_LOG_MAX - COLOUR_TABLE_LOG_MIN), 0.0, 1.0);
+    vec4 vertexColour = texture(colourTable, (u * (COLOUR_TABLE_SIZE - 1.0) + 0.5) / COLOUR_TABLE_SIZE);
     fragmentColour = sqrt(vertexLuminosity) * vertexColour;
 }
\ No newline at end of file
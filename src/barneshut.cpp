@@ -0,0 +1,359 @@
+#include "barneshut.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "directgravity.hpp"
+#include "simd.hpp"
+
+namespace {
+    constexpr size_t groupSize = 32;
+    
+    double secondsSince(std::chrono::steady_clock::time_point start){
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    //Accepted nodes of one group in structure-of-arrays form, so the multipole kernels can broadcast one node at a time
+    struct MultipoleList {
+        std::vector<float> comX, comY, comZ, mass, qxx, qxy, qxz, qyy, qyz, qzz;
+        
+        void clear(){
+            for(std::vector<float>* v : {&comX, &comY, &comZ, &mass, &qxx, &qxy, &qxz, &qyy, &qyz, &qzz}) v->clear();
+        }
+    };
+    
+    //a = -M d / (r^2 + eps^2)^(3/2) + Q d / r^5 - 5/2 (d.Q.d) d / r^7, d pointing from the centre of mass to the target
+    void multipoleScalar(const float* x, const float* y, const float* z, size_t begin, size_t end, const MultipoleList& l, float eps2, float* ax, float* ay, float* az){
+        for(size_t i = begin;i < end;++i){
+            float accX = 0.0f, accY = 0.0f, accZ = 0.0f;
+            for(size_t k = 0;k < l.mass.size();++k){
+                float dx = x[i] - l.comX[k], dy = y[i] - l.comY[k], dz = z[i] - l.comZ[k];
+                float r2 = dx * dx + dy * dy + dz * dz;
+                float invR = 1.0f / std::sqrt(r2);
+                float invSoft = 1.0f / std::sqrt(r2 + eps2);
+                float mono = l.mass[k] * invSoft * invSoft * invSoft;
+                float qx = l.qxx[k] * dx + l.qxy[k] * dy + l.qxz[k] * dz;
+                float qy = l.qxy[k] * dx + l.qyy[k] * dy + l.qyz[k] * dz;
+                float qz = l.qxz[k] * dx + l.qyz[k] * dy + l.qzz[k] * dz;
+                float invR2 = invR * invR;
+                float invR5 = invR2 * invR2 * invR;
+                float quad = mono + 2.5f * (qx * dx + qy * dy + qz * dz) * invR5 * invR2;
+                accX += qx * invR5 - quad * dx;
+                accY += qy * invR5 - quad * dy;
+                accZ += qz * invR5 - quad * dz;
+            }
+            ax[i] += accX;
+            ay[i] += accY;
+            az[i] += accZ;
+        }
+    }
+    
+#ifdef SIMD_X86
+    using namespace simd;
+    
+    //rsqrt estimate plus one Newton-Raphson step, about 2.7e-7 relative, below the error of the multipole expansion
+    constexpr fastmath::Accuracy rsqrtAccuracy = fastmath::Accuracy::Balanced;
+    
+    void multipoleSSE2(const float* x, const float* y, const float* z, size_t begin, size_t end, const MultipoleList& l, float eps2, float* ax, float* ay, float* az){
+        const __m128 vEps2 = _mm_set1_ps(eps2), half5 = _mm_set1_ps(2.5f);
+        size_t i = begin;
+        for(;i + 4 <= end;i += 4){
+            __m128 xi = _mm_loadu_ps(x + i), yi = _mm_loadu_ps(y + i), zi = _mm_loadu_ps(z + i);
+            __m128 accX = _mm_setzero_ps(), accY = _mm_setzero_ps(), accZ = _mm_setzero_ps();
+            for(size_t k = 0;k < l.mass.size();++k){
+                __m128 dx = _mm_sub_ps(xi, _mm_set1_ps(l.comX[k])), dy = _mm_sub_ps(yi, _mm_set1_ps(l.comY[k])), dz = _mm_sub_ps(zi, _mm_set1_ps(l.comZ[k]));
+                __m128 r2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+                __m128 invR = fastmath::rsqrt<rsqrtAccuracy>(r2), invSoft = fastmath::rsqrt<rsqrtAccuracy>(_mm_add_ps(r2, vEps2));
+                __m128 mono = _mm_mul_ps(_mm_set1_ps(l.mass[k]), _mm_mul_ps(_mm_mul_ps(invSoft, invSoft), invSoft));
+                __m128 qx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(l.qxx[k]), dx), _mm_mul_ps(_mm_set1_ps(l.qxy[k]), dy)), _mm_mul_ps(_mm_set1_ps(l.qxz[k]), dz));
+                __m128 qy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(l.qxy[k]), dx), _mm_mul_ps(_mm_set1_ps(l.qyy[k]), dy)), _mm_mul_ps(_mm_set1_ps(l.qyz[k]), dz));
+                __m128 qz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(l.qxz[k]), dx), _mm_mul_ps(_mm_set1_ps(l.qyz[k]), dy)), _mm_mul_ps(_mm_set1_ps(l.qzz[k]), dz));
+                __m128 invR2 = _mm_mul_ps(invR, invR);
+                __m128 invR5 = _mm_mul_ps(_mm_mul_ps(invR2, invR2), invR);
+                __m128 dqd = _mm_add_ps(_mm_add_ps(_mm_mul_ps(qx, dx), _mm_mul_ps(qy, dy)), _mm_mul_ps(qz, dz));
+                __m128 quad = _mm_add_ps(mono, _mm_mul_ps(_mm_mul_ps(half5, dqd), _mm_mul_ps(invR5, invR2)));
+                accX = _mm_add_ps(accX, _mm_sub_ps(_mm_mul_ps(qx, invR5), _mm_mul_ps(quad, dx)));
+                accY = _mm_add_ps(accY, _mm_sub_ps(_mm_mul_ps(qy, invR5), _mm_mul_ps(quad, dy)));
+                accZ = _mm_add_ps(accZ, _mm_sub_ps(_mm_mul_ps(qz, invR5), _mm_mul_ps(quad, dz)));
+            }
+            _mm_storeu_ps(ax + i, _mm_add_ps(_mm_loadu_ps(ax + i), accX));
+            _mm_storeu_ps(ay + i, _mm_add_ps(_mm_loadu_ps(ay + i), accY));
+            _mm_storeu_ps(az + i, _mm_add_ps(_mm_loadu_ps(az + i), accZ));
+        }
+        if(i < end) multipoleScalar(x, y, z, i, end, l, eps2, ax, ay, az);
+    }
+    
+    __attribute__((target("avx2,fma"))) void multipoleAVX2(const float* x, const float* y, const float* z, size_t begin, size_t end, const MultipoleList& l, float eps2, float* ax, float* ay, float* az){
+        const __m256 vEps2 = _mm256_set1_ps(eps2), half5 = _mm256_set1_ps(2.5f);
+        size_t i = begin;
+        for(;i + 8 <= end;i += 8){
+            __m256 xi = _mm256_loadu_ps(x + i), yi = _mm256_loadu_ps(y + i), zi = _mm256_loadu_ps(z + i);
+            __m256 accX = _mm256_setzero_ps(), accY = _mm256_setzero_ps(), accZ = _mm256_setzero_ps();
+            for(size_t k = 0;k < l.mass.size();++k){
+                __m256 dx = _mm256_sub_ps(xi, _mm256_broadcast_ss(&l.comX[k])), dy = _mm256_sub_ps(yi, _mm256_broadcast_ss(&l.comY[k])), dz = _mm256_sub_ps(zi, _mm256_broadcast_ss(&l.comZ[k]));
+                __m256 r2 = _mm256_fmadd_ps(dx, dx, _mm256_fmadd_ps(dy, dy, _mm256_mul_ps(dz, dz)));
+                __m256 invR = fastmath::rsqrt<rsqrtAccuracy>(r2), invSoft = fastmath::rsqrt<rsqrtAccuracy>(_mm256_add_ps(r2, vEps2));
+                __m256 mono = _mm256_mul_ps(_mm256_broadcast_ss(&l.mass[k]), _mm256_mul_ps(_mm256_mul_ps(invSoft, invSoft), invSoft));
+                __m256 qx = _mm256_fmadd_ps(_mm256_broadcast_ss(&l.qxx[k]), dx, _mm256_fmadd_ps(_mm256_broadcast_ss(&l.qxy[k]), dy, _mm256_mul_ps(_mm256_broadcast_ss(&l.qxz[k]), dz)));
+                __m256 qy = _mm256_fmadd_ps(_mm256_broadcast_ss(&l.qxy[k]), dx, _mm256_fmadd_ps(_mm256_broadcast_ss(&l.qyy[k]), dy, _mm256_mul_ps(_mm256_broadcast_ss(&l.qyz[k]), dz)));
+                __m256 qz = _mm256_fmadd_ps(_mm256_broadcast_ss(&l.qxz[k]), dx, _mm256_fmadd_ps(_mm256_broadcast_ss(&l.qyz[k]), dy, _mm256_mul_ps(_mm256_broadcast_ss(&l.qzz[k]), dz)));
+                __m256 invR2 = _mm256_mul_ps(invR, invR);
+                __m256 invR5 = _mm256_mul_ps(_mm256_mul_ps(invR2, invR2), invR);
+                __m256 dqd = _mm256_fmadd_ps(qx, dx, _mm256_fmadd_ps(qy, dy, _mm256_mul_ps(qz, dz)));
+                __m256 quad = _mm256_fmadd_ps(_mm256_mul_ps(half5, dqd), _mm256_mul_ps(invR5, invR2), mono);
+                accX = _mm256_add_ps(accX, _mm256_fnmadd_ps(quad, dx, _mm256_mul_ps(qx, invR5)));
+                accY = _mm256_add_ps(accY, _mm256_fnmadd_ps(quad, dy, _mm256_mul_ps(qy, invR5)));
+                accZ = _mm256_add_ps(accZ, _mm256_fnmadd_ps(quad, dz, _mm256_mul_ps(qz, invR5)));
+            }
+            _mm256_storeu_ps(ax + i, _mm256_add_ps(_mm256_loadu_ps(ax + i), accX));
+            _mm256_storeu_ps(ay + i, _mm256_add_ps(_mm256_loadu_ps(ay + i), accY));
+            _mm256_storeu_ps(az + i, _mm256_add_ps(_mm256_loadu_ps(az + i), accZ));
+        }
+        if(i < end) multipoleScalar(x, y, z, i, end, l, eps2, ax, ay, az);
+    }
+    
+    __attribute__((target("avx512f"))) void multipoleAVX512(const float* x, const float* y, const float* z, size_t begin, size_t end, const MultipoleList& l, float eps2, float* ax, float* ay, float* az){
+        const __m512 vEps2 = _mm512_set1_ps(eps2), half5 = _mm512_set1_ps(2.5f);
+        for(size_t i = begin;i < end;i += 16){
+            //Masked-off lanes load zero positions, which give infinities that are never stored
+            __mmask16 mask = end - i >= 16 ? 0xffff : static_cast<__mmask16>((1u << (end - i)) - 1);
+            __m512 xi = _mm512_maskz_loadu_ps(mask, x + i), yi = _mm512_maskz_loadu_ps(mask, y + i), zi = _mm512_maskz_loadu_ps(mask, z + i);
+            __m512 accX = _mm512_setzero_ps(), accY = _mm512_setzero_ps(), accZ = _mm512_setzero_ps();
+            for(size_t k = 0;k < l.mass.size();++k){
+                __m512 dx = _mm512_sub_ps(xi, _mm512_set1_ps(l.comX[k])), dy = _mm512_sub_ps(yi, _mm512_set1_ps(l.comY[k])), dz = _mm512_sub_ps(zi, _mm512_set1_ps(l.comZ[k]));
+                __m512 r2 = _mm512_fmadd_ps(dx, dx, _mm512_fmadd_ps(dy, dy, _mm512_mul_ps(dz, dz)));
+                __m512 invR = fastmath::rsqrt<rsqrtAccuracy>(r2), invSoft = fastmath::rsqrt<rsqrtAccuracy>(_mm512_add_ps(r2, vEps2));
+                __m512 mono = _mm512_mul_ps(_mm512_set1_ps(l.mass[k]), _mm512_mul_ps(_mm512_mul_ps(invSoft, invSoft), invSoft));
+                __m512 qx = _mm512_fmadd_ps(_mm512_set1_ps(l.qxx[k]), dx, _mm512_fmadd_ps(_mm512_set1_ps(l.qxy[k]), dy, _mm512_mul_ps(_mm512_set1_ps(l.qxz[k]), dz)));
+                __m512 qy = _mm512_fmadd_ps(_mm512_set1_ps(l.qxy[k]), dx, _mm512_fmadd_ps(_mm512_set1_ps(l.qyy[k]), dy, _mm512_mul_ps(_mm512_set1_ps(l.qyz[k]), dz)));
+                __m512 qz = _mm512_fmadd_ps(_mm512_set1_ps(l.qxz[k]), dx, _mm512_fmadd_ps(_mm512_set1_ps(l.qyz[k]), dy, _mm512_mul_ps(_mm512_set1_ps(l.qzz[k]), dz)));
+                __m512 invR2 = _mm512_mul_ps(invR, invR);
+                __m512 invR5 = _mm512_mul_ps(_mm512_mul_ps(invR2, invR2), invR);
+                __m512 dqd = _mm512_fmadd_ps(qx, dx, _mm512_fmadd_ps(qy, dy, _mm512_mul_ps(qz, dz)));
+                __m512 quad = _mm512_fmadd_ps(_mm512_mul_ps(half5, dqd), _mm512_mul_ps(invR5, invR2), mono);
+                accX = _mm512_add_ps(accX, _mm512_fnmadd_ps(quad, dx, _mm512_mul_ps(qx, invR5)));
+                accY = _mm512_add_ps(accY, _mm512_fnmadd_ps(quad, dy, _mm512_mul_ps(qy, invR5)));
+                accZ = _mm512_add_ps(accZ, _mm512_fnmadd_ps(quad, dz, _mm512_mul_ps(qz, invR5)));
+            }
+            _mm512_mask_storeu_ps(ax + i, mask, _mm512_add_ps(_mm512_maskz_loadu_ps(mask, ax + i), accX));
+            _mm512_mask_storeu_ps(ay + i, mask, _mm512_add_ps(_mm512_maskz_loadu_ps(mask, ay + i), accY));
+            _mm512_mask_storeu_ps(az + i, mask, _mm512_add_ps(_mm512_maskz_loadu_ps(mask, az + i), accZ));
+        }
+    }
+#endif
+    
+    void multipoleTile(const float* x, const float* y, const float* z, size_t begin, size_t end, const MultipoleList& l, float eps2, float* ax, float* ay, float* az){
+        switch(detectSimdLevel()){
+#ifdef SIMD_X86
+            case SimdLevel::AVX512: multipoleAVX512(x, y, z, begin, end, l, eps2, ax, ay, az); break;
+            case SimdLevel::AVX2: multipoleAVX2(x, y, z, begin, end, l, eps2, ax, ay, az); break;
+            case SimdLevel::SSE2: multipoleSSE2(x, y, z, begin, end, l, eps2, ax, ay, az); break;
+#endif
+            default: multipoleScalar(x, y, z, begin, end, l, eps2, ax, ay, az); break;
+        }
+    }
+}
+
+BarnesHut::BarnesHut(float theta, size_t leafSize):
+    theta(theta), leafSize(std::max<size_t>(leafSize, 1)), buildSeconds(0.0), walkSeconds(0.0) {
+    
+}
+
+void BarnesHut::computeAccelerations(const float* x, const float* y, const float* z, const float* m, size_t n, float softening, float* ax, float* ay, float* az, ThreadPool& pool){
+    auto startTime = std::chrono::steady_clock::now();
+    tree.build(x, y, z, m, n, leafSize, pool);
+    computeMoments(pool);
+    buildSeconds = secondsSince(startTime);
+    
+    startTime = std::chrono::steady_clock::now();
+    walk(softening, ax, ay, az, pool);
+    walkSeconds = secondsSince(startTime);
+}
+
+void BarnesHut::setTheta(float newTheta){
+    theta = newTheta;
+}
+
+float BarnesHut::getTheta() const {
+    return theta;
+}
+
+double BarnesHut::getBuildSeconds() const {
+    return buildSeconds;
+}
+
+double BarnesHut::getWalkSeconds() const {
+    return walkSeconds;
+}
+
+size_t BarnesHut::getNodeCount() const {
+    return tree.nodes.size();
+}
+
+void BarnesHut::computeMoments(ThreadPool& pool){
+    const std::vector<float>& sortedX = tree.sortedX;
+    const std::vector<float>& sortedY = tree.sortedY;
+    const std::vector<float>& sortedZ = tree.sortedZ;
+    const std::vector<float>& sortedMass = tree.sortedMass;
+    moments.resize(tree.nodes.size());
+    
+    //Bottom-up: every level only reads the level below it, so each level is one parallel pass
+    for(size_t level = tree.levelStart.size() - 1;level-- > 0;){
+        pool.parallelFor(tree.levelStart[level], tree.levelStart[level + 1], 256, [&](size_t begin, size_t end){
+            for(size_t i = begin;i < end;++i){
+                const OctreeNode& node = tree.nodes[i];
+                Moments& moment = moments[i];
+                double mass = 0.0, cx = 0.0, cy = 0.0, cz = 0.0;
+                if(node.childCount == 0){
+                    for(uint32_t j = node.begin;j < node.end;++j){
+                        mass += sortedMass[j];
+                        cx += static_cast<double>(sortedMass[j]) * sortedX[j];
+                        cy += static_cast<double>(sortedMass[j]) * sortedY[j];
+                        cz += static_cast<double>(sortedMass[j]) * sortedZ[j];
+                    }
+                }else{
+                    for(uint32_t c = node.firstChild;c < node.firstChild + node.childCount;++c){
+                        const Moments& child = moments[c];
+                        mass += child.mass;
+                        cx += static_cast<double>(child.mass) * child.comX;
+                        cy += static_cast<double>(child.mass) * child.comY;
+                        cz += static_cast<double>(child.mass) * child.comZ;
+                    }
+                }
+                if(mass > 0.0){
+                    cx /= mass;
+                    cy /= mass;
+                    cz /= mass;
+                }
+                
+                //Traceless quadrupole Q = sum m (3 d d^T - |d|^2 I) about the centre of mass, shifted up from the children
+                double qxx = 0.0, qxy = 0.0, qxz = 0.0, qyy = 0.0, qyz = 0.0, qzz = 0.0;
+                auto add = [&](double m, double dx, double dy, double dz){
+                    double d2 = dx * dx + dy * dy + dz * dz;
+                    qxx += m * (3.0 * dx * dx - d2);
+                    qxy += m * 3.0 * dx * dy;
+                    qxz += m * 3.0 * dx * dz;
+                    qyy += m * (3.0 * dy * dy - d2);
+                    qyz += m * 3.0 * dy * dz;
+                    qzz += m * (3.0 * dz * dz - d2);
+                };
+                if(node.childCount == 0){
+                    for(uint32_t j = node.begin;j < node.end;++j) add(sortedMass[j], sortedX[j] - cx, sortedY[j] - cy, sortedZ[j] - cz);
+                }else{
+                    for(uint32_t c = node.firstChild;c < node.firstChild + node.childCount;++c){
+                        const Moments& child = moments[c];
+                        add(child.mass, child.comX - cx, child.comY - cy, child.comZ - cz);
+                        qxx += child.qxx;
+                        qxy += child.qxy;
+                        qxz += child.qxz;
+                        qyy += child.qyy;
+                        qyz += child.qyz;
+                        qzz += child.qzz;
+                    }
+                }
+                
+                moment.mass = mass;
+                moment.comX = cx;
+                moment.comY = cy;
+                moment.comZ = cz;
+                moment.qxx = qxx;
+                moment.qxy = qxy;
+                moment.qxz = qxz;
+                moment.qyy = qyy;
+                moment.qyz = qyz;
+                moment.qzz = qzz;
+                
+                //Opening criterion from the cell size and the offset of the centre of mass from the cell centre, so a target
+                //inside a cell whose mass sits in one corner still opens it
+                float ox = node.centreX - cx, oy = node.centreY - cy, oz = node.centreZ - cz;
+                float radius = node.size / theta + std::sqrt(ox * ox + oy * oy + oz * oz);
+                moment.openRadius2 = radius * radius;
+            }
+        });
+    }
+}
+
+void BarnesHut::walk(float softening, float* ax, float* ay, float* az, ThreadPool& pool){
+    const float eps2 = std::max(softening * softening, 1e-20f);
+    const std::vector<float>& sortedX = tree.sortedX;
+    const std::vector<float>& sortedY = tree.sortedY;
+    const std::vector<float>& sortedZ = tree.sortedZ;
+    const std::vector<float>& sortedMass = tree.sortedMass;
+    const size_t n = sortedX.size();
+    if(n == 0) return;
+    sortedAccelerationX.resize(n);
+    sortedAccelerationY.resize(n);
+    sortedAccelerationZ.resize(n);
+    
+    //Targets go in Morton order, so every chunk is a spatially coherent batch. Each group of groupSize targets walks the tree once
+    //against its bounding box, and the resulting interaction list is evaluated for the whole group.
+    pool.parallelFor(0, n, 32 * groupSize, [&](size_t begin, size_t end){
+        std::vector<float> listX, listY, listZ, listMass;
+        MultipoleList accepted;
+        uint32_t stack[8 * mortonLevels + 8];
+        for(size_t groupBegin = begin;groupBegin < end;groupBegin += groupSize){
+            const size_t groupEnd = std::min(end, groupBegin + groupSize);
+            float minX = sortedX[groupBegin], minY = sortedY[groupBegin], minZ = sortedZ[groupBegin];
+            float maxX = minX, maxY = minY, maxZ = minZ;
+            for(size_t i = groupBegin + 1;i < groupEnd;++i){
+                minX = std::min(minX, sortedX[i]);
+                minY = std::min(minY, sortedY[i]);
+                minZ = std::min(minZ, sortedZ[i]);
+                maxX = std::max(maxX, sortedX[i]);
+                maxY = std::max(maxY, sortedY[i]);
+                maxZ = std::max(maxZ, sortedZ[i]);
+            }
+            
+            listX.clear();
+            listY.clear();
+            listZ.clear();
+            listMass.clear();
+            accepted.clear();
+            size_t top = 0;
+            stack[top++] = 0;
+            while(top > 0){
+                const uint32_t index = stack[--top];
+                const OctreeNode& node = tree.nodes[index];
+                const Moments& moment = moments[index];
+                //Distance from the centre of mass to the nearest point of the group box, so the node is far enough for every target
+                float dx = std::max({minX - moment.comX, 0.0f, moment.comX - maxX});
+                float dy = std::max({minY - moment.comY, 0.0f, moment.comY - maxY});
+                float dz = std::max({minZ - moment.comZ, 0.0f, moment.comZ - maxZ});
+                if(dx * dx + dy * dy + dz * dz > moment.openRadius2){
+                    accepted.comX.push_back(moment.comX);
+                    accepted.comY.push_back(moment.comY);
+                    accepted.comZ.push_back(moment.comZ);
+                    accepted.mass.push_back(moment.mass);
+                    accepted.qxx.push_back(moment.qxx);
+                    accepted.qxy.push_back(moment.qxy);
+                    accepted.qxz.push_back(moment.qxz);
+                    accepted.qyy.push_back(moment.qyy);
+                    accepted.qyz.push_back(moment.qyz);
+                    accepted.qzz.push_back(moment.qzz);
+                }else if(node.childCount == 0){
+                    listX.insert(listX.end(), sortedX.begin() + node.begin, sortedX.begin() + node.end);
+                    listY.insert(listY.end(), sortedY.begin() + node.begin, sortedY.begin() + node.end);
+                    listZ.insert(listZ.end(), sortedZ.begin() + node.begin, sortedZ.begin() + node.end);
+                    listMass.insert(listMass.end(), sortedMass.begin() + node.begin, sortedMass.begin() + node.end);
+                }else{
+                    for(uint32_t c = 0;c < node.childCount;++c) stack[top++] = node.firstChild + c;
+                }
+            }
+            
+            std::fill(sortedAccelerationX.begin() + groupBegin, sortedAccelerationX.begin() + groupEnd, 0.0f);
+            std::fill(sortedAccelerationY.begin() + groupBegin, sortedAccelerationY.begin() + groupEnd, 0.0f);
+            std::fill(sortedAccelerationZ.begin() + groupBegin, sortedAccelerationZ.begin() + groupEnd, 0.0f);
+            directTile(sortedX.data(), sortedY.data(), sortedZ.data(), groupBegin, groupEnd, listX.data(), listY.data(), listZ.data(), listMass.data(), listX.size(), eps2, sortedAccelerationX.data(), sortedAccelerationY.data(), sortedAccelerationZ.data());
+            
+            multipoleTile(sortedX.data(), sortedY.data(), sortedZ.data(), groupBegin, groupEnd, accepted, eps2, sortedAccelerationX.data(), sortedAccelerationY.data(), sortedAccelerationZ.data());
+            
+            for(size_t i = groupBegin;i < groupEnd;++i){
+                uint32_t j = tree.order[i];
+                ax[j] = sortedAccelerationX[i];
+                ay[j] = sortedAccelerationY[i];
+                az[j] = sortedAccelerationZ[i];
+            }
+        }
+    });
+}
\ No newline at end of file
@@ -0,0 +1,1009 @@
+#include "benchmark.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "barneshut.hpp"
+#include "celllist.hpp"
+#include "colourtable.hpp"
+#include "directgravity.hpp"
+#include "fastmath.hpp"
+#include "fmm.hpp"
+#include "galaxy.hpp"
+#include "iccache.hpp"
+#include "integrator.hpp"
+#include "mixedprecision.hpp"
+#include "particlemesh.hpp"
+#include "potential.hpp"
+#include "potentialtable.hpp"
+#include "sph.hpp"
+#include "util.hpp"
+
+namespace {
+    //Exponential disk with the same scale lengths and total mass as the default galaxy in main.cpp
+    constexpr float benchHr = 200.0f, benchHz = 20.0f, benchGM = 75000.0f * 1.4f, benchDt = 0.001f;
+    
+    void fillDisk(ParticleArrays& p, size_t n, unsigned int seed){
+        p.resize(n);
+        std::mt19937 engine(seed);
+        std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+        for(size_t i = 0;i < n;++i){
+            float r = -benchHr * std::log(1.0f - distribution(engine));
+            float phi = 2.0f * M_PI * distribution(engine);
+            float dz = distribution(engine);
+            p.x[i] = r * std::cos(phi);
+            p.y[i] = r * std::sin(phi);
+            p.z[i] = dz <= 0.5f ? -benchHz * std::log(1.0f - 2.0f * dz) : benchHz * std::log(2.0f * dz - 1.0f);
+            p.prevX[i] = p.x[i] - 0.1f * p.y[i] * benchDt;
+            p.prevY[i] = p.y[i] + 0.1f * p.x[i] * benchDt;
+            p.prevZ[i] = p.z[i];
+        }
+    }
+    
+    //Largest relative difference of the acceleration between a kernel and the scalar reference. With prev = 2 * x the
+    //step returns exactly -a * x * dt^2, which would otherwise be lost in the rounding of the positions.
+    float accelerationError(const ParticleArrays& start, SimdLevel level, fastmath::Accuracy accuracy){
+        ParticleArrays reference = start;
+        for(size_t i = 0;i < start.size();++i){
+            reference.prevX[i] = 2.0f * start.x[i];
+            reference.prevY[i] = 2.0f * start.y[i];
+            reference.prevZ[i] = 2.0f * start.z[i];
+        }
+        ParticleArrays test = reference;
+        verletStepScalar(reference, 0, start.size(), benchGM, benchHr, benchHz, benchDt);
+        verletStep(test, 0, start.size(), benchGM, benchHr, benchHz, benchDt, level, accuracy);
+        float maxError = 0.0f;
+        for(size_t i = 0;i < start.size();++i){
+            float ax = reference.prevX[i], ay = reference.prevY[i], az = reference.prevZ[i];
+            float dx = test.prevX[i] - ax, dy = test.prevY[i] - ay, dz = test.prevZ[i] - az;
+            float a = std::sqrt(ax * ax + ay * ay + az * az);
+            if(a > 0.0f) maxError = std::max(maxError, std::sqrt(dx * dx + dy * dy + dz * dz) / a);
+        }
+        return maxError;
+    }
+    
+    //Largest and root mean square relative difference of an acceleration field from the reference
+    void fieldError(const std::vector<float>& ax, const std::vector<float>& ay, const std::vector<float>& az, const std::vector<float>& rx, const std::vector<float>& ry, const std::vector<float>& rz, double& maxError, double& rmsError){
+        maxError = 0.0;
+        rmsError = 0.0;
+        for(size_t i = 0;i < ax.size();++i){
+            double dx = ax[i] - rx[i], dy = ay[i] - ry[i], dz = az[i] - rz[i];
+            double a = std::sqrt(double(rx[i]) * rx[i] + double(ry[i]) * ry[i] + double(rz[i]) * rz[i]);
+            if(a == 0.0) continue;
+            double error = std::sqrt(dx * dx + dy * dy + dz * dz) / a;
+            maxError = std::max(maxError, error);
+            rmsError += error * error;
+        }
+        rmsError = std::sqrt(rmsError / std::max<size_t>(ax.size(), 1));
+    }
+    
+    //Kinetic energy and total |L| of a state given as positions and the displacements over the last step
+    template<class Position, class Displacement> void energyAndMomentum(const Position& x, const Position& y, const Position& z, const Displacement& dx, const Displacement& dy, const Displacement& dz, size_t n, double& kinetic, double& momentum){
+        kinetic = 0.0;
+        double lx = 0.0, ly = 0.0, lz = 0.0;
+        for(size_t i = 0;i < n;++i){
+            double vx = dx[i] / benchDt, vy = dy[i] / benchDt, vz = dz[i] / benchDt;
+            kinetic += 0.5 * (vx * vx + vy * vy + vz * vz);
+            lx += double(y[i]) * vz - double(z[i]) * vy;
+            ly += double(z[i]) * vx - double(x[i]) * vz;
+            lz += double(x[i]) * vy - double(y[i]) * vx;
+        }
+        momentum = std::sqrt(lx * lx + ly * ly + lz * lz);
+    }
+}
+
+void benchmarkDiskKernel(size_t maxN){
+    const SimdLevel best = detectSimdLevel();
+    const char* tiers[3] = {"fast", "balanced", "precise"};
+    std::cout << "Disk kernel benchmark, best SIMD level: " << simdLevelName(best) << std::endl;
+    
+    ParticleArrays p;
+    for(size_t n = 1000000;n <= maxN;n *= 10){
+        fillDisk(p, n, 1);
+        //Keep the total work per measurement around 10^8 particle steps
+        const size_t reps = std::max<size_t>(2, 100000000 / n);
+        double scalarTime = 0.0;
+        for(int l = static_cast<int>(SimdLevel::Scalar);l <= static_cast<int>(best);++l){
+            SimdLevel level = static_cast<SimdLevel>(l);
+            //The scalar reference has libm and no tiers, the kernels run at every accuracy of fastmath.hpp
+            for(int a = level == SimdLevel::Scalar ? 2 : 0;a < 3;++a){
+                fastmath::Accuracy accuracy = static_cast<fastmath::Accuracy>(a);
+                verletStep(p, 0, n, benchGM, benchHr, benchHz, benchDt, level, accuracy);
+                auto startTime = std::chrono::high_resolution_clock::now();
+                for(size_t r = 0;r < reps;++r){
+                    if(level == SimdLevel::Scalar) verletStepScalar(p, 0, n, benchGM, benchHr, benchHz, benchDt);
+                    else verletStep(p, 0, n, benchGM, benchHr, benchHz, benchDt, level, accuracy);
+                }
+                double elapsed = static_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - startTime).count() / reps;
+                if(level == SimdLevel::Scalar) scalarTime = elapsed;
+                
+                //6 floats read and 3 written per particle
+                std::cout << "  n = " << n << " " << simdLevelName(level);
+                if(level != SimdLevel::Scalar) std::cout << " " << tiers[a];
+                std::cout << ": " << elapsed * 1e9 / n << " ns/particle, " << 36.0 * n / elapsed / 1e9 << " GB/s, " << scalarTime / elapsed << "x scalar";
+                if(level != SimdLevel::Scalar){
+                    ParticleArrays sample;
+                    fillDisk(sample, std::min<size_t>(n, 1000000), 2);
+                    std::cout << ", max acceleration error " << accelerationError(sample, level, accuracy);
+                }
+                std::cout << std::endl;
+            }
+        }
+        
+        //The best level at the accuracy Galaxy uses, split over the pool the way Galaxy calls it, at 1, 2, 4 and every hardware thread
+        ThreadPool& pool = ThreadPool::global();
+        const size_t threads = pool.getThreadCount();
+        std::vector<size_t> counts = {1, 2, 4, std::max<size_t>(std::thread::hardware_concurrency(), 1)};
+        std::sort(counts.begin(), counts.end());
+        counts.erase(std::unique(counts.begin(), counts.end()), counts.end());
+        double singleTime = 0.0;
+        for(size_t count : counts){
+            pool.setThreadCount(count);
+            pool.parallelFor(0, n, [&](size_t begin, size_t end){
+                verletStep(p, begin, end, benchGM, benchHr, benchHz, benchDt, best);
+            });
+            auto startTime = std::chrono::high_resolution_clock::now();
+            for(size_t r = 0;r < reps;++r){
+                pool.parallelFor(0, n, [&](size_t begin, size_t end){
+                    verletStep(p, begin, end, benchGM, benchHr, benchHz, benchDt, best);
+                });
+            }
+            double elapsed = static_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - startTime).count() / reps;
+            if(count == 1) singleTime = elapsed;
+            std::cout << "  n = " << n << " " << simdLevelName(best) << " precise, " << count << " threads: " << elapsed * 1e9 / n << " ns/particle, " << 36.0 * n / elapsed / 1e9 << " GB/s, " << singleTime / elapsed << "x 1 thread" << std::endl;
+        }
+        pool.setThreadCount(threads);
+    }
+}
+
+void benchmarkFastMultipole(size_t n){
+    ThreadPool& pool = ThreadPool::global();
+    const float softening = benchHz / 4.0f;
+    ParticleArrays p;
+    fillDisk(p, n, 1);
+    std::vector<float> mass(n);
+    std::mt19937 engine(3);
+    std::uniform_real_distribution<float> distribution(0.5f, 15.0f);
+    for(size_t i = 0;i < n;++i) mass[i] = distribution(engine);
+    
+    std::vector<float> rx(n), ry(n), rz(n), ax(n), ay(n), az(n);
+    auto startTime = std::chrono::high_resolution_clock::now();
+    directAccelerations(p.x.data(), p.y.data(), p.z.data(), mass.data(), n, softening, rx.data(), ry.data(), rz.data(), pool);
+    double directTime = static_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - startTime).count();
+    std::cout << "Solver accuracy against direct summation, n = " << n << ", " << pool.getThreadCount() << " threads, softening " << softening << std::endl;
+    std::cout << "  direct: " << directTime << " s" << std::endl;
+    
+    double maxError, rmsError;
+    BarnesHut barnesHut;
+    for(float theta : {0.4f, 0.5f, 0.6f}){
+        barnesHut.setTheta(theta);
+        startTime = std::chrono::high_resolution_clock::now();
+        barnesHut.computeAccelerations(p.x.data(), p.y.data(), p.z.data(), mass.data(), n, softening, ax.data(), ay.data(), az.data(), pool);
+        double elapsed = static_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - startTime).count();
+        fieldError(ax, ay, az, rx, ry, rz, maxError, rmsError);
+        std::cout << "  Barnes-Hut theta " << theta << ": " << elapsed << " s, rms error " << rmsError << ", max error " << maxError << std::endl;
+    }
+    
+    //Every order runs at its matched opening angle, so the rows compare cost at about the error of Barnes-Hut at theta 0.5
+    FastMultipole fastMultipole;
+    for(int order = 1;order <= 8;++order){
+        fastMultipole.setOrder(order);
+        startTime = std::chrono::high_resolution_clock::now();
+        fastMultipole.computeAccelerations(p.x.data(), p.y.data(), p.z.data(), mass.data(), n, softening, ax.data(), ay.data(), az.data(), pool);
+        double elapsed = static_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - startTime).count();
+        fieldError(ax, ay, az, rx, ry, rz, maxError, rmsError);
+        std::cout << "  FMM order " << order << " theta " << fastMultipole.getTheta() << ": " << elapsed << " s (build " << fastMultipole.getBuildSeconds() << ", lists " << fastMultipole.getListSeconds() << ", evaluate " << fastMultipole.getEvaluateSeconds() << "), rms error " << rmsError << ", max error " << maxError << ", " << directTime / elapsed << "x direct" << std::endl;
+    }
+    
+    //The mesh smooths the force on the scale of a cell, so its error is mostly that smoothing and shrinks with the cells. Each
+    //grid runs twice, since the first builds the Green's function.
+    ParticleMesh particleMesh;
+    for(size_t cells : {64, 128, 256}){
+        for(MassAssignment assignment : {MassAssignment::CIC, MassAssignment::TSC}){
+            particleMesh.setGridSize(cells, cells, cells / 8);
+            particleMesh.setAssignment(assignment);
+            particleMesh.computeAccelerations(p.x.data(), p.y.data(), p.z.data(), mass.data(), n, softening, ax.data(), ay.data(), az.data(), pool);
+            startTime = std::chrono::high_resolution_clock::now();
+            particleMesh.computeAccelerations(p.x.data(), p.y.data(), p.z.data(), mass.data(), n, softening, ax.data(), ay.data(), az.data(), pool);
+            double elapsed = static_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - startTime).count();
+            fieldError(ax, ay, az, rx, ry, rz, maxError, rmsError);
+            std::cout << "  PM " << cells << "x" << cells << "x" << cells / 8 << " " << (assignment == MassAssignment::CIC ? "CIC" : "TSC") << ": " << elapsed << " s (deposit " << particleMesh.getDepositSeconds() << ", solve " << particleMesh.getSolveSeconds() << ", interpolate " << particleMesh.getInterpolateSeconds() << "), rms error " << rmsError << ", max error " << maxError << ", " << directTime / elapsed << "x direct" << std::endl;
+        }
+    }
+    
+    //Crossover against Barnes-Hut at theta 0.5, both at their defaults, on disks of n / 8 up to n. The faster of three runs
+    //counts, and the FMM only wins a size where it is faster without a larger rms error.
+    std::cout << "  Crossover, FMM order " << FastMultipole().getOrder() << " against Barnes-Hut theta 0.5:" << std::endl;
+    barnesHut.setTheta(0.5f);
+    fastMultipole = FastMultipole();
+    size_t crossover = 0;
+    for(size_t size = std::max<size_t>(n / 8, 1);;size = std::min(2 * size, n)){
+        ParticleArrays q;
+        fillDisk(q, size, 1);
+        std::vector<float> sx(size), sy(size), sz(size), tx(size), ty(size), tz(size);
+        directAccelerations(q.x.data(), q.y.data(), q.z.data(), mass.data(), size, softening, sx.data(), sy.data(), sz.data(), pool);
+        double seconds[2], rms[2];
+        for(int method = 0;method < 2;++method){
+            seconds[method] = 1e300;
+            for(int run = 0;run < 3;++run){
+                startTime = std::chrono::high_resolution_clock::now();
+                if(method == 0) barnesHut.computeAccelerations(q.x.data(), q.y.data(), q.z.data(), mass.data(), size, softening, tx.data(), ty.data(), tz.data(), pool);
+                else fastMultipole.computeAccelerations(q.x.data(), q.y.data(), q.z.data(), mass.data(), size, softening, tx.data(), ty.data(), tz.data(), pool);
+                seconds[method] = std::min(seconds[method], static_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - startTime).count());
+            }
+            fieldError(tx, ty, tz, sx, sy, sz, maxError, rms[method]);
+        }
+        bool wins = seconds[1] < seconds[0] && rms[1] <= rms[0];
+        if(!wins) crossover = 0;
+        else if(crossover == 0) crossover = size;
+        std::cout << "    n = " << size << ": Barnes-Hut " << seconds[0] << " s, rms error " << rms[0] << ", FMM " << seconds[1] << " s, rms error " << rms[1] << std::endl;
+        if(size == n) break;
+    }
+    if(crossover > 0) std::cout << "  FMM is faster at no larger error from n = " << crossover << " up" << std::endl;
+    else std::cout << "  No crossover up to n = " << n << ", Barnes-Hut stays faster at matched error" << std::endl;
+}
+
+void benchmarkPrecision(size_t steps){
+    //The disk field is not a gradient, so there is no energy to conserve exactly. Every mode runs the same position-Verlet
+    //scheme, so its deviation from a double-precision run of that scheme is the round-off alone. The field is central, so the
+    //angular momentum is also checked against its starting value.
+    const size_t n = 1000, block = 100000;
+    ParticleArrays start;
+    fillDisk(start, n, 1);
+    
+    std::vector<double> rx(start.x.begin(), start.x.end()), ry(start.y.begin(), start.y.end()), rz(start.z.begin(), start.z.end());
+    std::vector<double> rdx(n), rdy(n), rdz(n);
+    for(size_t i = 0;i < n;++i){
+        rdx[i] = double(start.x[i]) - start.prevX[i];
+        rdy[i] = double(start.y[i]) - start.prevY[i];
+        rdz[i] = double(start.z[i]) - start.prevZ[i];
+    }
+    ParticleArrays single = start;
+    PrecisePositions doubles, compensated;
+    doubles.load(start, Precision::Double);
+    compensated.load(start, Precision::Compensated);
+    
+    const char* names[3] = {"float", "double", "compensated"};
+    double seconds[3] = {0.0, 0.0, 0.0};
+    double momentum0;
+    double kinetic;
+    energyAndMomentum(rx, ry, rz, rdx, rdy, rdz, n, kinetic, momentum0);
+    std::cout << "Round-off energy error against a double-precision run, " << n << " particles, dt " << benchDt << std::endl;
+    
+    const double gmDt2 = double(benchGM) * benchDt * benchDt;
+    for(size_t done = 0;done < steps;done += block){
+        const size_t count = std::min(block, steps - done);
+        for(size_t i = 0;i < n;++i){
+            for(size_t k = 0;k < count;++k){
+                double rProj = std::sqrt(rx[i] * rx[i] + ry[i] * ry[i]), r = std::sqrt(rProj * rProj + rz[i] * rz[i]);
+                double a = gmDt2 * (1.0 - std::exp(-rProj / benchHr)) * (1.0 - std::exp(-std::fabs(rz[i]) / benchHz)) / (r * r * r);
+                rdx[i] -= a * rx[i];
+                rdy[i] -= a * ry[i];
+                rdz[i] -= a * rz[i];
+                rx[i] += rdx[i];
+                ry[i] += rdy[i];
+                rz[i] += rdz[i];
+            }
+        }
+        double referenceKinetic, referenceMomentum;
+        energyAndMomentum(rx, ry, rz, rdx, rdy, rdz, n, referenceKinetic, referenceMomentum);
+        
+        for(int mode = 0;mode < 3;++mode){
+            auto startTime = std::chrono::high_resolution_clock::now();
+            if(mode == 0) verletSteps(single, 0, n, benchGM, benchHr, benchHz, benchDt, count);
+            else preciseSteps(mode == 1 ? doubles : compensated, 0, n, benchGM, benchHr, benchHz, benchDt, count);
+            seconds[mode] += static_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - startTime).count();
+            
+            ParticleArrays view = single;
+            if(mode > 0) (mode == 1 ? doubles : compensated).store(view, 0, n);
+            std::vector<float> dx(n), dy(n), dz(n);
+            for(size_t i = 0;i < n;++i){
+                dx[i] = mode == 0 ? view.x[i] - view.prevX[i] : (mode == 1 ? doubles : compensated).dx[i];
+                dy[i] = mode == 0 ? view.y[i] - view.prevY[i] : (mode == 1 ? doubles : compensated).dy[i];
+                dz[i] = mode == 0 ? view.z[i] - view.prevZ[i] : (mode == 1 ? doubles : compensated).dz[i];
+            }
+            double momentum;
+            if(mode == 1) energyAndMomentum(doubles.x, doubles.y, doubles.z, dx, dy, dz, n, kinetic, momentum);
+            else energyAndMomentum(view.x, view.y, view.z, dx, dy, dz, n, kinetic, momentum);
+            std::cout << "  " << done + count << " steps, " << names[mode] << ": energy error " << std::fabs(kinetic - referenceKinetic) / referenceKinetic << ", angular momentum drift " << std::fabs(momentum - momentum0) / momentum0 << ", " << seconds[mode] * 1e9 / (double(done + count) * n) << " ns/particle step" << std::endl;
+        }
+    }
+}
+
+void benchmarkPotentialTable(size_t n){
+    ThreadPool& pool = ThreadPool::global();
+    const size_t steps = 20;
+    ParticleArrays start;
+    fillDisk(start, n, 1);
+    std::cout << "Tabulated disk potential against the analytic kernel, n = " << n << ", " << steps << " steps, " << simdLevelName(detectSimdLevel()) << std::endl;
+    
+    ParticleArrays p = start;
+    auto startTime = std::chrono::high_resolution_clock::now();
+    pool.parallelFor(0, n, [&](size_t begin, size_t end){
+        verletSteps(p, begin, end, benchGM, benchHr, benchHz, benchDt, steps);
+    });
+    double analyticTime = static_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - startTime).count();
+    std::cout << "  analytic: " << analyticTime * 1e9 / (double(n) * steps) << " ns/particle step" << std::endl;
+    
+    for(size_t size = 128;size <= 2048;size *= 2){
+        PotentialTable table;
+        startTime = std::chrono::high_resolution_clock::now();
+        table.build(benchHr, benchHz, size, size, pool);
+        double buildTime = static_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - startTime).count();
+        double maxError, rmsError;
+        table.error(start.x.data(), start.y.data(), start.z.data(), n, maxError, rmsError);
+        
+        p = start;
+        startTime = std::chrono::high_resolution_clock::now();
+        pool.parallelFor(0, n, [&](size_t begin, size_t end){
+            tabulatedSteps(p, begin, end, table, benchGM, benchDt, steps);
+        });
+        double elapsed = static_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - startTime).count();
+        std::cout << "  " << size << "x" << size << " (" << size * size * sizeof(float) / 1024 << " KiB): build " << buildTime << " s, rms error " << rmsError << ", max error " << maxError << ", " << elapsed * 1e9 / (double(n) * steps) << " ns/particle step, " << analyticTime / elapsed << "x analytic" << std::endl;
+    }
+}
+
+
+void benchmarkPotential(size_t n){
+    ThreadPool& pool = ThreadPool::global();
+    const size_t repeats = 20, steps = 20;
+    ParticleArrays start;
+    fillDisk(start, n, 1);
+    std::cout << "Fused multi-component potential against one pass per component, n = " << n << ", " << simdLevelName(detectSimdLevel()) << std::endl;
+    
+    const MiyamotoNagai disk{benchGM, benchHr, benchHz};
+    const Hernquist bulge{0.2f * benchGM, 0.1f * benchHr};
+    const NFW halo{2.0f * benchGM, 2.0f * benchHr};
+    const MilkyWayPotential fused{{disk, bulge, halo}};
+    const Potential<MiyamotoNagai> diskOnly{{disk}};
+    const Potential<Hernquist> bulgeOnly{{bulge}};
+    const Potential<NFW> haloOnly{{halo}};
+    
+    std::vector<float> ax(n), ay(n), az(n), rx(n), ry(n), rz(n);
+    auto startTime = std::chrono::high_resolution_clock::now();
+    for(size_t r = 0;r < repeats;++r){
+        std::fill(ax.begin(), ax.end(), 0.0f);
+        std::fill(ay.begin(), ay.end(), 0.0f);
+        std::fill(az.begin(), az.end(), 0.0f);
+        pool.parallelFor(0, n, [&](size_t begin, size_t end){
+            potentialAccelerations(start.x.data(), start.y.data(), start.z.data(), begin, end, fused, ax.data(), ay.data(), az.data());
+        });
+    }
+    double fusedTime = static_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - startTime).count();
+    
+    startTime = std::chrono::high_resolution_clock::now();
+    for(size_t r = 0;r < repeats;++r){
+        std::fill(rx.begin(), rx.end(), 0.0f);
+        std::fill(ry.begin(), ry.end(), 0.0f);
+        std::fill(rz.begin(), rz.end(), 0.0f);
+        pool.parallelFor(0, n, [&](size_t begin, size_t end){
+            potentialAccelerations(start.x.data(), start.y.data(), start.z.data(), begin, end, diskOnly, rx.data(), ry.data(), rz.data());
+        });
+        pool.parallelFor(0, n, [&](size_t begin, size_t end){
+            potentialAccelerations(start.x.data(), start.y.data(), start.z.data(), begin, end, bulgeOnly, rx.data(), ry.data(), rz.data());
+        });
+        pool.parallelFor(0, n, [&](size_t begin, size_t end){
+            potentialAccelerations(start.x.data(), start.y.data(), start.z.data(), begin, end, haloOnly, rx.data(), ry.data(), rz.data());
+        });
+    }
+    double separateTime = static_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - startTime).count();
+    double maxError, rmsError;
+    fieldError(ax, ay, az, rx, ry, rz, maxError, rmsError);
+    std::cout << "  accelerations: fused " << fusedTime * 1e9 / (double(n) * repeats) << " ns/particle, separate " << separateTime * 1e9 / (double(n) * repeats) << " ns/particle, " << separateTime / fusedTime << "x, max difference " << maxError << std::endl;
+    
+    //The galaxy's own disk with a bulge and halo, against the hand-written disk kernel it replaces
+    ParticleArrays p = start;
+    startTime = std::chrono::high_resolution_clock::now();
+    pool.parallelFor(0, n, [&](size_t begin, size_t end){
+        verletSteps(p, begin, end, benchGM, benchHr, benchHz, benchDt, steps);
+    });
+    double diskTime = static_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - startTime).count();
+    const GalaxyPotential galaxy{{ExponentialDisk{benchGM, benchHr, benchHz}, bulge, halo}};
+    p = start;
+    startTime = std::chrono::high_resolution_clock::now();
+    pool.parallelFor(0, n, [&](size_t begin, size_t end){
+        potentialSteps(p, begin, end, galaxy, benchDt, steps);
+    });
+    double galaxyTime = static_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - startTime).count();
+    std::cout << "  steps: disk kernel " << diskTime * 1e9 / (double(n) * steps) << " ns/particle step, disk + bulge + halo " << galaxyTime * 1e9 / (double(n) * steps) << " ns/particle step" << std::endl;
+}
+
+void benchmarkHydrodynamics(size_t n){
+    ThreadPool& pool = ThreadPool::global();
+    const size_t samples = std::min<size_t>(n, 1000), repeats = 5;
+    ParticleArrays p;
+    fillDisk(p, n, 1);
+    std::vector<float> m(n), vx(n, 0.0f), vy(n, 0.0f), vz(n, 0.0f), ax(n, 0.0f), ay(n, 0.0f), az(n, 0.0f);
+    //Masses spread over a factor 7 like the cloud's, so a heavy particle cannot hold up the neighbour count on its own
+    for(size_t i = 0;i < n;++i) m[i] = benchGM / n * (0.25f + 1.5f * (i * 7919 % 1000) / 1000.0f);
+    std::cout << "SPH on an n = " << n << " gas disk" << std::endl;
+    
+    //The first call starts h from the leaf sizes, the later ones from the previous h as in a running simulation
+    SmoothedParticles hydro;
+    auto startTime = std::chrono::high_resolution_clock::now();
+    hydro.computeAccelerations(p.x.data(), p.y.data(), p.z.data(), vx.data(), vy.data(), vz.data(), m.data(), n, ax.data(), ay.data(), az.data(), pool);
+    double firstTime = static_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - startTime).count();
+    double buildTime = 0.0, densityTime = 0.0, forceTime = 0.0;
+    for(size_t r = 0;r < repeats;++r){
+        std::fill(ax.begin(), ax.end(), 0.0f);
+        std::fill(ay.begin(), ay.end(), 0.0f);
+        std::fill(az.begin(), az.end(), 0.0f);
+        hydro.computeAccelerations(p.x.data(), p.y.data(), p.z.data(), vx.data(), vy.data(), vz.data(), m.data(), n, ax.data(), ay.data(), az.data(), pool);
+        buildTime += hydro.getBuildSeconds();
+        densityTime += hydro.getDensitySeconds();
+        forceTime += hydro.getForceSeconds();
+    }
+    std::cout << "  first call " << firstTime << " s, then build " << buildTime / repeats << " s, density " << densityTime / repeats << " s, force " << forceTime / repeats << " s, " << hydro.getMeanNeighbours() << " neighbours, " << hydro.getMeanPairs() << " pairs per particle" << std::endl;
+    
+    //Brute force over all particles with the same h, which any neighbour the tree walks missed would show up in. The particles
+    //are at rest, so only the pressure force is compared.
+    const std::vector<float>& h = hydro.getSmoothingLengths();
+    const std::vector<float>& rho = hydro.getDensities();
+    const float c2 = hydro.getSoundSpeed() * hydro.getSoundSpeed();
+    double densityError = 0.0, forceError = 0.0;
+    for(size_t s = 0;s < samples;++s){
+        size_t i = s * (n / samples);
+        double density = 0.0, fx = 0.0, fy = 0.0, fz = 0.0;
+        for(size_t j = 0;j < n;++j){
+            float dx = p.x[i] - p.x[j], dy = p.y[i] - p.y[j], dz = p.z[i] - p.z[j];
+            float r2 = dx * dx + dy * dy + dz * dz;
+            density += m[j] * SmoothedParticles::kernel(r2, h[i]);
+            if(j == i) continue;
+            double f = m[j] * (c2 / rho[i] + c2 / rho[j]) * 0.5 * (SmoothedParticles::kernelGradient(r2, h[i]) + SmoothedParticles::kernelGradient(r2, h[j]));
+            fx -= f * dx;
+            fy -= f * dy;
+            fz -= f * dz;
+        }
+        densityError = std::max(densityError, std::fabs(rho[i] - density) / density);
+        double f = std::sqrt(fx * fx + fy * fy + fz * fz);
+        if(f > 0.0) forceError = std::max(forceError, std::sqrt((ax[i] - fx) * (ax[i] - fx) + (ay[i] - fy) * (ay[i] - fy) + (az[i] - fz) * (az[i] - fz)) / f);
+    }
+    std::cout << "  against brute force over " << samples << " particles: max density error " << densityError << ", max force error " << forceError << std::endl;
+}
+
+void benchmarkCellList(size_t n){
+    ThreadPool& pool = ThreadPool::global();
+    const size_t repeats = 10, samples = std::min<size_t>(n, 1000), k = 16;
+    const float cellSize = 0.5f * benchHz;
+    ParticleArrays p;
+    fillDisk(p, n, 1);
+    std::cout << "Cell list over an n = " << n << " disk, cells of " << cellSize << std::endl;
+    
+    CellList cells;
+    cells.build(p.x.data(), p.y.data(), p.z.data(), n, cellSize, pool);
+    auto startTime = std::chrono::high_resolution_clock::now();
+    for(size_t r = 0;r < repeats;++r) cells.build(p.x.data(), p.y.data(), p.z.data(), n, cellSize, pool);
+    double buildTime = static_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - startTime).count() / repeats;
+    
+    //What the counting sort replaces: a hash map of per-cell vectors, allocated anew on every rebuild
+    startTime = std::chrono::high_resolution_clock::now();
+    size_t mapCells = 0;
+    for(size_t r = 0;r < repeats;++r){
+        std::unordered_map<uint64_t, std::vector<uint32_t>> map;
+        for(size_t i = 0;i < n;++i){
+            uint64_t ix = static_cast<int64_t>(std::floor(p.x[i] / cellSize)) & 0x1FFFFF, iy = static_cast<int64_t>(std::floor(p.y[i] / cellSize)) & 0x1FFFFF, iz = static_cast<int64_t>(std::floor(p.z[i] / cellSize)) & 0x1FFFFF;
+            map[ix | iy << 21 | iz << 42].push_back(i);
+        }
+        mapCells = map.size();
+    }
+    double mapTime = static_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - startTime).count() / repeats;
+    
+    ParticleArrays stepped = p;
+    startTime = std::chrono::high_resolution_clock::now();
+    for(size_t r = 0;r < repeats;++r){
+        pool.parallelFor(0, n, [&](size_t begin, size_t end){
+            verletStep(stepped, begin, end, benchGM, benchHr, benchHz, benchDt);
+        });
+        stepped.swap();
+    }
+    double stepTime = static_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - startTime).count() / repeats;
+    std::cout << "  build " << buildTime * 1e3 << " ms (" << buildTime * 1e9 / n << " ns/particle, " << cells.getBucketCount() << " buckets), unordered_map of vectors " << mapTime * 1e3 << " ms (" << mapCells << " cells), one disk step " << stepTime * 1e3 << " ms" << std::endl;
+    
+    //Every sample queries around a particle, so the dense centre and the sparse edge are both in
+    std::vector<uint32_t> found, expected;
+    std::vector<std::pair<float, uint32_t>> distances(n);
+    size_t rangeMismatches = 0, nearestMismatches = 0, rangeFound = 0;
+    double rangeTime = 0.0, nearestTime = 0.0;
+    for(size_t s = 0;s < samples;++s){
+        const size_t i = s * (n / samples);
+        const float radius = 2.0f * cellSize;
+        found.clear();
+        startTime = std::chrono::high_resolution_clock::now();
+        cells.rangeQuery(p.x[i], p.y[i], p.z[i], radius, found);
+        rangeTime += static_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - startTime).count();
+        for(size_t j = 0;j < n;++j){
+            float dx = p.x[j] - p.x[i], dy = p.y[j] - p.y[i], dz = p.z[j] - p.z[i];
+            distances[j] = {dx * dx + dy * dy + dz * dz, j};
+        }
+        expected.clear();
+        for(size_t j = 0;j < n;++j) if(distances[j].first < radius * radius) expected.push_back(j);
+        std::sort(found.begin(), found.end());
+        rangeMismatches += found != expected;
+        rangeFound += found.size();
+        
+        startTime = std::chrono::high_resolution_clock::now();
+        cells.nearest(p.x[i], p.y[i], p.z[i], k, found);
+        nearestTime += static_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - startTime).count();
+        //Compared by distance, as equally distant points may come in either order
+        std::partial_sort(distances.begin(), distances.begin() + std::min(k, n), distances.end());
+        bool same = found.size() == std::min(k, n);
+        for(size_t j = 0;same && j < found.size();++j){
+            float dx = p.x[found[j]] - p.x[i], dy = p.y[found[j]] - p.y[i], dz = p.z[found[j]] - p.z[i];
+            same = dx * dx + dy * dy + dz * dz == distances[j].first;
+        }
+        nearestMismatches += !same;
+    }
+    std::cout << "  range queries of radius " << 2.0f * cellSize << ": " << rangeTime * 1e6 / samples << " us, " << static_cast<double>(rangeFound) / samples << " points, " << rangeMismatches << " of " << samples << " differ from brute force" << std::endl;
+    std::cout << "  " << k << " nearest: " << nearestTime * 1e6 / samples << " us, " << nearestMismatches << " of " << samples << " differ from brute force" << std::endl;
+}
+
+void benchmarkParticlePool(size_t n){
+    const size_t batches = 50, perBatch = std::max<size_t>(n / 200, 1);
+    Galaxy galaxy(n, n / 2, benchHr, benchHz, 0.5f, 15.0f, benchDt, 0);
+    galaxy.reset();
+    std::cout << "Particle pool of " << n << " stars and " << n / 2 << " cloud particles, " << perBatch << " spawns, removals and star formations of each kind per step" << std::endl;
+    
+    //Whether every live particle should be in the cloud, by ID
+    std::unordered_map<uint32_t, bool> expected;
+    auto check = [&](){
+        const std::vector<uint32_t>& ids = galaxy.getParticleIds();
+        size_t wrong = galaxy.size() != expected.size();
+        for(size_t i = 0;i < galaxy.size();++i){
+            auto found = expected.find(ids[i]);
+            wrong += found == expected.end() || found->second != (i >= galaxy.getStarCount());
+        }
+        return wrong;
+    };
+    const std::vector<uint32_t>& ids = galaxy.getParticleIds();
+    for(size_t i = 0;i < galaxy.size();++i) expected[ids[i]] = i >= galaxy.getStarCount();
+    
+    galaxy.integrate(1);
+    auto startTime = std::chrono::high_resolution_clock::now();
+    for(size_t b = 0;b < batches;++b) galaxy.integrate(1);
+    double stepTime = static_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - startTime).count() / batches;
+    
+    std::mt19937 engine(1);
+    std::uniform_real_distribution<float> uniform(-benchHr, benchHr);
+    size_t wrong = 0, growths = 0, capacity = galaxy.getCapacity();
+    uint32_t nextId = galaxy.size();
+    double commandTime = 0.0;
+    std::vector<size_t> picks;
+    std::unordered_set<size_t> picked;
+    for(size_t b = 0;b < batches;++b){
+        //Distinct indices, redrawn until they are, the first perBatch removed and the rest of the cloud ones forming stars. A cloud
+        //too small to give perBatch more gives fewer.
+        picks.clear();
+        picked.clear();
+        std::uniform_int_distribution<size_t> any(0, galaxy.size() - 1);
+        while(picks.size() < perBatch){
+            const size_t i = any(engine);
+            if(picked.insert(i).second) picks.push_back(i);
+        }
+        std::uniform_int_distribution<size_t> cloud(galaxy.getStarCount(), galaxy.size() - 1);
+        for(size_t k = 0;k < 4 * perBatch && picks.size() < 2 * perBatch && galaxy.getCloudCount() > 0;++k){
+            const size_t i = cloud(engine);
+            if(picked.insert(i).second) picks.push_back(i);
+        }
+        std::sort(picks.begin() + perBatch, picks.end());
+        for(size_t k = 0;k < perBatch;++k){
+            galaxy.removeParticle(picks[k]);
+            expected.erase(ids[picks[k]]);
+        }
+        for(size_t k = perBatch;k < picks.size();++k){
+            galaxy.formStar(picks[k]);
+            auto found = expected.find(ids[picks[k]]);
+            if(found != expected.end()) found->second = false;
+        }
+        //Twice as many spawns as removals, so the pool has to grow along the way. They get their IDs in the order they were
+        //queued, after every ID handed out before.
+        for(size_t k = 0;k < 2 * perBatch;++k){
+            const bool isCloud = k % 2 == 1;
+            galaxy.spawnParticle(glm::vec3(uniform(engine), uniform(engine), 0.1f * uniform(engine)), glm::vec3(0.0f), 1.0f, isCloud);
+            expected[nextId++] = isCloud;
+        }
+        startTime = std::chrono::high_resolution_clock::now();
+        galaxy.integrate(1);
+        commandTime += static_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - startTime).count();
+        if(galaxy.getCapacity() != capacity){
+            capacity = galaxy.getCapacity();
+            ++growths;
+        }
+        wrong += check();
+    }
+    commandTime /= batches;
+    std::cout << "  step " << stepTime * 1e3 << " ms, with the commands applied " << commandTime * 1e3 << " ms, " << (commandTime - stepTime) * 1e9 / galaxy.size() << " ns per live particle for the partition they share" << std::endl;
+    std::cout << "  " << galaxy.getStarCount() << " stars and " << galaxy.getCloudCount() << " cloud particles after " << batches << " steps, capacity " << galaxy.getCapacity() << " after " << growths << " growths, " << wrong << " particles in the wrong place or missing" << std::endl;
+}
+
+void benchmarkStellarProperties(size_t n){
+    std::mt19937 engine(1);
+    //Salpeter masses over the range of the galaxy, plus the ends of every range of the mass-luminosity relation
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    std::vector<float> mass(n);
+    const float a = std::pow(0.5f, -1.35f), b = a - std::pow(60.0f, -1.35f);
+    for(size_t i = 0;i < n;++i) mass[i] = std::pow(a - b * uniform(engine), -1.0f / 1.35f);
+    const float edges[] = {0.43f, 2.0f, 55.0f};
+    for(size_t k = 0;k < 3 && 2 * k + 1 < n;++k){
+        mass[2 * k] = std::nextafter(edges[k], 0.0f);
+        mass[2 * k + 1] = edges[k];
+    }
+    std::vector<float> luminosity(n), temperature(n), referenceLuminosity(n), referenceTemperature(n);
+    std::vector<glm::vec4> colour(n), referenceColour(n);
+    std::cout << "Stellar properties of " << n << " stars, " << simdLevelName(detectSimdLevel()) << ", one thread" << std::endl;
+    
+    auto startTime = std::chrono::high_resolution_clock::now();
+    for(size_t i = 0;i < n;++i){
+        referenceLuminosity[i] = luminosityFromMass(mass[i]);
+        referenceTemperature[i] = temperatureFromMass(mass[i]);
+    }
+    double scalarTime = static_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - startTime).count();
+    
+    startTime = std::chrono::high_resolution_clock::now();
+    stellarProperties(mass, luminosity, temperature);
+    double batchTime = static_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - startTime).count();
+    
+    //What the same bytes cost just being read and written: the mass in, the luminosity and temperature out
+    std::vector<float> copyA(n), copyB(n);
+    startTime = std::chrono::high_resolution_clock::now();
+    for(size_t i = 0;i < n;++i){
+        copyA[i] = mass[i];
+        copyB[i] = mass[i];
+    }
+    double copyTime = static_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - startTime).count();
+    
+    double maxLuminosity = 0.0, maxTemperature = 0.0;
+    for(size_t i = 0;i < n;++i){
+        maxLuminosity = std::max(maxLuminosity, std::fabs(static_cast<double>(luminosity[i]) / referenceLuminosity[i] - 1.0));
+        maxTemperature = std::max(maxTemperature, std::fabs(static_cast<double>(temperature[i]) / referenceTemperature[i] - 1.0));
+    }
+    const double bytes = n * (4.0 + 4.0 + 4.0);
+    std::cout << "  scalar " << scalarTime * 1e9 / n << " ns/star, batch " << batchTime * 1e9 / n << " ns/star (" << bytes / batchTime * 1e-9 << " GB/s), copying the same bytes " << copyTime * 1e9 / n << " ns/star" << std::endl;
+    std::cout << "  largest relative error: luminosity " << maxLuminosity << ", temperature " << maxTemperature << std::endl;
+    
+    //colourFromTemperature() is the reference of the table
+    for(size_t i = 0;i < n;++i) colourFromTemperature(referenceTemperature[i], referenceColour[i]);
+    
+    //The compile-time table shader.vert uses, on the same stars and on a fine sweep of its whole range
+    startTime = std::chrono::high_resolution_clock::now();
+    for(size_t i = 0;i < n;++i) colour[i] = colourFromTemperatureTable(temperature[i]);
+    double tableTime = static_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - startTime).count();
+    double maxTable = 0.0;
+    for(size_t i = 0;i < n;++i){
+        for(int c = 0;c < 3;++c) maxTable = std::max(maxTable, std::fabs(static_cast<double>(colour[i][c]) - referenceColour[i][c]));
+    }
+    //The formula jumps at 2000, 6500 and 6600 K, which a cell either side of blurs
+    const double cell = (colourTable::logMax - colourTable::logMin) / (colourTable::size - 1);
+    double maxSweep = 0.0, maxSmooth = 0.0;
+    for(size_t k = 0;k <= 64 * colourTable::size;++k){
+        const float t = std::exp(colourTable::logMin + (colourTable::logMax - colourTable::logMin) * k / (64.0 * colourTable::size));
+        const glm::vec4 exact = colourFromTemperature(t), table = colourFromTemperatureTable(t);
+        double difference = 0.0;
+        for(int c = 0;c < 3;++c) difference = std::max(difference, std::fabs(static_cast<double>(table[c]) - exact[c]));
+        maxSweep = std::max(maxSweep, difference);
+        bool nearJump = false;
+        for(double jump : {2000.0, 6500.0, 6600.0}) nearJump = nearJump || std::fabs(std::log(t) - std::log(jump)) < cell;
+        if(!nearJump) maxSmooth = std::max(maxSmooth, difference);
+    }
+    std::cout << "  colour table of " << colourTable::size << " entries " << tableTime * 1e9 / n << " ns/star, largest difference " << maxTable << " on these stars, " << maxSweep << " over " << colourTable::minTemperature << " to " << colourTable::maxTemperature << " K and " << maxSmooth << " away from the jumps" << std::endl;
+}
+
+namespace {
+    //The functions of fastmath.hpp with one signature, y only read by pow. Results go through out like in fastmath.hpp's lanes,
+    //as a template returning a vector by value draws -Wpsabi.
+    template<fastmath::Accuracy A> struct FastExp {
+        template<class V> [[gnu::always_inline]] void operator()(const V& x, const V&, V& out) const {
+            fastmath::detail::expLanes<A>(x, out);
+        }
+    };
+    template<fastmath::Accuracy A> struct FastLog {
+        template<class V> [[gnu::always_inline]] void operator()(const V& x, const V&, V& out) const {
+            fastmath::detail::logLanes<A>(x, out);
+        }
+    };
+    template<fastmath::Accuracy A> struct FastPow {
+        template<class V> [[gnu::always_inline]] void operator()(const V& x, const V& y, V& out) const {
+            fastmath::detail::powLanes<A>(x, y, out);
+        }
+    };
+    template<fastmath::Accuracy A> struct FastSin {
+        template<class V> [[gnu::always_inline]] void operator()(const V& x, const V&, V& out) const {
+            V c;
+            fastmath::sincos<A>(x, out, c);
+        }
+    };
+    template<fastmath::Accuracy A> struct FastCos {
+        template<class V> [[gnu::always_inline]] void operator()(const V& x, const V&, V& out) const {
+            V s;
+            fastmath::sincos<A>(x, s, out);
+        }
+    };
+    template<fastmath::Accuracy A> struct FastRsqrt {
+        template<class V> [[gnu::always_inline]] void operator()(const V& x, const V&, V& out) const {
+            fastmath::detail::rsqrtLanes<A>(x, out);
+        }
+    };
+    
+    template<class F> void fastMathScalar(const float* x, const float* y, float* out, size_t n){
+        for(size_t i = 0;i < n;++i) F()(x[i], y[i], out[i]);
+    }
+
+#ifdef SIMD_X86
+    template<class F> __attribute__((target("avx2,fma"))) void fastMathAVX2(const float* x, const float* y, float* out, size_t n){
+        size_t i = 0;
+        for(;i + 8 <= n;i += 8){
+            __m256 result;
+            F()(_mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i), result);
+            _mm256_storeu_ps(out + i, result);
+        }
+        //Not a call to fastMathScalar(), which GCC makes a jump that skips the vzeroupper and leaves every SSE instruction after
+        //it slow, libm's included
+        for(;i < n;++i) F()(x[i], y[i], out[i]);
+    }
+    
+    template<class F> __attribute__((target("avx512f"))) void fastMathAVX512(const float* x, const float* y, float* out, size_t n){
+        size_t i = 0;
+        for(;i + 16 <= n;i += 16){
+            __m512 result;
+            F()(_mm512_loadu_ps(x + i), _mm512_loadu_ps(y + i), result);
+            _mm512_storeu_ps(out + i, result);
+        }
+        for(;i < n;++i) F()(x[i], y[i], out[i]);
+    }
+#endif
+    
+    //Floats in order of their value as consecutive integers, so stepping through them samples every binade alike
+    int32_t orderedBits(float x){
+        const int32_t bits = std::bit_cast<int32_t>(x);
+        return bits < 0 ? INT32_MIN - bits : bits;
+    }
+    float fromOrderedBits(int32_t k){
+        return std::bit_cast<float>(k < 0 ? INT32_MIN - k : k);
+    }
+    
+    //Difference from the double reference in units of the last place of the float nearest to it
+    double ulps(float value, double reference){
+        int exponent;
+        std::frexp(reference, &exponent);
+        return std::fabs(value - reference) / std::ldexp(1.0, std::max(exponent - 24, -149));
+    }
+    
+    struct FastMathTest {
+        const char* name;
+        float lo, hi;
+        //y of pow, uniform
+        float yLo, yHi;
+        double (*reference)(double, double);
+        float (*libm)(float, float);
+        std::array<void (*)(const float*, const float*, float*, size_t), 9> kernels;
+    };
+    
+    template<template<fastmath::Accuracy> class F> std::array<void (*)(const float*, const float*, float*, size_t), 9> fastMathKernels(){
+        using fastmath::Accuracy;
+#ifdef SIMD_X86
+        return {fastMathScalar<F<Accuracy::Fast>>, fastMathAVX2<F<Accuracy::Fast>>, fastMathAVX512<F<Accuracy::Fast>>, fastMathScalar<F<Accuracy::Balanced>>, fastMathAVX2<F<Accuracy::Balanced>>, fastMathAVX512<F<Accuracy::Balanced>>, fastMathScalar<F<Accuracy::Precise>>, fastMathAVX2<F<Accuracy::Precise>>, fastMathAVX512<F<Accuracy::Precise>>};
+#else
+        return {fastMathScalar<F<Accuracy::Fast>>, nullptr, nullptr, fastMathScalar<F<Accuracy::Balanced>>, nullptr, nullptr, fastMathScalar<F<Accuracy::Precise>>, nullptr, nullptr};
+#endif
+    }
+}
+
+void benchmarkFastMath(size_t n){
+    const FastMathTest tests[] = {
+        {"exp", -87.3f, 88.3f, 0.0f, 0.0f, [](double x, double){return std::exp(x);}, [](float x, float){return std::exp(x);}, fastMathKernels<FastExp>()},
+        {"log", FLT_MIN, FLT_MAX, 0.0f, 0.0f, [](double x, double){return std::log(x);}, [](float x, float){return std::log(x);}, fastMathKernels<FastLog>()},
+        {"pow", 1e-4f, 1e4f, -2.5f, 2.5f, [](double x, double y){return std::pow(x, y);}, [](float x, float y){return std::pow(x, y);}, fastMathKernels<FastPow>()},
+        {"sin", -8192.0f, 8192.0f, 0.0f, 0.0f, [](double x, double){return std::sin(x);}, [](float x, float){return std::sin(x);}, fastMathKernels<FastSin>()},
+        {"cos", -8192.0f, 8192.0f, 0.0f, 0.0f, [](double x, double){return std::cos(x);}, [](float x, float){return std::cos(x);}, fastMathKernels<FastCos>()},
+        {"rsqrt", FLT_MIN, FLT_MAX, 0.0f, 0.0f, [](double x, double){return 1.0 / std::sqrt(x);}, [](float x, float){return 1.0f / std::sqrt(x);}, fastMathKernels<FastRsqrt>()}
+    };
+    const char* tiers[3] = {"fast", "balanced", "precise"};
+    const char* widths[3] = {"scalar", "AVX2", "AVX-512"};
+    const SimdLevel level = detectSimdLevel();
+    const bool available[3] = {true, level >= SimdLevel::AVX2, level >= SimdLevel::AVX512};
+    std::cout << "Fast math against libm over " << n << " inputs per function, evenly spaced in the bits of the float, so exhaustive where that covers the domain" << std::endl;
+    
+    constexpr size_t chunk = 1 << 16;
+    std::vector<float> x(chunk), y(chunk), out(chunk), timeX(chunk), timeY(chunk);
+    std::vector<double> reference(chunk);
+    std::mt19937 engine(1);
+    for(const FastMathTest& test : tests){
+        const int64_t first = orderedBits(test.lo), last = orderedBits(test.hi);
+        const double stride = std::max(1.0, static_cast<double>(last - first + 1) / n);
+        const size_t count = std::min(n, static_cast<size_t>(last - first + 1));
+        std::uniform_real_distribution<float> uniformY(test.yLo, test.yHi);
+        //The sweep is mostly tiny numbers, whose squares are denormals that take a microcode assist, so the timing has inputs
+        //uniform over the domain instead
+        std::uniform_real_distribution<float> uniformX(test.lo, test.hi);
+        for(size_t i = 0;i < chunk;++i){
+            timeX[i] = uniformX(engine);
+            timeY[i] = uniformY(engine);
+        }
+        const size_t repeats = std::max<size_t>(1, count / chunk);
+        auto startTime = std::chrono::high_resolution_clock::now();
+        for(size_t r = 0;r < repeats;++r){
+            for(size_t i = 0;i < chunk;++i) out[i] = test.libm(timeX[i], timeY[i]);
+        }
+        const double libmTime = static_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - startTime).count() / (repeats * chunk);
+        
+        std::array<double, 9> maxUlps{}, maxRelative{};
+        for(size_t begin = 0;begin < count;begin += chunk){
+            const size_t size = std::min(chunk, count - begin);
+            for(size_t i = 0;i < size;++i){
+                x[i] = fromOrderedBits(static_cast<int32_t>(first + static_cast<int64_t>((begin + i) * stride)));
+                //Denormals are outside every domain
+                if(std::fabs(x[i]) < FLT_MIN) x[i] = 0.0f;
+                y[i] = uniformY(engine);
+                reference[i] = test.reference(x[i], y[i]);
+            }
+            for(size_t k = 0;k < 9;++k){
+                if(!available[k % 3]) continue;
+                test.kernels[k](x.data(), y.data(), out.data(), size);
+                for(size_t i = 0;i < size;++i){
+                    maxUlps[k] = std::max(maxUlps[k], ulps(out[i], reference[i]));
+                    if(reference[i] != 0.0) maxRelative[k] = std::max(maxRelative[k], std::fabs(out[i] / reference[i] - 1.0));
+                }
+            }
+        }
+        
+        std::array<double, 9> time{};
+        for(size_t k = 0;k < 9;++k){
+            if(!available[k % 3]) continue;
+            startTime = std::chrono::high_resolution_clock::now();
+            for(size_t r = 0;r < repeats;++r) test.kernels[k](timeX.data(), timeY.data(), out.data(), chunk);
+            time[k] = static_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - startTime).count() / (repeats * chunk);
+        }
+        std::cout << "  " << test.name << ", libm " << libmTime * 1e9 << " ns" << std::endl;
+        for(size_t t = 0;t < 3;++t){
+            std::cout << "    " << tiers[t];
+            for(size_t w = 0;w < 3;++w){
+                const size_t k = 3 * t + w;
+                if(available[w]) std::cout << (w == 0 ? ": " : ", ") << widths[w] << " " << time[k] * 1e9 << " ns " << maxUlps[k] << " ulp " << maxRelative[k];
+            }
+            std::cout << std::endl;
+        }
+    }
+}
+
+namespace {
+    //Particles of b that differ from those of a, or all of them if the counts do
+    size_t resetDifferences(const Galaxy& a, const Galaxy& b){
+        if(a.size() != b.size()) return std::max(a.size(), b.size());
+        size_t differences = 0;
+        for(size_t i = 0;i < a.size();++i){
+            differences += !(a.getPositions()[i] == b.getPositions()[i]) || !(a.getPreviousPositions()[i] == b.getPreviousPositions()[i]) || a.getMasses()[i] != b.getMasses()[i];
+        }
+        return differences;
+    }
+    
+    //Whether the arrays of a and b are the same bit for bit, which unlike == also tells -0 from 0 and compares NaNs
+    bool identicalBits(const Galaxy& a, const Galaxy& b){
+        return a.size() == b.size()
+            && std::memcmp(a.getPositions().data(), b.getPositions().data(), a.size() * sizeof(glm::vec4)) == 0
+            && std::memcmp(a.getPreviousPositions().data(), b.getPreviousPositions().data(), a.size() * sizeof(glm::vec4)) == 0
+            && std::memcmp(a.getMasses().data(), b.getMasses().data(), a.size() * sizeof(float)) == 0;
+    }
+}
+
+bool benchmarkReset(size_t n){
+    std::cout << "Reset of " << n << " stars and " << n / 2 << " cloud particles, headless" << std::endl;
+    //Every reset of a seed gives the same particles, so a background reset, and the reset() cancelling one, should match reset()
+    Galaxy plain(n, n / 2, benchHr, benchHz, 0.5f, 15.0f, benchDt, 0);
+    auto startTime = std::chrono::high_resolution_clock::now();
+    plain.reset();
+    const double resetTime = static_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - startTime).count();
+    
+    Galaxy background(n, n / 2, benchHr, benchHz, 0.5f, 15.0f, benchDt, 0);
+    startTime = std::chrono::high_resolution_clock::now();
+    background.startReset();
+    const double stallTime = static_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - startTime).count();
+    while(background.resetPending()){
+        background.updateReset();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    const double backgroundTime = static_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - startTime).count();
+    const size_t backgroundDifferences = resetDifferences(plain, background);
+    std::cout << "  reset() " << resetTime * 1e3 << " ms, startReset() returns after " << stallTime * 1e3 << " ms and swaps in after " << backgroundTime * 1e3 << " ms, " << backgroundDifferences << " particles differ from reset(), total mass " << background.getTotalMass() << " against " << plain.getTotalMass() << std::endl;
+    
+    //Cancelled a quarter of the way through, or once generated for a galaxy that takes a single slice
+    Galaxy cancelled(n, n / 2, benchHr, benchHz, 0.5f, 15.0f, benchDt, 0);
+    cancelled.startReset();
+    while(cancelled.getResetProgress() < 0.25f) std::this_thread::sleep_for(std::chrono::microseconds(100));
+    const float progress = cancelled.getResetProgress();
+    cancelled.reset();
+    const size_t cancelledDifferences = resetDifferences(plain, cancelled);
+    std::cout << "  reset() cancelling a background reset " << progress * 100.0f << "% done: " << cancelledDifferences << " particles differ from reset(), total mass " << cancelled.getTotalMass() << " against " << plain.getTotalMass() << std::endl;
+    
+    //Generated with one thread and with at least four, with the cache off so both generate, since the chunks and the order they
+    //finish in must not reach the particles
+    InitialConditionsCache& cache = InitialConditionsCache::global();
+    ThreadPool& pool = ThreadPool::global();
+    const std::string cacheDirectory = cache.getDirectory();
+    const size_t threads = pool.getThreadCount(), manyThreads = std::max<size_t>(threads, 4);
+    cache.setDirectory("");
+    pool.setThreadCount(1);
+    Galaxy single(n, n / 2, benchHr, benchHz, 0.5f, 15.0f, benchDt, 0);
+    single.reset();
+    pool.setThreadCount(manyThreads);
+    Galaxy many(n, n / 2, benchHr, benchHz, 0.5f, 15.0f, benchDt, 0);
+    many.reset();
+    pool.setThreadCount(threads);
+    cache.setDirectory(cacheDirectory);
+    const bool threadIndependent = identicalBits(single, many);
+    std::cout << "  reset() with 1 and " << manyThreads << " threads: " << (threadIndependent ? "identical" : "different") << " bits" << std::endl;
+    
+    //Two resets in a row, in a scratch directory without --ic-cache: the second has to map what the first stored
+    const bool scratchCache = !cache.enabled();
+    const std::filesystem::path scratch = std::filesystem::temp_directory_path() / "cgpr-ic-bench";
+    if(scratchCache) cache.setDirectory(scratch.string());
+    plain.reset();
+    const size_t hits = cache.getHits();
+    startTime = std::chrono::high_resolution_clock::now();
+    plain.reset();
+    const double hitTime = static_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - startTime).count();
+    const bool hit = cache.getHits() == hits + 1;
+    const size_t cachedDifferences = resetDifferences(background, plain);
+    std::cout << "  second of two reset()s in a row " << (hit ? "hit" : "missed") << " the cache, " << hitTime * 1e3 << " ms, " << cachedDifferences << " particles differ from the generated ones" << std::endl;
+    if(scratchCache){
+        cache.setDirectory("");
+        std::error_code error;
+        std::filesystem::remove_all(scratch, error);
+    }
+    return backgroundDifferences == 0 && cancelledDifferences == 0 && threadIndependent && hit && cachedDifferences == 0;
+}
+
+bool benchmarkBlockTimesteps(size_t n){
+    //Direct gravity, so the close pairs the deeper levels are for are there, over a fixed interval of 64 full steps. Steps this
+    //long put most of the particles on the deeper levels, the 0.001 of the app leaves every one of them on level 0.
+    const int levels = 4;
+    const size_t steps = 64;
+    const float dt = 2.0f;
+    std::cout << "Block timesteps of " << n << " stars and " << n / 2 << " cloud particles, direct gravity, " << steps << " steps of " << dt << std::endl;
+    auto run = [&](float stepDt, size_t stepCount, int maxLevel, double& time){
+        Galaxy galaxy(n, n / 2, benchHr, benchHz, 0.5f, 15.0f, stepDt, 0);
+        galaxy.setGravity(Gravity::Direct);
+        galaxy.reset();
+        galaxy.setBlockTimesteps(maxLevel);
+        const auto startTime = std::chrono::high_resolution_clock::now();
+        galaxy.integrate(stepCount);
+        time = static_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - startTime).count();
+        if(maxLevel > 0) galaxy.printSolverStats(std::cout);
+        return galaxy.getParticles();
+    };
+    //The reference takes every particle at the deepest level's step
+    double referenceTime, singleTime, blockTime;
+    const ParticleArrays reference = run(std::ldexp(dt, -levels), steps << levels, 0, referenceTime);
+    const ParticleArrays single = run(dt, steps, 0, singleTime);
+    const ParticleArrays block = run(dt, steps, levels, blockTime);
+    
+    //RMS and largest distance from the reference
+    auto drift = [&](const ParticleArrays& p, double& rms, double& largest){
+        rms = largest = 0.0;
+        for(size_t i = 0;i < n + n / 2;++i){
+            const double dx = double(p.x[i]) - reference.x[i], dy = double(p.y[i]) - reference.y[i], dz = double(p.z[i]) - reference.z[i];
+            const double d2 = dx * dx + dy * dy + dz * dz;
+            rms += d2;
+            largest = std::max(largest, d2);
+        }
+        rms = std::sqrt(rms / (n + n / 2));
+        largest = std::sqrt(largest);
+    };
+    double singleRms, singleLargest, blockRms, blockLargest;
+    drift(single, singleRms, singleLargest);
+    drift(block, blockRms, blockLargest);
+    std::cout << "  dt / " << (1 << levels) << " for every particle: " << referenceTime * 1e3 << " ms, the reference" << std::endl;
+    std::cout << "  dt for every particle: " << singleTime * 1e3 << " ms, position drift " << singleRms << " RMS, " << singleLargest << " largest" << std::endl;
+    std::cout << "  " << levels << " block levels: " << blockTime * 1e3 << " ms, position drift " << blockRms << " RMS, " << blockLargest << " largest" << std::endl;
+    return blockRms < singleRms;
+}
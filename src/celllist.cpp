@@ -0,0 +1,139 @@
+#include "celllist.hpp"
+
+#include <chrono>
+#include <utility>
+
+CellList::CellList(): cellSize(1.0f), invCellSize(1.0f), bucketMask(0), buildSeconds(0.0), cellMin{0, 0, 0}, cellMax{-1, -1, -1} {}
+
+void CellList::build(const float* x, const float* y, const float* z, size_t n, float newCellSize, ThreadPool& pool){
+    auto startTime = std::chrono::steady_clock::now();
+    cellSize = newCellSize;
+    invCellSize = 1.0f / newCellSize;
+    //About two points per bucket on average, so the histograms of every chunk stay small next to the points themselves
+    size_t buckets = 1;
+    while(2 * buckets < n) buckets <<= 1;
+    bucketMask = buckets - 1;
+    //One chunk per thread for the same reason: the counting sort keeps a histogram of every bucket for every chunk
+    const size_t threads = std::max<size_t>(pool.getThreadCount(), 1);
+    const size_t chunk = std::max<size_t>((n + threads - 1) / threads, 1);
+    const size_t chunks = (n + chunk - 1) / chunk;
+    
+    bucket.resize(n);
+    cell.resize(n);
+    chunkBounds.resize(6 * chunks);
+    pool.parallelFor(0, n, chunk, [&](size_t begin, size_t end){
+        int32_t* bounds = chunkBounds.data() + 6 * (begin / chunk);
+        for(int a = 0;a < 3;++a){
+            bounds[a] = cellLimit;
+            bounds[3 + a] = -cellLimit;
+        }
+        for(size_t i = begin;i < end;++i){
+            const int32_t ix = cellCoordinate(x[i]), iy = cellCoordinate(y[i]), iz = cellCoordinate(z[i]);
+            bucket[i] = bucketOf(ix, iy, iz);
+            cell[i] = packCell(ix, iy, iz);
+            bounds[0] = std::min(bounds[0], ix);
+            bounds[1] = std::min(bounds[1], iy);
+            bounds[2] = std::min(bounds[2], iz);
+            bounds[3] = std::max(bounds[3], ix);
+            bounds[4] = std::max(bounds[4], iy);
+            bounds[5] = std::max(bounds[5], iz);
+        }
+    });
+    for(int a = 0;a < 3;++a){
+        cellMin[a] = cellLimit;
+        cellMax[a] = -cellLimit;
+        for(size_t c = 0;c < chunks;++c){
+            cellMin[a] = std::min(cellMin[a], chunkBounds[6 * c + a]);
+            cellMax[a] = std::max(cellMax[a], chunkBounds[6 * c + 3 + a]);
+        }
+    }
+    
+    countingSort(n, buckets, [&](size_t i){return bucket[i];}, order, start, offsets, pool, chunk);
+    sortedX.resize(n);
+    sortedY.resize(n);
+    sortedZ.resize(n);
+    sortedCell.resize(n);
+    pool.parallelFor(0, n, [&](size_t begin, size_t end){
+        for(size_t p = begin;p < end;++p){
+            const uint32_t i = order[p];
+            sortedX[p] = x[i];
+            sortedY[p] = y[i];
+            sortedZ[p] = z[i];
+            sortedCell[p] = cell[i];
+        }
+    });
+    buildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void CellList::rangeQuery(float px, float py, float pz, float radius, std::vector<uint32_t>& out) const {
+    forEachInRange(px, py, pz, radius, [&](uint32_t i, float){out.push_back(i);});
+}
+
+void CellList::nearest(float px, float py, float pz, size_t k, std::vector<uint32_t>& out) const {
+    out.clear();
+    k = std::min(k, order.size());
+    if(k == 0) return;
+    //Max-heap of the k nearest so far by squared distance
+    std::vector<std::pair<float, uint32_t>> best;
+    best.reserve(k + 1);
+    auto consider = [&](size_t p){
+        float dx = sortedX[p] - px, dy = sortedY[p] - py, dz = sortedZ[p] - pz;
+        float r2 = dx * dx + dy * dy + dz * dz;
+        if(best.size() == k && r2 >= best.front().first) return;
+        best.emplace_back(r2, order[p]);
+        std::push_heap(best.begin(), best.end());
+        if(best.size() > k){
+            std::pop_heap(best.begin(), best.end());
+            best.pop_back();
+        }
+    };
+    
+    //Shells of cells at growing Chebyshev distance from the query's cell. A point beyond shell s lies at least s cells away, so
+    //the search ends once the k-th nearest is closer than that or the shells cover every occupied cell.
+    const int32_t centre[3] = {cellCoordinate(px), cellCoordinate(py), cellCoordinate(pz)};
+    int32_t lastShell = 0;
+    for(int a = 0;a < 3;++a) lastShell = std::max({lastShell, centre[a] - cellMin[a], cellMax[a] - centre[a]});
+    for(int32_t shell = 0;shell <= lastShell;++shell){
+        const double side = 2.0 * shell + 1.0;
+        if(side * side * side > static_cast<double>(order.size())){
+            //The shells have outgrown the points, which are cheaper to go through once
+            best.clear();
+            for(size_t p = 0;p < order.size();++p) consider(p);
+            break;
+        }
+        for(int32_t iz = std::max(centre[2] - shell, cellMin[2]);iz <= std::min(centre[2] + shell, cellMax[2]);++iz){
+            for(int32_t iy = std::max(centre[1] - shell, cellMin[1]);iy <= std::min(centre[1] + shell, cellMax[1]);++iy){
+                //Inside the faces of the shell only its two ends along x are new
+                const bool face = iz == centre[2] - shell || iz == centre[2] + shell || iy == centre[1] - shell || iy == centre[1] + shell;
+                const int32_t step = face || shell == 0 ? 1 : 2 * shell;
+                for(int32_t ix = centre[0] - shell;ix <= centre[0] + shell;ix += step){
+                    if(ix < cellMin[0] || ix > cellMax[0]) continue;
+                    const uint64_t key = packCell(ix, iy, iz);
+                    const uint32_t b = bucketOf(ix, iy, iz);
+                    for(uint32_t p = start[b];p < start[b + 1];++p) if(sortedCell[p] == key) consider(p);
+                }
+            }
+        }
+        const float reach = shell * cellSize;
+        if(best.size() == k && best.front().first <= reach * reach) break;
+    }
+    std::sort_heap(best.begin(), best.end());
+    out.reserve(best.size());
+    for(const std::pair<float, uint32_t>& b : best) out.push_back(b.second);
+}
+
+size_t CellList::size() const {
+    return order.size();
+}
+
+float CellList::getCellSize() const {
+    return cellSize;
+}
+
+size_t CellList::getBucketCount() const {
+    return bucketMask + 1;
+}
+
+double CellList::getBuildSeconds() const {
+    return buildSeconds;
+}
\ No newline at end of file
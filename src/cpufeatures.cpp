@@ -0,0 +1,24 @@
+#include "cpufeatures.hpp"
+
+SimdLevel detectSimdLevel(){
+#if defined(__x86_64__) || defined(__i386__)
+    static const SimdLevel level = []{
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx512f")) return SimdLevel::AVX512;
+        if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return SimdLevel::AVX2;
+        return SimdLevel::SSE2;
+    }();
+    return level;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+const char* simdLevelName(SimdLevel level){
+    switch(level){
+        case SimdLevel::SSE2: return "SSE2";
+        case SimdLevel::AVX2: return "AVX2";
+        case SimdLevel::AVX512: return "AVX-512";
+        default: return "scalar";
+    }
+}
\ No newline at end of file
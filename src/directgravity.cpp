@@ -0,0 +1,146 @@
+#include "directgravity.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "simd.hpp"
+
+namespace {
+    //4 arrays of 2048 floats = 32 KiB of sources per tile, reused by every target of a chunk before moving on
+    constexpr size_t sourceTile = 2048, targetChunk = 512;
+    
+    void tileScalar(const float* x, const float* y, const float* z, size_t begin, size_t end, const float* sx, const float* sy, const float* sz, const float* sm, size_t count, float eps2, float* ax, float* ay, float* az){
+        for(size_t i = begin;i < end;++i){
+            float accX = 0.0f, accY = 0.0f, accZ = 0.0f;
+            for(size_t j = 0;j < count;++j){
+                float dx = sx[j] - x[i], dy = sy[j] - y[i], dz = sz[j] - z[i];
+                float invR = 1.0f / std::sqrt(dx * dx + dy * dy + dz * dz + eps2);
+                float s = sm[j] * invR * invR * invR;
+                accX += s * dx;
+                accY += s * dy;
+                accZ += s * dz;
+            }
+            ax[i] += accX;
+            ay[i] += accY;
+            az[i] += accZ;
+        }
+    }
+    
+#ifdef SIMD_X86
+    using namespace simd;
+    
+    //rsqrt estimate plus one Newton-Raphson step, about 2.7e-7 relative, as close as the float sums it goes into
+    constexpr fastmath::Accuracy rsqrtAccuracy = fastmath::Accuracy::Balanced;
+    
+    //The vector kernels put consecutive targets in the lanes and broadcast one source at a time, so no horizontal sums are needed
+    void tileSSE2(const float* x, const float* y, const float* z, size_t begin, size_t end, const float* sx, const float* sy, const float* sz, const float* sm, size_t count, float eps2, float* ax, float* ay, float* az){
+        const __m128 vEps2 = _mm_set1_ps(eps2);
+        size_t i = begin;
+        for(;i + 4 <= end;i += 4){
+            __m128 xi = _mm_loadu_ps(x + i), yi = _mm_loadu_ps(y + i), zi = _mm_loadu_ps(z + i);
+            __m128 accX = _mm_setzero_ps(), accY = _mm_setzero_ps(), accZ = _mm_setzero_ps();
+            for(size_t j = 0;j < count;++j){
+                __m128 dx = _mm_sub_ps(_mm_set1_ps(sx[j]), xi), dy = _mm_sub_ps(_mm_set1_ps(sy[j]), yi), dz = _mm_sub_ps(_mm_set1_ps(sz[j]), zi);
+                __m128 invR = fastmath::rsqrt<rsqrtAccuracy>(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_add_ps(_mm_mul_ps(dz, dz), vEps2)));
+                __m128 s = _mm_mul_ps(_mm_set1_ps(sm[j]), _mm_mul_ps(_mm_mul_ps(invR, invR), invR));
+                accX = _mm_add_ps(accX, _mm_mul_ps(s, dx));
+                accY = _mm_add_ps(accY, _mm_mul_ps(s, dy));
+                accZ = _mm_add_ps(accZ, _mm_mul_ps(s, dz));
+            }
+            _mm_storeu_ps(ax + i, _mm_add_ps(_mm_loadu_ps(ax + i), accX));
+            _mm_storeu_ps(ay + i, _mm_add_ps(_mm_loadu_ps(ay + i), accY));
+            _mm_storeu_ps(az + i, _mm_add_ps(_mm_loadu_ps(az + i), accZ));
+        }
+        if(i < end) tileScalar(x, y, z, i, end, sx, sy, sz, sm, count, eps2, ax, ay, az);
+    }
+    
+    __attribute__((target("avx2,fma"))) void tileAVX2(const float* x, const float* y, const float* z, size_t begin, size_t end, const float* sx, const float* sy, const float* sz, const float* sm, size_t count, float eps2, float* ax, float* ay, float* az){
+        const __m256 vEps2 = _mm256_set1_ps(eps2);
+        size_t i = begin;
+        for(;i + 8 <= end;i += 8){
+            __m256 xi = _mm256_loadu_ps(x + i), yi = _mm256_loadu_ps(y + i), zi = _mm256_loadu_ps(z + i);
+            __m256 accX = _mm256_setzero_ps(), accY = _mm256_setzero_ps(), accZ = _mm256_setzero_ps();
+            for(size_t j = 0;j < count;++j){
+                __m256 dx = _mm256_sub_ps(_mm256_broadcast_ss(sx + j), xi), dy = _mm256_sub_ps(_mm256_broadcast_ss(sy + j), yi), dz = _mm256_sub_ps(_mm256_broadcast_ss(sz + j), zi);
+                __m256 invR = fastmath::rsqrt<rsqrtAccuracy>(_mm256_fmadd_ps(dx, dx, _mm256_fmadd_ps(dy, dy, _mm256_fmadd_ps(dz, dz, vEps2))));
+                __m256 s = _mm256_mul_ps(_mm256_broadcast_ss(sm + j), _mm256_mul_ps(_mm256_mul_ps(invR, invR), invR));
+                accX = _mm256_fmadd_ps(s, dx, accX);
+                accY = _mm256_fmadd_ps(s, dy, accY);
+                accZ = _mm256_fmadd_ps(s, dz, accZ);
+            }
+            _mm256_storeu_ps(ax + i, _mm256_add_ps(_mm256_loadu_ps(ax + i), accX));
+            _mm256_storeu_ps(ay + i, _mm256_add_ps(_mm256_loadu_ps(ay + i), accY));
+            _mm256_storeu_ps(az + i, _mm256_add_ps(_mm256_loadu_ps(az + i), accZ));
+        }
+        if(i < end) tileScalar(x, y, z, i, end, sx, sy, sz, sm, count, eps2, ax, ay, az);
+    }
+    
+    __attribute__((target("avx512f"))) void tileAVX512(const float* x, const float* y, const float* z, size_t begin, size_t end, const float* sx, const float* sy, const float* sz, const float* sm, size_t count, float eps2, float* ax, float* ay, float* az){
+        const __m512 vEps2 = _mm512_set1_ps(eps2);
+        for(size_t i = begin;i < end;i += 16){
+            __mmask16 mask = end - i >= 16 ? 0xffff : static_cast<__mmask16>((1u << (end - i)) - 1);
+            __m512 xi = _mm512_maskz_loadu_ps(mask, x + i), yi = _mm512_maskz_loadu_ps(mask, y + i), zi = _mm512_maskz_loadu_ps(mask, z + i);
+            __m512 accX = _mm512_setzero_ps(), accY = _mm512_setzero_ps(), accZ = _mm512_setzero_ps();
+            for(size_t j = 0;j < count;++j){
+                __m512 dx = _mm512_sub_ps(_mm512_set1_ps(sx[j]), xi), dy = _mm512_sub_ps(_mm512_set1_ps(sy[j]), yi), dz = _mm512_sub_ps(_mm512_set1_ps(sz[j]), zi);
+                __m512 invR = fastmath::rsqrt<rsqrtAccuracy>(_mm512_fmadd_ps(dx, dx, _mm512_fmadd_ps(dy, dy, _mm512_fmadd_ps(dz, dz, vEps2))));
+                __m512 s = _mm512_mul_ps(_mm512_set1_ps(sm[j]), _mm512_mul_ps(_mm512_mul_ps(invR, invR), invR));
+                accX = _mm512_fmadd_ps(s, dx, accX);
+                accY = _mm512_fmadd_ps(s, dy, accY);
+                accZ = _mm512_fmadd_ps(s, dz, accZ);
+            }
+            _mm512_mask_storeu_ps(ax + i, mask, _mm512_add_ps(_mm512_maskz_loadu_ps(mask, ax + i), accX));
+            _mm512_mask_storeu_ps(ay + i, mask, _mm512_add_ps(_mm512_maskz_loadu_ps(mask, ay + i), accY));
+            _mm512_mask_storeu_ps(az + i, mask, _mm512_add_ps(_mm512_maskz_loadu_ps(mask, az + i), accZ));
+        }
+    }
+#endif
+}
+
+void directTile(const float* x, const float* y, const float* z, size_t begin, size_t end, const float* sx, const float* sy, const float* sz, const float* sm, size_t count, float eps2, float* ax, float* ay, float* az){
+    switch(detectSimdLevel()){
+#ifdef SIMD_X86
+        case SimdLevel::AVX512: tileAVX512(x, y, z, begin, end, sx, sy, sz, sm, count, eps2, ax, ay, az); break;
+        case SimdLevel::AVX2: tileAVX2(x, y, z, begin, end, sx, sy, sz, sm, count, eps2, ax, ay, az); break;
+        case SimdLevel::SSE2: tileSSE2(x, y, z, begin, end, sx, sy, sz, sm, count, eps2, ax, ay, az); break;
+#endif
+        default: tileScalar(x, y, z, begin, end, sx, sy, sz, sm, count, eps2, ax, ay, az); break;
+    }
+}
+
+void directAccelerations(const float* x, const float* y, const float* z, const float* m, size_t n, float softening, float* ax, float* ay, float* az, ThreadPool& pool){
+    directAccelerations(x, y, z, n, x, y, z, m, n, softening, ax, ay, az, pool);
+}
+
+void directAccelerations(const float* tx, const float* ty, const float* tz, size_t targets, const float* x, const float* y, const float* z, const float* m, size_t n, float softening, float* ax, float* ay, float* az, ThreadPool& pool){
+    //Softening also removes the self-interaction (dx = 0), so it must never reach zero
+    const float eps2 = std::max(softening * softening, 1e-20f);
+    
+    pool.parallelFor(0, targets, targetChunk, [&](size_t begin, size_t end){
+        std::fill(ax + begin, ax + end, 0.0f);
+        std::fill(ay + begin, ay + end, 0.0f);
+        std::fill(az + begin, az + end, 0.0f);
+        for(size_t tileBegin = 0;tileBegin < n;tileBegin += sourceTile){
+            size_t count = std::min(n - tileBegin, sourceTile);
+            directTile(tx, ty, tz, begin, end, x + tileBegin, y + tileBegin, z + tileBegin, m + tileBegin, count, eps2, ax, ay, az);
+        }
+    });
+}
+
+void directAccelerationsReference(const float* x, const float* y, const float* z, const float* m, size_t n, float softening, double* ax, double* ay, double* az){
+    const double eps2 = std::max(static_cast<double>(softening) * softening, 1e-20);
+    for(size_t i = 0;i < n;++i){
+        double sx = 0.0, sy = 0.0, sz = 0.0;
+        for(size_t j = 0;j < n;++j){
+            double dx = static_cast<double>(x[j]) - x[i], dy = static_cast<double>(y[j]) - y[i], dz = static_cast<double>(z[j]) - z[i];
+            double r2 = dx * dx + dy * dy + dz * dz + eps2;
+            double s = m[j] / (r2 * std::sqrt(r2));
+            sx += s * dx;
+            sy += s * dy;
+            sz += s * dz;
+        }
+        ax[i] = sx;
+        ay[i] = sy;
+        az[i] = sz;
+    }
+}
\ No newline at end of file
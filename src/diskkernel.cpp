@@ -0,0 +1,343 @@
+#include "integrator.hpp"
+
+#include <cfloat>
+
+#include "simd.hpp"
+#include "symplectic.hpp"
+
+//Vectorised versions of verletStepScalar. Every lane does the same work as one GLSL invocation of verlet.comp, with exp and 1 / sqrt
+//from fastmath.hpp at the accuracy the kernel is instantiated for. Precise, the default, is within 2 ulp of libm.
+
+#ifdef SIMD_X86
+namespace {
+    using namespace simd;
+    
+    template<fastmath::Accuracy A> void verletStepSSE2(ParticleArrays& p, size_t begin, size_t end, float totalGM, float hr, float hz, float dt){
+        float* x = p.x.data();
+        float* y = p.y.data();
+        float* z = p.z.data();
+        float* px = p.prevX.data();
+        float* py = p.prevY.data();
+        float* pz = p.prevZ.data();
+        const __m128 negInvHr = _mm_set1_ps(-1.0f / hr), negInvHz = _mm_set1_ps(-1.0f / hz), gmDt2 = _mm_set1_ps(totalGM * dt * dt);
+        const __m128 two = _mm_set1_ps(2.0f);
+        
+        size_t i = begin;
+        for(;i + 4 <= end;i += 4){
+            __m128 vx = _mm_loadu_ps(x + i), vy = _mm_loadu_ps(y + i), vz = _mm_loadu_ps(z + i);
+            __m128 a = diskFactor128<A>(vx, vy, vz, negInvHr, negInvHz, gmDt2);
+            _mm_storeu_ps(px + i, _mm_sub_ps(_mm_sub_ps(_mm_mul_ps(two, vx), _mm_loadu_ps(px + i)), _mm_mul_ps(a, vx)));
+            _mm_storeu_ps(py + i, _mm_sub_ps(_mm_sub_ps(_mm_mul_ps(two, vy), _mm_loadu_ps(py + i)), _mm_mul_ps(a, vy)));
+            _mm_storeu_ps(pz + i, _mm_sub_ps(_mm_sub_ps(_mm_mul_ps(two, vz), _mm_loadu_ps(pz + i)), _mm_mul_ps(a, vz)));
+        }
+        if(i < end) verletStepScalar(p, i, end, totalGM, hr, hz, dt);
+    }
+    
+    template<fastmath::Accuracy A> __attribute__((target("avx2,fma"))) void verletStepAVX2(ParticleArrays& p, size_t begin, size_t end, float totalGM, float hr, float hz, float dt){
+        float* x = p.x.data();
+        float* y = p.y.data();
+        float* z = p.z.data();
+        float* px = p.prevX.data();
+        float* py = p.prevY.data();
+        float* pz = p.prevZ.data();
+        const __m256 negInvHr = _mm256_set1_ps(-1.0f / hr), negInvHz = _mm256_set1_ps(-1.0f / hz), gmDt2 = _mm256_set1_ps(totalGM * dt * dt);
+        const __m256 two = _mm256_set1_ps(2.0f);
+        
+        size_t i = begin;
+        for(;i + 8 <= end;i += 8){
+            __m256 vx = _mm256_loadu_ps(x + i), vy = _mm256_loadu_ps(y + i), vz = _mm256_loadu_ps(z + i);
+            __m256 a = diskFactor256<A>(vx, vy, vz, negInvHr, negInvHz, gmDt2);
+            _mm256_storeu_ps(px + i, _mm256_fnmadd_ps(a, vx, _mm256_fmsub_ps(two, vx, _mm256_loadu_ps(px + i))));
+            _mm256_storeu_ps(py + i, _mm256_fnmadd_ps(a, vy, _mm256_fmsub_ps(two, vy, _mm256_loadu_ps(py + i))));
+            _mm256_storeu_ps(pz + i, _mm256_fnmadd_ps(a, vz, _mm256_fmsub_ps(two, vz, _mm256_loadu_ps(pz + i))));
+        }
+        if(i < end) verletStepScalar(p, i, end, totalGM, hr, hz, dt);
+    }
+    
+    template<fastmath::Accuracy A> __attribute__((target("avx512f"))) void verletStepAVX512(ParticleArrays& p, size_t begin, size_t end, float totalGM, float hr, float hz, float dt){
+        float* x = p.x.data();
+        float* y = p.y.data();
+        float* z = p.z.data();
+        float* px = p.prevX.data();
+        float* py = p.prevY.data();
+        float* pz = p.prevZ.data();
+        const __m512 negInvHr = _mm512_set1_ps(-1.0f / hr), negInvHz = _mm512_set1_ps(-1.0f / hz), gmDt2 = _mm512_set1_ps(totalGM * dt * dt);
+        const __m512 two = _mm512_set1_ps(2.0f);
+        
+        size_t i = begin;
+        for(;i < end;i += 16){
+            //The tail is handled with a lane mask instead of a scalar loop
+            __mmask16 m = end - i >= 16 ? 0xffff : static_cast<__mmask16>((1u << (end - i)) - 1);
+            __m512 vx = _mm512_maskz_loadu_ps(m, x + i), vy = _mm512_maskz_loadu_ps(m, y + i), vz = _mm512_maskz_loadu_ps(m, z + i);
+            __m512 a = diskFactor512<A>(vx, vy, vz, negInvHr, negInvHz, gmDt2);
+            _mm512_mask_storeu_ps(px + i, m, _mm512_fnmadd_ps(a, vx, _mm512_fmsub_ps(two, vx, _mm512_maskz_loadu_ps(m, px + i))));
+            _mm512_mask_storeu_ps(py + i, m, _mm512_fnmadd_ps(a, vy, _mm512_fmsub_ps(two, vy, _mm512_maskz_loadu_ps(m, py + i))));
+            _mm512_mask_storeu_ps(pz + i, m, _mm512_fnmadd_ps(a, vz, _mm512_fmsub_ps(two, vz, _mm512_maskz_loadu_ps(m, pz + i))));
+        }
+    }
+    
+    //The multi-step kernels only do the widest two, SSE2 falls back to the scalar loop
+    template<fastmath::Accuracy A> __attribute__((target("avx2,fma"))) void verletStepsAVX2(ParticleArrays& p, size_t begin, size_t end, float totalGM, float hr, float hz, float dt, size_t steps){
+        const __m256 negInvHr = _mm256_set1_ps(-1.0f / hr), negInvHz = _mm256_set1_ps(-1.0f / hz), gmDt2 = _mm256_set1_ps(totalGM * dt * dt);
+        const __m256 two = _mm256_set1_ps(2.0f);
+        
+        size_t i = begin;
+        for(;i + 8 <= end;i += 8){
+            __m256 vx = _mm256_loadu_ps(p.x.data() + i), vy = _mm256_loadu_ps(p.y.data() + i), vz = _mm256_loadu_ps(p.z.data() + i);
+            __m256 px = _mm256_loadu_ps(p.prevX.data() + i), py = _mm256_loadu_ps(p.prevY.data() + i), pz = _mm256_loadu_ps(p.prevZ.data() + i);
+            for(size_t s = 0;s < steps;++s){
+                __m256 a = diskFactor256<A>(vx, vy, vz, negInvHr, negInvHz, gmDt2);
+                __m256 nx = _mm256_fnmadd_ps(a, vx, _mm256_fmsub_ps(two, vx, px));
+                __m256 ny = _mm256_fnmadd_ps(a, vy, _mm256_fmsub_ps(two, vy, py));
+                __m256 nz = _mm256_fnmadd_ps(a, vz, _mm256_fmsub_ps(two, vz, pz));
+                px = vx;
+                py = vy;
+                pz = vz;
+                vx = nx;
+                vy = ny;
+                vz = nz;
+            }
+            _mm256_storeu_ps(p.x.data() + i, vx);
+            _mm256_storeu_ps(p.y.data() + i, vy);
+            _mm256_storeu_ps(p.z.data() + i, vz);
+            _mm256_storeu_ps(p.prevX.data() + i, px);
+            _mm256_storeu_ps(p.prevY.data() + i, py);
+            _mm256_storeu_ps(p.prevZ.data() + i, pz);
+        }
+        if(i < end) verletStepsScalar(p, i, end, totalGM, hr, hz, dt, steps);
+    }
+    
+    template<fastmath::Accuracy A> __attribute__((target("avx512f"))) void verletStepsAVX512(ParticleArrays& p, size_t begin, size_t end, float totalGM, float hr, float hz, float dt, size_t steps){
+        const __m512 negInvHr = _mm512_set1_ps(-1.0f / hr), negInvHz = _mm512_set1_ps(-1.0f / hz), gmDt2 = _mm512_set1_ps(totalGM * dt * dt);
+        const __m512 two = _mm512_set1_ps(2.0f);
+        //Each step depends on the one before, so four independent vectors are kept in flight to hide the latency of exp
+        constexpr size_t lanes = 4;
+        
+        for(size_t i = begin;i < end;i += 16 * lanes){
+            __mmask16 m[lanes];
+            __m512 vx[lanes], vy[lanes], vz[lanes], px[lanes], py[lanes], pz[lanes];
+            for(size_t l = 0;l < lanes;++l){
+                size_t j = i + 16 * l;
+                m[l] = j >= end ? 0 : end - j >= 16 ? 0xffff : static_cast<__mmask16>((1u << (end - j)) - 1);
+                vx[l] = _mm512_maskz_loadu_ps(m[l], p.x.data() + j);
+                vy[l] = _mm512_maskz_loadu_ps(m[l], p.y.data() + j);
+                vz[l] = _mm512_maskz_loadu_ps(m[l], p.z.data() + j);
+                px[l] = _mm512_maskz_loadu_ps(m[l], p.prevX.data() + j);
+                py[l] = _mm512_maskz_loadu_ps(m[l], p.prevY.data() + j);
+                pz[l] = _mm512_maskz_loadu_ps(m[l], p.prevZ.data() + j);
+            }
+            for(size_t s = 0;s < steps;++s){
+                for(size_t l = 0;l < lanes;++l){
+                    __m512 a = diskFactor512<A>(vx[l], vy[l], vz[l], negInvHr, negInvHz, gmDt2);
+                    __m512 nx = _mm512_fnmadd_ps(a, vx[l], _mm512_fmsub_ps(two, vx[l], px[l]));
+                    __m512 ny = _mm512_fnmadd_ps(a, vy[l], _mm512_fmsub_ps(two, vy[l], py[l]));
+                    __m512 nz = _mm512_fnmadd_ps(a, vz[l], _mm512_fmsub_ps(two, vz[l], pz[l]));
+                    px[l] = vx[l];
+                    py[l] = vy[l];
+                    pz[l] = vz[l];
+                    vx[l] = nx;
+                    vy[l] = ny;
+                    vz[l] = nz;
+                }
+            }
+            for(size_t l = 0;l < lanes;++l){
+                size_t j = i + 16 * l;
+                _mm512_mask_storeu_ps(p.x.data() + j, m[l], vx[l]);
+                _mm512_mask_storeu_ps(p.y.data() + j, m[l], vy[l]);
+                _mm512_mask_storeu_ps(p.z.data() + j, m[l], vz[l]);
+                _mm512_mask_storeu_ps(p.prevX.data() + j, m[l], px[l]);
+                _mm512_mask_storeu_ps(p.prevY.data() + j, m[l], py[l]);
+                _mm512_mask_storeu_ps(p.prevZ.data() + j, m[l], pz[l]);
+            }
+        }
+    }
+    
+    //symplectic.hpp systems for the disk potential. The AVX-512 one carries four vectors for the same latency reason as verletStepsAVX512.
+    template<fastmath::Accuracy A> struct DiskSystemAVX2 {
+        __m256 x, y, z, vx, vy, vz, ax, ay, az;
+        __m256 negInvHr, negInvHz, totalGM;
+        
+        __attribute__((target("avx2,fma"))) void kick(float h){
+            const __m256 vh = _mm256_set1_ps(h);
+            vx = _mm256_fmadd_ps(vh, ax, vx);
+            vy = _mm256_fmadd_ps(vh, ay, vy);
+            vz = _mm256_fmadd_ps(vh, az, vz);
+        }
+        __attribute__((target("avx2,fma"))) void drift(float h, float h2){
+            const __m256 vh = _mm256_set1_ps(h), vh2 = _mm256_set1_ps(h2);
+            x = _mm256_fmadd_ps(vh, vx, _mm256_fmadd_ps(vh2, ax, x));
+            y = _mm256_fmadd_ps(vh, vy, _mm256_fmadd_ps(vh2, ay, y));
+            z = _mm256_fmadd_ps(vh, vz, _mm256_fmadd_ps(vh2, az, z));
+        }
+        __attribute__((target("avx2,fma"))) void forces(){
+            __m256 f = _mm256_sub_ps(_mm256_setzero_ps(), diskFactor256<A>(x, y, z, negInvHr, negInvHz, totalGM));
+            ax = _mm256_mul_ps(f, x);
+            ay = _mm256_mul_ps(f, y);
+            az = _mm256_mul_ps(f, z);
+        }
+    };
+    
+    template<fastmath::Accuracy A> struct DiskSystemAVX512 {
+        static constexpr size_t lanes = 4;
+        __m512 x[lanes], y[lanes], z[lanes], vx[lanes], vy[lanes], vz[lanes], ax[lanes], ay[lanes], az[lanes];
+        __m512 negInvHr, negInvHz, totalGM;
+        
+        __attribute__((target("avx512f"))) void kick(float h){
+            const __m512 vh = _mm512_set1_ps(h);
+            for(size_t l = 0;l < lanes;++l){
+                vx[l] = _mm512_fmadd_ps(vh, ax[l], vx[l]);
+                vy[l] = _mm512_fmadd_ps(vh, ay[l], vy[l]);
+                vz[l] = _mm512_fmadd_ps(vh, az[l], vz[l]);
+            }
+        }
+        __attribute__((target("avx512f"))) void drift(float h, float h2){
+            const __m512 vh = _mm512_set1_ps(h), vh2 = _mm512_set1_ps(h2);
+            for(size_t l = 0;l < lanes;++l){
+                x[l] = _mm512_fmadd_ps(vh, vx[l], _mm512_fmadd_ps(vh2, ax[l], x[l]));
+                y[l] = _mm512_fmadd_ps(vh, vy[l], _mm512_fmadd_ps(vh2, ay[l], y[l]));
+                z[l] = _mm512_fmadd_ps(vh, vz[l], _mm512_fmadd_ps(vh2, az[l], z[l]));
+            }
+        }
+        __attribute__((target("avx512f"))) void forces(){
+            for(size_t l = 0;l < lanes;++l){
+                __m512 f = _mm512_sub_ps(_mm512_setzero_ps(), diskFactor512<A>(x[l], y[l], z[l], negInvHr, negInvHz, totalGM));
+                ax[l] = _mm512_mul_ps(f, x[l]);
+                ay[l] = _mm512_mul_ps(f, y[l]);
+                az[l] = _mm512_mul_ps(f, z[l]);
+            }
+        }
+    };
+    
+    template<class Scheme, fastmath::Accuracy A> __attribute__((target("avx2,fma"))) void integrateDiskAVX2(ParticleArrays& p, size_t begin, size_t end, float totalGM, float hr, float hz, float dt, size_t steps){
+        const __m256 invDt = _mm256_set1_ps(1.0f / dt), vdt = _mm256_set1_ps(dt);
+        DiskSystemAVX2<A> s;
+        s.negInvHr = _mm256_set1_ps(-1.0f / hr);
+        s.negInvHz = _mm256_set1_ps(-1.0f / hz);
+        s.totalGM = _mm256_set1_ps(totalGM);
+        
+        size_t i = begin;
+        for(;i + 8 <= end;i += 8){
+            s.x = _mm256_loadu_ps(p.x.data() + i);
+            s.y = _mm256_loadu_ps(p.y.data() + i);
+            s.z = _mm256_loadu_ps(p.z.data() + i);
+            s.vx = _mm256_mul_ps(_mm256_sub_ps(s.x, _mm256_loadu_ps(p.prevX.data() + i)), invDt);
+            s.vy = _mm256_mul_ps(_mm256_sub_ps(s.y, _mm256_loadu_ps(p.prevY.data() + i)), invDt);
+            s.vz = _mm256_mul_ps(_mm256_sub_ps(s.z, _mm256_loadu_ps(p.prevZ.data() + i)), invDt);
+            runSteps<Scheme>(s, dt, steps);
+            _mm256_storeu_ps(p.x.data() + i, s.x);
+            _mm256_storeu_ps(p.y.data() + i, s.y);
+            _mm256_storeu_ps(p.z.data() + i, s.z);
+            _mm256_storeu_ps(p.prevX.data() + i, _mm256_fnmadd_ps(s.vx, vdt, s.x));
+            _mm256_storeu_ps(p.prevY.data() + i, _mm256_fnmadd_ps(s.vy, vdt, s.y));
+            _mm256_storeu_ps(p.prevZ.data() + i, _mm256_fnmadd_ps(s.vz, vdt, s.z));
+        }
+        if(i < end) integrateDiskScalar<Scheme>(p, i, end, totalGM, hr, hz, dt, steps);
+    }
+    
+    template<class Scheme, fastmath::Accuracy A> __attribute__((target("avx512f"))) void integrateDiskAVX512(ParticleArrays& p, size_t begin, size_t end, float totalGM, float hr, float hz, float dt, size_t steps){
+        constexpr size_t lanes = DiskSystemAVX512<A>::lanes;
+        const __m512 invDt = _mm512_set1_ps(1.0f / dt), vdt = _mm512_set1_ps(dt);
+        DiskSystemAVX512<A> s;
+        s.negInvHr = _mm512_set1_ps(-1.0f / hr);
+        s.negInvHz = _mm512_set1_ps(-1.0f / hz);
+        s.totalGM = _mm512_set1_ps(totalGM);
+        
+        for(size_t i = begin;i < end;i += 16 * lanes){
+            //Lanes past the end run on zeros, which the FLT_MIN clamp in diskFactor512 keeps finite, and are never stored
+            __mmask16 m[lanes];
+            for(size_t l = 0;l < lanes;++l){
+                size_t j = i + 16 * l;
+                m[l] = j >= end ? 0 : end - j >= 16 ? 0xffff : static_cast<__mmask16>((1u << (end - j)) - 1);
+                s.x[l] = _mm512_maskz_loadu_ps(m[l], p.x.data() + j);
+                s.y[l] = _mm512_maskz_loadu_ps(m[l], p.y.data() + j);
+                s.z[l] = _mm512_maskz_loadu_ps(m[l], p.z.data() + j);
+                s.vx[l] = _mm512_mul_ps(_mm512_sub_ps(s.x[l], _mm512_maskz_loadu_ps(m[l], p.prevX.data() + j)), invDt);
+                s.vy[l] = _mm512_mul_ps(_mm512_sub_ps(s.y[l], _mm512_maskz_loadu_ps(m[l], p.prevY.data() + j)), invDt);
+                s.vz[l] = _mm512_mul_ps(_mm512_sub_ps(s.z[l], _mm512_maskz_loadu_ps(m[l], p.prevZ.data() + j)), invDt);
+            }
+            runSteps<Scheme>(s, dt, steps);
+            for(size_t l = 0;l < lanes;++l){
+                size_t j = i + 16 * l;
+                _mm512_mask_storeu_ps(p.x.data() + j, m[l], s.x[l]);
+                _mm512_mask_storeu_ps(p.y.data() + j, m[l], s.y[l]);
+                _mm512_mask_storeu_ps(p.z.data() + j, m[l], s.z[l]);
+                _mm512_mask_storeu_ps(p.prevX.data() + j, m[l], _mm512_fnmadd_ps(s.vx[l], vdt, s.x[l]));
+                _mm512_mask_storeu_ps(p.prevY.data() + j, m[l], _mm512_fnmadd_ps(s.vy[l], vdt, s.y[l]));
+                _mm512_mask_storeu_ps(p.prevZ.data() + j, m[l], _mm512_fnmadd_ps(s.vz[l], vdt, s.z[l]));
+            }
+        }
+    }
+}
+#endif
+
+namespace {
+    template<fastmath::Accuracy A> void verletStepAt(ParticleArrays& p, size_t begin, size_t end, float totalGM, float hr, float hz, float dt, SimdLevel level){
+#ifdef SIMD_X86
+        //Never run a kernel the CPU cannot execute, whatever was asked for
+        if(level > detectSimdLevel()) level = detectSimdLevel();
+        switch(level){
+            case SimdLevel::AVX512: verletStepAVX512<A>(p, begin, end, totalGM, hr, hz, dt); return;
+            case SimdLevel::AVX2: verletStepAVX2<A>(p, begin, end, totalGM, hr, hz, dt); return;
+            case SimdLevel::SSE2: verletStepSSE2<A>(p, begin, end, totalGM, hr, hz, dt); return;
+            default: break;
+        }
+#else
+        (void) level;
+#endif
+        verletStepScalar(p, begin, end, totalGM, hr, hz, dt);
+    }
+    
+    template<fastmath::Accuracy A> void verletStepsAt(ParticleArrays& p, size_t begin, size_t end, float totalGM, float hr, float hz, float dt, size_t steps){
+#ifdef SIMD_X86
+        switch(detectSimdLevel()){
+            case SimdLevel::AVX512: verletStepsAVX512<A>(p, begin, end, totalGM, hr, hz, dt, steps); return;
+            case SimdLevel::AVX2: verletStepsAVX2<A>(p, begin, end, totalGM, hr, hz, dt, steps); return;
+            default: break;
+        }
+#endif
+        verletStepsScalar(p, begin, end, totalGM, hr, hz, dt, steps);
+    }
+    
+    template<class Scheme, fastmath::Accuracy A> void integrateDiskAt(ParticleArrays& p, size_t begin, size_t end, float totalGM, float hr, float hz, float dt, size_t steps){
+#ifdef SIMD_X86
+        switch(detectSimdLevel()){
+            case SimdLevel::AVX512: integrateDiskAVX512<Scheme, A>(p, begin, end, totalGM, hr, hz, dt, steps); return;
+            case SimdLevel::AVX2: integrateDiskAVX2<Scheme, A>(p, begin, end, totalGM, hr, hz, dt, steps); return;
+            default: break;
+        }
+#endif
+        integrateDiskScalar<Scheme>(p, begin, end, totalGM, hr, hz, dt, steps);
+    }
+}
+
+void verletStep(ParticleArrays& p, size_t begin, size_t end, float totalGM, float hr, float hz, float dt){
+    verletStep(p, begin, end, totalGM, hr, hz, dt, detectSimdLevel());
+}
+
+void verletStep(ParticleArrays& p, size_t begin, size_t end, float totalGM, float hr, float hz, float dt, SimdLevel level, fastmath::Accuracy accuracy){
+    switch(accuracy){
+        case fastmath::Accuracy::Fast: verletStepAt<fastmath::Accuracy::Fast>(p, begin, end, totalGM, hr, hz, dt, level); return;
+        case fastmath::Accuracy::Balanced: verletStepAt<fastmath::Accuracy::Balanced>(p, begin, end, totalGM, hr, hz, dt, level); return;
+        default: verletStepAt<fastmath::Accuracy::Precise>(p, begin, end, totalGM, hr, hz, dt, level); return;
+    }
+}
+
+void verletSteps(ParticleArrays& p, size_t begin, size_t end, float totalGM, float hr, float hz, float dt, size_t steps, fastmath::Accuracy accuracy){
+    switch(accuracy){
+        case fastmath::Accuracy::Fast: verletStepsAt<fastmath::Accuracy::Fast>(p, begin, end, totalGM, hr, hz, dt, steps); return;
+        case fastmath::Accuracy::Balanced: verletStepsAt<fastmath::Accuracy::Balanced>(p, begin, end, totalGM, hr, hz, dt, steps); return;
+        default: verletStepsAt<fastmath::Accuracy::Precise>(p, begin, end, totalGM, hr, hz, dt, steps); return;
+    }
+}
+
+template<class Scheme> void integrateDisk(ParticleArrays& p, size_t begin, size_t end, float totalGM, float hr, float hz, float dt, size_t steps, fastmath::Accuracy accuracy){
+    switch(accuracy){
+        case fastmath::Accuracy::Fast: integrateDiskAt<Scheme, fastmath::Accuracy::Fast>(p, begin, end, totalGM, hr, hz, dt, steps); return;
+        case fastmath::Accuracy::Balanced: integrateDiskAt<Scheme, fastmath::Accuracy::Balanced>(p, begin, end, totalGM, hr, hz, dt, steps); return;
+        default: integrateDiskAt<Scheme, fastmath::Accuracy::Precise>(p, begin, end, totalGM, hr, hz, dt, steps); return;
+    }
+}
+
+template void integrateDisk<LeapfrogKDK>(ParticleArrays&, size_t, size_t, float, float, float, float, size_t, fastmath::Accuracy);
+template void integrateDisk<VelocityVerlet>(ParticleArrays&, size_t, size_t, float, float, float, float, size_t, fastmath::Accuracy);
+template void integrateDisk<ForestRuth>(ParticleArrays&, size_t, size_t, float, float, float, float, size_t, fastmath::Accuracy);
\ No newline at end of file
@@ -0,0 +1,94 @@
+#include "fft.hpp"
+
+#include <cmath>
+#include <utility>
+
+namespace {
+    //Plain product, std::complex's operator* checks for infinities and NaNs through a libgcc call
+    inline std::complex<float> multiply(std::complex<float> a, std::complex<float> b){
+        return std::complex<float>(a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real());
+    }
+}
+
+FFTPlan::FFTPlan(size_t n):
+    n(nextPowerOfTwo(n)) {
+    twiddles.resize(this->n / 2);
+    for(size_t k = 0;k < twiddles.size();++k) twiddles[k] = std::polar(1.0, -2.0 * M_PI * k / this->n);
+    bitReverse.resize(this->n);
+    int bits = 0;
+    while((size_t(1) << bits) < this->n) ++bits;
+    for(size_t i = 0;i < this->n;++i){
+        uint32_t r = 0;
+        for(int b = 0;b < bits;++b) r |= ((i >> b) & 1) << (bits - 1 - b);
+        bitReverse[i] = r;
+    }
+}
+
+void FFTPlan::transform(std::complex<float>* data, bool inverse) const {
+    for(size_t i = 0;i < n;++i) if(i < bitReverse[i]) std::swap(data[i], data[bitReverse[i]]);
+    for(size_t length = 2;length <= n;length <<= 1){
+        const size_t halfLength = length / 2, step = n / length;
+        for(size_t start = 0;start < n;start += length){
+            for(size_t k = 0;k < halfLength;++k){
+                std::complex<float> w = twiddles[k * step];
+                if(inverse) w = std::conj(w);
+                std::complex<float> a = data[start + k], b = multiply(data[start + k + halfLength], w);
+                data[start + k] = a + b;
+                data[start + k + halfLength] = a - b;
+            }
+        }
+    }
+}
+
+size_t FFTPlan::size() const {
+    return n;
+}
+
+RealFFTPlan::RealFFTPlan(size_t n):
+    n(std::max<size_t>(nextPowerOfTwo(n), 2)), half(this->n / 2) {
+    twiddles.resize(this->n / 2 + 1);
+    for(size_t k = 0;k < twiddles.size();++k) twiddles[k] = std::polar(1.0, -2.0 * M_PI * k / this->n);
+}
+
+void RealFFTPlan::forward(const float* in, std::complex<float>* out) const {
+    //Even samples as the real part and odd ones as the imaginary part, then untangle the two spectra
+    const size_t h = n / 2;
+    for(size_t k = 0;k < h;++k) out[k] = std::complex<float>(in[2 * k], in[2 * k + 1]);
+    half.transform(out, false);
+    const std::complex<float> z0 = out[0];
+    out[0] = std::complex<float>(z0.real() + z0.imag(), 0.0f);
+    out[h] = std::complex<float>(z0.real() - z0.imag(), 0.0f);
+    for(size_t k = 1;k <= h / 2;++k){
+        const std::complex<float> a = out[k], b = std::conj(out[h - k]);
+        const std::complex<float> even = 0.5f * (a + b), odd = 0.5f * std::complex<float>((a - b).imag(), -(a - b).real());
+        const std::complex<float> c = std::conj(a), d = out[h - k];
+        //Same for the mirrored bin h - k, whose twiddle is -conj(w_k)
+        const std::complex<float> evenMirror = 0.5f * (d + c), oddMirror = 0.5f * std::complex<float>((d - c).imag(), -(d - c).real());
+        out[k] = even + multiply(twiddles[k], odd);
+        out[h - k] = evenMirror + multiply(twiddles[h - k], oddMirror);
+    }
+}
+
+void RealFFTPlan::inverse(std::complex<float>* in, float* out) const {
+    const size_t h = n / 2;
+    //Rebuild the half-length spectrum Z = E + i O from X, the mirror of forward
+    const std::complex<float> x0 = in[0], xh = in[h];
+    for(size_t k = 1;k <= h / 2;++k){
+        const std::complex<float> a = in[k], b = std::conj(in[h - k]);
+        const std::complex<float> even = a + b, odd = multiply(a - b, std::conj(twiddles[k]));
+        const std::complex<float> c = in[h - k], d = std::conj(in[k]);
+        const std::complex<float> evenMirror = c + d, oddMirror = multiply(c - d, std::conj(twiddles[h - k]));
+        in[k] = even + std::complex<float>(-odd.imag(), odd.real());
+        in[h - k] = evenMirror + std::complex<float>(-oddMirror.imag(), oddMirror.real());
+    }
+    in[0] = std::complex<float>(x0.real() + xh.real(), x0.real() - xh.real());
+    half.transform(in, true);
+    for(size_t k = 0;k < h;++k){
+        out[2 * k] = in[k].real();
+        out[2 * k + 1] = in[k].imag();
+    }
+}
+
+size_t RealFFTPlan::size() const {
+    return n;
+}
\ No newline at end of file
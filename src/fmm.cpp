@@ -0,0 +1,436 @@
+#include "fmm.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "directgravity.hpp"
+
+namespace {
+    double secondsSince(std::chrono::steady_clock::time_point start){
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    
+    constexpr size_t maxTerms = (FastMultipole::maxOrder + 1) * (FastMultipole::maxOrder + 2) * (FastMultipole::maxOrder + 3) / 6;
+    //All levels of the kernel derivatives, the terms of degree up to maxOrder - m for every level m
+    constexpr size_t maxDerivatives = (FastMultipole::maxOrder + 1) * (FastMultipole::maxOrder + 2) * (FastMultipole::maxOrder + 3) * (FastMultipole::maxOrder + 4) / 24;
+    
+    //M2L translates the sources of a node in groups of m2lBatch, one source per lane, so that every entry of its tables is read
+    //once per group rather than once per source. The lanes are held as pairs, the width of SSE2: GCC splits a wider vector type
+    //up by itself, but then keeps the sums of the products in memory.
+    constexpr size_t m2lBatch = 8, m2lPairs = m2lBatch / 2;
+    typedef double M2LPair __attribute__((vector_size(2 * sizeof(double))));
+    struct M2LLanes {
+        M2LPair pair[m2lPairs];
+        
+        double& operator[](size_t lane){
+            return pair[lane / 2][lane % 2];
+        }
+    };
+}
+
+//Expansions are Taylor series in multi-indices n = (a, b, c) of the potential phi = -m / sqrt(r^2 + eps^2). A node's multipoles are
+//M_n = sum m (s - c)^n / n! about its centre c, its locals the derivatives d^n phi at its centre, which are the two pieces of
+//phi(t) = sum_n (-1)^|n| M_n D_n(t - c) with D_n the derivatives of the softened kernel.
+FastMultipole::FastMultipole(int order, float theta, size_t leafSize):
+    order(std::clamp(order, 0, maxOrder)), theta(theta > 0.0f ? theta : matchedTheta(order)), matchTheta(theta <= 0.0f), leafSize(std::max<size_t>(leafSize, 1)), buildSeconds(0.0), listSeconds(0.0), evaluateSeconds(0.0) {
+    buildTables();
+}
+
+void FastMultipole::computeAccelerations(const float* x, const float* y, const float* z, const float* m, size_t n, float softening, float* ax, float* ay, float* az, ThreadPool& pool){
+    if(n == 0) return;
+    auto startTime = std::chrono::steady_clock::now();
+    tree.build(x, y, z, m, n, leafSize, pool);
+    computeRadii(pool);
+    buildSeconds = secondsSince(startTime);
+    
+    startTime = std::chrono::steady_clock::now();
+    buildLists();
+    buildTaskGraph();
+    listSeconds = secondsSince(startTime);
+    
+    startTime = std::chrono::steady_clock::now();
+    const size_t nodeCount = tree.nodes.size();
+    multipoles.assign(nodeCount * termA.size(), 0.0);
+    locals.assign(nodeCount * termA.size(), 0.0);
+    sortedAccelerationX.resize(n);
+    sortedAccelerationY.resize(n);
+    sortedAccelerationZ.resize(n);
+    const float eps2 = std::max(softening * softening, 1e-20f);
+    pool.runTasks(graph, [&](size_t task){
+        const uint32_t i = task % nodeCount;
+        switch(task / nodeCount){
+            case 0: upward(i); break;
+            case 1: multipoleToLocal(i, eps2); break;
+            case 2: nearField(i, eps2); break;
+            default: downward(i); break;
+        }
+    });
+    pool.parallelFor(0, n, [&](size_t begin, size_t end){
+        for(size_t i = begin;i < end;++i){
+            uint32_t j = tree.order[i];
+            ax[j] = sortedAccelerationX[i];
+            ay[j] = sortedAccelerationY[i];
+            az[j] = sortedAccelerationZ[i];
+        }
+    });
+    evaluateSeconds = secondsSince(startTime);
+}
+
+void FastMultipole::setOrder(int newOrder){
+    order = std::clamp(newOrder, 0, maxOrder);
+    if(matchTheta) theta = matchedTheta(order);
+    buildTables();
+}
+
+int FastMultipole::getOrder() const {
+    return order;
+}
+
+float FastMultipole::matchedTheta(int order){
+    //Measured on the benchmark disk with leaves of 256, rms error 1e-3 or a little below from order 4 up
+    static constexpr float thetas[maxOrder + 1] = {0.3f, 0.3f, 0.3f, 0.3f, 0.4f, 0.55f, 0.65f, 0.75f, 0.8f, 0.85f, 0.9f};
+    return thetas[std::clamp(order, 0, maxOrder)];
+}
+
+void FastMultipole::setTheta(float newTheta){
+    matchTheta = newTheta <= 0.0f;
+    theta = matchTheta ? matchedTheta(order) : newTheta;
+}
+
+float FastMultipole::getTheta() const {
+    return theta;
+}
+
+double FastMultipole::getBuildSeconds() const {
+    return buildSeconds;
+}
+
+double FastMultipole::getListSeconds() const {
+    return listSeconds;
+}
+
+double FastMultipole::getEvaluateSeconds() const {
+    return evaluateSeconds;
+}
+
+size_t FastMultipole::getNodeCount() const {
+    return tree.nodes.size();
+}
+
+size_t FastMultipole::getM2LCount() const {
+    return m2lSource.size();
+}
+
+size_t FastMultipole::getP2PCount() const {
+    return p2pSource.size();
+}
+
+void FastMultipole::buildTables(){
+    const int side = order + 1;
+    termA.clear();
+    termB.clear();
+    termC.clear();
+    termIndex.assign(side * side * side, -1);
+    for(int degree = 0;degree <= order;++degree){
+        for(int a = degree;a >= 0;--a){
+            for(int b = degree - a;b >= 0;--b){
+                int c = degree - a - b;
+                termIndex[(a * side + b) * side + c] = termA.size();
+                termA.push_back(a);
+                termB.push_back(b);
+                termC.push_back(c);
+            }
+        }
+    }
+    const size_t terms = termA.size();
+    auto index = [&](int a, int b, int c){
+        return a < 0 || b < 0 || c < 0 || a + b + c > order ? -1 : termIndex[(a * side + b) * side + c];
+    };
+    lowerX.resize(terms);
+    lowerY.resize(terms);
+    lowerZ.resize(terms);
+    upperX.resize(terms);
+    upperY.resize(terms);
+    upperZ.resize(terms);
+    inverseFactorial.resize(terms);
+    for(size_t t = 0;t < terms;++t){
+        lowerX[t] = index(termA[t] - 1, termB[t], termC[t]);
+        lowerY[t] = index(termA[t], termB[t] - 1, termC[t]);
+        lowerZ[t] = index(termA[t], termB[t], termC[t] - 1);
+        upperX[t] = index(termA[t] + 1, termB[t], termC[t]);
+        upperY[t] = index(termA[t], termB[t] + 1, termC[t]);
+        upperZ[t] = index(termA[t], termB[t], termC[t] + 1);
+        double factorial = 1.0;
+        for(int k : {termA[t], termB[t], termC[t]}) for(int f = 2;f <= k;++f) factorial *= f;
+        inverseFactorial[t] = 1.0 / factorial;
+    }
+    
+    //M2M: M_n += M'_m d^(n - m) / (n - m)!, L2L: L_j += L_k d^(k - j) / (k - j)!, both with d the child centre minus the parent's.
+    //M2L: L_k += (-1)^|n| M_n D_(n + k) for |n| + |k| <= order, with the sign applied to the multipoles up front.
+    m2mTable.clear();
+    l2lTable.clear();
+    m2lTable.clear();
+    for(size_t n = 0;n < terms;++n){
+        for(size_t m = 0;m < terms;++m){
+            int difference = index(termA[n] - termA[m], termB[n] - termB[m], termC[n] - termC[m]);
+            if(difference < 0) continue;
+            m2mTable.push_back({uint16_t(n), uint16_t(m), uint16_t(difference)});
+            l2lTable.push_back({uint16_t(m), uint16_t(n), uint16_t(difference)});
+        }
+    }
+    raiseTable.assign(terms, {0, 0, 0, 0});
+    inverseRaise.assign(terms, 1.0);
+    for(size_t t = 1;t < terms;++t){
+        const uint16_t axis = termA[t] > 0 ? 0 : termB[t] > 0 ? 1 : 2;
+        const int* lowerAxis = axis == 0 ? lowerX.data() : axis == 1 ? lowerY.data() : lowerZ.data();
+        const uint16_t lower = lowerAxis[t];
+        const uint16_t count = (axis == 0 ? termA[t] : axis == 1 ? termB[t] : termC[t]) - 1;
+        raiseTable[t] = {axis, lower, uint16_t(count > 0 ? lowerAxis[lower] : 0), count};
+        inverseRaise[t] = 1.0 / (count + 1);
+    }
+    derivativeLevelStart.assign(1, 0);
+    for(int m = 0;m <= order;++m){
+        const int degree = order - m;
+        derivativeLevelStart.push_back(derivativeLevelStart.back() + (degree + 1) * (degree + 2) * (degree + 3) / 6);
+    }
+    
+    m2lRowStart.assign(1, 0);
+    for(size_t k = 0;k < terms;++k){
+        for(size_t n = 0;n < terms;++n){
+            int sum = index(termA[n] + termA[k], termB[n] + termB[k], termC[n] + termC[k]);
+            if(sum >= 0) m2lTable.push_back({uint16_t(k), uint16_t(n), uint16_t(sum)});
+        }
+        m2lRowStart.push_back(m2lTable.size());
+    }
+}
+
+void FastMultipole::monomials(double dx, double dy, double dz, double* out, size_t count) const {
+    //d^n / n! for the first count terms, each built from the one with a single lower index
+    const double d[3] = {dx, dy, dz};
+    out[0] = 1.0;
+    for(size_t t = 1;t < count;++t) out[t] = out[raiseTable[t].lower] * d[raiseTable[t].axis] * inverseRaise[t];
+}
+
+void FastMultipole::computeRadii(ThreadPool& pool){
+    radius.resize(tree.nodes.size());
+    for(size_t level = tree.levelStart.size() - 1;level-- > 0;){
+        pool.parallelFor(tree.levelStart[level], tree.levelStart[level + 1], 256, [&](size_t begin, size_t end){
+            for(size_t i = begin;i < end;++i){
+                const OctreeNode& node = tree.nodes[i];
+                float r2 = 0.0f;
+                if(node.childCount == 0){
+                    for(uint32_t k = node.begin;k < node.end;++k){
+                        float dx = tree.sortedX[k] - node.centreX, dy = tree.sortedY[k] - node.centreY, dz = tree.sortedZ[k] - node.centreZ;
+                        r2 = std::max(r2, dx * dx + dy * dy + dz * dz);
+                    }
+                    radius[i] = std::sqrt(r2);
+                }else{
+                    float r = 0.0f;
+                    for(uint32_t c = node.firstChild;c < node.firstChild + node.childCount;++c){
+                        const OctreeNode& child = tree.nodes[c];
+                        float dx = child.centreX - node.centreX, dy = child.centreY - node.centreY, dz = child.centreZ - node.centreZ;
+                        r = std::max(r, radius[c] + std::sqrt(dx * dx + dy * dy + dz * dz));
+                    }
+                    radius[i] = r;
+                }
+            }
+        });
+    }
+}
+
+void FastMultipole::buildLists(){
+    //Dual tree traversal: a pair of nodes interacts through M2L once (rTarget + rSource) / theta is below their distance, otherwise
+    //the larger one is split, down to pairs of leaves which interact directly
+    std::vector<std::pair<uint32_t, uint32_t>> m2lPairs, p2pPairs, stack = {{0, 0}};
+    const float invTheta2 = 1.0f / (theta * theta);
+    while(!stack.empty()){
+        auto [target, source] = stack.back();
+        stack.pop_back();
+        const OctreeNode& t = tree.nodes[target];
+        const OctreeNode& s = tree.nodes[source];
+        float dx = t.centreX - s.centreX, dy = t.centreY - s.centreY, dz = t.centreZ - s.centreZ;
+        float r = radius[target] + radius[source];
+        if(dx * dx + dy * dy + dz * dz > r * r * invTheta2) m2lPairs.emplace_back(target, source);
+        else if(t.childCount == 0 && s.childCount == 0) p2pPairs.emplace_back(target, source);
+        else if(s.childCount == 0 || (t.childCount != 0 && radius[target] >= radius[source])){
+            for(uint32_t c = t.firstChild;c < t.firstChild + t.childCount;++c) stack.emplace_back(c, source);
+        }else{
+            for(uint32_t c = s.firstChild;c < s.firstChild + s.childCount;++c) stack.emplace_back(target, c);
+        }
+    }
+    
+    //Counting sort of both pair lists by target into compressed rows
+    auto compress = [&](const std::vector<std::pair<uint32_t, uint32_t>>& pairs, std::vector<uint32_t>& start, std::vector<uint32_t>& sources){
+        start.assign(tree.nodes.size() + 1, 0);
+        for(const auto& pair : pairs) ++start[pair.first + 1];
+        for(size_t i = 0;i < tree.nodes.size();++i) start[i + 1] += start[i];
+        sources.resize(pairs.size());
+        std::vector<uint32_t> fill(start.begin(), start.end() - 1);
+        for(const auto& pair : pairs) sources[fill[pair.first]++] = pair.second;
+    };
+    compress(m2lPairs, m2lStart, m2lSource);
+    compress(p2pPairs, p2pStart, p2pSource);
+}
+
+void FastMultipole::buildTaskGraph(){
+    //Tasks [0, N) are the upward pass, [N, 2N) M2L, [2N, 3N) the near field and [3N, 4N) the downward pass of node i
+    const uint32_t nodeCount = tree.nodes.size();
+    const uint32_t up = 0, m2l = nodeCount, near = 2 * nodeCount, down = 3 * nodeCount;
+    std::vector<std::pair<uint32_t, uint32_t>> edges;
+    edges.reserve(m2lSource.size() + 4 * size_t(nodeCount));
+    for(uint32_t i = 0;i < nodeCount;++i){
+        const OctreeNode& node = tree.nodes[i];
+        for(uint32_t c = node.firstChild;c < node.firstChild + node.childCount;++c){
+            edges.emplace_back(up + c, up + i);
+            edges.emplace_back(down + i, down + c);
+        }
+        for(uint32_t k = m2lStart[i];k < m2lStart[i + 1];++k) edges.emplace_back(up + m2lSource[k], m2l + i);
+        edges.emplace_back(m2l + i, down + i);
+        edges.emplace_back(near + i, down + i);
+    }
+    
+    graph.dependencyCount.assign(4 * size_t(nodeCount), 0);
+    graph.dependentStart.assign(4 * size_t(nodeCount) + 1, 0);
+    for(const auto& edge : edges){
+        ++graph.dependencyCount[edge.second];
+        ++graph.dependentStart[edge.first + 1];
+    }
+    for(size_t i = 0;i < 4 * size_t(nodeCount);++i) graph.dependentStart[i + 1] += graph.dependentStart[i];
+    graph.dependents.resize(edges.size());
+    std::vector<uint32_t> fill(graph.dependentStart.begin(), graph.dependentStart.end() - 1);
+    for(const auto& edge : edges) graph.dependents[fill[edge.first]++] = edge.second;
+}
+
+void FastMultipole::upward(uint32_t i){
+    const size_t terms = termA.size();
+    const OctreeNode& node = tree.nodes[i];
+    double* target = multipoles.data() + i * terms;
+    double mono[maxTerms];
+    if(node.childCount == 0){
+        //P2M
+        for(uint32_t k = node.begin;k < node.end;++k){
+            monomials(double(tree.sortedX[k]) - node.centreX, double(tree.sortedY[k]) - node.centreY, double(tree.sortedZ[k]) - node.centreZ, mono, terms);
+            const double m = tree.sortedMass[k];
+            for(size_t t = 0;t < terms;++t) target[t] += m * mono[t];
+        }
+        return;
+    }
+    //M2M
+    for(uint32_t c = node.firstChild;c < node.firstChild + node.childCount;++c){
+        const OctreeNode& child = tree.nodes[c];
+        const double* source = multipoles.data() + c * terms;
+        monomials(double(child.centreX) - node.centreX, double(child.centreY) - node.centreY, double(child.centreZ) - node.centreZ, mono, terms);
+        for(const Product& p : m2mTable) target[p.target] += source[p.leftTerm] * mono[p.rightTerm];
+    }
+}
+
+void FastMultipole::multipoleToLocal(uint32_t i, float eps2){
+    const size_t terms = termA.size();
+    const OctreeNode& node = tree.nodes[i];
+    double* target = locals.data() + i * terms;
+    //derivative[derivativeLevelStart[m] + t] is d^t of f^(m)(r^2 / 2), with f(u) = -(2u + eps^2)^(-1/2). Raising one index follows
+    //R^(m)_(n + x) = n_x R^(m + 1)_(n - x) + x R^(m + 1)_n, so level m is only needed up to degree order - m.
+    M2LLanes derivative[maxDerivatives], signedSource[maxTerms], sum[maxTerms];
+    for(size_t k = 0;k < terms;++k) sum[k] = M2LLanes{};
+    for(uint32_t s = m2lStart[i];s < m2lStart[i + 1];s += m2lBatch){
+        M2LLanes dx, dy, dz, invQ2, f;
+        for(size_t l = 0;l < m2lBatch;++l){
+            if(s + l < m2lStart[i + 1]){
+                const uint32_t sourceNode = m2lSource[s + l];
+                const OctreeNode& other = tree.nodes[sourceNode];
+                const double* source = multipoles.data() + sourceNode * terms;
+                dx[l] = double(node.centreX) - other.centreX;
+                dy[l] = double(node.centreY) - other.centreY;
+                dz[l] = double(node.centreZ) - other.centreZ;
+                for(size_t t = 0;t < terms;++t) signedSource[t][l] = ((termA[t] + termB[t] + termC[t]) & 1) ? -source[t] : source[t];
+            }else{
+                //Spare lanes of the last group translate nothing from a unit distance away
+                dx[l] = 1.0;
+                dy[l] = 0.0;
+                dz[l] = 0.0;
+                for(size_t t = 0;t < terms;++t) signedSource[t][l] = 0.0;
+            }
+            invQ2[l] = 1.0 / (dx[l] * dx[l] + dy[l] * dy[l] + dz[l] * dz[l] + eps2);
+            f[l] = -std::sqrt(invQ2[l]);
+        }
+        for(int m = 0;m <= order;++m){
+            derivative[derivativeLevelStart[m]] = f;
+            for(size_t p = 0;p < m2lPairs;++p) f.pair[p] *= -(2 * m + 1) * invQ2.pair[p];
+        }
+        for(size_t t = 1;t < terms;++t){
+            const Raise& r = raiseTable[t];
+            const M2LLanes& coordinate = r.axis == 0 ? dx : r.axis == 1 ? dy : dz;
+            const int degree = termA[t] + termB[t] + termC[t];
+            for(int m = 0;m <= order - degree;++m){
+                const M2LLanes* above = derivative + derivativeLevelStart[m + 1];
+                M2LLanes& value = derivative[derivativeLevelStart[m] + t];
+                for(size_t p = 0;p < m2lPairs;++p) value.pair[p] = coordinate.pair[p] * above[r.lower].pair[p] + double(r.count) * above[r.lower2].pair[p];
+            }
+        }
+        //One row per local term keeps the sums in registers
+        for(size_t k = 0;k < terms;++k){
+            M2LPair row[m2lPairs];
+            for(size_t p = 0;p < m2lPairs;++p) row[p] = sum[k].pair[p];
+            for(uint32_t e = m2lRowStart[k];e < m2lRowStart[k + 1];++e){
+                const M2LLanes& left = signedSource[m2lTable[e].leftTerm];
+                const M2LLanes& right = derivative[m2lTable[e].rightTerm];
+                for(size_t p = 0;p < m2lPairs;++p) row[p] += left.pair[p] * right.pair[p];
+            }
+            for(size_t p = 0;p < m2lPairs;++p) sum[k].pair[p] = row[p];
+        }
+    }
+    for(size_t k = 0;k < terms;++k){
+        for(size_t l = 0;l < m2lBatch;++l) target[k] += sum[k][l];
+    }
+}
+
+void FastMultipole::nearField(uint32_t i, float eps2){
+    const OctreeNode& node = tree.nodes[i];
+    if(node.childCount != 0) return;
+    std::fill(sortedAccelerationX.begin() + node.begin, sortedAccelerationX.begin() + node.end, 0.0f);
+    std::fill(sortedAccelerationY.begin() + node.begin, sortedAccelerationY.begin() + node.end, 0.0f);
+    std::fill(sortedAccelerationZ.begin() + node.begin, sortedAccelerationZ.begin() + node.end, 0.0f);
+    for(uint32_t s = p2pStart[i];s < p2pStart[i + 1];++s){
+        const OctreeNode& source = tree.nodes[p2pSource[s]];
+        directTile(tree.sortedX.data(), tree.sortedY.data(), tree.sortedZ.data(), node.begin, node.end, tree.sortedX.data() + source.begin, tree.sortedY.data() + source.begin, tree.sortedZ.data() + source.begin, tree.sortedMass.data() + source.begin, source.end - source.begin, eps2, sortedAccelerationX.data(), sortedAccelerationY.data(), sortedAccelerationZ.data());
+    }
+}
+
+void FastMultipole::downward(uint32_t i){
+    const size_t terms = termA.size();
+    const OctreeNode& node = tree.nodes[i];
+    double* target = locals.data() + i * terms;
+    double mono[maxTerms];
+    if(i != 0){
+        //L2L from the parent, which is complete since its downward task ran first
+        const OctreeNode& parent = tree.nodes[node.parent];
+        const double* source = locals.data() + node.parent * terms;
+        monomials(double(node.centreX) - parent.centreX, double(node.centreY) - parent.centreY, double(node.centreZ) - parent.centreZ, mono, terms);
+        for(const Product& p : l2lTable) target[p.target] += source[p.leftTerm] * mono[p.rightTerm];
+    }
+    if(node.childCount != 0) return;
+    
+    //L2P: the acceleration is minus the gradient, d/dx sum_k L_k y^k / k! = sum_u L_(u + x) y^u / u!, so three dot products with
+    //the monomials one degree short of the order
+    if(order == 0) return;
+    const size_t lowerTerms = order * (order + 1) * (order + 2) / 6;
+    double gradientX[maxTerms], gradientY[maxTerms], gradientZ[maxTerms];
+    for(size_t u = 0;u < lowerTerms;++u){
+        gradientX[u] = target[upperX[u]];
+        gradientY[u] = target[upperY[u]];
+        gradientZ[u] = target[upperZ[u]];
+    }
+    for(uint32_t k = node.begin;k < node.end;++k){
+        monomials(double(tree.sortedX[k]) - node.centreX, double(tree.sortedY[k]) - node.centreY, double(tree.sortedZ[k]) - node.centreZ, mono, lowerTerms);
+        double gradX = 0.0, gradY = 0.0, gradZ = 0.0;
+        for(size_t u = 0;u < lowerTerms;++u){
+            gradX += gradientX[u] * mono[u];
+            gradY += gradientY[u] * mono[u];
+            gradZ += gradientZ[u] * mono[u];
+        }
+        sortedAccelerationX[k] -= gradX;
+        sortedAccelerationY[k] -= gradY;
+        sortedAccelerationZ[k] -= gradZ;
+    }
+}
\ No newline at end of file
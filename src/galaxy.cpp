@@ -1,21 +1,39 @@
 #include "galaxy.hpp"
 
+#include <algorithm>
 #include <iostream>
+#include <numeric>
 
-Galaxy::Galaxy(size_t n, size_t nCloud, float hr, float hz, float gmMin, float gmMax, float dt, int seed, int screenWidth, int screenHeight):
-    n(n), nCloud(nCloud), hr(hr), hz(hz), totalMass(0.0f), dt(dt), salpeterA(pow(gmMin, -1.35f)), salpeterB(salpeterA - pow(gmMax, -1.35f)), salpeterC(-1.0f / 1.35f),
-    randomEngine(std::default_random_engine()), distribution(std::uniform_real_distribution<float>(0, 1)) {
+#include "threadpool.hpp"
+#include "directgravity.hpp"
+#include "colourtable.hpp"
+#include "fastmath.hpp"
+#include "iccache.hpp"
+
+Galaxy::Galaxy(size_t n, size_t nCloud, float hr, float hz, float gmMin, float gmMax, float dt, int seed):
+    headless(true), backend(Backend::CPU), gravity(Gravity::Analytic), n(n), nCloud(nCloud), initialN(n), initialNCloud(nCloud), hr(hr), hz(hz), totalMass(0.0f), dt(dt), softening(hz / 4.0f), salpeterA(pow(gmMin, -1.35f)), salpeterB(salpeterA - pow(gmMax, -1.35f)), salpeterC(-1.0f / 1.35f),
+    hydro(false), cellListCurrent(false), reorderInterval(0), stepsSinceReorder(0), escapeRadius(0.0f), compactionInterval(64), stepsSinceCompaction(0), commandsPending(false), nextParticleId(0), starFormationRate(0.0f), simulationTime(0.0), evolvedLastStep(0), evolutionUploads(0), integrator(Integrator::PositionVerlet), precision(Precision::Float), preciseLoaded(false), bulgeGM(0.0f), bulgeA(1.0f), haloGM(0.0f), haloRs(1.0f), maxLevel(0), timestepAccuracy(0.02f), activeSteps(0), computeProgram(0), tableTexture(0), seed(seed), resetRunning(false), resetGenerated(false), resetCancelled(false), resetProgress(0), resetCount(0), resetUploaded(0), resetTotalMass(0.0f), resetBuffers{}, resetBufferCapacity(0) {
     
-    srand(seed);
-    randomEngine.seed(seed);
+    formationEngine.seed(seed);
     
     currentPosition = std::vector<glm::vec4>(n + nCloud, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
     previousPosition = std::vector<glm::vec4>(n + nCloud, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
-    colour = std::vector<glm::vec4>(n + nCloud, glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
     mass = std::vector<float>(n + nCloud, 1.0f);
     luminosity = std::vector<float>(n + nCloud, 1.0f);
     temperature = std::vector<float>(n + nCloud, 6000.0f);
+    particles.resize(n + nCloud);
+    particleId = std::vector<uint32_t>(n + nCloud, 0);
+    fate = std::vector<uint8_t>(n + nCloud, Keep);
+    level = std::vector<uint8_t>(n + nCloud, 0);
+}
+
+Galaxy::Galaxy(size_t n, size_t nCloud, float hr, float hz, float gmMin, float gmMax, float dt, int seed, int screenWidth, int screenHeight, Backend backend):
+    Galaxy(n, nCloud, hr, hz, gmMin, gmMax, dt, seed) {
     
+    headless = false;
+    this->backend = backend;
+    
+    //Created with room for every particle, the first reset() fills them
     glGenBuffers(1, &currentPositionBuffer);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, currentPositionBuffer);
     glBufferData(GL_SHADER_STORAGE_BUFFER, currentPosition.size() * sizeof(glm::vec4), currentPosition.data(), GL_STATIC_DRAW);
@@ -32,16 +50,24 @@ Galaxy::Galaxy(size_t n, size_t nCloud, float hr, float hz, float gmMin, float g
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, luminosityBuffer);
     glBufferData(GL_SHADER_STORAGE_BUFFER, luminosity.size() * sizeof(float), luminosity.data(), GL_STATIC_DRAW);
     
-    glGenBuffers(1, &colourBuffer);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, colourBuffer);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, colour.size() * sizeof(glm::vec4), colour.data(), GL_STATIC_DRAW);
+    //shader.vert looks the colour up from the temperature, a quarter of the bytes of the colour itself
+    glGenBuffers(1, &temperatureBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, temperatureBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, temperature.size() * sizeof(float), temperature.data(), GL_STATIC_DRAW);
+    
+    glGenTextures(1, &colourTexture);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_1D, colourTexture);
+    glTexImage1D(GL_TEXTURE_1D, 0, GL_RGBA32F, colourTable::size, 0, GL_RGBA, GL_FLOAT, colourTable::table.data());
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glActiveTexture(GL_TEXTURE0);
     
     glGenBuffers(1, &vertexScreenBuffer);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, vertexScreenBuffer);
     glBufferData(GL_SHADER_STORAGE_BUFFER, 24 * sizeof(float), vertexScreen, GL_STATIC_DRAW);
     
-    reset();
-    
     const char* hGaussShaderFiles[2] = {"shaders/gauss.vert", "shaders/hgauss.frag"};
     const GLuint hGaussShaderTypes[2] = {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER};
     hGaussProgram = loadProgram(2, hGaussShaderFiles, hGaussShaderTypes);
@@ -55,17 +81,7 @@ Galaxy::Galaxy(size_t n, size_t nCloud, float hr, float hz, float gmMin, float g
         std::cerr << "Could not create vGauss program" << std::endl;
     }
     
-    const char* computeShaderFiles[1] = {"shaders/verlet.comp"};
-    const GLuint computeShaderTypes[1] = {GL_COMPUTE_SHADER};
-    computeProgram = loadProgram(1, computeShaderFiles, computeShaderTypes);
-    if(computeProgram == 0){
-        std::cerr << "Could not create compute program" << std::endl;
-    }
-    nId = glGetUniformLocation(computeProgram, "n");
-    totalGMId = glGetUniformLocation(computeProgram, "totalGM");
-    dtId = glGetUniformLocation(computeProgram, "dt");
-    hrId = glGetUniformLocation(computeProgram, "hr");
-    hzId = glGetUniformLocation(computeProgram, "hz");
+    loadComputeProgram();
     
     glGenFramebuffers(2, framebuffers);
     glActiveTexture(GL_TEXTURE0);
@@ -102,14 +118,52 @@ Galaxy::Galaxy(size_t n, size_t nCloud, float hr, float hz, float gmMin, float g
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
-void Galaxy::integrate(){
-    if(computeProgram != 0){
+Galaxy::~Galaxy(){
+    cancelReset();
+}
+
+void Galaxy::integrate(size_t steps){
+    if(steps == 0) return;
+    if(starFormationRate > 0.0f) formStars(steps);
+    if(commandsPending || !spawns.empty()) applyCommands();
+    cellListCurrent = false;
+    stepsSinceReorder += steps;
+    //Every other path moves the float arrays directly, which the precise positions have to be reloaded from afterwards
+    if(precision == Precision::Float || maxLevel > 0 || integrator != Integrator::PositionVerlet) preciseLoaded = false;
+    if(backend == Backend::CPU && maxLevel > 0){
+        for(size_t s = 0;s < steps;++s) integrateBlocks();
+        if(!headless) uploadPositions();
+    }else if(backend == Backend::CPU && precision != Precision::Float && integrator == Integrator::PositionVerlet){
+        integratePrecise(steps);
+        if(!headless) uploadPositions();
+    }else if(backend == Backend::CPU){
+        switch(integrator){
+            case Integrator::LeapfrogKDK: integrateCPU<LeapfrogKDK>(steps); break;
+            case Integrator::VelocityVerlet: integrateCPU<VelocityVerlet>(steps); break;
+            case Integrator::ForestRuth: integrateCPU<ForestRuth>(steps); break;
+            default: integrateVerlet(steps); break;
+        }
+        if(!headless) uploadPositions();
+    }else if(computeProgram != 0){
+        //Every particle only feels the fixed potential, so the whole batch is one dispatch
         glUseProgram(computeProgram);
         glUniform1i(nId, n + nCloud);
+        glUniform1i(stepsId, steps);
         glUniform1f(totalGMId, totalMass);
         glUniform1f(dtId, dt);
         glUniform1f(hrId, hr);
         glUniform1f(hzId, hz);
+        if(!potentialTable.empty()){
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, tableTexture);
+            glUniform1i(tableId, 1);
+            glActiveTexture(GL_TEXTURE0);
+        }
+        if(hasHaloOrBulge()){
+            float parameters[GalaxyPotential::parameterCount];
+            galaxyPotential(totalMass).parameters(parameters);
+            glUniform1fv(potentialId, GalaxyPotential::parameterCount, parameters);
+        }
         glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, currentPositionBuffer);
         glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, previousPositionBuffer);
         
@@ -119,6 +173,139 @@ void Galaxy::integrate(){
         
         std::swap(currentPositionBuffer, previousPositionBuffer);
     }
+    simulationTime += steps * static_cast<double>(dt);
+    if(evolution.enabled()) evolveStars();
+    stepsSinceCompaction += steps;
+    if(escapeRadius > 0.0f && stepsSinceCompaction >= compactionInterval) compact();
+    if(reorderInterval > 0 && stepsSinceReorder >= reorderInterval) reorder();
+}
+
+void Galaxy::integrateVerlet(size_t steps){
+    //The pressure couples the cloud particles, so with it on every step goes through the stored accelerations
+    const bool analytic = gravity == Gravity::Analytic && !hydro;
+    if(analytic && hasHaloOrBulge()){
+        const GalaxyPotential potential = galaxyPotential(totalMass);
+        ThreadPool::global().parallelFor(0, n + nCloud, [&](size_t begin, size_t end){
+            potentialSteps(particles, begin, end, potential, dt, steps);
+        });
+        return;
+    }
+    //The potential table is left to verlet.comp, the exps of the SIMD kernels are faster than its lookups here
+    if(analytic && steps > 1){
+        //Every particle moves on its own here, so each one runs all steps in registers and is written back once
+        ThreadPool::global().parallelFor(0, n + nCloud, [&](size_t begin, size_t end){
+            verletSteps(particles, begin, end, totalMass, hr, hz, dt, steps);
+        });
+        return;
+    }
+    for(size_t s = 0;s < steps;++s){
+        if(analytic){
+            ThreadPool::global().parallelFor(0, n + nCloud, [&](size_t begin, size_t end){
+                verletStep(particles, begin, end, totalMass, hr, hz, dt);
+            });
+        }else{
+            computeAccelerations(particles.x.data(), particles.y.data(), particles.z.data());
+            if(hydro) hydroAccelerations(true);
+            ThreadPool::global().parallelFor(0, n + nCloud, [&](size_t begin, size_t end){
+                verletStep(particles, begin, end, accelerationX.data(), accelerationY.data(), accelerationZ.data(), dt);
+            });
+        }
+        particles.swap();
+    }
+}
+
+void Galaxy::integratePrecise(size_t steps){
+    if(!preciseLoaded){
+        precise.load(particles, precision);
+        preciseLoaded = true;
+    }
+    ThreadPool& pool = ThreadPool::global();
+    if(gravity == Gravity::Analytic && !hasHaloOrBulge() && !hydro){
+        pool.parallelFor(0, n + nCloud, [&](size_t begin, size_t end){
+            preciseSteps(precise, begin, end, totalMass, hr, hz, dt, steps);
+            precise.store(particles, begin, end);
+        });
+        return;
+    }
+    //The solvers and the potential only need float positions, so they read the rounded view
+    for(size_t s = 0;s < steps;++s){
+        computeAccelerations(particles.x.data(), particles.y.data(), particles.z.data());
+        if(hydro) hydroAccelerations(true);
+        pool.parallelFor(0, n + nCloud, [&](size_t begin, size_t end){
+            preciseStep(precise, begin, end, accelerationX.data(), accelerationY.data(), accelerationZ.data(), dt);
+            precise.store(particles, begin, end);
+        });
+    }
+}
+
+template<class Scheme> void Galaxy::integrateCPU(size_t steps){
+    const size_t count = n + nCloud;
+    ThreadPool& pool = ThreadPool::global();
+    const bool analytic = gravity == Gravity::Analytic && !hydro;
+    if(analytic && hasHaloOrBulge()){
+        const GalaxyPotential potential = galaxyPotential(totalMass);
+        pool.parallelFor(0, count, [&](size_t begin, size_t end){
+            integratePotential<Scheme>(particles, begin, end, potential, dt, steps);
+        });
+        return;
+    }
+    if(analytic){
+        pool.parallelFor(0, count, [&](size_t begin, size_t end){
+            integrateDisk<Scheme>(particles, begin, end, totalMass, hr, hz, dt, steps);
+        });
+        return;
+    }
+    
+    //Every force evaluation needs all positions (or the neighbours' velocities), so the stages run over the whole arrays
+    struct SelfGravitySystem {
+        Galaxy& g;
+        
+        void kick(float h){
+            ThreadPool::global().parallelFor(0, g.n + g.nCloud, [&](size_t begin, size_t end){
+                for(size_t i = begin;i < end;++i){
+                    g.velocityX[i] += h * g.accelerationX[i];
+                    g.velocityY[i] += h * g.accelerationY[i];
+                    g.velocityZ[i] += h * g.accelerationZ[i];
+                }
+            });
+        }
+        void drift(float h, float h2){
+            ThreadPool::global().parallelFor(0, g.n + g.nCloud, [&](size_t begin, size_t end){
+                for(size_t i = begin;i < end;++i){
+                    g.particles.x[i] += h * g.velocityX[i] + h2 * g.accelerationX[i];
+                    g.particles.y[i] += h * g.velocityY[i] + h2 * g.accelerationY[i];
+                    g.particles.z[i] += h * g.velocityZ[i] + h2 * g.accelerationZ[i];
+                }
+            });
+        }
+        void forces(){
+            g.computeAccelerations(g.particles.x.data(), g.particles.y.data(), g.particles.z.data());
+            if(g.hydro) g.hydroAccelerations(false);
+        }
+    };
+    
+    if(velocityX.size() != count){
+        velocityX.resize(count);
+        velocityY.resize(count);
+        velocityZ.resize(count);
+    }
+    const float invDt = 1.0f / dt;
+    pool.parallelFor(0, count, [&](size_t begin, size_t end){
+        for(size_t i = begin;i < end;++i){
+            velocityX[i] = (particles.x[i] - particles.prevX[i]) * invDt;
+            velocityY[i] = (particles.y[i] - particles.prevY[i]) * invDt;
+            velocityZ[i] = (particles.z[i] - particles.prevZ[i]) * invDt;
+        }
+    });
+    SelfGravitySystem system{*this};
+    runSteps<Scheme>(system, dt, steps);
+    pool.parallelFor(0, count, [&](size_t begin, size_t end){
+        for(size_t i = begin;i < end;++i){
+            particles.prevX[i] = particles.x[i] - velocityX[i] * dt;
+            particles.prevY[i] = particles.y[i] - velocityY[i] * dt;
+            particles.prevZ[i] = particles.z[i] - velocityZ[i] * dt;
+        }
+    });
 }
 
 void Galaxy::draw(){
@@ -133,11 +320,14 @@ void Galaxy::draw(){
     glBindBuffer(GL_ARRAY_BUFFER, currentPositionBuffer);
     glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, (void*) 0);
     glEnableVertexAttribArray(1);
-    glBindBuffer(GL_ARRAY_BUFFER, colourBuffer);
-    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 0, (void*) 0);
+    glBindBuffer(GL_ARRAY_BUFFER, temperatureBuffer);
+    glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, 0, (void*) 0);
     glEnableVertexAttribArray(2);
     glBindBuffer(GL_ARRAY_BUFFER, luminosityBuffer);
-    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, 0, (void*) 0);
+    glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, 0, (void*) 0);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_1D, colourTexture);
+    glActiveTexture(GL_TEXTURE0);
     glDrawArrays(GL_POINTS, 0, n + nCloud);
     glDisableVertexAttribArray(0);
     glDisableVertexAttribArray(1);
@@ -168,50 +358,1133 @@ void Galaxy::draw(){
     glDisableVertexAttribArray(0);
 }
 
+//The initial conditions are random draws, for which 1e-5 relative is far below the scatter, and the disk's orbital speeds
+//agree with those of verlet.comp to the same
+constexpr fastmath::Accuracy initialConditionsAccuracy = fastmath::Accuracy::Balanced;
+//Part of the key of the initial conditions cache, to be bumped whenever generateInitialConditions() changes its output
+constexpr uint64_t initialConditionsVersion = 3;
+//Particles per parallelFor of a reset, so that a background one holds the pool for a few milliseconds at a time, and per frame
+//of its upload
+constexpr size_t resetSlice = 1 << 20, resetUploadSlice = 1 << 18;
+
 void Galaxy::reset(){
-    totalMass = 0.0f;
-    for(size_t i = 0;i < n + nCloud;++i){
-        glm::vec4& pos = currentPosition[i];
-        glm::vec4& prevPos = previousPosition[i];
-        
-        float dr = distribution(randomEngine);
-        float dz = distribution(randomEngine);
-        float phi = 2 * M_PI * distribution(randomEngine);
-        float r = -hr * log(1 - dr);
-        pos.x = r * cos(phi);
-        pos.y = r * sin(phi);
-        if(dz <= 0.5f) pos.z = -hz * log(1 - 2 * dz);
-        else pos.z = hz * log(2 * dz - 1);
-        
-        float& m = mass[i];
-        m = pow(salpeterA - salpeterB * distribution(randomEngine), salpeterC);
-        totalMass += m;
-        luminosity[i] = luminosityFromMass(m);
-        temperature[i] = temperatureFromMass(m);
-        colourFromTemperature(temperature[i], colour[i]);
-        
-        float r2 = sqrt(pos.x * pos.x + pos.y * pos.y + pos.z * pos.z);
-        float rProj = sqrt(pos.x * pos.x + pos.y * pos.y);
-        float cosTheta = pos.x * pos.x / r2 / rProj + pos.y * pos.y / r2 / rProj;
-        float vTot = sqrt(totalMass * (1 - exp(-rProj / hr)) * (1 - exp(-abs(pos.z) / hz)) / r2);
-        float vProj = vTot * cosTheta;
-        prevPos.x = pos.x - vProj * pos.y / rProj * dt;
-        prevPos.y = pos.y + vProj * pos.x / rProj * dt;
-        prevPos.z = pos.z - ((pos.z > 0) - (pos.z < 0)) * vTot * sqrt(1 - cosTheta * cosTheta) * dt;
+    cancelReset();
+    n = initialN;
+    nCloud = initialNCloud;
+    const size_t count = n + nCloud;
+    const InitialConditionsKey key = initialConditionsKey();
+    MappedInitialConditions cached = InitialConditionsCache::global().load(key);
+    //The GPU backend steps and draws from the buffers alone, so a hit goes up straight from the mapped file and the CPU arrays
+    //wait for loadArrays(). The evolution recolours the stars from the masses right away, so it needs them now.
+    pendingConditions = MappedInitialConditions();
+    if(cached && !headless && backend == Backend::GPU && !evolution.enabled()){
+        pendingConditions = std::move(cached);
+        totalMass = pendingConditions.totalMass();
+    }else{
+        loadInitialConditions(key, cached, {currentPosition.data(), previousPosition.data(), mass.data(), luminosity.data(), temperature.data()}, totalMass);
+    }
+    restartSimulation();
+    if(headless) return;
+    
+    const bool pending = static_cast<bool>(pendingConditions);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, currentPositionBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, count * sizeof(glm::vec4), pending ? pendingConditions.currentPosition() : currentPosition.data());
+    
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, previousPositionBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, count * sizeof(glm::vec4), pending ? pendingConditions.previousPosition() : previousPosition.data());
+    
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, massBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, count * sizeof(float), pending ? pendingConditions.mass() : mass.data());
+    
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, temperatureBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, count * sizeof(float), pending ? pendingConditions.temperature() : temperature.data());
+    
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, luminosityBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, count * sizeof(float), pending ? pendingConditions.luminosity() : luminosity.data());
+}
+
+void Galaxy::startReset(){
+    if(resetRunning) return;
+    resetRunning = true;
+    resetGenerated = false;
+    resetCancelled = false;
+    resetProgress = 0;
+    resetCount = initialN + initialNCloud;
+    resetUploaded = 0;
+    const InitialConditionsKey key = initialConditionsKey();
+    //The spare set matches the capacity at the start, updateReset() grows it with the rest if spawns outgrow that meanwhile
+    const size_t capacity = mass.size();
+    if(!headless && resetBufferCapacity != capacity){
+        if(resetBufferCapacity > 0) glDeleteBuffers(5, resetBuffers);
+        glGenBuffers(5, resetBuffers);
+        for(int b = 0;b < 5;++b){
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, resetBuffers[b]);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * (b < 2 ? sizeof(glm::vec4) : sizeof(float)), NULL, GL_STATIC_DRAW);
+        }
+        resetBufferCapacity = capacity;
+    }
+    resetThread = std::thread([this, key, capacity](){
+        resetCurrentPosition.resize(capacity, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+        resetPreviousPosition.resize(capacity, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+        resetMass.resize(capacity, 1.0f);
+        resetLuminosity.resize(capacity, 1.0f);
+        resetTemperature.resize(capacity, 6000.0f);
+        loadInitialConditions(key, InitialConditionsCache::global().load(key), {resetCurrentPosition.data(), resetPreviousPosition.data(), resetMass.data(), resetLuminosity.data(), resetTemperature.data()}, resetTotalMass);
+        resetGenerated.store(true, std::memory_order_release);
+    });
+}
+
+void Galaxy::updateReset(){
+    if(!resetRunning || !resetGenerated.load(std::memory_order_acquire)) return;
+    waitForResetThread();
+    if(!headless && resetUploaded < resetCount){
+        //A slice per frame, so that no frame waits on the whole upload
+        const size_t begin = resetUploaded, end = std::min(resetCount, begin + resetUploadSlice);
+        const void* arrays[5] = {resetCurrentPosition.data(), resetPreviousPosition.data(), resetMass.data(), resetLuminosity.data(), resetTemperature.data()};
+        for(int b = 0;b < 5;++b){
+            const size_t size = b < 2 ? sizeof(glm::vec4) : sizeof(float);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, resetBuffers[b]);
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, begin * size, (end - begin) * size, static_cast<const char*>(arrays[b]) + begin * size);
+        }
+        resetProgress += end - begin;
+        resetUploaded = end;
+        if(resetUploaded < resetCount) return;
+    }
+    
+    //The swap: the old particles become the spare set of the next background reset
+    const size_t capacity = mass.size();
+    pendingConditions = MappedInitialConditions();
+    currentPosition.swap(resetCurrentPosition);
+    previousPosition.swap(resetPreviousPosition);
+    mass.swap(resetMass);
+    luminosity.swap(resetLuminosity);
+    temperature.swap(resetTemperature);
+    if(!headless){
+        std::swap(currentPositionBuffer, resetBuffers[0]);
+        std::swap(previousPositionBuffer, resetBuffers[1]);
+        std::swap(massBuffer, resetBuffers[2]);
+        std::swap(luminosityBuffer, resetBuffers[3]);
+        std::swap(temperatureBuffer, resetBuffers[4]);
+        resetBufferCapacity = capacity;
+    }
+    resetRunning = false;
+    n = initialN;
+    nCloud = initialNCloud;
+    totalMass = resetTotalMass;
+    //Back to the capacity of the other arrays, should spawns have grown them since the start
+    reserveParticles(capacity);
+    restartSimulation();
+    if(!headless && evolution.enabled()) uploadAttributes(0, n);
+}
+
+bool Galaxy::resetPending() const {
+    return resetRunning;
+}
+
+float Galaxy::getResetProgress() const {
+    if(!resetRunning) return 1.0f;
+    //Both passes of the generation, or the copy from the cache, count twice the particles, the upload once
+    return static_cast<float>(resetProgress.load()) / ((headless ? 2 : 3) * std::max<size_t>(resetCount, 1));
+}
+
+void Galaxy::waitForResetThread(){
+    if(resetThread.joinable()) resetThread.join();
+}
+
+void Galaxy::cancelReset(){
+    if(!resetRunning) return;
+    resetCancelled = true;
+    waitForResetThread();
+    resetRunning = false;
+    //Cleared again for the reset() that follows, which reads it too
+    resetCancelled = false;
+}
+
+void Galaxy::loadInitialConditions(const InitialConditionsKey& key, const MappedInitialConditions& cached, const InitialConditions& conditions, float& total){
+    const size_t count = key.n + key.nCloud;
+    //The same settings always give the same particles, so they can come from an earlier reset or run
+    if(cached){
+        for(size_t slice = 0;slice < count && !resetCancelled;slice += resetSlice){
+            const size_t sliceEnd = std::min(count, slice + resetSlice);
+            ThreadPool::global().parallelFor(slice, sliceEnd, [&](size_t begin, size_t end){
+                std::copy(cached.currentPosition() + begin, cached.currentPosition() + end, conditions.currentPosition + begin);
+                std::copy(cached.previousPosition() + begin, cached.previousPosition() + end, conditions.previousPosition + begin);
+                std::copy(cached.mass() + begin, cached.mass() + end, conditions.mass + begin);
+                std::copy(cached.luminosity() + begin, cached.luminosity() + end, conditions.luminosity + begin);
+                std::copy(cached.temperature() + begin, cached.temperature() + end, conditions.temperature + begin);
+            });
+            resetProgress += 2 * (sliceEnd - slice);
+        }
+        total = cached.totalMass();
+    }else{
+        total = generateInitialConditions(key, conditions);
+        if(!resetCancelled) InitialConditionsCache::global().store(key, count, total, conditions.currentPosition, conditions.previousPosition, conditions.mass, conditions.luminosity, conditions.temperature);
+    }
+}
+
+float Galaxy::generateInitialConditions(const InitialConditionsKey& key, const InitialConditions& conditions){
+    const size_t count = key.n + key.nCloud;
+    float* mass = conditions.mass;
+    ThreadPool& pool = ThreadPool::global();
+    
+    //Particle i draws its four numbers from (seed, i) with the counter-based generator, so it needs nothing from the particles
+    //before it, and every reset of a seed gives the same galaxy
+    const std::array<uint32_t, 2> generatorKey = {static_cast<uint32_t>(key.seed), 0};
+    
+    //The velocities are those of circular orbits in the potential of the whole disk, which the integrators use too, so the masses
+    //and their total come first. The total sums blocks of a fixed size, then the block totals in order, so the rounding is the
+    //same whatever the thread count.
+    constexpr size_t massBlock = 4096;
+    const size_t blocks = (count + massBlock - 1) / massBlock;
+    std::vector<double> blockMass(blocks, 0.0);
+    constexpr size_t sliceBlocks = resetSlice / massBlock;
+    for(size_t slice = 0;slice < blocks;slice += sliceBlocks){
+        if(resetCancelled) return 0.0f;
+        pool.parallelFor(slice, std::min(blocks, slice + sliceBlocks), 1, [&](size_t blockBegin, size_t blockEnd){
+            for(size_t b = blockBegin;b < blockEnd;++b){
+                const size_t first = b * massBlock, last = std::min(count, first + massBlock);
+                double sum = 0.0;
+                for(size_t i = first;i < last;++i){
+                    mass[i] = fastmath::pow<initialConditionsAccuracy>(salpeterA - salpeterB * uniform4(generatorKey, i)[3], salpeterC);
+                    sum += mass[i];
+                }
+                blockMass[b] = sum;
+                //The attributes follow from the mass alone, while the block is still in cache
+                stellarProperties(std::span<const float>(mass + first, last - first), std::span<float>(conditions.luminosity + first, last - first), std::span<float>(conditions.temperature + first, last - first));
+            }
+        });
+        resetProgress += std::min(count, (slice + sliceBlocks) * massBlock) - slice * massBlock;
+    }
+    double sum = 0.0;
+    for(size_t b = 0;b < blocks;++b) sum += blockMass[b];
+    const float total = sum;
+    
+    const bool composite = hasHaloOrBulge();
+    for(size_t slice = 0;slice < count;slice += resetSlice){
+        if(resetCancelled) return 0.0f;
+        const size_t sliceEnd = std::min(count, slice + resetSlice);
+        pool.parallelFor(slice, sliceEnd, [&](size_t begin, size_t end){
+            for(size_t i = begin;i < end;++i){
+                glm::vec4& pos = conditions.currentPosition[i];
+                glm::vec4& prevPos = conditions.previousPosition[i];
+                
+                const std::array<float, 4> draws = uniform4(generatorKey, i);
+                float dr = draws[0];
+                float dz = draws[1];
+                float phi = 2 * M_PI * draws[2];
+                float r = -hr * fastmath::log<initialConditionsAccuracy>(1 - dr);
+                float sinPhi, cosPhi;
+                fastmath::sincos<initialConditionsAccuracy>(phi, sinPhi, cosPhi);
+                pos.x = r * cosPhi;
+                pos.y = r * sinPhi;
+                if(dz <= 0.5f) pos.z = -hz * fastmath::log<initialConditionsAccuracy>(1 - 2 * dz);
+                else pos.z = hz * fastmath::log<initialConditionsAccuracy>(2 * dz - 1);
+                
+                float r2 = sqrt(pos.x * pos.x + pos.y * pos.y + pos.z * pos.z);
+                float rProj = sqrt(pos.x * pos.x + pos.y * pos.y);
+                float cosTheta = pos.x * pos.x / r2 / rProj + pos.y * pos.y / r2 / rProj;
+                float vTot;
+                if(composite){
+                    //Circular speed from the inward part of the full acceleration
+                    float ax = 0.0f, ay = 0.0f, az = 0.0f;
+                    galaxyPotential(total).accelerate(pos.x, pos.y, pos.z, ax, ay, az);
+                    vTot = sqrt(std::max(0.0f, -(ax * pos.x + ay * pos.y + az * pos.z)));
+                }else{
+                    float h = potentialTable.empty() ? (1 - fastmath::exp<initialConditionsAccuracy>(-rProj / hr)) * (1 - fastmath::exp<initialConditionsAccuracy>(-abs(pos.z) / hz)) : potentialTable.lookup(rProj, abs(pos.z));
+                    vTot = sqrt(total * h / r2);
+                }
+                float vProj = vTot * cosTheta;
+                prevPos.x = pos.x - vProj * pos.y / rProj * dt;
+                prevPos.y = pos.y + vProj * pos.x / rProj * dt;
+                //cosTheta can round to just above 1, which used to leave a NaN prevPos.z that self-gravity spreads to every particle
+                prevPos.z = pos.z - ((pos.z > 0) - (pos.z < 0)) * vTot * sqrt(std::max(0.0f, 1 - cosTheta * cosTheta)) * dt;
+            }
+        });
+        resetProgress += sliceEnd - slice;
+    }
+    return total;
+}
+
+void Galaxy::restartSimulation(){
+    const size_t count = n + nCloud;
+    if(!pendingConditions) copyToArrays();
+    cellListCurrent = false;
+    std::iota(particleId.begin(), particleId.begin() + count, 0);
+    nextParticleId = count;
+    particleIndex.resize(count);
+    std::iota(particleIndex.begin(), particleIndex.end(), 0);
+    simulationTime = 0.0;
+    newStarIds.clear();
+    if(evolution.enabled()) startEvolution();
+    stepsSinceReorder = 0;
+    stepsSinceCompaction = 0;
+    commandsPending = false;
+    spawns.clear();
+    std::fill(fate.begin(), fate.end(), Keep);
+    //The initial velocities are set up for the full dt
+    std::fill(level.begin(), level.end(), 0);
+    preciseLoaded = false;
+}
+
+InitialConditionsKey Galaxy::initialConditionsKey() const {
+    InitialConditionsKey key;
+    key.version = initialConditionsVersion;
+    key.n = initialN;
+    key.nCloud = initialNCloud;
+    key.tableSizeR = potentialTable.empty() ? 0 : potentialTable.getSizeR();
+    key.tableSizeZ = potentialTable.empty() ? 0 : potentialTable.getSizeZ();
+    key.seed = seed;
+    key.hr = hr;
+    key.hz = hz;
+    key.salpeterA = salpeterA;
+    key.salpeterB = salpeterB;
+    key.salpeterC = salpeterC;
+    key.dt = dt;
+    key.bulgeGM = bulgeGM;
+    key.bulgeA = bulgeA;
+    key.haloGM = haloGM;
+    key.haloRs = haloRs;
+    return key;
+}
+
+void Galaxy::setBackend(Backend newBackend){
+    if(newBackend == backend || headless) return;
+    if(newBackend == Backend::GPU && gravity != Gravity::Analytic){
+        std::cerr << "Self-gravity only runs on the CPU backend" << std::endl;
+        return;
+    }
+    if(newBackend == Backend::GPU && maxLevel > 0){
+        std::cerr << "Block timesteps only run on the CPU backend" << std::endl;
+        return;
+    }
+    if(newBackend == Backend::GPU && hydro){
+        std::cerr << "Hydrodynamics only run on the CPU backend" << std::endl;
+        return;
+    }
+    if(newBackend == Backend::GPU && precision != Precision::Float){
+        std::cerr << "Mixed precision only runs on the CPU backend" << std::endl;
+        return;
+    }
+    if(newBackend == Backend::CPU && !potentialTable.empty()) std::cerr << "The CPU backend evaluates the disk force without the potential table" << std::endl;
+    if(newBackend == Backend::CPU){
+        downloadPositions();
+    }else{
+        //The GPU reads both position buffers, so previousPosition has to be brought up to date as well
+        ThreadPool::global().parallelFor(0, n + nCloud, [&](size_t begin, size_t end){
+            for(size_t i = begin;i < end;++i) previousPosition[i] = glm::vec4(particles.prevX[i], particles.prevY[i], particles.prevZ[i], 1.0f);
+        });
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, previousPositionBuffer);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, (n + nCloud) * sizeof(glm::vec4), previousPosition.data());
+        uploadPositions();
+    }
+    backend = newBackend;
+}
+
+Backend Galaxy::getBackend() const {
+    return backend;
+}
+
+float Galaxy::getTimestep() const {
+    return dt;
+}
+
+void Galaxy::setIntegrator(Integrator newIntegrator){
+    if(newIntegrator == integrator) return;
+    if(maxLevel > 0 && newIntegrator != Integrator::PositionVerlet) std::cerr << "Block timesteps keep using position Verlet" << std::endl;
+    integrator = newIntegrator;
+    if(!headless) loadComputeProgram();
+}
+
+Integrator Galaxy::getIntegrator() const {
+    return integrator;
+}
+
+void Galaxy::setPrecision(Precision newPrecision){
+    if(newPrecision != Precision::Float){
+        setBackend(Backend::CPU);
+        if(backend != Backend::CPU) return;
+        if(integrator != Integrator::PositionVerlet || maxLevel > 0) std::cerr << "Mixed precision only applies to position Verlet without block timesteps" << std::endl;
+    }
+    precision = newPrecision;
+    preciseLoaded = false;
+}
+
+Precision Galaxy::getPrecision() const {
+    return precision;
+}
+
+void Galaxy::setPotentialTable(size_t size){
+    waitForResetThread();
+    if(size == 0){
+        potentialTable = PotentialTable();
+    }else{
+        potentialTable.build(hr, hz, size, size, ThreadPool::global());
+    }
+    if(headless) return;
+    
+    if(!potentialTable.empty()){
+        if(tableTexture == 0) glGenTextures(1, &tableTexture);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, tableTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, potentialTable.getSizeR(), potentialTable.getSizeZ(), 0, GL_RED, GL_FLOAT, potentialTable.data().data());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glActiveTexture(GL_TEXTURE0);
+    }
+    loadComputeProgram();
+}
+
+void Galaxy::setBulge(float gm, float a){
+    waitForResetThread();
+    bulgeGM = gm;
+    bulgeA = a;
+    if(!headless) loadComputeProgram();
+}
+
+void Galaxy::setHalo(float gm, float rs){
+    waitForResetThread();
+    haloGM = gm;
+    haloRs = rs;
+    if(!headless) loadComputeProgram();
+}
+
+void Galaxy::setGravity(Gravity newGravity){
+    if(newGravity != Gravity::Analytic) setBackend(Backend::CPU);
+    if(newGravity != Gravity::Analytic && accelerationX.size() != n + nCloud){
+        accelerationX.resize(n + nCloud);
+        accelerationY.resize(n + nCloud);
+        accelerationZ.resize(n + nCloud);
+    }
+    gravity = newGravity;
+}
+
+Gravity Galaxy::getGravity() const {
+    return gravity;
+}
+
+void Galaxy::setSoftening(float newSoftening){
+    softening = newSoftening;
+}
+
+void Galaxy::setTheta(float theta){
+    barnesHut.setTheta(theta);
+    fastMultipole.setTheta(theta);
+}
+
+void Galaxy::setExpansionOrder(int order){
+    fastMultipole.setOrder(order);
+}
+
+void Galaxy::setBlockTimesteps(int newMaxLevel, float accuracy){
+    newMaxLevel = std::clamp(newMaxLevel, 0, maxBlockLevel);
+    timestepAccuracy = accuracy;
+    if(newMaxLevel > 0){
+        setBackend(Backend::CPU);
+        if(backend != Backend::CPU) return;
+        if(integrator != Integrator::PositionVerlet) std::cerr << "Block timesteps keep using position Verlet" << std::endl;
+        if(hydro) std::cerr << "Block timesteps step the cloud without hydrodynamics" << std::endl;
+    }
+    //Back to every particle on the full dt, the deeper levels pick themselves again at the next block
+    ThreadPool::global().parallelFor(0, n + nCloud, [&](size_t begin, size_t end){
+        for(size_t i = begin;i < end;++i) rescaleStep(i, 0);
+    });
+    maxLevel = newMaxLevel;
+    if(maxLevel > 0 && accelerationX.size() != n + nCloud){
+        accelerationX.resize(n + nCloud);
+        accelerationY.resize(n + nCloud);
+        accelerationZ.resize(n + nCloud);
+    }
+}
+
+void Galaxy::setHydrodynamics(float soundSpeed, float neighbours){
+    if(soundSpeed > 0.0f){
+        setBackend(Backend::CPU);
+        if(backend != Backend::CPU) return;
+        if(maxLevel > 0) std::cerr << "Block timesteps step the cloud without hydrodynamics" << std::endl;
+        hydrodynamics.setSoundSpeed(soundSpeed);
+        hydrodynamics.setNeighbours(neighbours);
+    }
+    hydro = soundSpeed > 0.0f;
+}
+
+void Galaxy::setMeshSize(size_t nx, size_t ny, size_t nz){
+    particleMesh.setGridSize(nx, ny, nz);
+}
+
+void Galaxy::setMassAssignment(MassAssignment assignment){
+    particleMesh.setAssignment(assignment);
+}
+
+void Galaxy::setReorderInterval(size_t steps){
+    reorderInterval = steps;
+}
+
+const std::vector<uint32_t>& Galaxy::getParticleIds() const {
+    return particleId;
+}
+
+void Galaxy::setEscapeRadius(float radius, size_t interval){
+    escapeRadius = radius;
+    compactionInterval = std::max<size_t>(interval, 1);
+}
+
+void Galaxy::spawnParticle(const glm::vec3& position, const glm::vec3& velocity, float m, bool cloud){
+    spawns.push_back(Spawn{position, velocity, m, cloud});
+}
+
+void Galaxy::removeParticle(size_t i){
+    if(i >= n + nCloud) return;
+    fate[i] = Remove;
+    commandsPending = true;
+}
+
+void Galaxy::formStar(size_t i){
+    if(i < n || i >= n + nCloud || fate[i] == Remove) return;
+    fate[i] = FormStar;
+    commandsPending = true;
+    if(evolution.enabled()) newStarIds.push_back(particleId[i]);
+}
+
+void Galaxy::setStarFormationRate(float rate){
+    starFormationRate = std::max(rate, 0.0f);
+}
+
+void Galaxy::setStellarEvolution(float solarLifetime){
+    loadArrays();
+    evolution.setSolarLifetime(solarLifetime);
+    newStarIds.clear();
+    if(evolution.enabled()){
+        startEvolution();
+    }else{
+        evolution.clear();
+        for(size_t i = 0;i < n;++i){
+            luminosity[i] = luminosityFromMass(mass[i]);
+            temperature[i] = temperatureFromMass(mass[i]);
+        }
+    }
+    if(!headless) uploadAttributes(0, n);
+}
+
+size_t Galaxy::getStarCount() const {
+    return n;
+}
+
+size_t Galaxy::getCloudCount() const {
+    return nCloud;
+}
+
+size_t Galaxy::getCapacity() const {
+    return mass.size();
+}
+
+const CellList& Galaxy::getCellList(float cellSize){
+    if(!cellListCurrent || cellList.getCellSize() != cellSize){
+        if(backend == Backend::GPU && !headless) downloadPositions();
+        cellList.build(particles.x.data(), particles.y.data(), particles.z.data(), n + nCloud, cellSize, ThreadPool::global());
+        cellListCurrent = true;
+    }
+    return cellList;
+}
+
+void Galaxy::printSolverStats(std::ostream& out) const {
+    if(gravity == Gravity::BarnesHut){
+        out << "Barnes-Hut: " << barnesHut.getNodeCount() << " nodes, build " << barnesHut.getBuildSeconds() << " s, walk " << barnesHut.getWalkSeconds() << " s" << std::endl;
+    }else if(gravity == Gravity::FMM){
+        out << "FMM order " << fastMultipole.getOrder() << ": " << fastMultipole.getNodeCount() << " nodes, " << fastMultipole.getM2LCount() << " M2L, " << fastMultipole.getP2PCount() << " P2P, build " << fastMultipole.getBuildSeconds() << " s, lists " << fastMultipole.getListSeconds() << " s, evaluate " << fastMultipole.getEvaluateSeconds() << " s" << std::endl;
+    }
+    if(maxLevel > 0 && levelCount.size() == static_cast<size_t>(maxLevel) + 1){
+        out << "Block timesteps, " << activeSteps << " particle steps in the last block, per level:";
+        for(int l = 0;l <= maxLevel;++l) out << " " << levelCount[l];
+        out << std::endl;
+    }
+    if(hydro && maxLevel == 0){
+        out << "SPH c = " << hydrodynamics.getSoundSpeed() << ": " << hydrodynamics.getMeanNeighbours() << " neighbours, " << hydrodynamics.getMeanPairs() << " pairs per particle, build " << hydrodynamics.getBuildSeconds() << " s, density " << hydrodynamics.getDensitySeconds() << " s, force " << hydrodynamics.getForceSeconds() << " s" << std::endl;
+    }
+    if(n != initialN || nCloud != initialNCloud){
+        out << "Particles: " << n << " stars and " << nCloud << " cloud particles live, " << initialN << " and " << initialNCloud << " after a reset, capacity " << getCapacity() << std::endl;
+    }
+    if(evolution.enabled()){
+        out << "Stellar evolution: " << evolution.getCount(StellarPhase::MainSequence) << " main sequence, " << evolution.getCount(StellarPhase::Giant) << " giants, " << evolution.getCount(StellarPhase::Remnant) << " remnants, " << evolution.getPendingEvents() << " pending events, " << evolvedLastStep << " stars recoloured in the last step in " << evolutionUploads << " uploads" << std::endl;
+    }
+    if(!potentialTable.empty()){
+        //Over the current particles, which the table may well have been built before
+        double maxError, rmsError;
+        potentialTable.error(particles.x.data(), particles.y.data(), particles.z.data(), n + nCloud, maxError, rmsError);
+        out << "Potential table " << potentialTable.getSizeR() << "x" << potentialTable.getSizeZ() << ": rms error " << rmsError << ", max error " << maxError << std::endl;
+    }
+    if(gravity == Gravity::ParticleMesh){
+        size_t nx, ny, nz;
+        particleMesh.getGridSize(nx, ny, nz);
+        out << "Particle-mesh " << nx << "x" << ny << "x" << nz << (particleMesh.getAssignment() == MassAssignment::CIC ? " CIC" : " TSC") << ": deposit " << particleMesh.getDepositSeconds() << " s, solve " << particleMesh.getSolveSeconds() << " s, interpolate " << particleMesh.getInterpolateSeconds() << " s, " << particleMesh.getGreenRebuilds() << " Green's function rebuilds" << std::endl;
+    }
+}
+
+size_t Galaxy::size() const {
+    return n + nCloud;
+}
+
+float Galaxy::getTotalMass() const {
+    return totalMass;
+}
+
+const std::vector<glm::vec4>& Galaxy::getPositions() const {
+    return currentPosition;
+}
+
+const std::vector<glm::vec4>& Galaxy::getPreviousPositions() const {
+    return previousPosition;
+}
+
+const std::vector<float>& Galaxy::getMasses() const {
+    return mass;
+}
+
+const ParticleArrays& Galaxy::getParticles() const {
+    return particles;
+}
+
+GalaxyPotential Galaxy::galaxyPotential(float diskGM) const {
+    return GalaxyPotential{{ExponentialDisk{diskGM, hr, hz}, Hernquist{bulgeGM, bulgeA}, NFW{haloGM, haloRs}}};
+}
+
+bool Galaxy::hasHaloOrBulge() const {
+    return bulgeGM > 0.0f || haloGM > 0.0f;
+}
+
+void Galaxy::uploadPositions(){
+    ThreadPool::global().parallelFor(0, n + nCloud, [&](size_t begin, size_t end){
+        for(size_t i = begin;i < end;++i) currentPosition[i] = glm::vec4(particles.x[i], particles.y[i], particles.z[i], 1.0f);
+    });
+    //Only the live particles, the slots behind them up to the capacity are never read
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, currentPositionBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, (n + nCloud) * sizeof(glm::vec4), currentPosition.data());
+}
+
+void Galaxy::downloadPositions(){
+    //The positions come from the buffers, but the rest of the arrays would otherwise be left from before the reset
+    loadArrays();
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, currentPositionBuffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, (n + nCloud) * sizeof(glm::vec4), currentPosition.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, previousPositionBuffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, (n + nCloud) * sizeof(glm::vec4), previousPosition.data());
+    copyToArrays();
+}
+
+void Galaxy::copyToArrays(){
+    ThreadPool::global().parallelFor(0, n + nCloud, [&](size_t begin, size_t end){
+        for(size_t i = begin;i < end;++i){
+            particles.x[i] = currentPosition[i].x;
+            particles.y[i] = currentPosition[i].y;
+            particles.z[i] = currentPosition[i].z;
+            particles.prevX[i] = previousPosition[i].x;
+            particles.prevY[i] = previousPosition[i].y;
+            particles.prevZ[i] = previousPosition[i].z;
+        }
+    });
+}
+
+void Galaxy::loadArrays(){
+    if(!pendingConditions) return;
+    const glm::vec4* cachedCurrent = pendingConditions.currentPosition();
+    const glm::vec4* cachedPrevious = pendingConditions.previousPosition();
+    //One pass over the mapping into both layouts
+    ThreadPool::global().parallelFor(0, pendingConditions.count(), [&](size_t begin, size_t end){
+        std::copy(cachedCurrent + begin, cachedCurrent + end, currentPosition.begin() + begin);
+        std::copy(cachedPrevious + begin, cachedPrevious + end, previousPosition.begin() + begin);
+        std::copy(pendingConditions.mass() + begin, pendingConditions.mass() + end, mass.begin() + begin);
+        std::copy(pendingConditions.luminosity() + begin, pendingConditions.luminosity() + end, luminosity.begin() + begin);
+        std::copy(pendingConditions.temperature() + begin, pendingConditions.temperature() + end, temperature.begin() + begin);
+        for(size_t i = begin;i < end;++i){
+            particles.x[i] = cachedCurrent[i].x;
+            particles.y[i] = cachedCurrent[i].y;
+            particles.z[i] = cachedCurrent[i].z;
+            particles.prevX[i] = cachedPrevious[i].x;
+            particles.prevY[i] = cachedPrevious[i].y;
+            particles.prevZ[i] = cachedPrevious[i].z;
+        }
+    });
+    pendingConditions = MappedInitialConditions();
+}
+
+void Galaxy::computeAccelerations(const float* x, const float* y, const float* z){
+    switch(gravity){
+        case Gravity::Direct:
+            directAccelerations(x, y, z, mass.data(), n + nCloud, softening, accelerationX.data(), accelerationY.data(), accelerationZ.data(), ThreadPool::global());
+            break;
+        case Gravity::BarnesHut:
+            barnesHut.computeAccelerations(x, y, z, mass.data(), n + nCloud, softening, accelerationX.data(), accelerationY.data(), accelerationZ.data(), ThreadPool::global());
+            break;
+        case Gravity::FMM:
+            fastMultipole.computeAccelerations(x, y, z, mass.data(), n + nCloud, softening, accelerationX.data(), accelerationY.data(), accelerationZ.data(), ThreadPool::global());
+            break;
+        case Gravity::ParticleMesh:
+            particleMesh.computeAccelerations(x, y, z, mass.data(), n + nCloud, softening, accelerationX.data(), accelerationY.data(), accelerationZ.data(), ThreadPool::global());
+            break;
+        default:
+            //Only reached with a bulge, a halo or the hydrodynamics, the disk alone has kernels that step without stored accelerations
+            if(accelerationX.size() != n + nCloud){
+                accelerationX.resize(n + nCloud);
+                accelerationY.resize(n + nCloud);
+                accelerationZ.resize(n + nCloud);
+            }
+            std::fill(accelerationX.begin(), accelerationX.end(), 0.0f);
+            std::fill(accelerationY.begin(), accelerationY.end(), 0.0f);
+            std::fill(accelerationZ.begin(), accelerationZ.end(), 0.0f);
+            ThreadPool::global().parallelFor(0, n + nCloud, [&](size_t begin, size_t end){
+                potentialAccelerations(x, y, z, begin, end, galaxyPotential(totalMass), accelerationX.data(), accelerationY.data(), accelerationZ.data());
+            });
+            break;
+    }
+}
+
+void Galaxy::hydroAccelerations(bool finiteDifference){
+    if(nCloud == 0) return;
+    if(finiteDifference){
+        if(velocityX.size() != n + nCloud){
+            velocityX.resize(n + nCloud);
+            velocityY.resize(n + nCloud);
+            velocityZ.resize(n + nCloud);
+        }
+        const float invDt = 1.0f / dt;
+        ThreadPool::global().parallelFor(n, n + nCloud, [&](size_t begin, size_t end){
+            for(size_t i = begin;i < end;++i){
+                velocityX[i] = (particles.x[i] - particles.prevX[i]) * invDt;
+                velocityY[i] = (particles.y[i] - particles.prevY[i]) * invDt;
+                velocityZ[i] = (particles.z[i] - particles.prevZ[i]) * invDt;
+            }
+        });
     }
+    //Only the cloud is gas, the stars pass through it
+    hydrodynamics.computeAccelerations(particles.x.data() + n, particles.y.data() + n, particles.z.data() + n, velocityX.data() + n, velocityY.data() + n, velocityZ.data() + n, mass.data() + n, nCloud, accelerationX.data() + n, accelerationY.data() + n, accelerationZ.data() + n, ThreadPool::global());
+}
+
+void Galaxy::reorder(){
+    const size_t count = n + nCloud;
+    ThreadPool& pool = ThreadPool::global();
+    stepsSinceReorder = 0;
+    if(backend == Backend::GPU && !headless) downloadPositions();
     
+    //The top bit puts the cloud after the stars, which keeps both in their index ranges
+    mortonKeys(mortonBounds(particles.x.data(), particles.y.data(), particles.z.data(), count, pool), particles.x.data(), particles.y.data(), particles.z.data(), count, reorderKeys, pool);
+    pool.parallelFor(n, count, [&](size_t begin, size_t end){
+        for(size_t i = begin;i < end;++i) reorderKeys[i] |= 1ull << 63;
+    });
+    radixSort(reorderKeys, reorderOrder, pool);
+    permuteParticles(reorderOrder, n, nCloud);
+    if(!headless) uploadParticleBuffers(0, count);
+}
+
+void Galaxy::formStars(size_t steps){
+    //Each cloud particle converts with probability rate * time, so the number converting is Poisson and the ones that do are
+    //uniform over the cloud
+    const double expected = static_cast<double>(starFormationRate) * dt * steps * nCloud;
+    if(nCloud == 0 || expected <= 0.0) return;
+    const size_t forming = std::poisson_distribution<size_t>(expected)(formationEngine);
+    std::uniform_int_distribution<size_t> pick(n, n + nCloud - 1);
+    for(size_t k = 0;k < forming;++k) formStar(pick(formationEngine));
+}
+
+void Galaxy::applyCommands(){
+    loadArrays();
+    const size_t count = n + nCloud, spawned = spawns.size();
+    reserveParticles(count + spawned);
+    for(size_t k = 0;k < spawned;++k){
+        const Spawn& s = spawns[k];
+        const size_t i = count + k;
+        //prev is one step back along the velocity, as the initial conditions are set up
+        const glm::vec3 prev = s.position - s.velocity * dt;
+        particles.x[i] = s.position.x;
+        particles.y[i] = s.position.y;
+        particles.z[i] = s.position.z;
+        particles.prevX[i] = prev.x;
+        particles.prevY[i] = prev.y;
+        particles.prevZ[i] = prev.z;
+        currentPosition[i] = glm::vec4(s.position, 1.0f);
+        previousPosition[i] = glm::vec4(prev, 1.0f);
+        mass[i] = s.mass;
+        luminosity[i] = luminosityFromMass(s.mass);
+        temperature[i] = temperatureFromMass(s.mass);
+        particleId[i] = nextParticleId++;
+        if(!s.cloud && evolution.enabled()) newStarIds.push_back(particleId[i]);
+        level[i] = 0;
+        //Behind the last star, a spawned star needs the same move to the star range as a cloud particle forming one
+        fate[i] = s.cloud ? Keep : FormStar;
+    }
+    spawns.clear();
+    commandsPending = false;
+    if(spawned > 0 && preciseLoaded) precise.reload(particles, count, count + spawned);
+    //On the GPU backend the compaction only uploads the particles it moves, so the new slots go up before it
+    if(spawned > 0 && !headless && backend == Backend::GPU) uploadParticleBuffers(count, count + spawned);
+    particleIndex.resize(nextParticleId, UINT32_MAX);
+    compact(spawned);
+    //New stars start on the main sequence, which their attributes already are. The ones removed in the same batch are gone.
+    std::sort(newStarIds.begin(), newStarIds.end());
+    newStarIds.erase(std::unique(newStarIds.begin(), newStarIds.end()), newStarIds.end());
+    for(uint32_t id : newStarIds) if(particleIndex[id] < n) evolution.addStar(id, mass[particleIndex[id]], simulationTime, simulationTime);
+    newStarIds.clear();
+}
+
+void Galaxy::startEvolution(){
+    evolution.clear();
+    for(size_t i = 0;i < n;++i){
+        //The ages come from the generator of the initial conditions on a stream of their own
+        const double age = uniform4({seed, 0}, particleId[i], 1)[0] * evolution.getSolarLifetime();
+        const StellarPhase phase = evolution.addStar(particleId[i], mass[i], simulationTime - age, simulationTime);
+        StellarEvolution::attributes(mass[i], phase, luminosity[i], temperature[i]);
+    }
+}
+
+void Galaxy::evolveStars(){
+    evolvedIds.clear();
+    evolution.advance(simulationTime, evolvedIds);
+    evolvedIndices.clear();
+    for(uint32_t id : evolvedIds){
+        //Removed stars keep their events until they come up
+        const uint32_t i = particleIndex[id];
+        if(i >= n) continue;
+        evolvedIndices.push_back(i);
+        StellarEvolution::attributes(mass[i], evolution.getPhase(id), luminosity[i], temperature[i]);
+    }
+    evolvedLastStep = evolvedIndices.size();
+    evolutionUploads = 0;
+    if(headless || evolvedIndices.empty()) return;
+    //Changes close together share one upload, as a few unchanged values in between cost less than another call
+    std::sort(evolvedIndices.begin(), evolvedIndices.end());
+    size_t begin = evolvedIndices[0], end = begin + 1;
+    for(size_t k = 1;k <= evolvedIndices.size();++k){
+        if(k < evolvedIndices.size() && evolvedIndices[k] <= end + 64){
+            end = evolvedIndices[k] + 1;
+            continue;
+        }
+        uploadAttributes(begin, end);
+        ++evolutionUploads;
+        if(k < evolvedIndices.size()){
+            begin = evolvedIndices[k];
+            end = begin + 1;
+        }
+    }
+}
+
+void Galaxy::uploadAttributes(size_t begin, size_t end){
+    if(begin >= end) return;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, temperatureBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, begin * sizeof(float), (end - begin) * sizeof(float), temperature.data() + begin);
+    
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, luminosityBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, begin * sizeof(float), (end - begin) * sizeof(float), luminosity.data() + begin);
+}
+
+void Galaxy::reserveParticles(size_t needed){
+    const size_t capacity = mass.size();
+    if(needed <= capacity) return;
+    const size_t newCapacity = std::max(needed, 2 * capacity);
+    currentPosition.resize(newCapacity, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+    previousPosition.resize(newCapacity, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+    mass.resize(newCapacity, 1.0f);
+    luminosity.resize(newCapacity, 1.0f);
+    temperature.resize(newCapacity, 6000.0f);
+    particleId.resize(newCapacity, 0);
+    fate.resize(newCapacity, Keep);
+    level.resize(newCapacity, 0);
+    particles.resize(newCapacity);
+    if(headless) return;
+    
+    //A new buffer per attribute with the live slots copied over on the GPU, which keeps the GPU backend's positions without a
+    //round trip through the CPU
+    auto grow = [&](GLuint& buffer, size_t oldSize, size_t newSize, GLenum usage){
+        GLuint grown;
+        glGenBuffers(1, &grown);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+        glBufferData(GL_COPY_WRITE_BUFFER, newSize, NULL, usage);
+        if(oldSize > 0){
+            glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldSize);
+        }
+        glDeleteBuffers(1, &buffer);
+        buffer = grown;
+    };
+    const size_t live = n + nCloud;
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    grow(currentPositionBuffer, live * sizeof(glm::vec4), newCapacity * sizeof(glm::vec4), GL_STATIC_DRAW);
+    grow(previousPositionBuffer, live * sizeof(glm::vec4), newCapacity * sizeof(glm::vec4), GL_STATIC_DRAW);
+    grow(temperatureBuffer, live * sizeof(float), newCapacity * sizeof(float), GL_STATIC_DRAW);
+    grow(massBuffer, live * sizeof(float), newCapacity * sizeof(float), GL_STATIC_DRAW);
+    grow(luminosityBuffer, live * sizeof(float), newCapacity * sizeof(float), GL_STATIC_DRAW);
+}
+
+void Galaxy::compact(size_t spawned){
+    loadArrays();
+    const size_t count = n + nCloud + spawned;
+    ThreadPool& pool = ThreadPool::global();
+    stepsSinceCompaction = 0;
+    //The GPU backend's only current positions are in the buffers
+    if(backend == Backend::GPU && !headless) downloadPositions();
+    //Stable partition into live stars, live cloud and removed particles: a counting sort with three buckets, whose per-chunk
+    //histograms and prefix sum are the parallel scan
+    const float radius2 = escapeRadius > 0.0f ? escapeRadius * escapeRadius : INFINITY;
+    particleClass.resize(count);
+    pool.parallelFor(0, count, [&](size_t begin, size_t end){
+        for(size_t i = begin;i < end;++i){
+            const float r2 = particles.x[i] * particles.x[i] + particles.y[i] * particles.y[i] + particles.z[i] * particles.z[i];
+            particleClass[i] = fate[i] == Remove || r2 > radius2 ? 2 : i < n || fate[i] == FormStar ? 0 : 1;
+        }
+    });
+    countingSort(count, 3, [&](size_t i){return particleClass[i];}, reorderOrder, compactStart, compactOffsets, pool);
+    const size_t liveStars = compactStart[1], liveCloud = compactStart[2] - compactStart[1];
+    std::fill(fate.begin(), fate.begin() + count, Keep);
+    if(spawned == 0 && liveStars == n && liveCloud == nCloud) return;
+    //The partition is stable, so everything before the first moved particle is where it was and stays valid in the buffers
+    size_t firstMoved = 0;
+    while(firstMoved < liveStars + liveCloud && reorderOrder[firstMoved] == firstMoved) ++firstMoved;
+    //Removed particles stay in the arrays until their slots are spawned into or the next reset(), but are no longer stepped or
+    //drawn
+    permuteParticles(reorderOrder, liveStars, liveCloud);
+    if(!headless) uploadParticleBuffers(firstMoved, liveStars + liveCloud);
+}
+
+void Galaxy::permuteParticles(const std::vector<uint32_t>& order, size_t newN, size_t newNCloud){
+    ThreadPool& pool = ThreadPool::global();
+    for(std::vector<float>* v : {&particles.x, &particles.y, &particles.z, &particles.prevX, &particles.prevY, &particles.prevZ, &mass, &luminosity, &temperature}) applyOrder(*v, order, pool);
+    applyOrder(currentPosition, order, pool);
+    applyOrder(previousPosition, order, pool);
+    applyOrder(particleId, order, pool);
+    const size_t live = newN + newNCloud;
+    pool.parallelFor(0, order.size(), [&](size_t begin, size_t end){
+        for(size_t i = begin;i < end;++i) particleIndex[particleId[i]] = i < live ? i : UINT32_MAX;
+    });
+    //State that outlives a step: the levels the prev positions are scaled to and the precise positions they are rounded from
+    if(level.size() >= order.size()) applyOrder(level, order, pool);
+    if(preciseLoaded) precise.permute(order, pool);
+    //Derived every step, but permuted along so the arrays never disagree
+    for(std::vector<float>* v : {&velocityX, &velocityY, &velocityZ, &accelerationX, &accelerationY, &accelerationZ}) if(v->size() >= order.size()) applyOrder(*v, order, pool);
+    //The SPH state is indexed from the first cloud particle. Particles that were not in the cloud before, spawned ones, map past
+    //its end, which starts them from a fresh smoothing length.
+    std::vector<uint32_t> cloudOrder(order.begin() + newN, order.begin() + newN + newNCloud);
+    for(uint32_t& i : cloudOrder) i = i >= n && i < n + nCloud ? i - n : UINT32_MAX;
+    hydrodynamics.permute(cloudOrder, pool);
+    n = newN;
+    nCloud = newNCloud;
+    cellListCurrent = false;
+}
+
+void Galaxy::uploadParticleBuffers(size_t begin, size_t end){
+    if(begin >= end) return;
+    ThreadPool::global().parallelFor(begin, end, [&](size_t rangeBegin, size_t rangeEnd){
+        for(size_t i = rangeBegin;i < rangeEnd;++i){
+            currentPosition[i] = glm::vec4(particles.x[i], particles.y[i], particles.z[i], 1.0f);
+            previousPosition[i] = glm::vec4(particles.prevX[i], particles.prevY[i], particles.prevZ[i], 1.0f);
+        }
+    });
+    const size_t count = end - begin;
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, currentPositionBuffer);
-    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, currentPosition.size() * sizeof(glm::vec4), currentPosition.data());
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, begin * sizeof(glm::vec4), count * sizeof(glm::vec4), currentPosition.data() + begin);
     
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, previousPositionBuffer);
-    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, previousPosition.size() * sizeof(glm::vec4), previousPosition.data());
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, begin * sizeof(glm::vec4), count * sizeof(glm::vec4), previousPosition.data() + begin);
     
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, massBuffer);
-    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, mass.size() * sizeof(float), mass.data());
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, begin * sizeof(float), count * sizeof(float), mass.data() + begin);
     
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, colourBuffer);
-    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, colour.size() * sizeof(glm::vec4), colour.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, temperatureBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, begin * sizeof(float), count * sizeof(float), temperature.data() + begin);
     
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, luminosityBuffer);
-    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, luminosity.size() * sizeof(float), luminosity.data());
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, begin * sizeof(float), count * sizeof(float), luminosity.data() + begin);
+}
+
+void Galaxy::rescaleStep(size_t i, int newLevel){
+    //Position Verlet keeps the velocity as x - prev over one step, so a new step size scales that difference
+    if(newLevel == level[i]) return;
+    const float scale = std::ldexp(1.0f, level[i] - newLevel);
+    particles.prevX[i] = particles.x[i] - (particles.x[i] - particles.prevX[i]) * scale;
+    particles.prevY[i] = particles.y[i] - (particles.y[i] - particles.prevY[i]) * scale;
+    particles.prevZ[i] = particles.z[i] - (particles.z[i] - particles.prevZ[i]) * scale;
+    level[i] = newLevel;
+}
+
+void Galaxy::diskAccelerations(){
+    if(hasHaloOrBulge()){
+        computeAccelerations(particles.x.data(), particles.y.data(), particles.z.data());
+        return;
+    }
+    //With prev = 2x the disk kernel's step leaves exactly a * dt^2 in prev, so dt = 1 gives the acceleration
+    ThreadPool::global().parallelFor(0, n + nCloud, [&](size_t begin, size_t end){
+        for(size_t i = begin;i < end;++i){
+            blockScratch.x[i] = particles.x[i];
+            blockScratch.y[i] = particles.y[i];
+            blockScratch.z[i] = particles.z[i];
+            blockScratch.prevX[i] = 2.0f * particles.x[i];
+            blockScratch.prevY[i] = 2.0f * particles.y[i];
+            blockScratch.prevZ[i] = 2.0f * particles.z[i];
+        }
+        verletStep(blockScratch, begin, end, totalMass, hr, hz, 1.0f);
+        std::copy(blockScratch.prevX.begin() + begin, blockScratch.prevX.begin() + end, accelerationX.begin() + begin);
+        std::copy(blockScratch.prevY.begin() + begin, blockScratch.prevY.begin() + end, accelerationY.begin() + begin);
+        std::copy(blockScratch.prevZ.begin() + begin, blockScratch.prevZ.begin() + end, accelerationZ.begin() + begin);
+    });
+}
+
+void Galaxy::assignLevels(){
+    const size_t count = n + nCloud;
+    ThreadPool& pool = ThreadPool::global();
+    const size_t levels = maxLevel + 1;
+    
+    //The step has to resolve a fraction timestepAccuracy of the local dynamical time sqrt(r / |a|)
+    pool.parallelFor(0, count, [&](size_t begin, size_t end){
+        for(size_t i = begin;i < end;++i){
+            float r = std::sqrt(particles.x[i] * particles.x[i] + particles.y[i] * particles.y[i] + particles.z[i] * particles.z[i]);
+            float a = std::sqrt(accelerationX[i] * accelerationX[i] + accelerationY[i] * accelerationY[i] + accelerationZ[i] * accelerationZ[i]);
+            int newLevel = 0;
+            if(a > 0.0f){
+                float ratio = dt / (timestepAccuracy * std::sqrt(std::max(r, softening) / a));
+                if(ratio > 1.0f) newLevel = std::min(static_cast<int>(std::ceil(std::log2(ratio))), maxLevel);
+            }
+            rescaleStep(i, newLevel);
+        }
+    });
+    
+    //Counting sort by level, so every substep's active particles are one contiguous tail of levelOrder
+    countingSort(count, levels, [&](size_t i){return level[i];}, levelOrder, levelStart, levelOffsets, pool);
+    for(size_t l = 0;l < levels;++l) levelCount[l] = levelStart[l + 1] - levelStart[l];
+}
+
+void Galaxy::integrateBlocks(){
+    const size_t count = n + nCloud;
+    const size_t substeps = size_t(1) << maxLevel;
+    ThreadPool& pool = ThreadPool::global();
+    if(blockScratch.size() != count){
+        blockScratch.resize(count);
+        active.resize(count);
+        levelOrder.resize(count);
+        activeAccelerationX.resize(count);
+        activeAccelerationY.resize(count);
+        activeAccelerationZ.resize(count);
+    }
+    levelStart.resize(maxLevel + 2);
+    levelCount.resize(maxLevel + 1);
+    
+    //Only at the start of a block is every particle synchronised, so levels change here and nowhere else
+    if(gravity == Gravity::Analytic) diskAccelerations();
+    else computeAccelerations(particles.x.data(), particles.y.data(), particles.z.data());
+    assignLevels();
+    activeSteps = 0;
+    
+    for(size_t sub = 0;sub < substeps;++sub){
+        //Level l steps every substeps >> l substeps, so the active ones are the levels from maxLevel minus the trailing zeros of sub up
+        int minLevel = 0;
+        if(sub > 0){
+            minLevel = maxLevel;
+            for(size_t s = sub;(s & 1) == 0;s >>= 1) --minLevel;
+        }
+        const size_t first = levelStart[minLevel];
+        const size_t activeCount = count - first;
+        const size_t* index = levelOrder.data() + first;
+        if(activeCount == 0) continue;
+        
+        pool.parallelFor(0, activeCount, [&](size_t begin, size_t end){
+            for(size_t j = begin;j < end;++j){
+                size_t i = index[j];
+                active.x[j] = particles.x[i];
+                active.y[j] = particles.y[i];
+                active.z[j] = particles.z[i];
+                active.prevX[j] = particles.prevX[i];
+                active.prevY[j] = particles.prevY[i];
+                active.prevZ[j] = particles.prevZ[i];
+            }
+        });
+        
+        if(gravity != Gravity::Analytic){
+            if(sub > 0){
+                //Inactive particles sit somewhere in their own step, between prev and x
+                pool.parallelFor(0, count, [&](size_t begin, size_t end){
+                    for(size_t i = begin;i < end;++i){
+                        size_t stride = substeps >> level[i];
+                        float f = static_cast<float>(sub % stride) / stride;
+                        if(f == 0.0f){
+                            blockScratch.x[i] = particles.x[i];
+                            blockScratch.y[i] = particles.y[i];
+                            blockScratch.z[i] = particles.z[i];
+                        }else{
+                            blockScratch.x[i] = particles.prevX[i] + (particles.x[i] - particles.prevX[i]) * f;
+                            blockScratch.y[i] = particles.prevY[i] + (particles.y[i] - particles.prevY[i]) * f;
+                            blockScratch.z[i] = particles.prevZ[i] + (particles.z[i] - particles.prevZ[i]) * f;
+                        }
+                    }
+                });
+            }
+            if(sub > 0 && gravity == Gravity::Direct){
+                directAccelerations(active.x.data(), active.y.data(), active.z.data(), activeCount, blockScratch.x.data(), blockScratch.y.data(), blockScratch.z.data(), mass.data(), count, softening, activeAccelerationX.data(), activeAccelerationY.data(), activeAccelerationZ.data(), pool);
+            }else{
+                //The tree and mesh solvers cost about the same for any number of targets, so they solve everything and the active part is gathered
+                if(sub > 0) computeAccelerations(blockScratch.x.data(), blockScratch.y.data(), blockScratch.z.data());
+                pool.parallelFor(0, activeCount, [&](size_t begin, size_t end){
+                    for(size_t j = begin;j < end;++j){
+                        activeAccelerationX[j] = accelerationX[index[j]];
+                        activeAccelerationY[j] = accelerationY[index[j]];
+                        activeAccelerationZ[j] = accelerationZ[index[j]];
+                    }
+                });
+            }
+        }
+        
+        for(int l = minLevel;l <= maxLevel;++l){
+            const float dtLevel = std::ldexp(dt, -l);
+            pool.parallelFor(levelStart[l] - first, levelStart[l + 1] - first, [&](size_t begin, size_t end){
+                if(gravity == Gravity::Analytic && hasHaloOrBulge()){
+                    std::fill(activeAccelerationX.begin() + begin, activeAccelerationX.begin() + end, 0.0f);
+                    std::fill(activeAccelerationY.begin() + begin, activeAccelerationY.begin() + end, 0.0f);
+                    std::fill(activeAccelerationZ.begin() + begin, activeAccelerationZ.begin() + end, 0.0f);
+                    potentialAccelerations(active.x.data(), active.y.data(), active.z.data(), begin, end, galaxyPotential(totalMass), activeAccelerationX.data(), activeAccelerationY.data(), activeAccelerationZ.data());
+                    verletStep(active, begin, end, activeAccelerationX.data(), activeAccelerationY.data(), activeAccelerationZ.data(), dtLevel);
+                }else if(gravity == Gravity::Analytic){
+                    verletStep(active, begin, end, totalMass, hr, hz, dtLevel);
+                }else{
+                    verletStep(active, begin, end, activeAccelerationX.data(), activeAccelerationY.data(), activeAccelerationZ.data(), dtLevel);
+                }
+            });
+        }
+        
+        //The kernels leave the new positions in prev, so scattering back swaps them in
+        pool.parallelFor(0, activeCount, [&](size_t begin, size_t end){
+            for(size_t j = begin;j < end;++j){
+                size_t i = index[j];
+                particles.prevX[i] = active.x[j];
+                particles.prevY[i] = active.y[j];
+                particles.prevZ[i] = active.z[j];
+                particles.x[i] = active.prevX[j];
+                particles.y[i] = active.prevY[j];
+                particles.z[i] = active.prevZ[j];
+            }
+        });
+        activeSteps += activeCount;
+    }
+}
+
+void Galaxy::loadComputeProgram(){
+    std::string defines;
+    switch(integrator){
+        case Integrator::LeapfrogKDK: defines = glslSplitting<LeapfrogKDK>(); break;
+        case Integrator::VelocityVerlet: defines = glslSplitting<VelocityVerlet>(); break;
+        case Integrator::ForestRuth: defines = glslSplitting<ForestRuth>(); break;
+        default: break;
+    }
+    if(!potentialTable.empty()) defines += "#define TABLE\n";
+    if(hasHaloOrBulge()) defines += GalaxyPotential::glsl();
+    if(computeProgram != 0) glDeleteProgram(computeProgram);
+    
+    const char* computeShaderFiles[1] = {"shaders/verlet.comp"};
+    const GLuint computeShaderTypes[1] = {GL_COMPUTE_SHADER};
+    computeProgram = loadProgram(1, computeShaderFiles, computeShaderTypes, defines);
+    if(computeProgram == 0){
+        std::cerr << "Could not create compute program" << std::endl;
+    }
+    nId = glGetUniformLocation(computeProgram, "n");
+    stepsId = glGetUniformLocation(computeProgram, "steps");
+    totalGMId = glGetUniformLocation(computeProgram, "totalGM");
+    dtId = glGetUniformLocation(computeProgram, "dt");
+    hrId = glGetUniformLocation(computeProgram, "hr");
+    hzId = glGetUniformLocation(computeProgram, "hz");
+    tableId = glGetUniformLocation(computeProgram, "potentialTable");
+    potentialId = glGetUniformLocation(computeProgram, "potentialParameters");
 }
\ No newline at end of file
@@ -0,0 +1,301 @@
+#include "iccache.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//The key is hashed and written byte for byte, so it must not have padding
+static_assert(sizeof(InitialConditionsKey) == 6 * sizeof(uint64_t) + 10 * sizeof(float), "InitialConditionsKey has padding");
+
+namespace {
+    //Bumped whenever the layout of the file changes
+    constexpr uint32_t formatVersion = 1;
+    constexpr char magic[8] = {'C', 'G', 'P', 'R', '-', 'I', 'C', '\0'};
+    constexpr size_t alignment = 64;
+    
+    struct Header {
+        char magic[8];
+        uint32_t format, keySize;
+        InitialConditionsKey key;
+        uint64_t count;
+        double totalMass;
+    };
+    
+    size_t alignUp(size_t x){
+        return (x + alignment - 1) / alignment * alignment;
+    }
+    
+    //Bytes of the current positions, previous positions, masses, luminosities and temperatures
+    std::array<size_t, 5> arraySizes(size_t count){
+        return {count * sizeof(glm::vec4), count * sizeof(glm::vec4), count * sizeof(float), count * sizeof(float), count * sizeof(float)};
+    }
+    
+    //Offsets of the arrays, then the file size
+    std::array<size_t, 6> layout(size_t count){
+        const std::array<size_t, 5> sizes = arraySizes(count);
+        std::array<size_t, 6> offsets;
+        offsets[0] = alignUp(sizeof(Header));
+        for(size_t i = 0;i < 5;++i) offsets[i + 1] = alignUp(offsets[i] + sizes[i]);
+        return offsets;
+    }
+    
+    //FNV-1a
+    uint64_t hash(const InitialConditionsKey& key){
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&key);
+        uint64_t h = 0xcbf29ce484222325ull;
+        for(size_t i = 0;i < sizeof(key);++i){
+            h ^= bytes[i];
+            h *= 0x100000001b3ull;
+        }
+        return h;
+    }
+    
+    const Header& header(const unsigned char* data){
+        return *reinterpret_cast<const Header*>(data);
+    }
+}
+
+MappedInitialConditions::MappedInitialConditions(MappedInitialConditions&& other) noexcept {
+    *this = std::move(other);
+}
+
+MappedInitialConditions& MappedInitialConditions::operator=(MappedInitialConditions&& other) noexcept {
+    if(this != &other){
+        release();
+        data = std::exchange(other.data, nullptr);
+        size = std::exchange(other.size, 0);
+#ifdef _WIN32
+        buffer = std::exchange(other.buffer, nullptr);
+#endif
+    }
+    return *this;
+}
+
+MappedInitialConditions::~MappedInitialConditions(){
+    release();
+}
+
+void MappedInitialConditions::release(){
+    if(data == nullptr) return;
+#ifdef _WIN32
+    delete[] buffer;
+    buffer = nullptr;
+#else
+    munmap(const_cast<unsigned char*>(data), size);
+#endif
+    data = nullptr;
+    size = 0;
+}
+
+MappedInitialConditions::operator bool() const {
+    return data != nullptr;
+}
+
+size_t MappedInitialConditions::count() const {
+    return header(data).count;
+}
+
+double MappedInitialConditions::totalMass() const {
+    return header(data).totalMass;
+}
+
+const glm::vec4* MappedInitialConditions::currentPosition() const {
+    return reinterpret_cast<const glm::vec4*>(data + layout(count())[0]);
+}
+
+const glm::vec4* MappedInitialConditions::previousPosition() const {
+    return reinterpret_cast<const glm::vec4*>(data + layout(count())[1]);
+}
+
+const float* MappedInitialConditions::mass() const {
+    return reinterpret_cast<const float*>(data + layout(count())[2]);
+}
+
+const float* MappedInitialConditions::luminosity() const {
+    return reinterpret_cast<const float*>(data + layout(count())[3]);
+}
+
+const float* MappedInitialConditions::temperature() const {
+    return reinterpret_cast<const float*>(data + layout(count())[4]);
+}
+
+InitialConditionsCache& InitialConditionsCache::global(){
+    static InitialConditionsCache cache;
+    return cache;
+}
+
+void InitialConditionsCache::setDirectory(const std::string& directory){
+    this->directory = directory;
+}
+
+const std::string& InitialConditionsCache::getDirectory() const {
+    return directory;
+}
+
+bool InitialConditionsCache::enabled() const {
+    return !directory.empty();
+}
+
+void InitialConditionsCache::setBudget(uint64_t bytes){
+    budget = bytes;
+}
+
+std::string InitialConditionsCache::path(const InitialConditionsKey& key) const {
+    std::ostringstream name;
+    name << "ic-" << std::hex << std::setw(16) << std::setfill('0') << hash(key) << ".bin";
+    return (std::filesystem::path(directory) / name.str()).string();
+}
+
+MappedInitialConditions InitialConditionsCache::load(const InitialConditionsKey& key) const {
+    if(!enabled()) return MappedInitialConditions();
+    MappedInitialConditions mapped = map(key);
+    ++(mapped ? hits : misses);
+    return mapped;
+}
+
+size_t InitialConditionsCache::getHits() const {
+    return hits;
+}
+
+size_t InitialConditionsCache::getMisses() const {
+    return misses;
+}
+
+MappedInitialConditions InitialConditionsCache::map(const InitialConditionsKey& key) const {
+    MappedInitialConditions mapped;
+    const std::string file = path(key);
+#ifdef _WIN32
+    std::ifstream in(file, std::ios::binary | std::ios::ate);
+    if(!in.is_open()) return mapped;
+    mapped.size = in.tellg();
+    mapped.buffer = new unsigned char[mapped.size];
+    in.seekg(0);
+    in.read(reinterpret_cast<char*>(mapped.buffer), mapped.size);
+    mapped.data = mapped.buffer;
+    if(!in){
+        mapped.release();
+        return mapped;
+    }
+#else
+    const int fd = open(file.c_str(), O_RDONLY);
+    if(fd < 0) return mapped;
+    struct stat status;
+    if(fstat(fd, &status) != 0 || status.st_size <= 0){
+        close(fd);
+        return mapped;
+    }
+    int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    //Every page is read straight after, faulting them in one go is cheaper than one at a time
+    flags |= MAP_POPULATE;
+#endif
+    void* address = mmap(nullptr, status.st_size, PROT_READ, flags, fd, 0);
+    close(fd);
+    if(address == MAP_FAILED) return mapped;
+    mapped.data = static_cast<const unsigned char*>(address);
+    mapped.size = status.st_size;
+#endif
+    
+    const Header& h = header(mapped.data);
+    if(mapped.size < sizeof(Header) || std::memcmp(h.magic, magic, sizeof(magic)) != 0 || h.format != formatVersion || h.keySize != sizeof(InitialConditionsKey) || !(h.key == key) || h.count != key.n + key.nCloud || mapped.size != layout(h.count)[5]){
+        std::cerr << "Ignoring " << file << ", which is not the initial conditions it should hold" << std::endl;
+        mapped.release();
+        return mapped;
+    }
+    //A hit counts as a use for the eviction
+    std::error_code error;
+    std::filesystem::last_write_time(file, std::filesystem::file_time_type::clock::now(), error);
+    return mapped;
+}
+
+void InitialConditionsCache::store(const InitialConditionsKey& key, size_t count, double totalMass, const glm::vec4* currentPosition, const glm::vec4* previousPosition, const float* mass, const float* luminosity, const float* temperature) const {
+    if(!enabled()) return;
+    const std::array<size_t, 6> offsets = layout(count);
+    if(offsets[5] > budget) return;
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    const std::string file = path(key);
+#ifdef _WIN32
+    const std::string temporary = file + ".tmp" + std::to_string(_getpid());
+#else
+    const std::string temporary = file + ".tmp" + std::to_string(getpid());
+#endif
+    
+    Header h;
+    std::memcpy(h.magic, magic, sizeof(magic));
+    h.format = formatVersion;
+    h.keySize = sizeof(InitialConditionsKey);
+    h.key = key;
+    h.count = count;
+    h.totalMass = totalMass;
+    const std::array<size_t, 5> sizes = arraySizes(count);
+    const void* arrays[5] = {currentPosition, previousPosition, mass, luminosity, temperature};
+    
+    std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    const char padding[alignment] = {};
+    size_t written = sizeof(h);
+    for(size_t i = 0;i < 5;++i){
+        out.write(padding, offsets[i] - written);
+        out.write(static_cast<const char*>(arrays[i]), sizes[i]);
+        written = offsets[i] + sizes[i];
+    }
+    out.write(padding, offsets[5] - written);
+    out.close();
+    if(!out){
+        std::cerr << "Could not write " << temporary << std::endl;
+        std::filesystem::remove(temporary, error);
+        return;
+    }
+    //Atomic on POSIX, so a process starting now either maps the whole file or misses
+    std::filesystem::rename(temporary, file, error);
+    if(error){
+        std::cerr << "Could not rename " << temporary << " to " << file << ": " << error.message() << std::endl;
+        std::filesystem::remove(temporary, error);
+        return;
+    }
+    evict(file);
+}
+
+void InitialConditionsCache::evict(const std::string& keep) const {
+    struct Entry {
+        std::filesystem::path path;
+        std::filesystem::file_time_type time;
+        uint64_t size;
+    };
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+    std::error_code error;
+    for(const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(directory, error)){
+        const std::string name = entry.path().filename().string();
+        if(name.rfind("ic-", 0) != 0 || name.size() < 4 || name.compare(name.size() - 4, 4, ".bin") != 0) continue;
+        std::error_code entryError;
+        const uint64_t size = entry.file_size(entryError);
+        const std::filesystem::file_time_type time = entry.last_write_time(entryError);
+        if(entryError) continue;
+        total += size;
+        if(entry.path() != std::filesystem::path(keep)) entries.push_back({entry.path(), time, size});
+    }
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b){return a.time < b.time;});
+    for(size_t i = 0;i < entries.size() && total > budget;++i){
+        std::filesystem::remove(entries[i].path, error);
+        if(error) std::cerr << "Could not remove " << entries[i].path.string() << ": " << error.message() << std::endl;
+        else total -= entries[i].size;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,134 @@
+#include "integrator.hpp"
+
+#include <cmath>
+#include <utility>
+
+#include "symplectic.hpp"
+
+void ParticleArrays::resize(size_t n){
+    x.resize(n);
+    y.resize(n);
+    z.resize(n);
+    prevX.resize(n);
+    prevY.resize(n);
+    prevZ.resize(n);
+}
+
+size_t ParticleArrays::size() const {
+    return x.size();
+}
+
+void ParticleArrays::swap(){
+    std::swap(x, prevX);
+    std::swap(y, prevY);
+    std::swap(z, prevZ);
+}
+
+namespace {
+    struct DiskSystem {
+        float x, y, z, vx, vy, vz, ax, ay, az;
+        float invHr, invHz, totalGM;
+        
+        void kick(float h){
+            vx += h * ax;
+            vy += h * ay;
+            vz += h * az;
+        }
+        void drift(float h, float h2){
+            x += h * vx + h2 * ax;
+            y += h * vy + h2 * ay;
+            z += h * vz + h2 * az;
+        }
+        void forces(){
+            float f = diskFactor(x, y, z, invHr, invHz, totalGM);
+            ax = -f * x;
+            ay = -f * y;
+            az = -f * z;
+        }
+    };
+}
+
+void verletStepScalar(ParticleArrays& p, size_t begin, size_t end, float totalGM, float hr, float hz, float dt){
+    const float* __restrict__ x = p.x.data();
+    const float* __restrict__ y = p.y.data();
+    const float* __restrict__ z = p.z.data();
+    float* __restrict__ px = p.prevX.data();
+    float* __restrict__ py = p.prevY.data();
+    float* __restrict__ pz = p.prevZ.data();
+    const float invHr = 1.0f / hr, invHz = 1.0f / hz, gmDt2 = totalGM * dt * dt;
+    
+    for(size_t i = begin;i < end;++i){
+        float a = diskFactor(x[i], y[i], z[i], invHr, invHz, gmDt2);
+        px[i] = 2.0f * x[i] - px[i] - a * x[i];
+        py[i] = 2.0f * y[i] - py[i] - a * y[i];
+        pz[i] = 2.0f * z[i] - pz[i] - a * z[i];
+    }
+}
+
+void verletStepsScalar(ParticleArrays& p, size_t begin, size_t end, float totalGM, float hr, float hz, float dt, size_t steps){
+    const float invHr = 1.0f / hr, invHz = 1.0f / hz, gmDt2 = totalGM * dt * dt;
+    
+    for(size_t i = begin;i < end;++i){
+        float x = p.x[i], y = p.y[i], z = p.z[i], px = p.prevX[i], py = p.prevY[i], pz = p.prevZ[i];
+        for(size_t s = 0;s < steps;++s){
+            float a = diskFactor(x, y, z, invHr, invHz, gmDt2);
+            float nx = 2.0f * x - px - a * x, ny = 2.0f * y - py - a * y, nz = 2.0f * z - pz - a * z;
+            px = x;
+            py = y;
+            pz = z;
+            x = nx;
+            y = ny;
+            z = nz;
+        }
+        p.x[i] = x;
+        p.y[i] = y;
+        p.z[i] = z;
+        p.prevX[i] = px;
+        p.prevY[i] = py;
+        p.prevZ[i] = pz;
+    }
+}
+
+void verletStep(ParticleArrays& p, size_t begin, size_t end, const float* ax, const float* ay, const float* az, float dt){
+    const float* __restrict__ x = p.x.data();
+    const float* __restrict__ y = p.y.data();
+    const float* __restrict__ z = p.z.data();
+    float* __restrict__ px = p.prevX.data();
+    float* __restrict__ py = p.prevY.data();
+    float* __restrict__ pz = p.prevZ.data();
+    const float dt2 = dt * dt;
+    
+    for(size_t i = begin;i < end;++i){
+        px[i] = 2.0f * x[i] - px[i] + ax[i] * dt2;
+        py[i] = 2.0f * y[i] - py[i] + ay[i] * dt2;
+        pz[i] = 2.0f * z[i] - pz[i] + az[i] * dt2;
+    }
+}
+
+template<class Scheme> void integrateDiskScalar(ParticleArrays& p, size_t begin, size_t end, float totalGM, float hr, float hz, float dt, size_t steps){
+    const float invDt = 1.0f / dt;
+    
+    for(size_t i = begin;i < end;++i){
+        DiskSystem s;
+        s.x = p.x[i];
+        s.y = p.y[i];
+        s.z = p.z[i];
+        s.vx = (p.x[i] - p.prevX[i]) * invDt;
+        s.vy = (p.y[i] - p.prevY[i]) * invDt;
+        s.vz = (p.z[i] - p.prevZ[i]) * invDt;
+        s.invHr = 1.0f / hr;
+        s.invHz = 1.0f / hz;
+        s.totalGM = totalGM;
+        runSteps<Scheme>(s, dt, steps);
+        p.x[i] = s.x;
+        p.y[i] = s.y;
+        p.z[i] = s.z;
+        p.prevX[i] = s.x - s.vx * dt;
+        p.prevY[i] = s.y - s.vy * dt;
+        p.prevZ[i] = s.z - s.vz * dt;
+    }
+}
+
+template void integrateDiskScalar<LeapfrogKDK>(ParticleArrays&, size_t, size_t, float, float, float, float, size_t);
+template void integrateDiskScalar<VelocityVerlet>(ParticleArrays&, size_t, size_t, float, float, float, float, size_t);
+template void integrateDiskScalar<ForestRuth>(ParticleArrays&, size_t, size_t, float, float, float, float, size_t);
\ No newline at end of file
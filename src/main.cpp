@@ -3,16 +3,236 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <string>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <chrono>
+#include <algorithm>
+#include <charconv>
+#include <stdexcept>
 
 #include "util.hpp"
+#include "colourtable.hpp"
 #include "galaxy.hpp"
+#include "benchmark.hpp"
+#include "threadpool.hpp"
 
-int main(){
+const char* gravityNames[] = {"analytic", "direct", "barneshut", "fmm", "pm"};
+const size_t gravityCount = sizeof(gravityNames) / sizeof(gravityNames[0]);
+
+//The whole of text as a T, throwing std::invalid_argument for anything else, such as "abc", "12abc" or a negative count
+template<class T> T parseNumber(const char* text){
+    const char* end = text + std::char_traits<char>::length(text);
+    T value;
+    const std::from_chars_result result = std::from_chars(text, end, value);
+    if(result.ec != std::errc() || result.ptr != end) throw std::invalid_argument(text);
+    return value;
+}
+
+//The command line settings of the Galaxy, with -1 or 0 leaving the Galaxy's own default
+struct GalaxyOptions {
+    Gravity gravity = Gravity::Analytic;
+    Integrator integrator = Integrator::PositionVerlet;
+    Precision precision = Precision::Float;
+    float softening = -1.0f, openingAngle = -1.0f, timestepAccuracy = 0.02f;
+    int expansionOrder = -1, blockLevels = 0;
+    size_t mesh[3] = {0, 0, 0};
+    std::string assignment;
+    size_t tableSize = 0, reorderInterval = 0;
+    float bulge[2] = {0.0f, 0.0f}, halo[2] = {0.0f, 0.0f};
+    float soundSpeed = 0.0f, sphNeighbours = 48.0f;
+    float escapeRadius = 0.0f, starFormationRate = 0.0f, solarLifetime = 0.0f;
+};
+
+//Applies options to a galaxy fresh from its constructor and generates its particles, once, with the table, bulge and halo already
+//in the initial velocities
+void configureGalaxy(Galaxy& galaxy, const GalaxyOptions& options){
+    if(options.softening > 0.0f) galaxy.setSoftening(options.softening);
+    if(options.openingAngle > 0.0f) galaxy.setTheta(options.openingAngle);
+    if(options.expansionOrder >= 0) galaxy.setExpansionOrder(options.expansionOrder);
+    if(options.mesh[0] > 0) galaxy.setMeshSize(options.mesh[0], options.mesh[1], options.mesh[2]);
+    if(!options.assignment.empty()) galaxy.setMassAssignment(options.assignment == "cic" ? MassAssignment::CIC : MassAssignment::TSC);
+    galaxy.setGravity(options.gravity);
+    galaxy.setIntegrator(options.integrator);
+    galaxy.setPrecision(options.precision);
+    if(options.tableSize > 0) galaxy.setPotentialTable(options.tableSize);
+    if(options.bulge[0] > 0.0f) galaxy.setBulge(options.bulge[0], options.bulge[1]);
+    if(options.halo[0] > 0.0f) galaxy.setHalo(options.halo[0], options.halo[1]);
+    if(options.soundSpeed > 0.0f) galaxy.setHydrodynamics(options.soundSpeed, options.sphNeighbours);
+    if(options.blockLevels > 0) galaxy.setBlockTimesteps(options.blockLevels, options.timestepAccuracy);
+    galaxy.setReorderInterval(options.reorderInterval);
+    galaxy.setEscapeRadius(options.escapeRadius);
+    galaxy.setStarFormationRate(options.starFormationRate);
+    galaxy.reset();
+    //After the reset, which would otherwise start the evolution over again
+    if(options.solarLifetime > 0.0f) galaxy.setStellarEvolution(options.solarLifetime);
+}
+
+int main(int argc, char** argv){
+    bool headless = false;
+    Backend backend = Backend::GPU;
+    GalaxyOptions options;
+    size_t headlessSteps = 1000, benchMax = 0, stars = 50000, clouds = 25000;
+    float simulationRate = 0.06f;
+    size_t maxStepsPerFrame = 32;
+    std::string bench;
+    const std::string usage = std::string("Usage: ") + argv[0] + " [--headless] [--cpu] [--steps n] [--stars n] [--clouds n] [--gravity analytic|direct|barneshut|fmm|pm] [--integrator verlet|kdk|vv|forestruth] [--precision float|double|compensated] [--softening eps] [--theta t] [--order p] [--mesh nx ny nz] [--assignment cic|tsc] [--table n] [--bulge gm a] [--halo gm rs] [--sph c] [--sph-neighbours n] [--levels n] [--reorder steps] [--escape-radius r] [--star-formation rate] [--evolution lifetime] [--timestep-accuracy eta] [--sim-rate t] [--max-steps-per-frame n] [--threads n] [--chunk n] [--ic-cache dir] [--ic-cache-budget megabytes] [--bench disk|fmm|precision|table|potential|sph|cells|pool|stellar|fastmath|reset|blocks] [--bench-max n]";
+    for(int i = 1;i < argc;++i){
+        std::string arg = argv[i];
+        try{
+            if(arg == "--headless") headless = true;
+            else if(arg == "--cpu") backend = Backend::CPU;
+            else if(arg == "--steps" && i + 1 < argc) headlessSteps = parseNumber<size_t>(argv[++i]);
+            else if(arg == "--stars" && i + 1 < argc) stars = parseNumber<size_t>(argv[++i]);
+            else if(arg == "--clouds" && i + 1 < argc) clouds = parseNumber<size_t>(argv[++i]);
+            else if(arg == "--softening" && i + 1 < argc) options.softening = parseNumber<float>(argv[++i]);
+            else if(arg == "--theta" && i + 1 < argc) options.openingAngle = parseNumber<float>(argv[++i]);
+            else if(arg == "--order" && i + 1 < argc) options.expansionOrder = parseNumber<int>(argv[++i]);
+            else if(arg == "--levels" && i + 1 < argc) options.blockLevels = parseNumber<int>(argv[++i]);
+            else if(arg == "--timestep-accuracy" && i + 1 < argc) options.timestepAccuracy = parseNumber<float>(argv[++i]);
+            else if(arg == "--sim-rate" && i + 1 < argc) simulationRate = parseNumber<float>(argv[++i]);
+            else if(arg == "--max-steps-per-frame" && i + 1 < argc) maxStepsPerFrame = std::max<size_t>(1, parseNumber<size_t>(argv[++i]));
+            else if(arg == "--table" && i + 1 < argc) options.tableSize = parseNumber<size_t>(argv[++i]);
+            else if(arg == "--reorder" && i + 1 < argc) options.reorderInterval = parseNumber<size_t>(argv[++i]);
+            else if(arg == "--escape-radius" && i + 1 < argc) options.escapeRadius = parseNumber<float>(argv[++i]);
+            else if(arg == "--star-formation" && i + 1 < argc) options.starFormationRate = parseNumber<float>(argv[++i]);
+            else if(arg == "--evolution" && i + 1 < argc) options.solarLifetime = parseNumber<float>(argv[++i]);
+            else if(arg == "--bulge" && i + 2 < argc){
+                for(int a = 0;a < 2;++a) options.bulge[a] = parseNumber<float>(argv[++i]);
+            }
+            else if(arg == "--halo" && i + 2 < argc){
+                for(int a = 0;a < 2;++a) options.halo[a] = parseNumber<float>(argv[++i]);
+            }
+            else if(arg == "--sph" && i + 1 < argc) options.soundSpeed = parseNumber<float>(argv[++i]);
+            else if(arg == "--sph-neighbours" && i + 1 < argc) options.sphNeighbours = parseNumber<float>(argv[++i]);
+            else if(arg == "--mesh" && i + 3 < argc){
+                for(int a = 0;a < 3;++a) options.mesh[a] = parseNumber<size_t>(argv[++i]);
+            }
+            else if(arg == "--assignment" && i + 1 < argc){
+                options.assignment = argv[++i];
+                if(options.assignment != "cic" && options.assignment != "tsc"){
+                    std::cerr << "Unknown mass assignment " << options.assignment << std::endl;
+                    return 1;
+                }
+            }
+            else if(arg == "--gravity" && i + 1 < argc){
+                std::string name = argv[++i];
+                size_t g = 0;
+                while(g < gravityCount && name != gravityNames[g]) ++g;
+                if(g == gravityCount){
+                    std::cerr << "Unknown gravity solver " << name << std::endl;
+                    return 1;
+                }
+                options.gravity = static_cast<Gravity>(g);
+            }
+            else if(arg == "--integrator" && i + 1 < argc){
+                std::string name = argv[++i];
+                size_t s = 0;
+                while(s < integratorCount && name != integratorNames[s]) ++s;
+                if(s == integratorCount){
+                    std::cerr << "Unknown integrator " << name << std::endl;
+                    return 1;
+                }
+                options.integrator = static_cast<Integrator>(s);
+            }
+            else if(arg == "--precision" && i + 1 < argc){
+                std::string name = argv[++i];
+                if(name == "float") options.precision = Precision::Float;
+                else if(name == "double") options.precision = Precision::Double;
+                else if(name == "compensated") options.precision = Precision::Compensated;
+                else{
+                    std::cerr << "Unknown precision " << name << std::endl;
+                    return 1;
+                }
+            }
+            else if(arg == "--threads" && i + 1 < argc) ThreadPool::global().setThreadCount(parseNumber<size_t>(argv[++i]));
+            else if(arg == "--chunk" && i + 1 < argc) ThreadPool::global().setChunkSize(parseNumber<size_t>(argv[++i]));
+            else if(arg == "--ic-cache" && i + 1 < argc) InitialConditionsCache::global().setDirectory(argv[++i]);
+            else if(arg == "--ic-cache-budget" && i + 1 < argc) InitialConditionsCache::global().setBudget(parseNumber<size_t>(argv[++i]) << 20);
+            else if(arg == "--bench" && i + 1 < argc) bench = argv[++i];
+            else if(arg == "--bench-max" && i + 1 < argc) benchMax = parseNumber<size_t>(argv[++i]);
+            else{
+                std::cerr << "Unknown argument " << arg << std::endl;
+                std::cerr << usage << std::endl;
+                return 1;
+            }
+        }catch(const std::invalid_argument&){
+            std::cerr << "Invalid value for " << arg << std::endl;
+            std::cerr << usage << std::endl;
+            return 1;
+        }
+    }
+    //The block timesteps only have a position-Verlet kernel, any other integrator would be ignored
+    if(options.blockLevels > 0 && options.integrator != Integrator::PositionVerlet){
+        std::cerr << "--levels needs --integrator verlet" << std::endl;
+        std::cerr << usage << std::endl;
+        return 1;
+    }
+    //Only verlet.comp reads the table, so it would be ignored by anything that moves the stepping to the CPU or replaces the disk force
+    const bool cpuOnly = headless || backend == Backend::CPU || options.gravity != Gravity::Analytic || options.blockLevels > 0 || options.precision != Precision::Float || options.soundSpeed > 0.0f;
+    if(options.tableSize > 0 && (cpuOnly || options.bulge[0] > 0.0f || options.halo[0] > 0.0f)){
+        std::cerr << "--table only applies to the GPU backend with the disk alone, so not with --headless, --cpu, --gravity other than analytic, --levels, --precision, --sph, --bulge or --halo" << std::endl;
+        std::cerr << usage << std::endl;
+        return 1;
+    }
+    
+    if(bench == "disk"){
+        benchmarkDiskKernel(benchMax > 0 ? benchMax : 100000000);
+        return 0;
+    }else if(bench == "fmm"){
+        benchmarkFastMultipole(benchMax > 0 ? benchMax : 100000);
+        return 0;
+    }else if(bench == "precision"){
+        benchmarkPrecision(benchMax > 0 ? benchMax : 1000000);
+        return 0;
+    }else if(bench == "table"){
+        benchmarkPotentialTable(benchMax > 0 ? benchMax : 1000000);
+        return 0;
+    }else if(bench == "potential"){
+        benchmarkPotential(benchMax > 0 ? benchMax : 1000000);
+        return 0;
+    }else if(bench == "sph"){
+        benchmarkHydrodynamics(benchMax > 0 ? benchMax : 100000);
+        return 0;
+    }else if(bench == "cells"){
+        benchmarkCellList(benchMax > 0 ? benchMax : 1000000);
+        return 0;
+    }else if(bench == "pool"){
+        benchmarkParticlePool(benchMax > 0 ? benchMax : 1000000);
+        return 0;
+    }else if(bench == "stellar"){
+        benchmarkStellarProperties(benchMax > 0 ? benchMax : 10000000);
+        return 0;
+    }else if(bench == "fastmath"){
+        benchmarkFastMath(benchMax > 0 ? benchMax : 1 << 24);
+        return 0;
+    }else if(bench == "reset"){
+        return benchmarkReset(benchMax > 0 ? benchMax : 4000000) ? 0 : 1;
+    }else if(bench == "blocks"){
+        return benchmarkBlockTimesteps(benchMax > 0 ? benchMax : 1000) ? 0 : 1;
+    }else if(!bench.empty()){
+        std::cerr << "Unknown benchmark " << bench << std::endl;
+        return 1;
+    }
+    
+    if(headless){
+        Galaxy galaxy(stars, clouds, 200.0f, 20.0f, 0.5f, 15.0f, 0.001f, 0);
+        configureGalaxy(galaxy, options);
+        ThreadPool::global().resetStats();
+        auto startTime = std::chrono::high_resolution_clock::now();
+        galaxy.integrate(headlessSteps);
+        float elapsed = static_cast<std::chrono::duration<float>>(std::chrono::high_resolution_clock::now() - startTime).count();
+        std::cout << headlessSteps << " steps of " << galaxy.size() << " particles in " << elapsed << " s (" << headlessSteps * galaxy.size() / elapsed << " particle steps/s)" << std::endl;
+        galaxy.printSolverStats(std::cout);
+        std::vector<ThreadPool::WorkerStats> stats = ThreadPool::global().getStats();
+        for(size_t i = 0;i < stats.size();++i){
+            std::cout << "  worker " << i << ": busy " << stats[i].busySeconds << " s, idle " << stats[i].idleSeconds << " s, " << stats[i].chunks << " chunks, " << stats[i].steals << " stolen" << std::endl;
+        }
+        return 0;
+    }
+    
     if(!glfwInit()){
         std::cerr << "Could not initialise GLFW" << std::endl;
         return 1;
@@ -32,7 +252,8 @@ int main(){
     glfwWindowHint(GLFW_GREEN_BITS, vidmode->greenBits);
     glfwWindowHint(GLFW_BLUE_BITS, vidmode->blueBits);
     glfwWindowHint(GLFW_REFRESH_RATE, vidmode->refreshRate);
-    GLFWwindow* window = glfwCreateWindow(width, height, "Computer Graphics project redo", monitor, NULL);
+    const char* windowTitle = "Computer Graphics project redo";
+    GLFWwindow* window = glfwCreateWindow(width, height, windowTitle, monitor, NULL);
     
     if(window == NULL){
         std::cerr << "Could not create window" << std::endl;
@@ -48,7 +269,7 @@ int main(){
     
     const char* shaderFiles[2] = {"shaders/shader.vert", "shaders/shader.frag"};
     const GLuint shaderTypes[2] = {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER};
-    GLuint renderProgram = loadProgram(2, shaderFiles, shaderTypes);
+    GLuint renderProgram = loadProgram(2, shaderFiles, shaderTypes, colourTable::glslDefines());
     if(renderProgram == 0){
         std::cerr << "Could not create program" << std::endl;
         glfwTerminate();
@@ -80,11 +301,18 @@ int main(){
     
     bool play = false, spaceBlock = false;
     
-    bool resetBlock = false;
+    bool resetBlock = false, backendBlock = false, gravityBlock = false, integratorBlock = false;
+    //-1 while no reset is shown
+    int shownResetPercent = -1;
+    
+    //Simulation time still owed to the wall clock. Frames that would need more than maxStepsPerFrame steps drop the rest, so a
+    //slow machine runs in slow motion instead of falling further behind every frame.
+    double accumulator = 0.0;
     
     auto previousFrameTime = std::chrono::high_resolution_clock::now();
     
-    Galaxy galaxy(50000, 25000, 200.0f, 20.0f, 0.5f, 15.0f, 0.001f, 0, width, height);
+    Galaxy galaxy(stars, clouds, 200.0f, 20.0f, 0.5f, 15.0f, 0.001f, 0, width, height, backend);
+    configureGalaxy(galaxy, options);
     
     while(!glfwWindowShouldClose(window)){
         auto currentFrameTime = std::chrono::high_resolution_clock::now();
@@ -122,12 +350,51 @@ int main(){
         if(spaceBlock && glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_RELEASE) spaceBlock = false;
         
         if(!resetBlock && glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS){
-            galaxy.reset();
+            galaxy.startReset();
             resetBlock = true;
         }
         if(resetBlock && glfwGetKey(window, GLFW_KEY_R) == GLFW_RELEASE) resetBlock = false;
+        //The progress of a reset in the title, updated when the percentage changes
+        galaxy.updateReset();
+        const int resetPercent = galaxy.resetPending() ? static_cast<int>(100.0f * galaxy.getResetProgress()) : -1;
+        if(resetPercent != shownResetPercent){
+            glfwSetWindowTitle(window, resetPercent < 0 ? windowTitle : (std::string(windowTitle) + " - resetting " + std::to_string(resetPercent) + "%").c_str());
+            shownResetPercent = resetPercent;
+        }
         
-        if(play) galaxy.integrate();
+        if(!backendBlock && glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS){
+            galaxy.setBackend(galaxy.getBackend() == Backend::CPU ? Backend::GPU : Backend::CPU);
+            backendBlock = true;
+        }
+        if(backendBlock && glfwGetKey(window, GLFW_KEY_C) == GLFW_RELEASE) backendBlock = false;
+        
+        if(!gravityBlock && glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS){
+            galaxy.setGravity(static_cast<Gravity>((static_cast<size_t>(galaxy.getGravity()) + 1) % gravityCount));
+            gravityBlock = true;
+        }
+        if(gravityBlock && glfwGetKey(window, GLFW_KEY_G) == GLFW_RELEASE) gravityBlock = false;
+        
+        //Fixed to position Verlet with block timesteps, like the command line
+        if(!integratorBlock && options.blockLevels == 0 && glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS){
+            galaxy.setIntegrator(static_cast<Integrator>((static_cast<size_t>(galaxy.getIntegrator()) + 1) % integratorCount));
+            integratorBlock = true;
+        }
+        if(integratorBlock && glfwGetKey(window, GLFW_KEY_I) == GLFW_RELEASE) integratorBlock = false;
+        
+        if(play){
+            const double step = galaxy.getTimestep();
+            accumulator += simulationRate * static_cast<double>(dt);
+            size_t steps = static_cast<size_t>(accumulator / step);
+            if(steps > maxStepsPerFrame){
+                steps = maxStepsPerFrame;
+                accumulator = 0.0;
+            }else{
+                accumulator -= steps * step;
+            }
+            galaxy.integrate(steps);
+        }else{
+            accumulator = 0.0;
+        }
         
         glUseProgram(renderProgram);
         glm::mat4 mat = mvp * glm::rotate(glm::mat4(1.0f), theta, glm::vec3(1.0f, 0.0f, 0.0f)) * glm::rotate(glm::mat4(1.0f), phi, glm::vec3(0.0f, 0.0f, 1.0f));
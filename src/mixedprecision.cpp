@@ -0,0 +1,329 @@
+#include "mixedprecision.hpp"
+
+#include "morton.hpp"
+#include "simd.hpp"
+
+void PrecisePositions::load(const ParticleArrays& p, Precision newPrecision){
+    precision = newPrecision;
+    const size_t n = p.size();
+    dx.resize(n);
+    dy.resize(n);
+    dz.resize(n);
+    loDx.assign(n, 0.0f);
+    loDy.assign(n, 0.0f);
+    loDz.assign(n, 0.0f);
+    for(size_t i = 0;i < n;++i){
+        dx[i] = p.x[i] - p.prevX[i];
+        dy[i] = p.y[i] - p.prevY[i];
+        dz[i] = p.z[i] - p.prevZ[i];
+    }
+    if(precision == Precision::Double){
+        x.assign(p.x.begin(), p.x.end());
+        y.assign(p.y.begin(), p.y.end());
+        z.assign(p.z.begin(), p.z.end());
+    }else{
+        hiX = p.x;
+        hiY = p.y;
+        hiZ = p.z;
+        loX.assign(n, 0.0f);
+        loY.assign(n, 0.0f);
+        loZ.assign(n, 0.0f);
+    }
+}
+
+void PrecisePositions::reload(const ParticleArrays& p, size_t begin, size_t end){
+    for(std::vector<float>* v : {&dx, &dy, &dz, &loDx, &loDy, &loDz}) if(v->size() < end) v->resize(end);
+    for(std::vector<double>* v : {&x, &y, &z}) if(precision == Precision::Double && v->size() < end) v->resize(end);
+    for(std::vector<float>* v : {&hiX, &hiY, &hiZ, &loX, &loY, &loZ}) if(precision != Precision::Double && v->size() < end) v->resize(end);
+    for(size_t i = begin;i < end;++i){
+        dx[i] = p.x[i] - p.prevX[i];
+        dy[i] = p.y[i] - p.prevY[i];
+        dz[i] = p.z[i] - p.prevZ[i];
+        loDx[i] = loDy[i] = loDz[i] = 0.0f;
+        if(precision == Precision::Double){
+            x[i] = p.x[i];
+            y[i] = p.y[i];
+            z[i] = p.z[i];
+        }else{
+            hiX[i] = p.x[i];
+            hiY[i] = p.y[i];
+            hiZ[i] = p.z[i];
+            loX[i] = loY[i] = loZ[i] = 0.0f;
+        }
+    }
+}
+
+void PrecisePositions::store(ParticleArrays& p, size_t begin, size_t end) const {
+    for(size_t i = begin;i < end;++i){
+        if(precision == Precision::Double){
+            p.x[i] = x[i];
+            p.y[i] = y[i];
+            p.z[i] = z[i];
+        }else{
+            p.x[i] = hiX[i] + loX[i];
+            p.y[i] = hiY[i] + loY[i];
+            p.z[i] = hiZ[i] + loZ[i];
+        }
+        p.prevX[i] = p.x[i] - dx[i];
+        p.prevY[i] = p.y[i] - dy[i];
+        p.prevZ[i] = p.z[i] - dz[i];
+    }
+}
+
+void PrecisePositions::permute(const std::vector<uint32_t>& order, ThreadPool& pool){
+    //Arrays of another precision may be left over from an earlier load, at any size
+    for(std::vector<double>* v : {&x, &y, &z}) if(v->size() >= order.size()) applyOrder(*v, order, pool);
+    for(std::vector<float>* v : {&hiX, &hiY, &hiZ, &loX, &loY, &loZ, &dx, &dy, &dz, &loDx, &loDy, &loDz}) if(v->size() >= order.size()) applyOrder(*v, order, pool);
+}
+
+size_t PrecisePositions::size() const {
+    return dx.size();
+}
+
+namespace {
+    //hi + lo += d, Kahan style: lo carries what the last rounding of hi dropped and is folded into the next increment
+    inline void compensatedAdd(float& hi, float& lo, float d){
+        float y = d + lo;
+        float t = hi + y;
+        lo = y - (t - hi);
+        hi = t;
+    }
+}
+
+void preciseStepsScalar(PrecisePositions& s, size_t begin, size_t end, float totalGM, float hr, float hz, float dt, size_t steps){
+    const float invHr = 1.0f / hr, invHz = 1.0f / hz, gmDt2 = totalGM * dt * dt;
+    
+    for(size_t i = begin;i < end;++i){
+        float dx = s.dx[i], dy = s.dy[i], dz = s.dz[i], loDx = s.loDx[i], loDy = s.loDy[i], loDz = s.loDz[i];
+        if(s.precision == Precision::Double){
+            double x = s.x[i], y = s.y[i], z = s.z[i];
+            for(size_t k = 0;k < steps;++k){
+                float fx = x, fy = y, fz = z;
+                float a = diskFactor(fx, fy, fz, invHr, invHz, gmDt2);
+                compensatedAdd(dx, loDx, -a * fx);
+                compensatedAdd(dy, loDy, -a * fy);
+                compensatedAdd(dz, loDz, -a * fz);
+                x += double(dx) + double(loDx);
+                y += double(dy) + double(loDy);
+                z += double(dz) + double(loDz);
+            }
+            s.x[i] = x;
+            s.y[i] = y;
+            s.z[i] = z;
+        }else{
+            float hiX = s.hiX[i], hiY = s.hiY[i], hiZ = s.hiZ[i], loX = s.loX[i], loY = s.loY[i], loZ = s.loZ[i];
+            for(size_t k = 0;k < steps;++k){
+                float a = diskFactor(hiX, hiY, hiZ, invHr, invHz, gmDt2);
+                compensatedAdd(dx, loDx, -a * hiX);
+                compensatedAdd(dy, loDy, -a * hiY);
+                compensatedAdd(dz, loDz, -a * hiZ);
+                compensatedAdd(hiX, loX, dx);
+                compensatedAdd(hiY, loY, dy);
+                compensatedAdd(hiZ, loZ, dz);
+                loX += loDx;
+                loY += loDy;
+                loZ += loDz;
+            }
+            s.hiX[i] = hiX;
+            s.hiY[i] = hiY;
+            s.hiZ[i] = hiZ;
+            s.loX[i] = loX;
+            s.loY[i] = loY;
+            s.loZ[i] = loZ;
+        }
+        s.dx[i] = dx;
+        s.dy[i] = dy;
+        s.dz[i] = dz;
+        s.loDx[i] = loDx;
+        s.loDy[i] = loDy;
+        s.loDz[i] = loDz;
+    }
+}
+
+#ifdef SIMD_X86
+namespace {
+    using namespace simd;
+    
+    //The force only needs float positions, so doubles are rounded in, and d is widened again for the one double add per axis
+    __attribute__((target("avx512f"))) inline __m512 narrow512(__m512d lo, __m512d hi){
+        return _mm512_castpd_ps(_mm512_insertf64x4(_mm512_castps_pd(_mm512_castps256_ps512(_mm512_cvtpd_ps(lo))), _mm256_castps_pd(_mm512_cvtpd_ps(hi)), 1));
+    }
+    
+    __attribute__((target("avx512f"))) inline void widenAdd512(__m512d& lo, __m512d& hi, __m512 d){
+        lo = _mm512_add_pd(lo, _mm512_cvtps_pd(_mm512_castps512_ps256(d)));
+        hi = _mm512_add_pd(hi, _mm512_cvtps_pd(_mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(d), 1))));
+    }
+    
+    __attribute__((target("avx512f"))) inline void compensatedAdd512(__m512& hi, __m512& lo, __m512 d){
+        __m512 y = _mm512_add_ps(d, lo);
+        __m512 t = _mm512_add_ps(hi, y);
+        lo = _mm512_sub_ps(y, _mm512_sub_ps(t, hi));
+        hi = t;
+    }
+    
+    __attribute__((target("avx2,fma"))) inline __m256 narrow256(__m256d lo, __m256d hi){
+        return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(lo)), _mm256_cvtpd_ps(hi), 1);
+    }
+    
+    __attribute__((target("avx2,fma"))) inline void widenAdd256(__m256d& lo, __m256d& hi, __m256 d){
+        lo = _mm256_add_pd(lo, _mm256_cvtps_pd(_mm256_castps256_ps128(d)));
+        hi = _mm256_add_pd(hi, _mm256_cvtps_pd(_mm256_extractf128_ps(d, 1)));
+    }
+    
+    __attribute__((target("avx2,fma"))) inline void compensatedAdd256(__m256& hi, __m256& lo, __m256 d){
+        __m256 y = _mm256_add_ps(d, lo);
+        __m256 t = _mm256_add_ps(hi, y);
+        lo = _mm256_sub_ps(y, _mm256_sub_ps(t, hi));
+        hi = t;
+    }
+    
+    //Steps are the outer loop so consecutive vectors are independent and their latencies overlap
+    __attribute__((target("avx512f"))) void preciseStepsAVX512(PrecisePositions& s, size_t begin, size_t end, float totalGM, float hr, float hz, float dt, size_t steps){
+        const __m512 negInvHr = _mm512_set1_ps(-1.0f / hr), negInvHz = _mm512_set1_ps(-1.0f / hz), gmDt2 = _mm512_set1_ps(totalGM * dt * dt), zero = _mm512_setzero_ps();
+        const size_t vectorEnd = begin + (end - begin) / 16 * 16;
+        
+        for(size_t k = 0;k < steps;++k){
+            for(size_t i = begin;i < vectorEnd;i += 16){
+                __m512 dx = _mm512_loadu_ps(s.dx.data() + i), dy = _mm512_loadu_ps(s.dy.data() + i), dz = _mm512_loadu_ps(s.dz.data() + i);
+                __m512 loDx = _mm512_loadu_ps(s.loDx.data() + i), loDy = _mm512_loadu_ps(s.loDy.data() + i), loDz = _mm512_loadu_ps(s.loDz.data() + i);
+                if(s.precision == Precision::Double){
+                    __m512d x0 = _mm512_loadu_pd(s.x.data() + i), x1 = _mm512_loadu_pd(s.x.data() + i + 8);
+                    __m512d y0 = _mm512_loadu_pd(s.y.data() + i), y1 = _mm512_loadu_pd(s.y.data() + i + 8);
+                    __m512d z0 = _mm512_loadu_pd(s.z.data() + i), z1 = _mm512_loadu_pd(s.z.data() + i + 8);
+                    __m512 fx = narrow512(x0, x1), fy = narrow512(y0, y1), fz = narrow512(z0, z1);
+                    __m512 a = _mm512_sub_ps(zero, diskFactor512<fastmath::Accuracy::Precise>(fx, fy, fz, negInvHr, negInvHz, gmDt2));
+                    compensatedAdd512(dx, loDx, _mm512_mul_ps(a, fx));
+                    compensatedAdd512(dy, loDy, _mm512_mul_ps(a, fy));
+                    compensatedAdd512(dz, loDz, _mm512_mul_ps(a, fz));
+                    widenAdd512(x0, x1, dx);
+                    widenAdd512(y0, y1, dy);
+                    widenAdd512(z0, z1, dz);
+                    widenAdd512(x0, x1, loDx);
+                    widenAdd512(y0, y1, loDy);
+                    widenAdd512(z0, z1, loDz);
+                    _mm512_storeu_pd(s.x.data() + i, x0);
+                    _mm512_storeu_pd(s.x.data() + i + 8, x1);
+                    _mm512_storeu_pd(s.y.data() + i, y0);
+                    _mm512_storeu_pd(s.y.data() + i + 8, y1);
+                    _mm512_storeu_pd(s.z.data() + i, z0);
+                    _mm512_storeu_pd(s.z.data() + i + 8, z1);
+                }else{
+                    __m512 hiX = _mm512_loadu_ps(s.hiX.data() + i), hiY = _mm512_loadu_ps(s.hiY.data() + i), hiZ = _mm512_loadu_ps(s.hiZ.data() + i);
+                    __m512 loX = _mm512_loadu_ps(s.loX.data() + i), loY = _mm512_loadu_ps(s.loY.data() + i), loZ = _mm512_loadu_ps(s.loZ.data() + i);
+                    __m512 a = _mm512_sub_ps(zero, diskFactor512<fastmath::Accuracy::Precise>(hiX, hiY, hiZ, negInvHr, negInvHz, gmDt2));
+                    compensatedAdd512(dx, loDx, _mm512_mul_ps(a, hiX));
+                    compensatedAdd512(dy, loDy, _mm512_mul_ps(a, hiY));
+                    compensatedAdd512(dz, loDz, _mm512_mul_ps(a, hiZ));
+                    compensatedAdd512(hiX, loX, dx);
+                    compensatedAdd512(hiY, loY, dy);
+                    compensatedAdd512(hiZ, loZ, dz);
+                    _mm512_storeu_ps(s.hiX.data() + i, hiX);
+                    _mm512_storeu_ps(s.hiY.data() + i, hiY);
+                    _mm512_storeu_ps(s.hiZ.data() + i, hiZ);
+                    _mm512_storeu_ps(s.loX.data() + i, _mm512_add_ps(loX, loDx));
+                    _mm512_storeu_ps(s.loY.data() + i, _mm512_add_ps(loY, loDy));
+                    _mm512_storeu_ps(s.loZ.data() + i, _mm512_add_ps(loZ, loDz));
+                }
+                _mm512_storeu_ps(s.dx.data() + i, dx);
+                _mm512_storeu_ps(s.dy.data() + i, dy);
+                _mm512_storeu_ps(s.dz.data() + i, dz);
+                _mm512_storeu_ps(s.loDx.data() + i, loDx);
+                _mm512_storeu_ps(s.loDy.data() + i, loDy);
+                _mm512_storeu_ps(s.loDz.data() + i, loDz);
+            }
+        }
+        if(vectorEnd < end) preciseStepsScalar(s, vectorEnd, end, totalGM, hr, hz, dt, steps);
+    }
+    
+    //Steps are the outer loop so consecutive vectors are independent and their latencies overlap
+    __attribute__((target("avx2,fma"))) void preciseStepsAVX2(PrecisePositions& s, size_t begin, size_t end, float totalGM, float hr, float hz, float dt, size_t steps){
+        const __m256 negInvHr = _mm256_set1_ps(-1.0f / hr), negInvHz = _mm256_set1_ps(-1.0f / hz), gmDt2 = _mm256_set1_ps(totalGM * dt * dt), zero = _mm256_setzero_ps();
+        const size_t vectorEnd = begin + (end - begin) / 8 * 8;
+        
+        for(size_t k = 0;k < steps;++k){
+            for(size_t i = begin;i < vectorEnd;i += 8){
+                __m256 dx = _mm256_loadu_ps(s.dx.data() + i), dy = _mm256_loadu_ps(s.dy.data() + i), dz = _mm256_loadu_ps(s.dz.data() + i);
+                __m256 loDx = _mm256_loadu_ps(s.loDx.data() + i), loDy = _mm256_loadu_ps(s.loDy.data() + i), loDz = _mm256_loadu_ps(s.loDz.data() + i);
+                if(s.precision == Precision::Double){
+                    __m256d x0 = _mm256_loadu_pd(s.x.data() + i), x1 = _mm256_loadu_pd(s.x.data() + i + 4);
+                    __m256d y0 = _mm256_loadu_pd(s.y.data() + i), y1 = _mm256_loadu_pd(s.y.data() + i + 4);
+                    __m256d z0 = _mm256_loadu_pd(s.z.data() + i), z1 = _mm256_loadu_pd(s.z.data() + i + 4);
+                    __m256 fx = narrow256(x0, x1), fy = narrow256(y0, y1), fz = narrow256(z0, z1);
+                    __m256 a = _mm256_sub_ps(zero, diskFactor256<fastmath::Accuracy::Precise>(fx, fy, fz, negInvHr, negInvHz, gmDt2));
+                    compensatedAdd256(dx, loDx, _mm256_mul_ps(a, fx));
+                    compensatedAdd256(dy, loDy, _mm256_mul_ps(a, fy));
+                    compensatedAdd256(dz, loDz, _mm256_mul_ps(a, fz));
+                    widenAdd256(x0, x1, dx);
+                    widenAdd256(y0, y1, dy);
+                    widenAdd256(z0, z1, dz);
+                    widenAdd256(x0, x1, loDx);
+                    widenAdd256(y0, y1, loDy);
+                    widenAdd256(z0, z1, loDz);
+                    _mm256_storeu_pd(s.x.data() + i, x0);
+                    _mm256_storeu_pd(s.x.data() + i + 4, x1);
+                    _mm256_storeu_pd(s.y.data() + i, y0);
+                    _mm256_storeu_pd(s.y.data() + i + 4, y1);
+                    _mm256_storeu_pd(s.z.data() + i, z0);
+                    _mm256_storeu_pd(s.z.data() + i + 4, z1);
+                }else{
+                    __m256 hiX = _mm256_loadu_ps(s.hiX.data() + i), hiY = _mm256_loadu_ps(s.hiY.data() + i), hiZ = _mm256_loadu_ps(s.hiZ.data() + i);
+                    __m256 loX = _mm256_loadu_ps(s.loX.data() + i), loY = _mm256_loadu_ps(s.loY.data() + i), loZ = _mm256_loadu_ps(s.loZ.data() + i);
+                    __m256 a = _mm256_sub_ps(zero, diskFactor256<fastmath::Accuracy::Precise>(hiX, hiY, hiZ, negInvHr, negInvHz, gmDt2));
+                    compensatedAdd256(dx, loDx, _mm256_mul_ps(a, hiX));
+                    compensatedAdd256(dy, loDy, _mm256_mul_ps(a, hiY));
+                    compensatedAdd256(dz, loDz, _mm256_mul_ps(a, hiZ));
+                    compensatedAdd256(hiX, loX, dx);
+                    compensatedAdd256(hiY, loY, dy);
+                    compensatedAdd256(hiZ, loZ, dz);
+                    _mm256_storeu_ps(s.hiX.data() + i, hiX);
+                    _mm256_storeu_ps(s.hiY.data() + i, hiY);
+                    _mm256_storeu_ps(s.hiZ.data() + i, hiZ);
+                    _mm256_storeu_ps(s.loX.data() + i, _mm256_add_ps(loX, loDx));
+                    _mm256_storeu_ps(s.loY.data() + i, _mm256_add_ps(loY, loDy));
+                    _mm256_storeu_ps(s.loZ.data() + i, _mm256_add_ps(loZ, loDz));
+                }
+                _mm256_storeu_ps(s.dx.data() + i, dx);
+                _mm256_storeu_ps(s.dy.data() + i, dy);
+                _mm256_storeu_ps(s.dz.data() + i, dz);
+                _mm256_storeu_ps(s.loDx.data() + i, loDx);
+                _mm256_storeu_ps(s.loDy.data() + i, loDy);
+                _mm256_storeu_ps(s.loDz.data() + i, loDz);
+            }
+        }
+        if(vectorEnd < end) preciseStepsScalar(s, vectorEnd, end, totalGM, hr, hz, dt, steps);
+    }
+}
+#endif
+
+void preciseSteps(PrecisePositions& s, size_t begin, size_t end, float totalGM, float hr, float hz, float dt, size_t steps){
+#ifdef SIMD_X86
+    switch(detectSimdLevel()){
+        case SimdLevel::AVX512: preciseStepsAVX512(s, begin, end, totalGM, hr, hz, dt, steps); return;
+        case SimdLevel::AVX2: preciseStepsAVX2(s, begin, end, totalGM, hr, hz, dt, steps); return;
+        default: break;
+    }
+#endif
+    preciseStepsScalar(s, begin, end, totalGM, hr, hz, dt, steps);
+}
+
+void preciseStep(PrecisePositions& s, size_t begin, size_t end, const float* ax, const float* ay, const float* az, float dt){
+    const float dt2 = dt * dt;
+    
+    for(size_t i = begin;i < end;++i){
+        compensatedAdd(s.dx[i], s.loDx[i], ax[i] * dt2);
+        compensatedAdd(s.dy[i], s.loDy[i], ay[i] * dt2);
+        compensatedAdd(s.dz[i], s.loDz[i], az[i] * dt2);
+        if(s.precision == Precision::Double){
+            s.x[i] += double(s.dx[i]) + double(s.loDx[i]);
+            s.y[i] += double(s.dy[i]) + double(s.loDy[i]);
+            s.z[i] += double(s.dz[i]) + double(s.loDz[i]);
+        }else{
+            compensatedAdd(s.hiX[i], s.loX[i], s.dx[i]);
+            compensatedAdd(s.hiY[i], s.loY[i], s.dy[i]);
+            compensatedAdd(s.hiZ[i], s.loZ[i], s.dz[i]);
+            s.loX[i] += s.loDx[i];
+            s.loY[i] += s.loDy[i];
+            s.loZ[i] += s.loDz[i];
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,103 @@
+#include "morton.hpp"
+
+#include <algorithm>
+#include <cfloat>
+
+namespace {
+    constexpr size_t sortChunk = 65536;
+}
+
+void axisBounds(const float* x, const float* y, const float* z, size_t n, float min[3], float max[3], ThreadPool& pool){
+    const size_t chunk = pool.getChunkSize();
+    const size_t chunkTotal = (n + chunk - 1) / chunk;
+    std::vector<float> partial(6 * chunkTotal);
+    pool.parallelFor(0, n, chunk, [&](size_t begin, size_t end){
+        float* p = &partial[6 * (begin / chunk)];
+        p[0] = p[1] = p[2] = FLT_MAX;
+        p[3] = p[4] = p[5] = -FLT_MAX;
+        for(size_t i = begin;i < end;++i){
+            p[0] = std::min(p[0], x[i]);
+            p[1] = std::min(p[1], y[i]);
+            p[2] = std::min(p[2], z[i]);
+            p[3] = std::max(p[3], x[i]);
+            p[4] = std::max(p[4], y[i]);
+            p[5] = std::max(p[5], z[i]);
+        }
+    });
+    
+    for(int a = 0;a < 3;++a){
+        min[a] = FLT_MAX;
+        max[a] = -FLT_MAX;
+    }
+    for(size_t c = 0;c < chunkTotal;++c){
+        for(int a = 0;a < 3;++a){
+            min[a] = std::min(min[a], partial[6 * c + a]);
+            max[a] = std::max(max[a], partial[6 * c + 3 + a]);
+        }
+    }
+}
+
+MortonBox mortonBounds(const float* x, const float* y, const float* z, size_t n, ThreadPool& pool){
+    float min[3], max[3];
+    axisBounds(x, y, z, n, min, max, pool);
+    if(n == 0) return {0.0f, 0.0f, 0.0f, 1.0f};
+    float size = std::max({max[0] - min[0], max[1] - min[1], max[2] - min[2]});
+    size = std::max(size * 1.0001f, FLT_MIN);
+    return {min[0], min[1], min[2], size};
+}
+
+void mortonKeys(const MortonBox& box, const float* x, const float* y, const float* z, size_t n, std::vector<uint64_t>& keys, ThreadPool& pool){
+    keys.resize(n);
+    pool.parallelFor(0, n, [&](size_t begin, size_t end){
+        for(size_t i = begin;i < end;++i) keys[i] = mortonKey(box, x[i], y[i], z[i]);
+    });
+}
+
+void radixSort(std::vector<uint64_t>& keys, std::vector<uint32_t>& order, ThreadPool& pool){
+    const size_t n = keys.size();
+    order.resize(n);
+    pool.parallelFor(0, n, [&](size_t begin, size_t end){
+        for(size_t i = begin;i < end;++i) order[i] = i;
+    });
+    
+    const size_t chunkTotal = (n + sortChunk - 1) / sortChunk;
+    std::vector<uint64_t> keysOut(n);
+    std::vector<uint32_t> orderOut(n);
+    std::vector<size_t> histogram(256 * chunkTotal);
+    
+    for(int shift = 0;shift < 64;shift += 8){
+        pool.parallelFor(0, n, sortChunk, [&](size_t begin, size_t end){
+            size_t* h = &histogram[256 * (begin / sortChunk)];
+            std::fill(h, h + 256, 0);
+            for(size_t i = begin;i < end;++i) ++h[(keys[i] >> shift) & 0xff];
+        });
+        
+        //Digit-major prefix sum, so every chunk scatters its run of each digit after the earlier chunks: that keeps the sort stable
+        size_t offset = 0;
+        bool sorted = false;
+        for(size_t d = 0;d < 256;++d){
+            size_t digitTotal = 0;
+            for(size_t c = 0;c < chunkTotal;++c){
+                size_t count = histogram[256 * c + d];
+                histogram[256 * c + d] = offset;
+                offset += count;
+                digitTotal += count;
+            }
+            //All keys share this digit, nothing would move
+            if(digitTotal == n) sorted = true;
+        }
+        if(sorted) continue;
+        
+        pool.parallelFor(0, n, sortChunk, [&](size_t begin, size_t end){
+            size_t* h = &histogram[256 * (begin / sortChunk)];
+            for(size_t i = begin;i < end;++i){
+                size_t& target = h[(keys[i] >> shift) & 0xff];
+                keysOut[target] = keys[i];
+                orderOut[target] = order[i];
+                ++target;
+            }
+        });
+        keys.swap(keysOut);
+        order.swap(orderOut);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,95 @@
+#include "octree.hpp"
+
+#include <algorithm>
+
+namespace {
+    //Child ranges of a node at the given depth: keys[begin, end) share every digit above it, so the next 3-bit digit is sorted
+    template<class F>
+    void forEachChild(const std::vector<uint64_t>& keys, uint32_t begin, uint32_t end, int depth, F f){
+        const int shift = 3 * (mortonLevels - 1 - depth);
+        const uint64_t lowMask = (uint64_t(1) << shift) - 1;
+        uint32_t pos = begin;
+        while(pos < end){
+            uint32_t next = std::upper_bound(keys.begin() + pos, keys.begin() + end, keys[pos] | lowMask) - keys.begin();
+            f(pos, next);
+            pos = next;
+        }
+    }
+}
+
+void Octree::build(const float* x, const float* y, const float* z, const float* m, size_t n, size_t leafSize, ThreadPool& pool){
+    box = mortonBounds(x, y, z, n, pool);
+    mortonKeys(box, x, y, z, n, keys, pool);
+    radixSort(keys, order, pool);
+    
+    sortedX.resize(n);
+    sortedY.resize(n);
+    sortedZ.resize(n);
+    sortedMass.resize(n);
+    pool.parallelFor(0, n, [&](size_t begin, size_t end){
+        for(size_t i = begin;i < end;++i){
+            uint32_t j = order[i];
+            sortedX[i] = x[j];
+            sortedY[i] = y[j];
+            sortedZ[i] = z[j];
+            sortedMass[i] = m[j];
+        }
+    });
+    
+    //Breadth-first, one level at a time: count the children of every node in parallel, prefix sum, then write them in parallel
+    nodes.assign(1, OctreeNode{});
+    nodes[0].end = n;
+    nodes[0].centreX = box.minX + 0.5f * box.size;
+    nodes[0].centreY = box.minY + 0.5f * box.size;
+    nodes[0].centreZ = box.minZ + 0.5f * box.size;
+    nodes[0].size = box.size;
+    levelStart.assign({0, 1});
+    std::vector<uint32_t> childOffset;
+    for(int depth = 0;depth < mortonLevels && n > 0;++depth){
+        const size_t levelBegin = levelStart[depth], levelEnd = levelStart[depth + 1];
+        childOffset.resize(levelEnd - levelBegin);
+        pool.parallelFor(levelBegin, levelEnd, 256, [&](size_t begin, size_t end){
+            for(size_t i = begin;i < end;++i){
+                OctreeNode& node = nodes[i];
+                uint32_t count = 0;
+                if(node.end - node.begin > leafSize) forEachChild(keys, node.begin, node.end, depth, [&](uint32_t, uint32_t){++count;});
+                node.childCount = count;
+                childOffset[i - levelBegin] = count;
+            }
+        });
+        uint32_t total = nodes.size();
+        for(size_t i = 0;i < levelEnd - levelBegin;++i){
+            uint32_t count = childOffset[i];
+            childOffset[i] = total;
+            total += count;
+        }
+        if(total == nodes.size()) break;
+        nodes.resize(total);
+        
+        const int childShift = 3 * (mortonLevels - 1 - depth);
+        const float childSize = box.size / (2 << depth);
+        pool.parallelFor(levelBegin, levelEnd, 256, [&](size_t begin, size_t end){
+            for(size_t i = begin;i < end;++i){
+                OctreeNode& node = nodes[i];
+                if(node.childCount == 0) continue;
+                node.firstChild = childOffset[i - levelBegin];
+                uint32_t c = node.firstChild;
+                forEachChild(keys, node.begin, node.end, depth, [&](uint32_t childBegin, uint32_t childEnd){
+                    OctreeNode& child = nodes[c++];
+                    //The octant is the 3-bit Morton digit below the parent's prefix
+                    uint64_t octant = keys[childBegin] >> childShift & 7;
+                    child.begin = childBegin;
+                    child.end = childEnd;
+                    child.parent = i;
+                    child.depth = depth + 1;
+                    child.childCount = 0;
+                    child.size = childSize;
+                    child.centreX = node.centreX + ((octant & 1) ? 0.5f : -0.5f) * childSize;
+                    child.centreY = node.centreY + ((octant & 2) ? 0.5f : -0.5f) * childSize;
+                    child.centreZ = node.centreZ + ((octant & 4) ? 0.5f : -0.5f) * childSize;
+                });
+            }
+        });
+        levelStart.push_back(total);
+    }
+}
\ No newline at end of file
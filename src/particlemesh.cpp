@@ -0,0 +1,332 @@
+#include "particlemesh.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "celllist.hpp"
+#include "morton.hpp"
+
+namespace {
+    //Cells kept free on every side, so the gradient stencil of every cell a particle touches stays inside the grid
+    constexpr size_t gridMargin = 3;
+    constexpr size_t lineChunk = 64;
+    
+    double secondsSince(std::chrono::steady_clock::time_point start){
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    
+    //Assignment weights along one axis: first cell index and up to three weights, for grid coordinate u measured in cells from the
+    //centre of cell 0
+    inline int weights(MassAssignment assignment, float u, float w[3]){
+        if(assignment == MassAssignment::CIC){
+            float base = std::floor(u), f = u - base;
+            w[0] = 1.0f - f;
+            w[1] = f;
+            w[2] = 0.0f;
+            return static_cast<int>(base);
+        }
+        float centre = std::floor(u + 0.5f), d = u - centre;
+        w[0] = 0.5f * (0.5f - d) * (0.5f - d);
+        w[1] = 0.75f - d * d;
+        w[2] = 0.5f * (0.5f + d) * (0.5f + d);
+        return static_cast<int>(centre) - 1;
+    }
+    
+    inline size_t clampIndex(int i, size_t n){
+        return static_cast<size_t>(std::clamp(i, 0, static_cast<int>(n) - 1));
+    }
+}
+
+ParticleMesh::ParticleMesh(size_t nx, size_t ny, size_t nz, MassAssignment assignment):
+    assignment(assignment), origin{0.0f, 0.0f, 0.0f}, spacing{0.0f, 0.0f, 0.0f}, greenSoftening(0.0f), greenValid(false), greenRebuilds(0), depositSeconds(0.0), solveSeconds(0.0), interpolateSeconds(0.0) {
+    setGridSize(nx, ny, nz);
+}
+
+void ParticleMesh::computeAccelerations(const float* x, const float* y, const float* z, const float* m, size_t n, float softening, float* ax, float* ay, float* az, ThreadPool& pool){
+    if(n == 0) return;
+    auto startTime = std::chrono::steady_clock::now();
+    if(updateBox(x, y, z, n, pool)) greenValid = false;
+    deposit(x, y, z, m, n, pool);
+    depositSeconds = secondsSince(startTime);
+    
+    startTime = std::chrono::steady_clock::now();
+    //Below half a cell the grid cannot resolve the softening anyway, and a sharper kernel only adds aliasing
+    softening = std::max(softening, 0.5f * std::min({spacing[0], spacing[1], spacing[2]}));
+    if(!greenValid || softening != greenSoftening) buildGreen(softening, pool);
+    forward(density.data(), spectrum.data(), true, pool);
+    pool.parallelFor(0, spectrum.size(), [&](size_t begin, size_t end){
+        for(size_t i = begin;i < end;++i) spectrum[i] *= greenSpectrum[i];
+    });
+    inverse(spectrum.data(), potential.data(), pool);
+    differentiate(pool);
+    solveSeconds = secondsSince(startTime);
+    
+    startTime = std::chrono::steady_clock::now();
+    interpolate(x, y, z, n, ax, ay, az, pool);
+    interpolateSeconds = secondsSince(startTime);
+}
+
+void ParticleMesh::setGridSize(size_t nx, size_t ny, size_t nz){
+    size_t requested[3] = {nx, ny, nz};
+    for(int a = 0;a < 3;++a){
+        size[a] = nextPowerOfTwo(std::max<size_t>(requested[a], 8));
+        padded[a] = 2 * size[a];
+    }
+    planX = RealFFTPlan(padded[0]);
+    planY = FFTPlan(padded[1]);
+    planZ = FFTPlan(padded[2]);
+    const size_t cells = size[0] * size[1] * size[2];
+    density.assign(cells, 0.0f);
+    potential.assign(cells, 0.0f);
+    gridX.assign(cells, 0.0f);
+    gridY.assign(cells, 0.0f);
+    gridZ.assign(cells, 0.0f);
+    spectrum.assign((padded[0] / 2 + 1) * padded[1] * padded[2], 0.0f);
+    greenSpectrum.assign(spectrum.size(), 0.0f);
+    spacing[0] = spacing[1] = spacing[2] = 0.0f;
+    greenValid = false;
+}
+
+void ParticleMesh::getGridSize(size_t& nx, size_t& ny, size_t& nz) const {
+    nx = size[0];
+    ny = size[1];
+    nz = size[2];
+}
+
+void ParticleMesh::setAssignment(MassAssignment newAssignment){
+    assignment = newAssignment;
+}
+
+MassAssignment ParticleMesh::getAssignment() const {
+    return assignment;
+}
+
+double ParticleMesh::getDepositSeconds() const {
+    return depositSeconds;
+}
+
+double ParticleMesh::getSolveSeconds() const {
+    return solveSeconds;
+}
+
+double ParticleMesh::getInterpolateSeconds() const {
+    return interpolateSeconds;
+}
+
+size_t ParticleMesh::getGreenRebuilds() const {
+    return greenRebuilds;
+}
+
+bool ParticleMesh::updateBox(const float* x, const float* y, const float* z, size_t n, ThreadPool& pool){
+    //The Green's function depends on the cell sizes, so the grid only moves once particles leave it or it has become 1.5 times
+    //too large along some axis, and then gets 5% slack on every side
+    float min[3], max[3];
+    axisBounds(x, y, z, n, min, max, pool);
+    const float largest = std::max({max[0] - min[0], max[1] - min[1], max[2] - min[2], 1e-6f});
+    bool keep = spacing[0] > 0.0f;
+    float extent[3];
+    for(int a = 0;a < 3;++a){
+        extent[a] = std::max(max[a] - min[a], 1e-4f * largest);
+        const float inner = (size[a] - 2 * gridMargin) * spacing[a];
+        const float innerMin = origin[a] + gridMargin * spacing[a];
+        if(min[a] < innerMin || max[a] > innerMin + inner || inner > 1.5f * 1.1f * extent[a]) keep = false;
+    }
+    if(keep) return false;
+    for(int a = 0;a < 3;++a){
+        spacing[a] = 1.1f * extent[a] / (size[a] - 2 * gridMargin);
+        origin[a] = min[a] - 0.05f * extent[a] - gridMargin * spacing[a];
+    }
+    return true;
+}
+
+void ParticleMesh::buildGreen(float softening, ThreadPool& pool){
+    //-1 / sqrt(r^2 + eps^2) on the padded grid with offsets wrapped around, so the cyclic convolution is the isolated one over the
+    //physical part. The FFT normalisation is folded in.
+    std::vector<float> green(padded[0] * padded[1] * padded[2]);
+    const float eps2 = softening * softening;
+    pool.parallelFor(0, padded[1] * padded[2], lineChunk, [&](size_t begin, size_t end){
+        for(size_t line = begin;line < end;++line){
+            const size_t j = line % padded[1], k = line / padded[1];
+            const float dy = std::min(j, padded[1] - j) * spacing[1], dz = std::min(k, padded[2] - k) * spacing[2];
+            float* row = green.data() + line * padded[0];
+            for(size_t i = 0;i < padded[0];++i){
+                const float dx = std::min(i, padded[0] - i) * spacing[0];
+                row[i] = -1.0f / std::sqrt(dx * dx + dy * dy + dz * dz + eps2);
+            }
+        }
+    });
+    forward(green.data(), spectrum.data(), false, pool);
+    const float normalisation = 1.0f / (padded[0] * padded[1] * padded[2]);
+    pool.parallelFor(0, spectrum.size(), [&](size_t begin, size_t end){
+        for(size_t i = begin;i < end;++i) greenSpectrum[i] = spectrum[i].real() * normalisation;
+    });
+    greenSoftening = softening;
+    greenValid = true;
+    ++greenRebuilds;
+}
+
+void ParticleMesh::forward(const float* in, std::complex<float>* out, bool sparse, ThreadPool& pool){
+    //sparse input is the physical grid, zero everywhere else in the padded one, so lines and planes that are all zero are skipped
+    const size_t halfX = padded[0] / 2 + 1;
+    const size_t inX = sparse ? size[0] : padded[0], inY = sparse ? size[1] : padded[1], inZ = sparse ? size[2] : padded[2];
+    pool.parallelFor(0, padded[1] * padded[2], lineChunk, [&](size_t begin, size_t end){
+        std::vector<float> line(padded[0], 0.0f);
+        for(size_t l = begin;l < end;++l){
+            const size_t j = l % padded[1], k = l / padded[1];
+            std::complex<float>* row = out + l * halfX;
+            if(j >= inY || k >= inZ){
+                std::fill(row, row + halfX, 0.0f);
+                continue;
+            }
+            std::copy(in + (k * inY + j) * inX, in + (k * inY + j) * inX + inX, line.begin());
+            planX.forward(line.data(), row);
+        }
+    });
+    pool.parallelFor(0, inZ * halfX, lineChunk, [&](size_t begin, size_t end){
+        std::vector<std::complex<float>> column(padded[1]);
+        for(size_t l = begin;l < end;++l){
+            const size_t i = l % halfX, k = l / halfX;
+            std::complex<float>* base = out + k * padded[1] * halfX + i;
+            for(size_t j = 0;j < padded[1];++j) column[j] = base[j * halfX];
+            planY.transform(column.data(), false);
+            for(size_t j = 0;j < padded[1];++j) base[j * halfX] = column[j];
+        }
+    });
+    transformZ(out, false, padded[2], pool);
+}
+
+void ParticleMesh::transformZ(std::complex<float>* data, bool inverse, size_t keep, ThreadPool& pool){
+    //The z lines are a whole xy plane apart, so they are gathered lineChunk at a time to read whole cache lines. Only the first keep
+    //values of every line are written back.
+    const size_t lines = padded[1] * (padded[0] / 2 + 1);
+    pool.parallelFor(0, lines, lineChunk, [&](size_t begin, size_t end){
+        std::vector<std::complex<float>> block(lineChunk * padded[2]);
+        const size_t count = end - begin;
+        for(size_t k = 0;k < padded[2];++k){
+            const std::complex<float>* row = data + k * lines + begin;
+            for(size_t b = 0;b < count;++b) block[b * padded[2] + k] = row[b];
+        }
+        for(size_t b = 0;b < count;++b) planZ.transform(block.data() + b * padded[2], inverse);
+        for(size_t k = 0;k < keep;++k){
+            std::complex<float>* row = data + k * lines + begin;
+            for(size_t b = 0;b < count;++b) row[b] = block[b * padded[2] + k];
+        }
+    });
+}
+
+void ParticleMesh::inverse(std::complex<float>* in, float* out, ThreadPool& pool){
+    //Only the physical part of the result is needed, so the y and x passes skip everything outside it
+    const size_t halfX = padded[0] / 2 + 1;
+    transformZ(in, true, size[2], pool);
+    pool.parallelFor(0, size[2] * halfX, lineChunk, [&](size_t begin, size_t end){
+        std::vector<std::complex<float>> column(padded[1]);
+        for(size_t l = begin;l < end;++l){
+            const size_t i = l % halfX, k = l / halfX;
+            std::complex<float>* base = in + k * padded[1] * halfX + i;
+            for(size_t j = 0;j < padded[1];++j) column[j] = base[j * halfX];
+            planY.transform(column.data(), true);
+            for(size_t j = 0;j < size[1];++j) base[j * halfX] = column[j];
+        }
+    });
+    pool.parallelFor(0, size[1] * size[2], lineChunk, [&](size_t begin, size_t end){
+        std::vector<float> line(padded[0]);
+        for(size_t l = begin;l < end;++l){
+            const size_t j = l % size[1], k = l / size[1];
+            planX.inverse(in + (k * padded[1] + j) * halfX, line.data());
+            std::copy(line.begin(), line.begin() + size[0], out + l * size[0]);
+        }
+    });
+}
+
+void ParticleMesh::deposit(const float* x, const float* y, const float* z, const float* m, size_t n, ThreadPool& pool){
+    //Colouring along x: particles are binned into slabs of at least two cells by the first cell they touch, and every other slab is
+    //deposited in parallel, so no two slabs running at once write the same cell and no atomics are needed
+    const size_t slabWidth = std::max<size_t>(2, size[0] / (8 * pool.getThreadCount()));
+    const size_t slabs = (size[0] + slabWidth - 1) / slabWidth;
+    auto slabOf = [&](size_t i){
+        float w[3];
+        int first = weights(assignment, (x[i] - origin[0]) / spacing[0] - 0.5f, w);
+        return clampIndex(first, size[0]) / slabWidth;
+    };
+    
+    std::vector<uint32_t> offsets;
+    countingSort(n, slabs, slabOf, slabOrder, slabStart, offsets, pool);
+    
+    pool.parallelFor(0, density.size(), [&](size_t begin, size_t end){
+        std::fill(density.begin() + begin, density.begin() + end, 0.0f);
+    });
+    const int stencil = assignment == MassAssignment::CIC ? 2 : 3;
+    for(size_t colour = 0;colour < 2;++colour){
+        pool.parallelFor(0, (slabs - colour + 1) / 2, 1, [&](size_t begin, size_t end){
+            for(size_t t = begin;t < end;++t){
+                const size_t s = colour + 2 * t;
+                for(uint32_t p = slabStart[s];p < slabStart[s + 1];++p){
+                    const uint32_t i = slabOrder[p];
+                    float wx[3], wy[3], wz[3];
+                    const int fx = weights(assignment, (x[i] - origin[0]) / spacing[0] - 0.5f, wx);
+                    const int fy = weights(assignment, (y[i] - origin[1]) / spacing[1] - 0.5f, wy);
+                    const int fz = weights(assignment, (z[i] - origin[2]) / spacing[2] - 0.5f, wz);
+                    for(int c = 0;c < stencil;++c){
+                        const size_t k = clampIndex(fz + c, size[2]);
+                        for(int b = 0;b < stencil;++b){
+                            const size_t j = clampIndex(fy + b, size[1]);
+                            float* row = density.data() + (k * size[1] + j) * size[0];
+                            const float w = m[i] * wz[c] * wy[b];
+                            for(int a = 0;a < stencil;++a) row[clampIndex(fx + a, size[0])] += w * wx[a];
+                        }
+                    }
+                }
+            }
+        });
+    }
+}
+
+void ParticleMesh::differentiate(ThreadPool& pool){
+    //a = -grad(phi) with the fourth-order central difference (8 (f(+1) - f(-1)) - (f(+2) - f(-2))) / 12h, clamped at the edges
+    const float scale[3] = {-1.0f / (12.0f * spacing[0]), -1.0f / (12.0f * spacing[1]), -1.0f / (12.0f * spacing[2])};
+    pool.parallelFor(0, size[1] * size[2], lineChunk, [&](size_t begin, size_t end){
+        for(size_t l = begin;l < end;++l){
+            const int j = l % size[1], k = l / size[1];
+            for(int i = 0;i < static_cast<int>(size[0]);++i){
+                auto at = [&](int di, int dj, int dk){
+                    return potential[(clampIndex(k + dk, size[2]) * size[1] + clampIndex(j + dj, size[1])) * size[0] + clampIndex(i + di, size[0])];
+                };
+                const size_t cell = l * size[0] + i;
+                gridX[cell] = scale[0] * (8.0f * (at(1, 0, 0) - at(-1, 0, 0)) - (at(2, 0, 0) - at(-2, 0, 0)));
+                gridY[cell] = scale[1] * (8.0f * (at(0, 1, 0) - at(0, -1, 0)) - (at(0, 2, 0) - at(0, -2, 0)));
+                gridZ[cell] = scale[2] * (8.0f * (at(0, 0, 1) - at(0, 0, -1)) - (at(0, 0, 2) - at(0, 0, -2)));
+            }
+        }
+    });
+}
+
+void ParticleMesh::interpolate(const float* x, const float* y, const float* z, size_t n, float* ax, float* ay, float* az, ThreadPool& pool){
+    //Same weights as the deposit, which keeps the self-force zero and momentum conserved. Only reads the grids, so no colouring.
+    const int stencil = assignment == MassAssignment::CIC ? 2 : 3;
+    pool.parallelFor(0, n, [&](size_t begin, size_t end){
+        for(size_t i = begin;i < end;++i){
+            float wx[3], wy[3], wz[3];
+            const int fx = weights(assignment, (x[i] - origin[0]) / spacing[0] - 0.5f, wx);
+            const int fy = weights(assignment, (y[i] - origin[1]) / spacing[1] - 0.5f, wy);
+            const int fz = weights(assignment, (z[i] - origin[2]) / spacing[2] - 0.5f, wz);
+            float accX = 0.0f, accY = 0.0f, accZ = 0.0f;
+            for(int c = 0;c < stencil;++c){
+                const size_t k = clampIndex(fz + c, size[2]);
+                for(int b = 0;b < stencil;++b){
+                    const size_t row = (k * size[1] + clampIndex(fy + b, size[1])) * size[0];
+                    for(int a = 0;a < stencil;++a){
+                        const size_t cell = row + clampIndex(fx + a, size[0]);
+                        const float w = wz[c] * wy[b] * wx[a];
+                        accX += w * gridX[cell];
+                        accY += w * gridY[cell];
+                        accZ += w * gridZ[cell];
+                    }
+                }
+            }
+            ax[i] = accX;
+            ay[i] = accY;
+            az[i] = accZ;
+        }
+    });
+}
\ No newline at end of file
@@ -0,0 +1,299 @@
+#include "potential.hpp"
+
+#include "symplectic.hpp"
+
+//The kernels here only load, store and step. Everything a potential computes comes from its accelerate(), inlined for the lane
+//type of each kernel, so a new component or combination needs no kernel code of its own.
+
+namespace {
+    //symplectic.hpp systems, for one particle and, with the target attribute the vector ones need, one SIMD vector of them
+    template<class P> struct PotentialSystem {
+        const P& potential;
+        float x{}, y{}, z{}, vx{}, vy{}, vz{}, ax{}, ay{}, az{};
+        
+        void kick(float h){
+            vx += h * ax;
+            vy += h * ay;
+            vz += h * az;
+        }
+        void drift(float h, float h2){
+            x += h * vx + h2 * ax;
+            y += h * vy + h2 * ay;
+            z += h * vz + h2 * az;
+        }
+        void forces(){
+            ax = ay = az = 0.0f;
+            potential.accelerate(x, y, z, ax, ay, az);
+        }
+    };
+    
+    template<class P> void potentialAccelerationsScalar(const float* x, const float* y, const float* z, size_t begin, size_t end, const P& potential, float* ax, float* ay, float* az){
+        for(size_t i = begin;i < end;++i) potential.accelerate(x[i], y[i], z[i], ax[i], ay[i], az[i]);
+    }
+    
+    template<class P> void potentialStepsScalar(ParticleArrays& p, size_t begin, size_t end, const P& potential, float dt, size_t steps){
+        const float dt2 = dt * dt;
+        for(size_t i = begin;i < end;++i){
+            float x = p.x[i], y = p.y[i], z = p.z[i], px = p.prevX[i], py = p.prevY[i], pz = p.prevZ[i];
+            for(size_t s = 0;s < steps;++s){
+                float ax = 0.0f, ay = 0.0f, az = 0.0f;
+                potential.accelerate(x, y, z, ax, ay, az);
+                float nx = 2.0f * x - px + ax * dt2, ny = 2.0f * y - py + ay * dt2, nz = 2.0f * z - pz + az * dt2;
+                px = x;
+                py = y;
+                pz = z;
+                x = nx;
+                y = ny;
+                z = nz;
+            }
+            p.x[i] = x;
+            p.y[i] = y;
+            p.z[i] = z;
+            p.prevX[i] = px;
+            p.prevY[i] = py;
+            p.prevZ[i] = pz;
+        }
+    }
+    
+    template<class Scheme, class P> void integratePotentialScalar(ParticleArrays& p, size_t begin, size_t end, const P& potential, float dt, size_t steps){
+        const float invDt = 1.0f / dt;
+        for(size_t i = begin;i < end;++i){
+            PotentialSystem<P> s{potential};
+            s.x = p.x[i];
+            s.y = p.y[i];
+            s.z = p.z[i];
+            s.vx = (p.x[i] - p.prevX[i]) * invDt;
+            s.vy = (p.y[i] - p.prevY[i]) * invDt;
+            s.vz = (p.z[i] - p.prevZ[i]) * invDt;
+            runSteps<Scheme>(s, dt, steps);
+            p.x[i] = s.x;
+            p.y[i] = s.y;
+            p.z[i] = s.z;
+            p.prevX[i] = s.x - s.vx * dt;
+            p.prevY[i] = s.y - s.vy * dt;
+            p.prevZ[i] = s.z - s.vz * dt;
+        }
+    }
+
+#ifdef SIMD_X86
+    template<class P> struct PotentialSystemAVX2 {
+        const P& potential;
+        __m256 x{}, y{}, z{}, vx{}, vy{}, vz{}, ax{}, ay{}, az{};
+        
+        __attribute__((target("avx2,fma"))) void kick(float h){
+            vx += h * ax;
+            vy += h * ay;
+            vz += h * az;
+        }
+        __attribute__((target("avx2,fma"))) void drift(float h, float h2){
+            x += h * vx + h2 * ax;
+            y += h * vy + h2 * ay;
+            z += h * vz + h2 * az;
+        }
+        __attribute__((target("avx2,fma"))) void forces(){
+            ax = ay = az = _mm256_setzero_ps();
+            potential.accelerate(x, y, z, ax, ay, az);
+        }
+    };
+    
+    template<class P> struct PotentialSystemAVX512 {
+        const P& potential;
+        __m512 x{}, y{}, z{}, vx{}, vy{}, vz{}, ax{}, ay{}, az{};
+        
+        __attribute__((target("avx512f"))) void kick(float h){
+            vx += h * ax;
+            vy += h * ay;
+            vz += h * az;
+        }
+        __attribute__((target("avx512f"))) void drift(float h, float h2){
+            x += h * vx + h2 * ax;
+            y += h * vy + h2 * ay;
+            z += h * vz + h2 * az;
+        }
+        __attribute__((target("avx512f"))) void forces(){
+            ax = ay = az = _mm512_setzero_ps();
+            potential.accelerate(x, y, z, ax, ay, az);
+        }
+    };
+    
+    template<class P> __attribute__((target("avx2,fma"))) void potentialAccelerationsAVX2(const float* x, const float* y, const float* z, size_t begin, size_t end, const P& potential, float* ax, float* ay, float* az){
+        size_t i = begin;
+        for(;i + 8 <= end;i += 8){
+            __m256 vax = _mm256_loadu_ps(ax + i), vay = _mm256_loadu_ps(ay + i), vaz = _mm256_loadu_ps(az + i);
+            potential.accelerate(_mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i), _mm256_loadu_ps(z + i), vax, vay, vaz);
+            _mm256_storeu_ps(ax + i, vax);
+            _mm256_storeu_ps(ay + i, vay);
+            _mm256_storeu_ps(az + i, vaz);
+        }
+        if(i < end) potentialAccelerationsScalar(x, y, z, i, end, potential, ax, ay, az);
+    }
+    
+    template<class P> __attribute__((target("avx512f"))) void potentialAccelerationsAVX512(const float* x, const float* y, const float* z, size_t begin, size_t end, const P& potential, float* ax, float* ay, float* az){
+        for(size_t i = begin;i < end;i += 16){
+            //Lanes past the end run on zeros, which every component keeps finite, and are never stored
+            __mmask16 m = end - i >= 16 ? 0xffff : static_cast<__mmask16>((1u << (end - i)) - 1);
+            __m512 vax = _mm512_maskz_loadu_ps(m, ax + i), vay = _mm512_maskz_loadu_ps(m, ay + i), vaz = _mm512_maskz_loadu_ps(m, az + i);
+            potential.accelerate(_mm512_maskz_loadu_ps(m, x + i), _mm512_maskz_loadu_ps(m, y + i), _mm512_maskz_loadu_ps(m, z + i), vax, vay, vaz);
+            _mm512_mask_storeu_ps(ax + i, m, vax);
+            _mm512_mask_storeu_ps(ay + i, m, vay);
+            _mm512_mask_storeu_ps(az + i, m, vaz);
+        }
+    }
+    
+    template<class P> __attribute__((target("avx2,fma"))) void potentialStepsAVX2(ParticleArrays& p, size_t begin, size_t end, const P& potential, float dt, size_t steps){
+        const float dt2 = dt * dt;
+        size_t i = begin;
+        for(;i + 8 <= end;i += 8){
+            __m256 x = _mm256_loadu_ps(p.x.data() + i), y = _mm256_loadu_ps(p.y.data() + i), z = _mm256_loadu_ps(p.z.data() + i);
+            __m256 px = _mm256_loadu_ps(p.prevX.data() + i), py = _mm256_loadu_ps(p.prevY.data() + i), pz = _mm256_loadu_ps(p.prevZ.data() + i);
+            for(size_t s = 0;s < steps;++s){
+                __m256 ax = _mm256_setzero_ps(), ay = ax, az = ax;
+                potential.accelerate(x, y, z, ax, ay, az);
+                __m256 nx = 2.0f * x - px + ax * dt2, ny = 2.0f * y - py + ay * dt2, nz = 2.0f * z - pz + az * dt2;
+                px = x;
+                py = y;
+                pz = z;
+                x = nx;
+                y = ny;
+                z = nz;
+            }
+            _mm256_storeu_ps(p.x.data() + i, x);
+            _mm256_storeu_ps(p.y.data() + i, y);
+            _mm256_storeu_ps(p.z.data() + i, z);
+            _mm256_storeu_ps(p.prevX.data() + i, px);
+            _mm256_storeu_ps(p.prevY.data() + i, py);
+            _mm256_storeu_ps(p.prevZ.data() + i, pz);
+        }
+        if(i < end) potentialStepsScalar(p, i, end, potential, dt, steps);
+    }
+    
+    template<class P> __attribute__((target("avx512f"))) void potentialStepsAVX512(ParticleArrays& p, size_t begin, size_t end, const P& potential, float dt, size_t steps){
+        const float dt2 = dt * dt;
+        //Four vectors in flight, as in verletStepsAVX512
+        constexpr size_t lanes = 4;
+        
+        for(size_t i = begin;i < end;i += 16 * lanes){
+            __mmask16 m[lanes];
+            __m512 x[lanes], y[lanes], z[lanes], px[lanes], py[lanes], pz[lanes];
+            for(size_t l = 0;l < lanes;++l){
+                size_t j = i + 16 * l;
+                m[l] = j >= end ? 0 : end - j >= 16 ? 0xffff : static_cast<__mmask16>((1u << (end - j)) - 1);
+                x[l] = _mm512_maskz_loadu_ps(m[l], p.x.data() + j);
+                y[l] = _mm512_maskz_loadu_ps(m[l], p.y.data() + j);
+                z[l] = _mm512_maskz_loadu_ps(m[l], p.z.data() + j);
+                px[l] = _mm512_maskz_loadu_ps(m[l], p.prevX.data() + j);
+                py[l] = _mm512_maskz_loadu_ps(m[l], p.prevY.data() + j);
+                pz[l] = _mm512_maskz_loadu_ps(m[l], p.prevZ.data() + j);
+            }
+            for(size_t s = 0;s < steps;++s){
+                for(size_t l = 0;l < lanes;++l){
+                    __m512 ax = _mm512_setzero_ps(), ay = ax, az = ax;
+                    potential.accelerate(x[l], y[l], z[l], ax, ay, az);
+                    __m512 nx = 2.0f * x[l] - px[l] + ax * dt2, ny = 2.0f * y[l] - py[l] + ay * dt2, nz = 2.0f * z[l] - pz[l] + az * dt2;
+                    px[l] = x[l];
+                    py[l] = y[l];
+                    pz[l] = z[l];
+                    x[l] = nx;
+                    y[l] = ny;
+                    z[l] = nz;
+                }
+            }
+            for(size_t l = 0;l < lanes;++l){
+                size_t j = i + 16 * l;
+                _mm512_mask_storeu_ps(p.x.data() + j, m[l], x[l]);
+                _mm512_mask_storeu_ps(p.y.data() + j, m[l], y[l]);
+                _mm512_mask_storeu_ps(p.z.data() + j, m[l], z[l]);
+                _mm512_mask_storeu_ps(p.prevX.data() + j, m[l], px[l]);
+                _mm512_mask_storeu_ps(p.prevY.data() + j, m[l], py[l]);
+                _mm512_mask_storeu_ps(p.prevZ.data() + j, m[l], pz[l]);
+            }
+        }
+    }
+    
+    template<class Scheme, class P> __attribute__((target("avx2,fma"))) void integratePotentialAVX2(ParticleArrays& p, size_t begin, size_t end, const P& potential, float dt, size_t steps){
+        const float invDt = 1.0f / dt;
+        size_t i = begin;
+        for(;i + 8 <= end;i += 8){
+            PotentialSystemAVX2<P> s{potential};
+            s.x = _mm256_loadu_ps(p.x.data() + i);
+            s.y = _mm256_loadu_ps(p.y.data() + i);
+            s.z = _mm256_loadu_ps(p.z.data() + i);
+            s.vx = (s.x - _mm256_loadu_ps(p.prevX.data() + i)) * invDt;
+            s.vy = (s.y - _mm256_loadu_ps(p.prevY.data() + i)) * invDt;
+            s.vz = (s.z - _mm256_loadu_ps(p.prevZ.data() + i)) * invDt;
+            runSteps<Scheme>(s, dt, steps);
+            _mm256_storeu_ps(p.x.data() + i, s.x);
+            _mm256_storeu_ps(p.y.data() + i, s.y);
+            _mm256_storeu_ps(p.z.data() + i, s.z);
+            _mm256_storeu_ps(p.prevX.data() + i, s.x - s.vx * dt);
+            _mm256_storeu_ps(p.prevY.data() + i, s.y - s.vy * dt);
+            _mm256_storeu_ps(p.prevZ.data() + i, s.z - s.vz * dt);
+        }
+        if(i < end) integratePotentialScalar<Scheme>(p, i, end, potential, dt, steps);
+    }
+    
+    template<class Scheme, class P> __attribute__((target("avx512f"))) void integratePotentialAVX512(ParticleArrays& p, size_t begin, size_t end, const P& potential, float dt, size_t steps){
+        const float invDt = 1.0f / dt;
+        for(size_t i = begin;i < end;i += 16){
+            __mmask16 m = end - i >= 16 ? 0xffff : static_cast<__mmask16>((1u << (end - i)) - 1);
+            PotentialSystemAVX512<P> s{potential};
+            s.x = _mm512_maskz_loadu_ps(m, p.x.data() + i);
+            s.y = _mm512_maskz_loadu_ps(m, p.y.data() + i);
+            s.z = _mm512_maskz_loadu_ps(m, p.z.data() + i);
+            s.vx = (s.x - _mm512_maskz_loadu_ps(m, p.prevX.data() + i)) * invDt;
+            s.vy = (s.y - _mm512_maskz_loadu_ps(m, p.prevY.data() + i)) * invDt;
+            s.vz = (s.z - _mm512_maskz_loadu_ps(m, p.prevZ.data() + i)) * invDt;
+            runSteps<Scheme>(s, dt, steps);
+            _mm512_mask_storeu_ps(p.x.data() + i, m, s.x);
+            _mm512_mask_storeu_ps(p.y.data() + i, m, s.y);
+            _mm512_mask_storeu_ps(p.z.data() + i, m, s.z);
+            _mm512_mask_storeu_ps(p.prevX.data() + i, m, s.x - s.vx * dt);
+            _mm512_mask_storeu_ps(p.prevY.data() + i, m, s.y - s.vy * dt);
+            _mm512_mask_storeu_ps(p.prevZ.data() + i, m, s.z - s.vz * dt);
+        }
+    }
+#endif
+}
+
+template<class P> void potentialAccelerations(const float* x, const float* y, const float* z, size_t begin, size_t end, const P& potential, float* ax, float* ay, float* az){
+#ifdef SIMD_X86
+    switch(detectSimdLevel()){
+        case SimdLevel::AVX512: potentialAccelerationsAVX512(x, y, z, begin, end, potential, ax, ay, az); return;
+        case SimdLevel::AVX2: potentialAccelerationsAVX2(x, y, z, begin, end, potential, ax, ay, az); return;
+        default: break;
+    }
+#endif
+    potentialAccelerationsScalar(x, y, z, begin, end, potential, ax, ay, az);
+}
+
+template<class P> void potentialSteps(ParticleArrays& p, size_t begin, size_t end, const P& potential, float dt, size_t steps){
+#ifdef SIMD_X86
+    switch(detectSimdLevel()){
+        case SimdLevel::AVX512: potentialStepsAVX512(p, begin, end, potential, dt, steps); return;
+        case SimdLevel::AVX2: potentialStepsAVX2(p, begin, end, potential, dt, steps); return;
+        default: break;
+    }
+#endif
+    potentialStepsScalar(p, begin, end, potential, dt, steps);
+}
+
+template<class Scheme, class P> void integratePotential(ParticleArrays& p, size_t begin, size_t end, const P& potential, float dt, size_t steps){
+#ifdef SIMD_X86
+    switch(detectSimdLevel()){
+        case SimdLevel::AVX512: integratePotentialAVX512<Scheme>(p, begin, end, potential, dt, steps); return;
+        case SimdLevel::AVX2: integratePotentialAVX2<Scheme>(p, begin, end, potential, dt, steps); return;
+        default: break;
+    }
+#endif
+    integratePotentialScalar<Scheme>(p, begin, end, potential, dt, steps);
+}
+
+template void potentialAccelerations<GalaxyPotential>(const float*, const float*, const float*, size_t, size_t, const GalaxyPotential&, float*, float*, float*);
+template void potentialAccelerations<MilkyWayPotential>(const float*, const float*, const float*, size_t, size_t, const MilkyWayPotential&, float*, float*, float*);
+template void potentialAccelerations<Potential<MiyamotoNagai>>(const float*, const float*, const float*, size_t, size_t, const Potential<MiyamotoNagai>&, float*, float*, float*);
+template void potentialAccelerations<Potential<Hernquist>>(const float*, const float*, const float*, size_t, size_t, const Potential<Hernquist>&, float*, float*, float*);
+template void potentialAccelerations<Potential<NFW>>(const float*, const float*, const float*, size_t, size_t, const Potential<NFW>&, float*, float*, float*);
+template void potentialSteps<GalaxyPotential>(ParticleArrays&, size_t, size_t, const GalaxyPotential&, float, size_t);
+template void integratePotential<LeapfrogKDK, GalaxyPotential>(ParticleArrays&, size_t, size_t, const GalaxyPotential&, float, size_t);
+template void integratePotential<VelocityVerlet, GalaxyPotential>(ParticleArrays&, size_t, size_t, const GalaxyPotential&, float, size_t);
+template void integratePotential<ForestRuth, GalaxyPotential>(ParticleArrays&, size_t, size_t, const GalaxyPotential&, float, size_t);
\ No newline at end of file
@@ -0,0 +1,262 @@
+#include "potentialtable.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <limits>
+
+#include "simd.hpp"
+
+void PotentialTable::build(float newHr, float newHz, size_t newNR, size_t newNZ, ThreadPool& pool){
+    newNR = std::max<size_t>(newNR, 2);
+    newNZ = std::max<size_t>(newNZ, 2);
+    if(newHr == hr && newHz == hz && newNR == nR && newNZ == nZ) return;
+    hr = newHr;
+    hz = newHz;
+    nR = newNR;
+    nZ = newNZ;
+    table.resize(nR * nZ);
+    
+    pool.parallelFor(0, nZ, 1, [&](size_t begin, size_t end){
+        for(size_t j = begin;j < end;++j){
+            double t = static_cast<double>(j) / (nZ - 1);
+            double absZ = t < 1.0 ? hz * t / (1.0 - t) : std::numeric_limits<double>::infinity();
+            for(size_t i = 0;i < nR;++i){
+                double s = static_cast<double>(i) / (nR - 1);
+                double rProj = s < 1.0 ? hr * s / (1.0 - s) : std::numeric_limits<double>::infinity();
+                table[j * nR + i] = exact(rProj, absZ, hr, hz);
+            }
+        }
+    });
+}
+
+float PotentialTable::lookup(float rProj, float absZ) const {
+    //Written so that NaN and infinity end up on the last node instead of indexing out of the table
+    float u = rProj / (rProj + hr) * (nR - 1), w = absZ / (absZ + hz) * (nZ - 1);
+    if(!(u < nR - 1)) u = nR - 1;
+    if(!(w < nZ - 1)) w = nZ - 1;
+    size_t i = std::min(static_cast<size_t>(u), nR - 2), j = std::min(static_cast<size_t>(w), nZ - 2);
+    float fu = u - i, fw = w - j;
+    const float* node = table.data() + j * nR + i;
+    float h0 = node[0] + (node[1] - node[0]) * fu;
+    float h1 = node[nR] + (node[nR + 1] - node[nR]) * fu;
+    return h0 + (h1 - h0) * fw;
+}
+
+void PotentialTable::error(const float* x, const float* y, const float* z, size_t n, double& maxError, double& rmsError) const {
+    maxError = 0.0;
+    rmsError = 0.0;
+    size_t count = 0;
+    for(size_t i = 0;i < n;++i){
+        //Everything but h is exact, so the relative error of h is that of the acceleration
+        float rProj = std::sqrt(x[i] * x[i] + y[i] * y[i]);
+        double h = exact(rProj, std::fabs(z[i]), hr, hz);
+        if(h == 0.0) continue;
+        double e = std::fabs(lookup(rProj, std::fabs(z[i])) - h) / h;
+        maxError = std::max(maxError, e);
+        rmsError += e * e;
+        ++count;
+    }
+    rmsError = std::sqrt(rmsError / std::max<size_t>(count, 1));
+}
+
+const std::vector<float>& PotentialTable::data() const {
+    return table;
+}
+
+float PotentialTable::getHr() const {
+    return hr;
+}
+
+float PotentialTable::getHz() const {
+    return hz;
+}
+
+size_t PotentialTable::getSizeR() const {
+    return nR;
+}
+
+size_t PotentialTable::getSizeZ() const {
+    return nZ;
+}
+
+bool PotentialTable::empty() const {
+    return table.empty();
+}
+
+double PotentialTable::exact(double rProj, double absZ, double hr, double hz){
+    return std::expm1(-rProj / hr) * std::expm1(-absZ / hz);
+}
+
+void tabulatedStepsScalar(ParticleArrays& p, size_t begin, size_t end, const PotentialTable& table, float totalGM, float dt, size_t steps){
+    const float gmDt2 = totalGM * dt * dt;
+    for(size_t i = begin;i < end;++i){
+        float x = p.x[i], y = p.y[i], z = p.z[i], px = p.prevX[i], py = p.prevY[i], pz = p.prevZ[i];
+        for(size_t s = 0;s < steps;++s){
+            float rProj2 = x * x + y * y;
+            float invR = 1.0f / std::sqrt(std::max(rProj2 + z * z, FLT_MIN));
+            float a = gmDt2 * table.lookup(std::sqrt(rProj2), std::fabs(z)) * invR * invR * invR;
+            float nx = 2.0f * x - px - a * x;
+            float ny = 2.0f * y - py - a * y;
+            float nz = 2.0f * z - pz - a * z;
+            px = x;
+            py = y;
+            pz = z;
+            x = nx;
+            y = ny;
+            z = nz;
+        }
+        p.x[i] = x;
+        p.y[i] = y;
+        p.z[i] = z;
+        p.prevX[i] = px;
+        p.prevY[i] = py;
+        p.prevZ[i] = pz;
+    }
+}
+
+#ifdef SIMD_X86
+namespace {
+    using namespace simd;
+    
+    //rsqrt estimate plus one Newton-Raphson step, about 2.7e-7 relative, well below the error of the interpolation
+    constexpr fastmath::Accuracy rsqrtAccuracy = fastmath::Accuracy::Balanced;
+    
+    //1 / x to about float precision, rcp14 plus one Newton-Raphson iteration
+    __attribute__((target("avx512f"))) inline __m512 rcp512(__m512 x){
+        __m512 y = _mm512_rcp14_ps(x);
+        return _mm512_mul_ps(y, _mm512_fnmadd_ps(x, y, _mm512_set1_ps(2.0f)));
+    }
+    
+    //The four corners are gathered, the index arithmetic is the same as PotentialTable::lookup
+    __attribute__((target("avx2,fma"))) inline __m256 tableFactor256(__m256 vx, __m256 vy, __m256 vz, const float* table, __m256 hr, __m256 hz, __m256 maxU, __m256 maxW, __m256i nR, __m256i maxI, __m256i maxJ, __m256 gmDt2){
+        const __m256 tiny = _mm256_set1_ps(FLT_MIN), absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+        __m256 rProj2 = _mm256_max_ps(_mm256_fmadd_ps(vx, vx, _mm256_mul_ps(vy, vy)), tiny);
+        __m256 invR = fastmath::rsqrt<rsqrtAccuracy>(_mm256_fmadd_ps(vz, vz, rProj2));
+        __m256 rProj = _mm256_mul_ps(rProj2, fastmath::rsqrt<rsqrtAccuracy>(rProj2));
+        __m256 absZ = _mm256_and_ps(vz, absMask);
+        __m256 u = _mm256_min_ps(_mm256_mul_ps(_mm256_div_ps(rProj, _mm256_add_ps(rProj, hr)), maxU), maxU);
+        __m256 w = _mm256_min_ps(_mm256_mul_ps(_mm256_div_ps(absZ, _mm256_add_ps(absZ, hz)), maxW), maxW);
+        __m256i i = _mm256_min_epi32(_mm256_cvttps_epi32(u), maxI), j = _mm256_min_epi32(_mm256_cvttps_epi32(w), maxJ);
+        __m256 fu = _mm256_sub_ps(u, _mm256_cvtepi32_ps(i)), fw = _mm256_sub_ps(w, _mm256_cvtepi32_ps(j));
+        __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(j, nR), i);
+        __m256 h00 = _mm256_i32gather_ps(table, index, 4);
+        __m256 h10 = _mm256_i32gather_ps(table + 1, index, 4);
+        __m256 h01 = _mm256_i32gather_ps(table, _mm256_add_epi32(index, nR), 4);
+        __m256 h11 = _mm256_i32gather_ps(table + 1, _mm256_add_epi32(index, nR), 4);
+        __m256 h0 = _mm256_fmadd_ps(fu, _mm256_sub_ps(h10, h00), h00);
+        __m256 h1 = _mm256_fmadd_ps(fu, _mm256_sub_ps(h11, h01), h01);
+        return _mm256_mul_ps(_mm256_mul_ps(gmDt2, _mm256_fmadd_ps(fw, _mm256_sub_ps(h1, h0), h0)), _mm256_mul_ps(_mm256_mul_ps(invR, invR), invR));
+    }
+    
+    __attribute__((target("avx512f"))) inline __m512 tableFactor512(__m512 vx, __m512 vy, __m512 vz, const float* table, __m512 hr, __m512 hz, __m512 maxU, __m512 maxW, __m512i nR, __m512i maxI, __m512i maxJ, __m512 gmDt2){
+        const __m512 tiny = _mm512_set1_ps(FLT_MIN);
+        __m512 rProj2 = _mm512_max_ps(_mm512_fmadd_ps(vx, vx, _mm512_mul_ps(vy, vy)), tiny);
+        __m512 invR = fastmath::rsqrt<rsqrtAccuracy>(_mm512_fmadd_ps(vz, vz, rProj2));
+        __m512 rProj = _mm512_mul_ps(rProj2, fastmath::rsqrt<rsqrtAccuracy>(rProj2));
+        __m512 absZ = _mm512_abs_ps(vz);
+        __m512 u = _mm512_min_ps(_mm512_mul_ps(_mm512_mul_ps(rProj, rcp512(_mm512_add_ps(rProj, hr))), maxU), maxU);
+        __m512 w = _mm512_min_ps(_mm512_mul_ps(_mm512_mul_ps(absZ, rcp512(_mm512_add_ps(absZ, hz))), maxW), maxW);
+        __m512i i = _mm512_min_epi32(_mm512_cvttps_epi32(u), maxI), j = _mm512_min_epi32(_mm512_cvttps_epi32(w), maxJ);
+        __m512 fu = _mm512_sub_ps(u, _mm512_cvtepi32_ps(i)), fw = _mm512_sub_ps(w, _mm512_cvtepi32_ps(j));
+        __m512i index = _mm512_add_epi32(_mm512_mullo_epi32(j, nR), i);
+        __m512 h00 = _mm512_i32gather_ps(index, table, 4);
+        __m512 h10 = _mm512_i32gather_ps(index, table + 1, 4);
+        __m512 h01 = _mm512_i32gather_ps(_mm512_add_epi32(index, nR), table, 4);
+        __m512 h11 = _mm512_i32gather_ps(_mm512_add_epi32(index, nR), table + 1, 4);
+        __m512 h0 = _mm512_fmadd_ps(fu, _mm512_sub_ps(h10, h00), h00);
+        __m512 h1 = _mm512_fmadd_ps(fu, _mm512_sub_ps(h11, h01), h01);
+        return _mm512_mul_ps(_mm512_mul_ps(gmDt2, _mm512_fmadd_ps(fw, _mm512_sub_ps(h1, h0), h0)), _mm512_mul_ps(_mm512_mul_ps(invR, invR), invR));
+    }
+    
+    __attribute__((target("avx2,fma"))) void tabulatedStepsAVX2(ParticleArrays& p, size_t begin, size_t end, const PotentialTable& table, float totalGM, float dt, size_t steps){
+        const __m256 hr = _mm256_set1_ps(table.getHr()), hz = _mm256_set1_ps(table.getHz()), gmDt2 = _mm256_set1_ps(totalGM * dt * dt);
+        const __m256 maxU = _mm256_set1_ps(table.getSizeR() - 1), maxW = _mm256_set1_ps(table.getSizeZ() - 1), two = _mm256_set1_ps(2.0f);
+        const __m256i nR = _mm256_set1_epi32(table.getSizeR()), maxI = _mm256_set1_epi32(table.getSizeR() - 2), maxJ = _mm256_set1_epi32(table.getSizeZ() - 2);
+        const float* data = table.data().data();
+        
+        size_t i = begin;
+        for(;i + 8 <= end;i += 8){
+            __m256 vx = _mm256_loadu_ps(p.x.data() + i), vy = _mm256_loadu_ps(p.y.data() + i), vz = _mm256_loadu_ps(p.z.data() + i);
+            __m256 px = _mm256_loadu_ps(p.prevX.data() + i), py = _mm256_loadu_ps(p.prevY.data() + i), pz = _mm256_loadu_ps(p.prevZ.data() + i);
+            for(size_t s = 0;s < steps;++s){
+                __m256 a = tableFactor256(vx, vy, vz, data, hr, hz, maxU, maxW, nR, maxI, maxJ, gmDt2);
+                __m256 nx = _mm256_fnmadd_ps(a, vx, _mm256_fmsub_ps(two, vx, px));
+                __m256 ny = _mm256_fnmadd_ps(a, vy, _mm256_fmsub_ps(two, vy, py));
+                __m256 nz = _mm256_fnmadd_ps(a, vz, _mm256_fmsub_ps(two, vz, pz));
+                px = vx;
+                py = vy;
+                pz = vz;
+                vx = nx;
+                vy = ny;
+                vz = nz;
+            }
+            _mm256_storeu_ps(p.x.data() + i, vx);
+            _mm256_storeu_ps(p.y.data() + i, vy);
+            _mm256_storeu_ps(p.z.data() + i, vz);
+            _mm256_storeu_ps(p.prevX.data() + i, px);
+            _mm256_storeu_ps(p.prevY.data() + i, py);
+            _mm256_storeu_ps(p.prevZ.data() + i, pz);
+        }
+        if(i < end) tabulatedStepsScalar(p, i, end, table, totalGM, dt, steps);
+    }
+    
+    __attribute__((target("avx512f"))) void tabulatedStepsAVX512(ParticleArrays& p, size_t begin, size_t end, const PotentialTable& table, float totalGM, float dt, size_t steps){
+        const __m512 hr = _mm512_set1_ps(table.getHr()), hz = _mm512_set1_ps(table.getHz()), gmDt2 = _mm512_set1_ps(totalGM * dt * dt);
+        const __m512 maxU = _mm512_set1_ps(table.getSizeR() - 1), maxW = _mm512_set1_ps(table.getSizeZ() - 1), two = _mm512_set1_ps(2.0f);
+        const __m512i nR = _mm512_set1_epi32(table.getSizeR()), maxI = _mm512_set1_epi32(table.getSizeR() - 2), maxJ = _mm512_set1_epi32(table.getSizeZ() - 2);
+        const float* data = table.data().data();
+        //Same four vectors in flight as verletStepsAVX512, here for the latency of the gathers
+        constexpr size_t lanes = 4;
+        
+        for(size_t i = begin;i < end;i += 16 * lanes){
+            __mmask16 m[lanes];
+            __m512 vx[lanes], vy[lanes], vz[lanes], px[lanes], py[lanes], pz[lanes];
+            for(size_t l = 0;l < lanes;++l){
+                size_t j = i + 16 * l;
+                m[l] = j >= end ? 0 : end - j >= 16 ? 0xffff : static_cast<__mmask16>((1u << (end - j)) - 1);
+                vx[l] = _mm512_maskz_loadu_ps(m[l], p.x.data() + j);
+                vy[l] = _mm512_maskz_loadu_ps(m[l], p.y.data() + j);
+                vz[l] = _mm512_maskz_loadu_ps(m[l], p.z.data() + j);
+                px[l] = _mm512_maskz_loadu_ps(m[l], p.prevX.data() + j);
+                py[l] = _mm512_maskz_loadu_ps(m[l], p.prevY.data() + j);
+                pz[l] = _mm512_maskz_loadu_ps(m[l], p.prevZ.data() + j);
+            }
+            for(size_t s = 0;s < steps;++s){
+                for(size_t l = 0;l < lanes;++l){
+                    __m512 a = tableFactor512(vx[l], vy[l], vz[l], data, hr, hz, maxU, maxW, nR, maxI, maxJ, gmDt2);
+                    __m512 nx = _mm512_fnmadd_ps(a, vx[l], _mm512_fmsub_ps(two, vx[l], px[l]));
+                    __m512 ny = _mm512_fnmadd_ps(a, vy[l], _mm512_fmsub_ps(two, vy[l], py[l]));
+                    __m512 nz = _mm512_fnmadd_ps(a, vz[l], _mm512_fmsub_ps(two, vz[l], pz[l]));
+                    px[l] = vx[l];
+                    py[l] = vy[l];
+                    pz[l] = vz[l];
+                    vx[l] = nx;
+                    vy[l] = ny;
+                    vz[l] = nz;
+                }
+            }
+            for(size_t l = 0;l < lanes;++l){
+                size_t j = i + 16 * l;
+                _mm512_mask_storeu_ps(p.x.data() + j, m[l], vx[l]);
+                _mm512_mask_storeu_ps(p.y.data() + j, m[l], vy[l]);
+                _mm512_mask_storeu_ps(p.z.data() + j, m[l], vz[l]);
+                _mm512_mask_storeu_ps(p.prevX.data() + j, m[l], px[l]);
+                _mm512_mask_storeu_ps(p.prevY.data() + j, m[l], py[l]);
+                _mm512_mask_storeu_ps(p.prevZ.data() + j, m[l], pz[l]);
+            }
+        }
+    }
+}
+#endif
+
+void tabulatedSteps(ParticleArrays& p, size_t begin, size_t end, const PotentialTable& table, float totalGM, float dt, size_t steps){
+#ifdef SIMD_X86
+    switch(detectSimdLevel()){
+        case SimdLevel::AVX512: tabulatedStepsAVX512(p, begin, end, table, totalGM, dt, steps); return;
+        case SimdLevel::AVX2: tabulatedStepsAVX2(p, begin, end, table, totalGM, dt, steps); return;
+        default: break;
+    }
+#endif
+    tabulatedStepsScalar(p, begin, end, table, totalGM, dt, steps);
+}
\ No newline at end of file
@@ -0,0 +1,429 @@
+#include "sph.hpp"
+
+#define _USE_MATH_DEFINES
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace {
+    //Relative tolerance of the neighbour count and the largest number of h updates per particle
+    constexpr float countTolerance = 1e-3f;
+    constexpr int maxIterations = 32;
+    //The density walk gathers out to this many times the largest 2h of the group, so h can grow that much without another walk
+    constexpr float gatherSlack = 1.25f;
+    //Monaghan's viscosity: alpha for the bulk and beta for the von Neumann-Richtmyer term, with eta^2 keeping mu finite
+    constexpr float alpha = 1.0f, beta = 2.0f, eta2 = 0.01f;
+    
+    double secondsSince(std::chrono::steady_clock::time_point start){
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    
+    //Groups of Morton-consecutive particles walk the tree together: the largest nodes holding at most this many
+    constexpr size_t groupSize = 32;
+    
+    //Squared distance between the nearest points of two boxes
+    float boxDistance2(const float minA[3], const float maxA[3], const float minB[3], const float maxB[3]){
+        float dx = std::max({minA[0] - maxB[0], 0.0f, minB[0] - maxA[0]});
+        float dy = std::max({minA[1] - maxB[1], 0.0f, minB[1] - maxA[1]});
+        float dz = std::max({minA[2] - maxB[2], 0.0f, minB[2] - maxA[2]});
+        return dx * dx + dy * dy + dz * dz;
+    }
+    
+    //rho = sum m W(r, h), the neighbour count (4 pi / 3) (2h)^3 sum W(r, h) = 32 / 3 sum w(q) and its derivative in h,
+    //-32 / 3 sum q w'(q) / h. The count leaves the masses out: a heavy particle would otherwise outweigh the target on its own.
+    void kernelSums(const float* r2, const float* m, size_t count, float h, float& rho, float& neighbourCount, float& slope){
+        const float invH = 1.0f / h;
+        float w = 0.0f, mw = 0.0f, dw = 0.0f;
+        //w(q) = (2 - q)^3 / 4 - (1 - q)^3 with both terms clamped at 0, which has no branches to vectorise around
+        for(size_t j = 0;j < count;++j){
+            const float q = std::sqrt(r2[j]) * invH;
+            const float t = std::max(2.0f - q, 0.0f), u = std::max(1.0f - q, 0.0f);
+            const float shape = 0.25f * t * t * t - u * u * u;
+            w += shape;
+            mw += m[j] * shape;
+            dw += q * (0.75f * t * t - 3.0f * u * u);
+        }
+        rho = mw * static_cast<float>(M_1_PI) * invH * invH * invH;
+        neighbourCount = 32.0f / 3.0f * w;
+        slope = 32.0f / 3.0f * dw * invH;
+    }
+    
+    //Squared distance from the nearest point of a box to a particle
+    float pointDistance2(float x, float y, float z, const float min[3], const float max[3]){
+        float dx = std::max({min[0] - x, 0.0f, x - max[0]});
+        float dy = std::max({min[1] - y, 0.0f, y - max[1]});
+        float dz = std::max({min[2] - z, 0.0f, z - max[2]});
+        return dx * dx + dy * dy + dz * dz;
+    }
+}
+
+SmoothedParticles::SmoothedParticles(float soundSpeed, float neighbours, size_t leafSize):
+    soundSpeed(soundSpeed), neighbours(neighbours), leafSize(std::max<size_t>(leafSize, 1)), buildSeconds(0.0), densitySeconds(0.0), forceSeconds(0.0), meanNeighbours(0.0), meanPairs(0.0) {
+
+}
+
+void SmoothedParticles::computeAccelerations(const float* x, const float* y, const float* z, const float* vx, const float* vy, const float* vz, const float* m, size_t n, float* ax, float* ay, float* az, ThreadPool& pool){
+    if(n == 0) return;
+    auto startTime = std::chrono::steady_clock::now();
+    tree.build(x, y, z, m, n, leafSize, pool);
+    const bool haveGuess = smoothingLength.size() == n;
+    sortedVx.resize(n);
+    sortedVy.resize(n);
+    sortedVz.resize(n);
+    sortedH.resize(n);
+    pool.parallelFor(0, n, [&](size_t begin, size_t end){
+        for(size_t i = begin;i < end;++i){
+            uint32_t j = tree.order[i];
+            sortedVx[i] = vx[j];
+            sortedVy[i] = vy[j];
+            sortedVz[i] = vz[j];
+            sortedH[i] = haveGuess ? smoothingLength[j] : 0.0f;
+        }
+    });
+    computeNodeBounds(pool);
+    groups.clear();
+    for(size_t k = 0;k < tree.nodes.size();++k){
+        const OctreeNode& node = tree.nodes[k];
+        if(node.end - node.begin <= groupSize && (k == 0 || tree.nodes[node.parent].end - tree.nodes[node.parent].begin > groupSize)) groups.push_back(k);
+    }
+    std::sort(groups.begin(), groups.end(), [&](uint32_t a, uint32_t b){return tree.nodes[a].begin < tree.nodes[b].begin;});
+    buildSeconds = secondsSince(startTime);
+    
+    startTime = std::chrono::steady_clock::now();
+    solveDensities(pool);
+    densitySeconds = secondsSince(startTime);
+    
+    startTime = std::chrono::steady_clock::now();
+    computeNodeSmoothingLengths(pool);
+    computeForces(pool);
+    smoothingLength.resize(n);
+    density.resize(n);
+    pool.parallelFor(0, n, [&](size_t begin, size_t end){
+        for(size_t i = begin;i < end;++i){
+            uint32_t j = tree.order[i];
+            ax[j] += sortedAccelerationX[i];
+            ay[j] += sortedAccelerationY[i];
+            az[j] += sortedAccelerationZ[i];
+            smoothingLength[j] = sortedH[i];
+            density[j] = sortedDensity[i];
+        }
+    });
+    forceSeconds = secondsSince(startTime);
+}
+
+void SmoothedParticles::setSoundSpeed(float newSoundSpeed){
+    soundSpeed = newSoundSpeed;
+}
+
+float SmoothedParticles::getSoundSpeed() const {
+    return soundSpeed;
+}
+
+void SmoothedParticles::setNeighbours(float newNeighbours){
+    neighbours = std::max(newNeighbours, 1.0f);
+}
+
+float SmoothedParticles::getNeighbours() const {
+    return neighbours;
+}
+
+const std::vector<float>& SmoothedParticles::getSmoothingLengths() const {
+    return smoothingLength;
+}
+
+const std::vector<float>& SmoothedParticles::getDensities() const {
+    return density;
+}
+
+void SmoothedParticles::permute(const std::vector<uint32_t>& order, ThreadPool& pool){
+    if(smoothingLength.empty()) return;
+    std::vector<float> h(order.size()), rho(order.size());
+    pool.parallelFor(0, order.size(), [&](size_t begin, size_t end){
+        for(size_t i = begin;i < end;++i){
+            const bool known = order[i] < smoothingLength.size();
+            h[i] = known ? smoothingLength[order[i]] : 0.0f;
+            rho[i] = known ? density[order[i]] : 0.0f;
+        }
+    });
+    smoothingLength.swap(h);
+    density.swap(rho);
+}
+
+double SmoothedParticles::getBuildSeconds() const {
+    return buildSeconds;
+}
+
+double SmoothedParticles::getDensitySeconds() const {
+    return densitySeconds;
+}
+
+double SmoothedParticles::getForceSeconds() const {
+    return forceSeconds;
+}
+
+double SmoothedParticles::getMeanNeighbours() const {
+    return meanNeighbours;
+}
+
+double SmoothedParticles::getMeanPairs() const {
+    return meanPairs;
+}
+
+float SmoothedParticles::kernel(float r2, float h){
+    const float invH = 1.0f / h;
+    const float q = std::sqrt(r2) * invH;
+    const float sigma = static_cast<float>(M_1_PI) * invH * invH * invH;
+    if(q < 1.0f) return sigma * (1.0f - q * q * (1.5f - 0.75f * q));
+    if(q < 2.0f) return sigma * 0.25f * (2.0f - q) * (2.0f - q) * (2.0f - q);
+    return 0.0f;
+}
+
+float SmoothedParticles::kernelGradient(float r2, float h){
+    const float invH = 1.0f / h;
+    const float q = std::sqrt(r2) * invH;
+    const float sigma = static_cast<float>(M_1_PI) * invH * invH * invH * invH * invH;
+    const float t = std::max(2.0f - q, 0.0f);
+    //Both pieces are evaluated and one selected, which stays finite at q = 0 and leaves no branch in the pair loop
+    return sigma * (q < 1.0f ? 2.25f * q - 3.0f : -0.75f * t * t / std::max(q, 1.0f));
+}
+
+void SmoothedParticles::solveDensities(ThreadPool& pool){
+    const size_t n = tree.sortedX.size();
+    const std::vector<float>& sortedX = tree.sortedX;
+    const std::vector<float>& sortedY = tree.sortedY;
+    const std::vector<float>& sortedZ = tree.sortedZ;
+    const std::vector<float>& sortedMass = tree.sortedMass;
+    sortedDensity.resize(n);
+    
+    //New particles start from the size of their leaf, as if it were filled evenly
+    pool.parallelFor(0, tree.nodes.size(), 256, [&](size_t begin, size_t end){
+        for(size_t k = begin;k < end;++k){
+            const OctreeNode& node = tree.nodes[k];
+            if(node.childCount != 0) continue;
+            //Never below the finest Morton cell, so coincident particles still start with a radius to gather in
+            const float guess = 0.5f * std::max(node.size, std::ldexp(tree.box.size, -mortonLevels)) * std::cbrt(3.0f * neighbours / (4.0f * static_cast<float>(M_PI) * (node.end - node.begin)));
+            for(uint32_t j = node.begin;j < node.end;++j) if(!(sortedH[j] > 0.0f)) sortedH[j] = guess;
+        }
+    });
+    
+    std::vector<double> groupCounts(groups.size(), 0.0);
+    pool.parallelFor(0, groups.size(), 16, [&](size_t begin, size_t end){
+        std::vector<float> listX, listY, listZ, listMass, neighbourR2, neighbourMass;
+        uint32_t stack[8 * mortonLevels + 8];
+        for(size_t g = begin;g < end;++g){
+            const OctreeNode& group = tree.nodes[groups[g]];
+            const float* min = bounds[groups[g]].min;
+            const float* max = bounds[groups[g]].max;
+            float radius = 0.0f;
+            for(uint32_t i = group.begin;i < group.end;++i) radius = std::max(radius, 2.0f * gatherSlack * sortedH[i]);
+            
+            //Until every h of the group has converged inside the gathered radius, each retry gathering twice as far
+            for(;;){
+                listX.clear();
+                listY.clear();
+                listZ.clear();
+                listMass.clear();
+                size_t top = 0;
+                stack[top++] = 0;
+                while(top > 0){
+                    const uint32_t index = stack[--top];
+                    const OctreeNode& node = tree.nodes[index];
+                    if(boxDistance2(bounds[index].min, bounds[index].max, min, max) >= radius * radius) continue;
+                    if(node.childCount == 0){
+                        for(uint32_t j = node.begin;j < node.end;++j){
+                            if(pointDistance2(sortedX[j], sortedY[j], sortedZ[j], min, max) >= radius * radius) continue;
+                            listX.push_back(sortedX[j]);
+                            listY.push_back(sortedY[j]);
+                            listZ.push_back(sortedZ[j]);
+                            listMass.push_back(sortedMass[j]);
+                        }
+                    }else{
+                        for(uint32_t c = 0;c < node.childCount;++c) stack[top++] = node.firstChild + c;
+                    }
+                }
+                //Once the radius spans the whole tree there is nothing left to gather
+                const float limit = radius >= std::sqrt(3.0f) * tree.box.size ? INFINITY : 0.5f * radius;
+                
+                bool fits = true;
+                double counts = 0.0;
+                for(uint32_t i = group.begin;i < group.end && fits;++i){
+                    neighbourR2.resize(listX.size());
+                    neighbourMass.resize(listX.size());
+                    size_t candidates = 0;
+                    for(size_t j = 0;j < listX.size();++j){
+                        float dx = sortedX[i] - listX[j], dy = sortedY[i] - listY[j], dz = sortedZ[i] - listZ[j];
+                        float r2 = dx * dx + dy * dy + dz * dz;
+                        neighbourR2[candidates] = r2;
+                        neighbourMass[candidates] = listMass[j];
+                        candidates += r2 < radius * radius;
+                    }
+                    
+                    //Newton on count(h) - neighbours, falling back to bisection or doubling whenever a step leaves the bracket
+                    float h = std::min(sortedH[i], limit), low = 0.0f, high = limit, rho = 0.0f, count = 0.0f;
+                    for(int iteration = 0;;++iteration){
+                        float slope;
+                        kernelSums(neighbourR2.data(), neighbourMass.data(), candidates, h, rho, count, slope);
+                        if(std::fabs(count - neighbours) <= countTolerance * neighbours || iteration + 1 == maxIterations) break;
+                        if(count < neighbours) low = h;
+                        else high = h;
+                        if(count < neighbours && h == limit){
+                            fits = false;
+                            break;
+                        }
+                        float next = slope > 0.0f ? h - (count - neighbours) / slope : -1.0f;
+                        if(!(next > low && next < high)){
+                            //Without an upper bound yet the gather limit itself is tried, and beyond that h doubles
+                            if(high == limit) next = std::min(2.0f * h, limit);
+                            else next = 0.5f * (low + high);
+                        }
+                        h = next;
+                    }
+                    sortedH[i] = h;
+                    sortedDensity[i] = rho;
+                    counts += count;
+                }
+                if(fits){
+                    groupCounts[g] = counts;
+                    break;
+                }
+                radius *= 2.0f;
+            }
+        }
+    });
+    double counts = 0.0;
+    for(double c : groupCounts) counts += c;
+    meanNeighbours = counts / n;
+}
+
+void SmoothedParticles::computeNodeBounds(ThreadPool& pool){
+    bounds.resize(tree.nodes.size());
+    //Bottom-up like the Barnes-Hut moments, one parallel pass per level
+    for(size_t level = tree.levelStart.size() - 1;level-- > 0;){
+        pool.parallelFor(tree.levelStart[level], tree.levelStart[level + 1], 256, [&](size_t begin, size_t end){
+            for(size_t k = begin;k < end;++k){
+                const OctreeNode& node = tree.nodes[k];
+                NodeBounds& b = bounds[k];
+                b.min[0] = b.min[1] = b.min[2] = INFINITY;
+                b.max[0] = b.max[1] = b.max[2] = -INFINITY;
+                if(node.childCount == 0){
+                    for(uint32_t j = node.begin;j < node.end;++j){
+                        b.min[0] = std::min(b.min[0], tree.sortedX[j]);
+                        b.min[1] = std::min(b.min[1], tree.sortedY[j]);
+                        b.min[2] = std::min(b.min[2], tree.sortedZ[j]);
+                        b.max[0] = std::max(b.max[0], tree.sortedX[j]);
+                        b.max[1] = std::max(b.max[1], tree.sortedY[j]);
+                        b.max[2] = std::max(b.max[2], tree.sortedZ[j]);
+                    }
+                }else{
+                    for(uint32_t c = node.firstChild;c < node.firstChild + node.childCount;++c){
+                        for(int a = 0;a < 3;++a){
+                            b.min[a] = std::min(b.min[a], bounds[c].min[a]);
+                            b.max[a] = std::max(b.max[a], bounds[c].max[a]);
+                        }
+                    }
+                }
+            }
+        });
+    }
+}
+
+void SmoothedParticles::computeNodeSmoothingLengths(ThreadPool& pool){
+    for(size_t level = tree.levelStart.size() - 1;level-- > 0;){
+        pool.parallelFor(tree.levelStart[level], tree.levelStart[level + 1], 256, [&](size_t begin, size_t end){
+            for(size_t k = begin;k < end;++k){
+                const OctreeNode& node = tree.nodes[k];
+                float h = 0.0f;
+                if(node.childCount == 0){
+                    for(uint32_t j = node.begin;j < node.end;++j) h = std::max(h, sortedH[j]);
+                }else{
+                    for(uint32_t c = node.firstChild;c < node.firstChild + node.childCount;++c) h = std::max(h, bounds[c].h);
+                }
+                bounds[k].h = h;
+            }
+        });
+    }
+}
+
+void SmoothedParticles::computeForces(ThreadPool& pool){
+    const size_t n = tree.sortedX.size();
+    const std::vector<float>& sortedX = tree.sortedX;
+    const std::vector<float>& sortedY = tree.sortedY;
+    const std::vector<float>& sortedZ = tree.sortedZ;
+    const std::vector<float>& sortedMass = tree.sortedMass;
+    const float c2 = soundSpeed * soundSpeed;
+    sortedAccelerationX.resize(n);
+    sortedAccelerationY.resize(n);
+    sortedAccelerationZ.resize(n);
+    
+    std::vector<double> groupPairs(groups.size(), 0.0);
+    pool.parallelFor(0, groups.size(), 16, [&](size_t begin, size_t end){
+        std::vector<uint32_t> list, pairList;
+        uint32_t stack[8 * mortonLevels + 8];
+        for(size_t g = begin;g < end;++g){
+            const OctreeNode& group = tree.nodes[groups[g]];
+            const float* min = bounds[groups[g]].min;
+            const float* max = bounds[groups[g]].max;
+            const float groupH = bounds[groups[g]].h;
+            double pairs = 0.0;
+            
+            //A pair interacts if either particle reaches the other, so a node is opened if its largest h or the group's does
+            list.clear();
+            size_t top = 0;
+            stack[top++] = 0;
+            while(top > 0){
+                const uint32_t index = stack[--top];
+                const OctreeNode& node = tree.nodes[index];
+                const float reach = 2.0f * std::max(groupH, bounds[index].h);
+                if(boxDistance2(bounds[index].min, bounds[index].max, min, max) >= reach * reach) continue;
+                if(node.childCount == 0){
+                    for(uint32_t j = node.begin;j < node.end;++j){
+                        const float particleReach = 2.0f * std::max(groupH, sortedH[j]);
+                        if(pointDistance2(sortedX[j], sortedY[j], sortedZ[j], min, max) < particleReach * particleReach) list.push_back(j);
+                    }
+                }else{
+                    for(uint32_t c = 0;c < node.childCount;++c) stack[top++] = node.firstChild + c;
+                }
+            }
+            
+            for(uint32_t i = group.begin;i < group.end;++i){
+                const float hi = sortedH[i], rhoi = sortedDensity[i], pressureI = c2 / rhoi;
+                //The pairs in reach first, without branches, then the force over only those
+                pairList.resize(list.size());
+                size_t count = 0;
+                for(uint32_t j : list){
+                    float dx = sortedX[i] - sortedX[j], dy = sortedY[i] - sortedY[j], dz = sortedZ[i] - sortedZ[j];
+                    const float hMax = std::max(hi, sortedH[j]);
+                    pairList[count] = j;
+                    count += (dx * dx + dy * dy + dz * dz < 4.0f * hMax * hMax) & (j != i);
+                }
+                pairs += count;
+                
+                float accX = 0.0f, accY = 0.0f, accZ = 0.0f;
+                for(size_t k = 0;k < count;++k){
+                    const uint32_t j = pairList[k];
+                    float dx = sortedX[i] - sortedX[j], dy = sortedY[i] - sortedY[j], dz = sortedZ[i] - sortedZ[j];
+                    float r2 = dx * dx + dy * dy + dz * dz;
+                    const float hj = sortedH[j], rhoj = sortedDensity[j];
+                    float dvx = sortedVx[i] - sortedVx[j], dvy = sortedVy[i] - sortedVy[j], dvz = sortedVz[i] - sortedVz[j];
+                    //Only approaching pairs, vr < 0, are damped
+                    float vr = std::min(dvx * dx + dvy * dy + dvz * dz, 0.0f);
+                    float hMean = 0.5f * (hi + hj);
+                    float mu = hMean * vr / (r2 + eta2 * hMean * hMean);
+                    float viscosity = (beta * mu - alpha * soundSpeed) * mu / (0.5f * (rhoi + rhoj));
+                    float gradient = 0.5f * (kernelGradient(r2, hi) + kernelGradient(r2, hj));
+                    float f = sortedMass[j] * (pressureI + c2 / rhoj + viscosity) * gradient;
+                    accX -= f * dx;
+                    accY -= f * dy;
+                    accZ -= f * dz;
+                }
+                sortedAccelerationX[i] = accX;
+                sortedAccelerationY[i] = accY;
+                sortedAccelerationZ[i] = accZ;
+            }
+            groupPairs[g] = pairs;
+        }
+    });
+    double pairs = 0.0;
+    for(double p : groupPairs) pairs += p;
+    meanPairs = pairs / n;
+}
\ No newline at end of file
@@ -0,0 +1,108 @@
+#include "stellarevolution.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "util.hpp"
+
+StellarEvolution::StellarEvolution(float solarLifetime): solarLifetime(solarLifetime), counts{0, 0, 0} {}
+
+void StellarEvolution::setSolarLifetime(float newSolarLifetime){
+    solarLifetime = std::max(newSolarLifetime, 0.0f);
+}
+
+float StellarEvolution::getSolarLifetime() const {
+    return solarLifetime;
+}
+
+bool StellarEvolution::enabled() const {
+    return solarLifetime > 0.0f;
+}
+
+void StellarEvolution::clear(){
+    phase.clear();
+    stellarMass.clear();
+    tracked.clear();
+    counts[0] = counts[1] = counts[2] = 0;
+    events = decltype(events)();
+}
+
+StellarPhase StellarEvolution::addStar(uint32_t id, float mass, double birthTime, double time){
+    if(id >= phase.size()){
+        phase.resize(id + 1, StellarPhase::MainSequence);
+        stellarMass.resize(id + 1, 0.0f);
+        tracked.resize(id + 1, 0);
+    }
+    if(tracked[id]) --counts[static_cast<size_t>(phase[id])];
+    tracked[id] = 1;
+    stellarMass[id] = mass;
+    const double giantStart = birthTime + mainSequenceLifetime(mass), remnantStart = giantStart + giantLifetime(mass);
+    if(time >= remnantStart){
+        phase[id] = StellarPhase::Remnant;
+    }else if(time >= giantStart){
+        phase[id] = StellarPhase::Giant;
+        schedule(id, remnantStart);
+    }else{
+        phase[id] = StellarPhase::MainSequence;
+        schedule(id, giantStart);
+    }
+    ++counts[static_cast<size_t>(phase[id])];
+    return phase[id];
+}
+
+void StellarEvolution::advance(double time, std::vector<uint32_t>& changed){
+    while(!events.empty() && events.top().time <= time){
+        const Event e = events.top();
+        events.pop();
+        --counts[static_cast<size_t>(phase[e.id])];
+        if(phase[e.id] == StellarPhase::MainSequence){
+            phase[e.id] = StellarPhase::Giant;
+            schedule(e.id, e.time + giantLifetime(stellarMass[e.id]));
+        }else{
+            phase[e.id] = StellarPhase::Remnant;
+        }
+        ++counts[static_cast<size_t>(phase[e.id])];
+        changed.push_back(e.id);
+    }
+}
+
+StellarPhase StellarEvolution::getPhase(uint32_t id) const {
+    return id < phase.size() ? phase[id] : StellarPhase::MainSequence;
+}
+
+size_t StellarEvolution::getPendingEvents() const {
+    return events.size();
+}
+
+size_t StellarEvolution::getCount(StellarPhase p) const {
+    return counts[static_cast<size_t>(p)];
+}
+
+double StellarEvolution::mainSequenceLifetime(float mass) const {
+    return solarLifetime * std::pow(static_cast<double>(mass), -2.5);
+}
+
+double StellarEvolution::giantLifetime(float mass) const {
+    return 0.1 * mainSequenceLifetime(mass);
+}
+
+void StellarEvolution::attributes(float mass, StellarPhase phase, float& luminosity, float& temperature){
+    switch(phase){
+        case StellarPhase::MainSequence:
+            luminosity = luminosityFromMass(mass);
+            temperature = temperatureFromMass(mass);
+            break;
+        case StellarPhase::Giant:
+            luminosity = mass < 8.0f ? 10.0f * luminosityFromMass(mass) : luminosityFromMass(mass);
+            temperature = mass < 8.0f ? 4000.0f : 3500.0f;
+            break;
+        default:
+            luminosity = mass < 8.0f ? 1e-3f : 1e-5f;
+            temperature = mass < 8.0f ? 25000.0f : 100000.0f;
+            break;
+    }
+}
+
+void StellarEvolution::schedule(uint32_t id, double time){
+    events.push(Event{time, id});
+}
\ No newline at end of file
@@ -0,0 +1,223 @@
+#include "threadpool.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+namespace {
+    thread_local bool insideChunk = false;
+    
+    uint64_t nanosecondsSince(std::chrono::steady_clock::time_point start){
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+ThreadPool::ThreadPool(size_t threads, size_t chunkSize):
+    chunkSize(std::max<size_t>(chunkSize, 1)), job(nullptr), remaining(0), generation(0), stopping(false) {
+    start(threads);
+}
+
+ThreadPool::~ThreadPool(){
+    stop();
+}
+
+void ThreadPool::parallelFor(size_t begin, size_t end, const std::function<void(size_t, size_t)>& f){
+    parallelFor(begin, end, chunkSize, f);
+}
+
+void ThreadPool::parallelFor(size_t begin, size_t end, size_t size, const std::function<void(size_t, size_t)>& f){
+    if(end <= begin) return;
+    size = std::max<size_t>(size, 1);
+    if(insideChunk){
+        for(size_t c = begin;c < end;c += size) f(c, std::min(end, c + size));
+        return;
+    }
+    if(workers.size() == 1 || end - begin <= size){
+        auto chunkStart = std::chrono::steady_clock::now();
+        insideChunk = true;
+        for(size_t c = begin;c < end;c += size){
+            f(c, std::min(end, c + size));
+            ++workers[0]->chunkCount;
+        }
+        insideChunk = false;
+        workers[0]->busyNanoseconds += nanosecondsSince(chunkStart);
+        return;
+    }
+    
+    std::lock_guard<std::mutex> callLock(callMutex);
+    const size_t chunkTotal = (end - begin + size - 1) / size;
+    job = &f;
+    remaining = chunkTotal;
+    for(size_t w = 0;w < workers.size();++w){
+        std::lock_guard<std::mutex> lock(workers[w]->mutex);
+        for(size_t c = w * chunkTotal / workers.size();c < (w + 1) * chunkTotal / workers.size();++c){
+            workers[w]->chunks.emplace_back(begin + c * size, std::min(end, begin + (c + 1) * size));
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        ++generation;
+    }
+    wakeCondition.notify_all();
+    
+    runChunks(0);
+    
+    auto waitStart = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(doneMutex);
+    doneCondition.wait(lock, [this]{return remaining == 0;});
+    workers[0]->idleNanoseconds += nanosecondsSince(waitStart);
+    job = nullptr;
+}
+
+void ThreadPool::runTasks(const TaskGraph& graph, const std::function<void(size_t)>& task){
+    const size_t count = graph.dependencyCount.size();
+    if(count == 0) return;
+    std::unique_ptr<std::atomic<uint32_t>[]> waiting(new std::atomic<uint32_t>[count]);
+    std::vector<uint32_t> ready;
+    for(size_t i = 0;i < count;++i){
+        waiting[i] = graph.dependencyCount[i];
+        if(graph.dependencyCount[i] == 0) ready.push_back(i);
+    }
+    std::mutex readyMutex;
+    std::condition_variable readyCondition;
+    size_t finished = 0;
+    
+    //One chunk per worker, each looping over the shared ready list until the whole graph is done
+    parallelFor(0, workers.size(), 1, [&](size_t, size_t){
+        std::vector<uint32_t> released;
+        std::unique_lock<std::mutex> lock(readyMutex);
+        while(true){
+            readyCondition.wait(lock, [&]{return !ready.empty() || finished == count;});
+            if(ready.empty()) return;
+            uint32_t t = ready.back();
+            ready.pop_back();
+            lock.unlock();
+            
+            task(t);
+            released.clear();
+            for(uint32_t d = graph.dependentStart[t];d < graph.dependentStart[t + 1];++d){
+                uint32_t dependent = graph.dependents[d];
+                if(--waiting[dependent] == 0) released.push_back(dependent);
+            }
+            
+            lock.lock();
+            ready.insert(ready.end(), released.begin(), released.end());
+            if(++finished == count || released.size() > 1) readyCondition.notify_all();
+            else if(released.size() == 1) readyCondition.notify_one();
+        }
+    });
+}
+
+void ThreadPool::setThreadCount(size_t threads){
+    std::lock_guard<std::mutex> callLock(callMutex);
+    stop();
+    start(threads);
+}
+
+size_t ThreadPool::getThreadCount() const {
+    return workers.size();
+}
+
+void ThreadPool::setChunkSize(size_t size){
+    chunkSize = std::max<size_t>(size, 1);
+}
+
+size_t ThreadPool::getChunkSize() const {
+    return chunkSize;
+}
+
+std::vector<ThreadPool::WorkerStats> ThreadPool::getStats() const {
+    std::vector<WorkerStats> stats;
+    for(const auto& worker : workers){
+        stats.push_back({worker->busyNanoseconds * 1e-9, worker->idleNanoseconds * 1e-9, static_cast<size_t>(worker->chunkCount), static_cast<size_t>(worker->stealCount)});
+    }
+    return stats;
+}
+
+void ThreadPool::resetStats(){
+    for(auto& worker : workers){
+        worker->busyNanoseconds = 0;
+        worker->idleNanoseconds = 0;
+        worker->chunkCount = 0;
+        worker->stealCount = 0;
+    }
+}
+
+ThreadPool& ThreadPool::global(){
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::start(size_t threadCount){
+    threadCount = std::max<size_t>(threadCount, 1);
+    stopping = false;
+    for(size_t i = 0;i < threadCount;++i) workers.push_back(std::make_unique<Worker>());
+    //Worker 0 is whichever thread calls parallelFor
+    for(size_t i = 1;i < threadCount;++i) threads.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+void ThreadPool::stop(){
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        stopping = true;
+    }
+    wakeCondition.notify_all();
+    for(auto& thread : threads) thread.join();
+    threads.clear();
+    workers.clear();
+}
+
+void ThreadPool::workerLoop(size_t index){
+    uint64_t seen = 0;
+    while(true){
+        auto waitStart = std::chrono::steady_clock::now();
+        {
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            wakeCondition.wait(lock, [&]{return stopping || generation != seen;});
+            if(stopping) return;
+            seen = generation;
+        }
+        workers[index]->idleNanoseconds += nanosecondsSince(waitStart);
+        runChunks(index);
+    }
+}
+
+void ThreadPool::runChunks(size_t index){
+    Worker& worker = *workers[index];
+    std::pair<size_t, size_t> chunk;
+    while(popChunk(index, chunk)){
+        auto chunkStart = std::chrono::steady_clock::now();
+        insideChunk = true;
+        (*job)(chunk.first, chunk.second);
+        insideChunk = false;
+        worker.busyNanoseconds += nanosecondsSince(chunkStart);
+        ++worker.chunkCount;
+        if(--remaining == 0){
+            std::lock_guard<std::mutex> lock(doneMutex);
+            doneCondition.notify_all();
+        }
+    }
+}
+
+bool ThreadPool::popChunk(size_t index, std::pair<size_t, size_t>& chunk){
+    {
+        Worker& own = *workers[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if(!own.chunks.empty()){
+            chunk = own.chunks.front();
+            own.chunks.pop_front();
+            return true;
+        }
+    }
+    //Steal from the back so the victim keeps working through its own contiguous run from the front
+    for(size_t offset = 1;offset < workers.size();++offset){
+        Worker& victim = *workers[(index + offset) % workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if(!victim.chunks.empty()){
+            chunk = victim.chunks.back();
+            victim.chunks.pop_back();
+            ++workers[index]->stealCount;
+            return true;
+        }
+    }
+    return false;
+}
\ No newline at end of file
@@ -3,8 +3,12 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <iomanip>
 
-GLuint loadShader(const char* file, GLuint type){
+#include "colourtable.hpp"
+#include "simd.hpp"
+
+GLuint loadShader(const char* file, GLuint type, const std::string& defines){
     GLuint shaderId = glCreateShader(type);
     
     std::string shaderSource;
@@ -13,6 +17,11 @@ GLuint loadShader(const char* file, GLuint type){
         std::stringstream strStream;
         strStream << shaderStream.rdbuf();
         shaderSource = strStream.str();
+        //Defines have to come after the #version line
+        if(!defines.empty()){
+            size_t lineEnd = shaderSource.find('\n');
+            shaderSource.insert(lineEnd == std::string::npos ? shaderSource.size() : lineEnd + 1, defines);
+        }
         shaderStream.close();
     }else{
         std::cerr << "Could not open " << file << std::endl;
@@ -38,10 +47,10 @@ GLuint loadShader(const char* file, GLuint type){
     return shaderId;
 }
 
-GLuint loadProgram(size_t count, const char** files, const GLuint* types){
+GLuint loadProgram(size_t count, const char** files, const GLuint* types, const std::string& defines){
     GLuint ids[count];
     for(size_t i = 0;i < count;++i){
-        ids[i] = loadShader(files[i], types[i]);
+        ids[i] = loadShader(files[i], types[i], defines);
     }
     
     GLuint programId = glCreateProgram();
@@ -122,4 +131,81 @@ glm::vec4 colourFromTemperature(float temp){
     glm::vec4 c = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
     colourFromTemperature(temp, c);
     return c;
+}
+
+namespace {
+    //ln of the coefficients of the mass-luminosity relation L = c m^p, one per range
+    constexpr float lnCoefficientLow = -1.46967597f, lnCoefficientHigh = 0.336472237f, lnCoefficientMassive = 10.3734912f;
+    
+    //Lane templates, only ever inlined into kernels with a target, so -Wpsabi's warning about passing __m256 and __m512
+    //without one does not apply
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpsabi"
+    //The ranges of the relation become a coefficient and an exponent selected per lane, so every star takes one log and one exp
+    //and no branch. 5772 (L m^1.5)^0.25 is then one more exp of the same logs.
+    template<fastmath::Accuracy A, class V> [[gnu::always_inline]] inline void stellarLanes(const V& mass, V& luminosity, V& temperature){
+        using namespace simd;
+        const V logMass = fastmath::log<A>(mass);
+        const V logC = mass < 0.43f ? V{} + lnCoefficientLow : mass < 2.0f ? V{} : mass < 55.0f ? V{} + lnCoefficientHigh : V{} + lnCoefficientMassive;
+        const V power = mass < 0.43f ? V{} + 2.3f : mass < 2.0f ? V{} + 4.0f : mass < 55.0f ? V{} + 3.5f : V{} + 1.0f;
+        const V logLuminosity = logC + power * logMass;
+        luminosity = fastmath::exp<A>(logLuminosity);
+        temperature = 5772.005317f * fastmath::exp<A>(0.25f * logLuminosity + 0.375f * logMass);
+    }
+    
+#pragma GCC diagnostic pop
+    
+    template<fastmath::Accuracy A> void stellarPropertiesScalar(const float* mass, float* luminosity, float* temperature, size_t begin, size_t end){
+        for(size_t i = begin;i < end;++i) stellarLanes<A>(mass[i], luminosity[i], temperature[i]);
+    }
+
+#ifdef SIMD_X86
+    template<fastmath::Accuracy A> __attribute__((target("avx2,fma"))) void stellarPropertiesAVX2(const float* mass, float* luminosity, float* temperature, size_t n){
+        size_t i = 0;
+        for(;i + 8 <= n;i += 8){
+            __m256 l, t;
+            stellarLanes<A>(_mm256_loadu_ps(mass + i), l, t);
+            _mm256_storeu_ps(luminosity + i, l);
+            _mm256_storeu_ps(temperature + i, t);
+        }
+        stellarPropertiesScalar<A>(mass, luminosity, temperature, i, n);
+    }
+    
+    template<fastmath::Accuracy A> __attribute__((target("avx512f"))) void stellarPropertiesAVX512(const float* mass, float* luminosity, float* temperature, size_t n){
+        for(size_t i = 0;i < n;i += 16){
+            //Lanes past the end run on ones and are never stored
+            const __mmask16 m = n - i >= 16 ? 0xffff : static_cast<__mmask16>((1u << (n - i)) - 1);
+            __m512 l, t;
+            stellarLanes<A>(_mm512_mask_loadu_ps(_mm512_set1_ps(1.0f), m, mass + i), l, t);
+            _mm512_mask_storeu_ps(luminosity + i, m, l);
+            _mm512_mask_storeu_ps(temperature + i, m, t);
+        }
+    }
+#endif
+    
+    template<fastmath::Accuracy A> void stellarPropertiesAt(std::span<const float> mass, std::span<float> luminosity, std::span<float> temperature){
+        const size_t n = mass.size();
+#ifdef SIMD_X86
+        switch(detectSimdLevel()){
+            case SimdLevel::AVX512: stellarPropertiesAVX512<A>(mass.data(), luminosity.data(), temperature.data(), n); return;
+            case SimdLevel::AVX2: stellarPropertiesAVX2<A>(mass.data(), luminosity.data(), temperature.data(), n); return;
+            default: break;
+        }
+#endif
+        stellarPropertiesScalar<A>(mass.data(), luminosity.data(), temperature.data(), 0, n);
+    }
+}
+
+void stellarProperties(std::span<const float> mass, std::span<float> luminosity, std::span<float> temperature, fastmath::Accuracy accuracy){
+    switch(accuracy){
+        case fastmath::Accuracy::Fast: stellarPropertiesAt<fastmath::Accuracy::Fast>(mass, luminosity, temperature); return;
+        case fastmath::Accuracy::Balanced: stellarPropertiesAt<fastmath::Accuracy::Balanced>(mass, luminosity, temperature); return;
+        default: stellarPropertiesAt<fastmath::Accuracy::Precise>(mass, luminosity, temperature); return;
+    }
+}
+
+std::string colourTable::glslDefines(){
+    std::ostringstream defines;
+    defines << std::setprecision(17) << "#define COLOUR_TABLE_LOG_MIN " << logMin << "\n#define COLOUR_TABLE_LOG_MAX " << logMax << "\n#define COLOUR_TABLE_SIZE " << size << ".0\n";
+    return defines.str();
 }
\ No newline at end of file